@@ -0,0 +1,201 @@
+/**
+ * @file trigger_proto.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Binary UDP trigger protocol between PIR nodes and camera
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include <string.h>
+#include "trigger_proto.h"
+
+static void put_u16(uint8_t *buf, uint16_t value) {
+    buf[0] = value >> 8;
+    buf[1] = value;
+}
+
+static void put_u32(uint8_t *buf, uint32_t value) {
+    put_u16(buf, value >> 16);
+    put_u16(buf + 2, value);
+}
+
+static uint16_t get_u16(const uint8_t *buf) {
+    return (uint16_t)(buf[0] << 8 | buf[1]);
+}
+
+static uint32_t get_u32(const uint8_t *buf) {
+    return (uint32_t)get_u16(buf) << 16 | get_u16(buf + 2);
+}
+
+static void put_i64(uint8_t *buf, int64_t value) {
+    put_u32(buf, (uint64_t)value >> 32);
+    put_u32(buf + 4, (uint64_t)value);
+}
+
+static int64_t get_i64(const uint8_t *buf) {
+    return (int64_t)((uint64_t)get_u32(buf) << 32 | get_u32(buf + 4));
+}
+
+/**
+ * @brief Length of message of type with flags, 0 for unknown type
+ */
+static size_t message_size(uint8_t type, uint16_t flags) {
+    switch (type) {
+        case TRIGGER_MSG_EVENT:
+            return flags & TRIGGER_FLAG_SYNCED ? TRIGGER_EVENT_SYNCED_SIZE : TRIGGER_MSG_SIZE;
+        case TRIGGER_MSG_ACK:
+        case TRIGGER_MSG_SYNC:
+            return TRIGGER_MSG_SIZE;
+        case TRIGGER_MSG_SYNC_REPLY:
+            return TRIGGER_SYNC_REPLY_SIZE;
+        default:
+            return 0;
+    }
+}
+
+size_t trigger_encode(const trigger_msg_t *msg, uint8_t *buf) {
+    put_u16(buf, TRIGGER_MAGIC);
+    buf[2] = TRIGGER_VERSION;
+    buf[3] = msg->type;
+    put_u16(buf + 4, msg->node_id);
+    put_u16(buf + 6, msg->flags);
+    put_u32(buf + 8, msg->seq);
+    put_i64(buf + 12, msg->timestamp);
+    if (msg->type == TRIGGER_MSG_EVENT && (msg->flags & TRIGGER_FLAG_SYNCED)) {
+        put_u32(buf + TRIGGER_MSG_SIZE, msg->delay_us);
+        return TRIGGER_EVENT_SYNCED_SIZE;
+    }
+    if (msg->type == TRIGGER_MSG_SYNC_REPLY) {
+        put_i64(buf + TRIGGER_MSG_SIZE, msg->receive);
+        return TRIGGER_SYNC_REPLY_SIZE;
+    }
+    return TRIGGER_MSG_SIZE;
+}
+
+bool trigger_decode(const uint8_t *buf, size_t len, trigger_msg_t *msg) {
+    if (len < TRIGGER_MSG_SIZE || get_u16(buf) != TRIGGER_MAGIC || buf[2] != TRIGGER_VERSION ||
+        buf[3] == TRIGGER_MSG_BATCH || len != message_size(buf[3], get_u16(buf + 6))) {
+        return false;
+    }
+    msg->type = buf[3];
+    msg->node_id = get_u16(buf + 4);
+    msg->flags = get_u16(buf + 6);
+    msg->seq = get_u32(buf + 8);
+    msg->timestamp = get_i64(buf + 12);
+    msg->delay_us = msg->type == TRIGGER_MSG_EVENT && len == TRIGGER_EVENT_SYNCED_SIZE ? get_u32(buf + 20) : 0;
+    msg->receive = msg->type == TRIGGER_MSG_SYNC_REPLY ? get_i64(buf + 20) : 0;
+    return true;
+}
+
+size_t trigger_encode_batch(const trigger_msg_t *msg, const trigger_batch_entry_t *entries, size_t count,
+                            uint8_t *buf) {
+    if (count == 0 || count > TRIGGER_BATCH_MAX) {
+        return 0;
+    }
+    trigger_msg_t header = *msg;
+    header.type = TRIGGER_MSG_BATCH;
+    size_t len = trigger_encode(&header, buf);      // Batch header never has the event extension
+    for (size_t i = 0; i < count; i++, len += TRIGGER_BATCH_ENTRY_SIZE) {
+        put_u32(buf + len, entries[i].seq);
+        put_u32(buf + len + 4, entries[i].age_ms);
+    }
+    return len;
+}
+
+bool trigger_decode_batch(const uint8_t *buf, size_t len, trigger_msg_t *msg, trigger_batch_entry_t *entries,
+                          size_t *count) {
+    if (len < TRIGGER_MSG_SIZE + TRIGGER_BATCH_ENTRY_SIZE || len > TRIGGER_BATCH_MAX_SIZE ||
+        (len - TRIGGER_MSG_SIZE) % TRIGGER_BATCH_ENTRY_SIZE != 0 || get_u16(buf) != TRIGGER_MAGIC ||
+        buf[2] != TRIGGER_VERSION || buf[3] != TRIGGER_MSG_BATCH) {
+        return false;
+    }
+    msg->type = buf[3];
+    msg->node_id = get_u16(buf + 4);
+    msg->flags = get_u16(buf + 6);
+    msg->seq = get_u32(buf + 8);
+    msg->timestamp = get_i64(buf + 12);
+    msg->delay_us = 0;
+    msg->receive = 0;
+    *count = (len - TRIGGER_MSG_SIZE) / TRIGGER_BATCH_ENTRY_SIZE;
+    for (size_t i = 0; i < *count; i++) {
+        const uint8_t *entry = buf + TRIGGER_MSG_SIZE + i * TRIGGER_BATCH_ENTRY_SIZE;
+        entries[i].seq = get_u32(entry);
+        entries[i].age_ms = get_u32(entry + 4);
+    }
+    return true;
+}
+
+void trigger_make_ack(const trigger_msg_t *event, int64_t timestamp, trigger_msg_t *ack) {
+    ack->type = TRIGGER_MSG_ACK;
+    ack->node_id = event->node_id;
+    ack->flags = 0;
+    ack->seq = event->seq;
+    ack->timestamp = timestamp;
+    ack->delay_us = 0;
+    ack->receive = 0;
+}
+
+void trigger_make_sync_reply(const trigger_msg_t *sync, int64_t receive, int64_t transmit, trigger_msg_t *reply) {
+    reply->type = TRIGGER_MSG_SYNC_REPLY;
+    reply->node_id = sync->node_id;
+    reply->flags = 0;
+    reply->seq = sync->seq;
+    reply->timestamp = transmit;
+    reply->delay_us = 0;
+    reply->receive = receive;
+}
+
+void trigger_dedup_init(trigger_dedup_t *dedup) {
+    memset(dedup, 0, sizeof(*dedup));
+}
+
+bool trigger_dedup_accept(trigger_dedup_t *dedup, uint16_t node_id, uint32_t seq) {
+    size_t slot = TRIGGER_MAX_NODES;
+    for (size_t i = 0; i < TRIGGER_MAX_NODES; i++) {
+        if (dedup->nodes[i].used && dedup->nodes[i].node_id == node_id) {
+            slot = i;
+            break;
+        }
+        if (!dedup->nodes[i].used && slot == TRIGGER_MAX_NODES) {
+            slot = i;
+        }
+    }
+    // Table full - unknown node can not be tracked, accept its events anyway
+    if (slot == TRIGGER_MAX_NODES) {
+        return true;
+    }
+    if (!dedup->nodes[slot].used) {
+        dedup->nodes[slot].used = true;
+        dedup->nodes[slot].node_id = node_id;
+        dedup->nodes[slot].last_seq = seq;
+        dedup->nodes[slot].window = 1;
+        return true;
+    }
+    // Distance in modular arithmetic, sequence numbers wrap around
+    int32_t ahead = (int32_t)(seq - dedup->nodes[slot].last_seq);
+    if (ahead >= TRIGGER_RESTART_GAP || ahead <= -TRIGGER_RESTART_GAP) {
+        dedup->restarts++;
+        dedup->nodes[slot].last_seq = seq;
+        dedup->nodes[slot].window = 1;
+        return true;
+    }
+    if (ahead > 0) {
+        dedup->missing += ahead - 1;
+        dedup->nodes[slot].window = ahead < TRIGGER_DEDUP_WINDOW ? dedup->nodes[slot].window << ahead | 1 : 1;
+        dedup->nodes[slot].last_seq = seq;
+        return true;
+    }
+    uint32_t behind = (uint32_t)-ahead;
+    if (behind >= TRIGGER_DEDUP_WINDOW || dedup->nodes[slot].window & (1u << behind)) {
+        dedup->duplicates++;
+        return false;
+    }
+    dedup->nodes[slot].window |= 1u << behind;
+    dedup->reordered++;
+    if (dedup->missing > 0) {
+        dedup->missing--;
+    }
+    return true;
+}
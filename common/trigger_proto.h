@@ -0,0 +1,155 @@
+/**
+ * @file trigger_proto.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Binary UDP trigger protocol between PIR nodes and camera
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ * Every datagram is TRIGGER_MSG_SIZE bytes, all fields big-endian:
+ *  0  magic      u16   TRIGGER_MAGIC
+ *  2  version    u8    TRIGGER_VERSION
+ *  3  type       u8    trigger_msg_type_t
+ *  4  node_id    u16   sensor node identity
+ *  6  flags      u16   TRIGGER_FLAG_*
+ *  8  seq        u32   per-node sequence number, acks echo it
+ *  12 timestamp  i64   event time on sender clock (us), acks carry receive time on camera clock
+ *
+ * With TRIGGER_FLAG_SYNCED the sender converted timestamp to camera clock, TRIGGER_MSG_EVENT is then
+ * TRIGGER_EVENT_SYNCED_SIZE bytes long:
+ *  20 delay      u32   us between the event and sending this copy of it
+ *
+ * TRIGGER_MSG_SYNC is NTP-style clock offset request, timestamp is its send time on node clock and seq
+ * is echoed. TRIGGER_MSG_SYNC_REPLY timestamp is reply send time on camera clock, followed by:
+ *  20 receive    i64   time request arrived, camera clock
+ *
+ * TRIGGER_MSG_BATCH carries events a node could not deliver while the camera was unreachable. Header
+ * seq is the newest event (the ack echoes it), timestamp is send time and 1 to TRIGGER_BATCH_MAX
+ * entries follow, oldest first:
+ *  0  seq        u32   sequence number of the event
+ *  4  age        u32   ms between the event and sending the batch, TRIGGER_AGE_UNKNOWN after reboot
+ */
+#ifndef TRIGGER_PROTO_H
+#define TRIGGER_PROTO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRIGGER_UDP_PORT        3333
+#define TRIGGER_MAGIC           0x5452          // "TR"
+#define TRIGGER_VERSION         1
+#define TRIGGER_MSG_SIZE        20
+#define TRIGGER_EVENT_SYNCED_SIZE 24
+#define TRIGGER_SYNC_REPLY_SIZE 28
+#define TRIGGER_MAX_NODES       64              // Nodes tracked for duplicate detection
+#define TRIGGER_BATCH_MAX       16              // Events in one batch
+#define TRIGGER_BATCH_ENTRY_SIZE 8
+#define TRIGGER_BATCH_MAX_SIZE  (TRIGGER_MSG_SIZE + TRIGGER_BATCH_MAX * TRIGGER_BATCH_ENTRY_SIZE)
+#define TRIGGER_AGE_UNKNOWN     0xFFFFFFFF      // Event from before the sender rebooted
+#define TRIGGER_DEDUP_WINDOW    32              // Events behind the newest one still told apart from duplicates
+#define TRIGGER_RESTART_GAP     1024            // Sequence jump this big means the node started a new sequence
+
+#define TRIGGER_FLAG_MOTION     0x0001          // Motion started
+#define TRIGGER_FLAG_RETRY      0x0002          // Retransmission of unacked event
+#define TRIGGER_FLAG_SYNCED     0x0004          // Timestamp is on camera clock
+
+typedef enum {
+    TRIGGER_MSG_EVENT = 1,
+    TRIGGER_MSG_ACK = 2,
+    TRIGGER_MSG_BATCH = 3,
+    TRIGGER_MSG_SYNC = 4,
+    TRIGGER_MSG_SYNC_REPLY = 5,
+} trigger_msg_type_t;
+
+/**
+ * @brief Decoded trigger datagram
+ */
+typedef struct {
+    uint8_t type;
+    uint16_t node_id;
+    uint16_t flags;
+    uint32_t seq;
+    int64_t timestamp;
+    uint32_t delay_us;          // Synced event - event to sending of this copy
+    int64_t receive;            // Sync reply - request arrival on camera clock
+} trigger_msg_t;
+
+/**
+ * @brief One event of TRIGGER_MSG_BATCH
+ */
+typedef struct {
+    uint32_t seq;
+    uint32_t age_ms;
+} trigger_batch_entry_t;
+
+/**
+ * @brief Sequence numbers accepted recently from every known node
+ * Batches replay older events after newer ones may have got through, so every node keeps a window of
+ * TRIGGER_DEDUP_WINDOW sequence numbers below the newest one. Nodes start at a random sequence number
+ * after power up, a jump of TRIGGER_RESTART_GAP or more in either direction starts the window over.
+ */
+typedef struct {
+    struct {
+        uint16_t node_id;
+        uint32_t last_seq;      // Newest accepted sequence number
+        uint32_t window;        // Bit n set when last_seq - n was accepted
+        bool used;
+    } nodes[TRIGGER_MAX_NODES];
+    uint32_t duplicates;
+    uint32_t reordered;         // Accepted after a newer event of the same node
+    uint32_t missing;           // Sequence numbers skipped and not received (yet)
+    uint32_t restarts;          // Sequence started over
+} trigger_dedup_t;
+
+/**
+ * @brief Write message to buf (at least TRIGGER_SYNC_REPLY_SIZE bytes)
+ * @return number of bytes written
+ */
+size_t trigger_encode(const trigger_msg_t *msg, uint8_t *buf);
+
+/**
+ * @brief Parse datagram
+ * @return false when datagram has wrong size, magic, version or type
+ */
+bool trigger_decode(const uint8_t *buf, size_t len, trigger_msg_t *msg);
+
+/**
+ * @brief Write batch header & entries to buf (at least TRIGGER_BATCH_MAX_SIZE bytes)
+ * @return number of bytes written, 0 when count is not 1 to TRIGGER_BATCH_MAX
+ */
+size_t trigger_encode_batch(const trigger_msg_t *msg, const trigger_batch_entry_t *entries, size_t count,
+                            uint8_t *buf);
+
+/**
+ * @brief Parse batch datagram into header & entries (room for TRIGGER_BATCH_MAX)
+ * @return false when it is not a well formed TRIGGER_MSG_BATCH
+ */
+bool trigger_decode_batch(const uint8_t *buf, size_t len, trigger_msg_t *msg, trigger_batch_entry_t *entries,
+                          size_t *count);
+
+/**
+ * @brief Build ack for received event
+ */
+void trigger_make_ack(const trigger_msg_t *event, int64_t timestamp, trigger_msg_t *ack);
+
+/**
+ * @brief Build reply to clock sync request
+ * @param receive arrival of request, camera clock
+ * @param transmit send time of reply, camera clock
+ */
+void trigger_make_sync_reply(const trigger_msg_t *sync, int64_t receive, int64_t transmit, trigger_msg_t *reply);
+
+/**
+ * @brief Forget all nodes
+ */
+void trigger_dedup_init(trigger_dedup_t *dedup);
+
+/**
+ * @brief Check whether event is new, remembering its sequence number
+ * @return false for event accepted before (retransmission or replay of delivered event)
+ */
+bool trigger_dedup_accept(trigger_dedup_t *dedup, uint16_t node_id, uint32_t seq);
+
+#endif
@@ -0,0 +1,704 @@
+/**
+ * @file esp_camera.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - camera driver and JPEG converters
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * Frames are all *.jpg files of SIM_FRAMES_DIR in name order, the one shown is picked by time
+ * (SIM_CAMERA_FPS, default 12) so the directory plays like a looped video. Without SIM_FRAMES_DIR
+ * the scene is synthesized: a dark figure crossing a gradient, so motion check always passes.
+ * Frames count as taken at jpeg_quality & frame_size of camera_config. When set_quality or
+ * set_framesize asks for something else, every frame is decoded and encoded again at that setting
+ * (sensor quality 0-63 mapped to libjpeg 100-5, frame scaled in 1/8 steps by width), so frame length
+ * follows the sensor settings like on the device.
+ * Decoding and encoding need libjpeg, without it esp_jpg_decode and fmt2jpg fail and frames are
+ * always sent as taken.
+ * Sensor AEC follows scene light: SIM_AMBIENT_LUX (default 300) is ambient light, a comma separated
+ * list is cycled every SIM_AMBIENT_PERIOD_MS (default 30000), flash on GPIO4 adds AEC_FLASH_LUX.
+ * Exposure index approaches AEC_TARGET / lux with time constant SIM_AEC_TAU_MS (default 40) and is
+ * read back through OV2640 exposure & gain registers. Frames themselves do not get darker.
+ * SIM_CAMERA_HANG_MS=MS[,COUNT] makes the sensor stop delivering frames MS after esp_camera_init (0 right
+ * away), every esp_camera_fb_get then fails after CAMERA_FB_TIMEOUT_MS like a driver whose sensor hung.
+ * Deinit and init bring it back, the first COUNT (default 1) inits hang.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_camera.h"
+#include "esp_log.h"
+#ifdef SIM_HAVE_LIBJPEG
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
+
+#define CAMERA_MAX_FRAMES       256
+#define CAMERA_DEFAULT_FPS      12
+#define CAMERA_MAX_FB           4           // Frame buffer descriptors, preallocated like the driver does
+#define CAMERA_FB_TIMEOUT_MS    4000        // Same as the real driver before "Failed to get the frame on time!"
+#define JPG_CHUNK_SIZE          1024        // Encoder output is handed to the callback in blocks like JPGE does
+#define SYNTH_FRAMES            24
+#define SYNTH_WIDTH             800
+#define SYNTH_HEIGHT            600
+#define SYNTH_QUALITY           80
+#define AEC_STEP_MS             10          // AEC model update period, one tick
+#define AEC_TARGET              30000       // Exposure index (lines x gain) needed at 1 lux
+#define AEC_FLASH_LUX           60          // Light flash LED adds on the scene
+#define AEC_MAX_LINES           1248        // UXGA frame length, longer exposure needs gain
+#define AEC_MAX_GAIN_X16        (32 * 16)
+#define AEC_MAX_AMBIENT         16
+
+typedef struct sim_variant {
+    struct sim_variant *next;
+    int quality;
+    framesize_t framesize;
+    uint8_t *buf;
+    size_t len;
+    size_t width;
+    size_t height;
+} sim_variant_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t width;
+    size_t height;
+    sim_variant_t *variants;    // Frame encoded at other sensor settings, kept until deinit
+} sim_frame_t;
+
+static sim_frame_t frames[CAMERA_MAX_FRAMES];
+static size_t frame_count = 0;
+static int64_t frame_period_us = 1000000 / CAMERA_DEFAULT_FPS;
+static int64_t next_frame_us = 0;
+static SemaphoreHandle_t fb_free = NULL;    // Driver owned frame buffers left
+static SemaphoreHandle_t fb_lock = NULL;    // Guards next_frame_us
+static SemaphoreHandle_t fb_pool_lock = NULL;
+static camera_fb_t fb_pool[CAMERA_MAX_FB];
+static bool fb_used[CAMERA_MAX_FB];         // Guarded by fb_pool_lock
+static sensor_t sensor;
+static int config_quality;                  // Settings the frames were taken at
+static framesize_t config_framesize;
+static SemaphoreHandle_t variant_lock = NULL;   // Guards variants of frames
+static double ambient_lux[AEC_MAX_AMBIENT] = { 300 };
+static size_t ambient_count = 1;
+static int64_t ambient_period_us = 30000000;
+static int64_t aec_tau_us = 40000;
+static volatile uint32_t aec_level;         // Exposure index the sensor is at now
+static TaskHandle_t aec_task_handle = NULL;
+static int64_t hang_after_us = -1;          // SIM_CAMERA_HANG_MS, -1 never hangs
+static int hang_inits = 1;                  // Inits still to hang
+static volatile int64_t hang_at_us = 0;     // Time sensor stops delivering frames, 0 never
+
+static const uint16_t framesize_width[FRAMESIZE_INVALID] = {
+    96, 160, 176, 240, 240, 320, 400, 480, 640, 800, 1024, 1280, 1280, 1600,
+};
+
+/**
+ * @brief Read size from SOF marker
+ */
+static bool jpeg_size(const uint8_t *buf, size_t len, size_t *width, size_t *height) {
+    size_t i = 2;
+    while (i + 9 < len) {
+        if (buf[i] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = buf[i + 1];
+        size_t segment = (buf[i + 2] << 8) | buf[i + 3];
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            *height = (buf[i + 5] << 8) | buf[i + 6];
+            *width = (buf[i + 7] << 8) | buf[i + 8];
+            return true;
+        }
+        i += 2 + segment;
+    }
+    return false;
+}
+
+static int frame_name_cmp(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static bool frame_load(const char *path, sim_frame_t *frame) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    frame->buf = len > 0 ? malloc(len) : NULL;
+    bool ok = frame->buf != NULL && fread(frame->buf, 1, len, file) == (size_t)len;
+    fclose(file);
+    frame->len = len;
+    if (ok && !jpeg_size(frame->buf, frame->len, &frame->width, &frame->height)) {
+        ESP_LOGW("sim", "%s is not baseline JPEG, skipped", path);
+        ok = false;
+    }
+    if (!ok) {
+        free(frame->buf);
+    }
+    return ok;
+}
+
+/**
+ * @brief Render frames of the synthetic scene
+ */
+static bool frames_synthesize(void) {
+    uint8_t *rgb = malloc(SYNTH_WIDTH * SYNTH_HEIGHT * 3);
+    if (rgb == NULL) {
+        return false;
+    }
+    for (size_t n = 0; n < SYNTH_FRAMES; n++) {
+        size_t figure_x = n * (SYNTH_WIDTH + 160) / SYNTH_FRAMES;
+        for (size_t y = 0; y < SYNTH_HEIGHT; y++) {
+            for (size_t x = 0; x < SYNTH_WIDTH; x++) {
+                uint8_t *px = rgb + (y * SYNTH_WIDTH + x) * 3;
+                bool figure = x + 160 >= figure_x && x < figure_x && y >= 200 && y < 560;
+                px[0] = figure ? 40 : 60 + x * 120 / SYNTH_WIDTH;
+                px[1] = figure ? 30 : 90 + y * 100 / SYNTH_HEIGHT;
+                px[2] = figure ? 30 : 140;
+            }
+        }
+        sim_frame_t *frame = &frames[frame_count];
+        if (!fmt2jpg(rgb, SYNTH_WIDTH * SYNTH_HEIGHT * 3, SYNTH_WIDTH, SYNTH_HEIGHT, PIXFORMAT_RGB888,
+                     SYNTH_QUALITY, &frame->buf, &frame->len)) {
+            break;
+        }
+        frame->width = SYNTH_WIDTH;
+        frame->height = SYNTH_HEIGHT;
+        frame_count++;
+    }
+    free(rgb);
+    return frame_count > 0;
+}
+
+static bool frames_load(const char *dir_path) {
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        ESP_LOGE("sim", "Can not open frames directory %s", dir_path);
+        return false;
+    }
+    char *names[CAMERA_MAX_FRAMES];
+    size_t name_count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && name_count < CAMERA_MAX_FRAMES) {
+        size_t len = strlen(entry->d_name);
+        if (len > 4 && (strcmp(entry->d_name + len - 4, ".jpg") == 0 || strcmp(entry->d_name + len - 4, ".JPG") == 0)) {
+            names[name_count++] = strdup(entry->d_name);
+        }
+    }
+    closedir(dir);
+    qsort(names, name_count, sizeof(char *), frame_name_cmp);
+    for (size_t i = 0; i < name_count; i++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, names[i]);
+        if (frame_load(path, &frames[frame_count])) {
+            frame_count++;
+        }
+        free(names[i]);
+    }
+    return frame_count > 0;
+}
+
+// =========================== SENSOR ===========================
+static int sensor_set_pixformat(sensor_t *s, pixformat_t pixformat) { s->pixformat = pixformat; return 0; }
+static int sensor_set_framesize(sensor_t *s, framesize_t framesize) { s->status.framesize = framesize; return 0; }
+static int sensor_set_quality(sensor_t *s, int quality) { s->status.quality = quality; return 0; }
+static int sensor_set_brightness(sensor_t *s, int level) { s->status.brightness = level; return 0; }
+static int sensor_set_contrast(sensor_t *s, int level) { s->status.contrast = level; return 0; }
+static int sensor_set_saturation(sensor_t *s, int level) { s->status.saturation = level; return 0; }
+static int sensor_set_exposure_ctrl(sensor_t *s, int enable) { s->status.aec = enable; return 0; }
+static int sensor_set_aec2(sensor_t *s, int enable) { s->status.aec2 = enable; return 0; }
+static int sensor_set_ae_level(sensor_t *s, int level) { s->status.ae_level = level; return 0; }
+static int sensor_set_aec_value(sensor_t *s, int value) { s->status.aec_value = value; return 0; }
+static int sensor_set_gain_ctrl(sensor_t *s, int enable) { s->status.agc = enable; return 0; }
+static int sensor_set_agc_gain(sensor_t *s, int gain) { s->status.agc_gain = gain; return 0; }
+static int sensor_set_whitebal(sensor_t *s, int enable) { s->status.awb = enable; return 0; }
+static int sensor_set_awb_gain(sensor_t *s, int enable) { s->status.awb_gain = enable; return 0; }
+
+/**
+ * @brief Registers of OV2640 sensor bank holding exposure (AEC[15:10], AEC[9:2], AEC[1:0]) & gain
+ */
+static int sensor_get_reg(sensor_t *s, int reg, int mask) {
+    uint32_t level = aec_level;
+    uint32_t lines = level < AEC_MAX_LINES ? level : AEC_MAX_LINES;
+    lines = lines == 0 ? 1 : lines;
+    uint32_t gain_x16 = level * 16 / lines;
+    gain_x16 = gain_x16 < 16 ? 16 : gain_x16 > AEC_MAX_GAIN_X16 - 1 ? AEC_MAX_GAIN_X16 - 1 : gain_x16;
+    // Gain is (1 + GAIN[3:0] / 16) times 2 for every bit set in GAIN[7:4]
+    uint8_t doublings = 0;
+    while (gain_x16 >= 32 && doublings < 4) {
+        gain_x16 /= 2;
+        doublings++;
+    }
+    int value = 0;
+    switch (reg) {
+    case 0x100:
+        value = (((1 << doublings) - 1) << 4) | (gain_x16 - 16);
+        break;
+    case 0x103:
+        value = lines & 0x03;
+        break;
+    case 0x110:
+        value = (lines >> 2) & 0xFF;
+        break;
+    case 0x145:
+        value = (lines >> 10) & 0x3F;
+        break;
+    }
+    return value & mask;
+}
+
+/**
+ * @brief Move exposure towards what current scene light needs
+ */
+static void aec_task(void *arg) {
+    int64_t last = esp_timer_get_time();
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(AEC_STEP_MS));
+        int64_t now = esp_timer_get_time();
+        double lux = ambient_lux[(now / ambient_period_us) % ambient_count];
+        lux += gpio_get_level(GPIO_NUM_4) ? AEC_FLASH_LUX : 0;
+        double target = AEC_TARGET / (lux > 0.01 ? lux : 0.01);
+        double level = aec_level;
+        double step = (double)(now - last);
+        level += (target - level) * step / (aec_tau_us + step);
+        aec_level = level < 1 ? 1 : level;
+        last = now;
+    }
+}
+
+static void aec_init(void) {
+    const char *lux = getenv("SIM_AMBIENT_LUX");
+    if (lux != NULL) {
+        ambient_count = 0;
+        char *end = (char *)lux;
+        while (*end != '\0' && ambient_count < AEC_MAX_AMBIENT) {
+            ambient_lux[ambient_count++] = strtod(end, &end);
+            end += *end == ',' ? 1 : 0;
+        }
+        ambient_count = ambient_count == 0 ? 1 : ambient_count;
+    }
+    const char *period = getenv("SIM_AMBIENT_PERIOD_MS");
+    if (period != NULL && atoi(period) > 0) {
+        ambient_period_us = atoi(period) * 1000LL;
+    }
+    const char *tau = getenv("SIM_AEC_TAU_MS");
+    if (tau != NULL && atoi(tau) > 0) {
+        aec_tau_us = atoi(tau) * 1000LL;
+    }
+    aec_level = AEC_TARGET / (ambient_lux[0] > 0.01 ? ambient_lux[0] : 0.01);
+    if (aec_task_handle != NULL) {
+        return;                             // Camera initialized again, sensor model keeps running
+    }
+    xTaskCreate(aec_task, "sim_aec", 2048, NULL, 1, &aec_task_handle);
+    ESP_LOGI("sim", "Ambient light %g lux (%u levels every %lld ms), AEC time constant %lld ms",
+             ambient_lux[0], (unsigned)ambient_count, (long long)(ambient_period_us / 1000),
+             (long long)(aec_tau_us / 1000));
+}
+
+/**
+ * @brief Arm injected sensor hang for this init
+ */
+static void hang_init(void) {
+    const char *hang = getenv("SIM_CAMERA_HANG_MS");
+    if (hang_after_us < 0 && hang != NULL && atoi(hang) >= 0) {
+        char *end;
+        hang_after_us = strtol(hang, &end, 10) * 1000LL;
+        hang_inits = *end == ',' ? atoi(end + 1) : 1;
+    }
+    hang_at_us = 0;
+    if (hang_after_us >= 0 && hang_inits > 0) {
+        hang_inits--;
+        hang_at_us = esp_timer_get_time() + hang_after_us;
+        ESP_LOGI("sim", "Sensor hangs in %lld ms", (long long)(hang_after_us / 1000));
+    }
+}
+
+static sim_variant_t *frame_encode(sim_frame_t *frame, int quality, framesize_t framesize);
+
+/**
+ * @brief Frame as sensor would give it at current quality & frame size, original when not possible
+ */
+static void frame_variant(sim_frame_t *frame, const uint8_t **buf, size_t *len, size_t *width, size_t *height) {
+    *buf = frame->buf;
+    *len = frame->len;
+    *width = frame->width;
+    *height = frame->height;
+    int quality = sensor.status.quality;
+    framesize_t framesize = sensor.status.framesize;
+    if (quality == config_quality && framesize == config_framesize) {
+        return;
+    }
+    xSemaphoreTake(variant_lock, portMAX_DELAY);
+    sim_variant_t *variant = frame->variants;
+    while (variant != NULL && (variant->quality != quality || variant->framesize != framesize)) {
+        variant = variant->next;
+    }
+    if (variant == NULL) {
+        variant = frame_encode(frame, quality, framesize);
+    }
+    xSemaphoreGive(variant_lock);
+    if (variant != NULL) {
+        *buf = variant->buf;
+        *len = variant->len;
+        *width = variant->width;
+        *height = variant->height;
+    }
+}
+
+// =========================== DRIVER ===========================
+esp_err_t esp_camera_init(const camera_config_t *config) {
+    const char *dir_path = getenv("SIM_FRAMES_DIR");
+    if (!(dir_path != NULL ? frames_load(dir_path) : frames_synthesize())) {
+        ESP_LOGE("sim", "No JPEG frames in %s", dir_path != NULL ? dir_path : "synthetic scene");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const char *fps = getenv("SIM_CAMERA_FPS");
+    if (fps != NULL && atoi(fps) > 0) {
+        frame_period_us = 1000000 / atoi(fps);
+    }
+    size_t fb_count = config->fb_count < CAMERA_MAX_FB ? config->fb_count : CAMERA_MAX_FB;
+    memset(fb_used, 0, sizeof(fb_used));
+    fb_free = xSemaphoreCreateCounting(fb_count, fb_count);
+    fb_lock = xSemaphoreCreateMutex();
+    fb_pool_lock = xSemaphoreCreateMutex();
+    variant_lock = xSemaphoreCreateMutex();
+    config_quality = config->jpeg_quality;
+    config_framesize = config->frame_size;
+    sensor.pixformat = config->pixel_format;
+    sensor.status.framesize = config->frame_size;
+    sensor.status.quality = config->jpeg_quality;
+    sensor.status.aec = 1;
+    sensor.status.agc = 1;
+    sensor.status.awb = 1;
+    sensor.set_pixformat = sensor_set_pixformat;
+    sensor.set_framesize = sensor_set_framesize;
+    sensor.set_quality = sensor_set_quality;
+    sensor.set_brightness = sensor_set_brightness;
+    sensor.set_contrast = sensor_set_contrast;
+    sensor.set_saturation = sensor_set_saturation;
+    sensor.set_exposure_ctrl = sensor_set_exposure_ctrl;
+    sensor.set_aec2 = sensor_set_aec2;
+    sensor.set_ae_level = sensor_set_ae_level;
+    sensor.set_aec_value = sensor_set_aec_value;
+    sensor.set_gain_ctrl = sensor_set_gain_ctrl;
+    sensor.set_agc_gain = sensor_set_agc_gain;
+    sensor.set_whitebal = sensor_set_whitebal;
+    sensor.set_awb_gain = sensor_set_awb_gain;
+    sensor.get_reg = sensor_get_reg;
+    aec_init();
+    hang_init();
+    ESP_LOGI("sim", "Camera plays %u frames from %s every %lld ms", (unsigned)frame_count,
+             dir_path != NULL ? dir_path : "synthetic scene",
+             (long long)(frame_period_us / 1000));
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit(void) {
+    for (size_t i = 0; i < frame_count; i++) {
+        while (frames[i].variants != NULL) {
+            sim_variant_t *variant = frames[i].variants;
+            frames[i].variants = variant->next;
+            free(variant->buf);
+            free(variant);
+        }
+        free(frames[i].buf);
+    }
+    frame_count = 0;
+    // Caller has every frame buffer back, nobody waits on these
+    vSemaphoreDelete(fb_free);
+    vSemaphoreDelete(fb_lock);
+    vSemaphoreDelete(fb_pool_lock);
+    vSemaphoreDelete(variant_lock);
+    fb_free = fb_lock = fb_pool_lock = variant_lock = NULL;
+    return ESP_OK;
+}
+
+camera_fb_t *esp_camera_fb_get(void) {
+    if (frame_count == 0) {
+        return NULL;
+    }
+    if (hang_at_us != 0 && esp_timer_get_time() >= hang_at_us) {
+        vTaskDelay(pdMS_TO_TICKS(CAMERA_FB_TIMEOUT_MS));
+        ESP_LOGE("sim", "Failed to get the frame on time!");
+        return NULL;
+    }
+    if (xSemaphoreTake(fb_free, pdMS_TO_TICKS(CAMERA_FB_TIMEOUT_MS)) != pdTRUE) {
+        ESP_LOGE("sim", "Failed to get the frame on time!");
+        return NULL;
+    }
+    camera_fb_t *fb = NULL;
+    xSemaphoreTake(fb_pool_lock, portMAX_DELAY);
+    for (size_t i = 0; fb == NULL; i++) {   // fb_free guarantees a free descriptor
+        if (!fb_used[i]) {
+            fb_used[i] = true;
+            fb = &fb_pool[i];
+        }
+    }
+    xSemaphoreGive(fb_pool_lock);
+
+    // Frames come at sensor pace, a caller asking faster waits for the next one
+    xSemaphoreTake(fb_lock, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    if (now < next_frame_us) {
+        vTaskDelay(pdMS_TO_TICKS((next_frame_us - now) / 1000) + 1);
+        now = esp_timer_get_time();
+    }
+    next_frame_us = now + frame_period_us;
+    xSemaphoreGive(fb_lock);
+
+    sim_frame_t *frame = &frames[(now / frame_period_us) % frame_count];
+    const uint8_t *buf;
+    // Frames are never written, driver buffers are shared
+    frame_variant(frame, &buf, &fb->len, &fb->width, &fb->height);
+    fb->buf = (uint8_t *)buf;
+    fb->format = PIXFORMAT_JPEG;
+    fb->timestamp.tv_sec = now / 1000000;
+    fb->timestamp.tv_usec = now % 1000000;
+    return fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb) {
+    if (fb == NULL) {
+        return;
+    }
+    xSemaphoreTake(fb_pool_lock, portMAX_DELAY);
+    fb_used[fb - fb_pool] = false;
+    xSemaphoreGive(fb_pool_lock);
+    xSemaphoreGive(fb_free);
+}
+
+sensor_t *esp_camera_sensor_get(void) {
+    return frame_count > 0 ? &sensor : NULL;
+}
+
+// =========================== CONVERTERS ===========================
+bool frame2jpg_cb(camera_fb_t *fb, uint8_t quality, jpg_out_cb cb, void *arg) {
+    if (fb->format == PIXFORMAT_JPEG) {
+        return cb(arg, 0, fb->buf, fb->len) == fb->len;
+    }
+    return fmt2jpg_cb(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, cb, arg);
+}
+
+bool frame2jpg(camera_fb_t *fb, uint8_t quality, uint8_t **out, size_t *out_len) {
+    if (fb->format == PIXFORMAT_JPEG) {
+        *out = malloc(fb->len);
+        if (*out == NULL) {
+            return false;
+        }
+        memcpy(*out, fb->buf, fb->len);
+        *out_len = fb->len;
+        return true;
+    }
+    return fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
+}
+
+#ifdef SIM_HAVE_LIBJPEG
+static sim_variant_t *frame_encode(sim_frame_t *frame, int quality, framesize_t framesize) {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, frame->buf, frame->len);
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        return NULL;
+    }
+    unsigned scale = 8;
+    if (framesize < FRAMESIZE_INVALID && config_framesize < FRAMESIZE_INVALID) {
+        scale = (8 * framesize_width[framesize] + framesize_width[config_framesize] / 2) / framesize_width[config_framesize];
+        scale = scale < 1 ? 1 : scale > 8 ? 8 : scale;
+    }
+    cinfo.scale_num = scale;
+    cinfo.scale_denom = 8;
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+    size_t width = cinfo.output_width;
+    size_t height = cinfo.output_height;
+    uint8_t *rgb = malloc(width * height * 3);
+    while (rgb != NULL && cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = rgb + (size_t)cinfo.output_scanline * width * 3;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    if (rgb != NULL) {
+        jpeg_finish_decompress(&cinfo);
+    } else {
+        jpeg_abort_decompress(&cinfo);
+    }
+    jpeg_destroy_decompress(&cinfo);
+
+    sim_variant_t *variant = rgb != NULL ? calloc(1, sizeof(*variant)) : NULL;
+    int jpeg_quality = 100 - quality * 3 / 2;
+    if (variant == NULL || !fmt2jpg(rgb, width * height * 3, width, height, PIXFORMAT_RGB888,
+                                    jpeg_quality < 5 ? 5 : jpeg_quality, &variant->buf, &variant->len)) {
+        free(variant);
+        free(rgb);
+        return NULL;
+    }
+    free(rgb);
+    variant->quality = quality;
+    variant->framesize = framesize;
+    variant->width = width;
+    variant->height = height;
+    variant->next = frame->variants;
+    frame->variants = variant;
+    return variant;
+}
+
+bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format,
+             uint8_t quality, uint8_t **out, size_t *out_len) {
+    int components;
+    J_COLOR_SPACE space;
+    if (format == PIXFORMAT_RGB888) {
+        components = 3;
+        space = JCS_RGB;
+    } else if (format == PIXFORMAT_GRAYSCALE) {
+        components = 1;
+        space = JCS_GRAYSCALE;
+    } else {
+        return false;
+    }
+    if (src_len < (size_t)width * height * components) {
+        return false;
+    }
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned char *mem = NULL;
+    unsigned long mem_len = 0;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &mem, &mem_len);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = components;
+    cinfo.in_color_space = space;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = src + (size_t)cinfo.next_scanline * width * components;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    *out = mem;
+    *out_len = mem_len;
+    return true;
+}
+
+bool fmt2jpg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format,
+                uint8_t quality, jpg_out_cb cb, void *arg) {
+    uint8_t *jpg;
+    size_t jpg_len;
+    if (!fmt2jpg(src, src_len, width, height, format, quality, &jpg, &jpg_len)) {
+        return false;
+    }
+    bool ok = true;
+    for (size_t index = 0; index < jpg_len && ok; index += JPG_CHUNK_SIZE) {
+        size_t len = jpg_len - index < JPG_CHUNK_SIZE ? jpg_len - index : JPG_CHUNK_SIZE;
+        ok = cb(arg, index, jpg + index, len) == len;
+    }
+    free(jpg);
+    return ok;
+}
+
+typedef struct {
+    struct jpeg_error_mgr mgr;
+    jmp_buf jump;
+} decode_error_t;
+
+/**
+ * @brief Broken input fails the decode like on the device, default handler of libjpeg exits the process
+ */
+static void decode_error_exit(j_common_ptr cinfo) {
+    (*cinfo->err->output_message)(cinfo);
+    longjmp(((decode_error_t *)cinfo->err)->jump, 1);
+}
+
+esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void *arg) {
+    uint8_t *jpg = malloc(len);
+    if (jpg == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (reader(arg, 0, jpg, len) != len) {
+        free(jpg);
+        return ESP_FAIL;
+    }
+    struct jpeg_decompress_struct cinfo;
+    decode_error_t jerr;
+    uint8_t *volatile row = NULL;
+    cinfo.err = jpeg_std_error(&jerr.mgr);
+    jerr.mgr.error_exit = decode_error_exit;
+    jpeg_create_decompress(&cinfo);
+    if (setjmp(jerr.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        free(row);
+        free(jpg);
+        return ESP_FAIL;
+    }
+    jpeg_mem_src(&cinfo, jpg, len);
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        free(jpg);
+        return ESP_FAIL;
+    }
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1 << scale;
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    esp_err_t err = ESP_OK;
+    uint16_t width = cinfo.output_width;
+    uint16_t height = cinfo.output_height;
+    row = malloc((size_t)width * 3);
+    if (row == NULL || !writer(arg, 0, 0, width, height, NULL)) {
+        err = ESP_FAIL;
+    }
+    while (err == ESP_OK && cinfo.output_scanline < cinfo.output_height) {
+        uint16_t y = cinfo.output_scanline;
+        JSAMPROW rows[1] = { (JSAMPROW)row };
+        jpeg_read_scanlines(&cinfo, rows, 1);
+        if (!writer(arg, 0, y, width, 1, row)) {
+            err = ESP_FAIL;
+        }
+    }
+    if (err == ESP_OK) {
+        jpeg_finish_decompress(&cinfo);
+        writer(arg, width, height, width, height, NULL);
+    } else {
+        jpeg_abort_decompress(&cinfo);
+    }
+    jpeg_destroy_decompress(&cinfo);
+    free(row);
+    free(jpg);
+    return err;
+}
+#else
+static sim_variant_t *frame_encode(sim_frame_t *frame, int quality, framesize_t framesize) {
+    return NULL;
+}
+
+bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format,
+             uint8_t quality, uint8_t **out, size_t *out_len) {
+    return false;
+}
+
+bool fmt2jpg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format,
+                uint8_t quality, jpg_out_cb cb, void *arg) {
+    return false;
+}
+
+esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void *arg) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
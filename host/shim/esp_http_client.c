@@ -0,0 +1,428 @@
+/**
+ * @file esp_http_client.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - blocking HTTP/1.1 client keeping connection open between requests
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "lwip/sockets.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "sim_port.h"
+
+#define CLIENT_URL_SIZE         256
+#define CLIENT_BUF_SIZE         2048
+#define CLIENT_DEFAULT_TIMEOUT  5000
+#define CLIENT_HEADERS_SIZE     512
+
+struct esp_http_client {
+    char host[128];
+    uint16_t port;
+    char path[CLIENT_URL_SIZE];
+    esp_http_client_method_t method;
+    int timeout_ms;
+    bool keep_alive;
+    http_event_handle_cb handler;
+    void *user_data;
+    int fd;
+    int status;
+    int content_length;
+    bool chunked;
+    bool server_close;
+    const char *post_data;
+    int post_len;
+    char headers[CLIENT_HEADERS_SIZE];      // Extra "Key: value\r\n" lines of set_header
+    int body_left;                          // Body bytes not read by esp_http_client_read yet, -1 unknown
+    char buf[CLIENT_BUF_SIZE];
+    size_t len;                             // Received bytes not consumed yet
+};
+
+static const char *client_methods[] = { "GET", "POST", "PUT", "HEAD" };
+
+static void client_event(esp_http_client_handle_t client, esp_http_client_event_id_t id, void *data, int data_len,
+                         char *key, char *value) {
+    if (client->handler == NULL) {
+        return;
+    }
+    esp_http_client_event_t event = {
+        .event_id = id,
+        .client = client,
+        .data = data,
+        .data_len = data_len,
+        .user_data = client->user_data,
+        .header_key = key,
+        .header_value = value,
+    };
+    client->handler(&event);
+}
+
+/**
+ * @brief Split "http://host[:port]/path" into client fields
+ */
+static esp_err_t client_parse_url(esp_http_client_handle_t client, const char *url) {
+    const char *host = strstr(url, "://");
+    host = host != NULL ? host + 3 : url;
+    size_t host_len = strcspn(host, ":/");
+    if (host_len == 0 || host_len >= sizeof(client->host)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char new_host[sizeof(client->host)];
+    memcpy(new_host, host, host_len);
+    new_host[host_len] = '\0';
+    uint16_t port = 80;
+    const char *path = host + host_len;
+    if (*path == ':') {
+        port = (uint16_t)strtoul(path + 1, (char **)&path, 10);
+    }
+    if (client->fd >= 0 && (strcmp(new_host, client->host) != 0 || sim_port_map(port) != client->port)) {
+        esp_http_client_close(client);
+    }
+    strcpy(client->host, new_host);
+    client->port = sim_port_map(port);
+    snprintf(client->path, sizeof(client->path), "%s", *path == '/' ? path : "/");
+    return ESP_OK;
+}
+
+static bool client_connect(esp_http_client_handle_t client) {
+    char port[8];
+    snprintf(port, sizeof(port), "%u", client->port);
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res;
+    if (getaddrinfo(client->host, port, &hints, &res) != 0) {
+        return false;
+    }
+    client->fd = socket(res->ai_family, res->ai_socktype, 0);
+    struct timeval timeout = { .tv_sec = client->timeout_ms / 1000, .tv_usec = (client->timeout_ms % 1000) * 1000 };
+    int one = 1;
+    setsockopt(client->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    bool ok = connect(client->fd, res->ai_addr, res->ai_addrlen) == 0;
+    freeaddrinfo(res);
+    if (!ok) {
+        close(client->fd);
+        client->fd = -1;
+        return false;
+    }
+    client->len = 0;
+    client_event(client, HTTP_EVENT_ON_CONNECTED, NULL, 0, NULL, NULL);
+    return true;
+}
+
+static bool client_send(esp_http_client_handle_t client, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(client->fd, buf, len, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        buf += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+/**
+ * @brief Receive more bytes into buffer
+ */
+static bool client_fill(esp_http_client_handle_t client) {
+    if (client->len == CLIENT_BUF_SIZE) {
+        return false;
+    }
+    ssize_t got = recv(client->fd, client->buf + client->len, CLIENT_BUF_SIZE - client->len, 0);
+    if (got <= 0) {
+        return false;
+    }
+    client->len += got;
+    return true;
+}
+
+static void client_consume(esp_http_client_handle_t client, size_t len) {
+    memmove(client->buf, client->buf + len, client->len - len);
+    client->len -= len;
+}
+
+/**
+ * @brief Read one CRLF terminated line into line (NUL terminated, without CRLF)
+ */
+static bool client_read_line(esp_http_client_handle_t client, char *line, size_t size) {
+    char *end;
+    while ((end = memmem(client->buf, client->len, "\r\n", 2)) == NULL) {
+        if (!client_fill(client)) {
+            return false;
+        }
+    }
+    size_t len = end - client->buf;
+    if (len >= size) {
+        return false;
+    }
+    memcpy(line, client->buf, len);
+    line[len] = '\0';
+    client_consume(client, len + 2);
+    return true;
+}
+
+/**
+ * @brief Deliver len body bytes through ON_DATA events
+ */
+static bool client_read_body(esp_http_client_handle_t client, size_t len) {
+    while (len > 0) {
+        if (client->len == 0 && !client_fill(client)) {
+            return false;
+        }
+        size_t part = client->len < len ? client->len : len;
+        client_event(client, HTTP_EVENT_ON_DATA, client->buf, part, NULL, NULL);
+        client_consume(client, part);
+        len -= part;
+    }
+    return true;
+}
+
+/**
+ * @brief Read status line & headers of response
+ */
+static bool client_read_headers(esp_http_client_handle_t client) {
+    char line[512];
+    if (!client_read_line(client, line, sizeof(line)) || sscanf(line, "HTTP/1.%*d %d", &client->status) != 1) {
+        return false;
+    }
+    client->content_length = -1;
+    client->chunked = false;
+    client->server_close = false;
+    while (client_read_line(client, line, sizeof(line))) {
+        if (line[0] == '\0') {
+            break;
+        }
+        char *value = strchr(line, ':');
+        if (value == NULL) {
+            continue;
+        }
+        *value++ = '\0';
+        while (*value == ' ') {
+            value++;
+        }
+        if (strcasecmp(line, "Content-Length") == 0) {
+            client->content_length = atoi(value);
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0 && strcasecmp(value, "chunked") == 0) {
+            client->chunked = true;
+        } else if (strcasecmp(line, "Connection") == 0 && strcasecmp(value, "close") == 0) {
+            client->server_close = true;
+        }
+        client_event(client, HTTP_EVENT_ON_HEADER, NULL, 0, line, value);
+    }
+    return line[0] == '\0';
+}
+
+static bool client_read_response(esp_http_client_handle_t client) {
+    char line[512];
+    if (!client_read_headers(client)) {
+        return false;
+    }
+    if (client->method == HTTP_METHOD_HEAD) {
+        return true;
+    }
+    if (client->chunked) {
+        while (client_read_line(client, line, sizeof(line))) {
+            size_t size = strtoul(line, NULL, 16);
+            if (size == 0) {
+                return client_read_line(client, line, sizeof(line));
+            }
+            if (!client_read_body(client, size) || !client_read_line(client, line, sizeof(line))) {
+                return false;
+            }
+        }
+        return false;
+    }
+    if (client->content_length >= 0) {
+        return client_read_body(client, client->content_length);
+    }
+    while (client_read_body(client, client->len > 0 ? client->len : 1)) {     // Body ends with connection
+    }
+    client->server_close = true;
+    return true;
+}
+
+// =========================== CLIENT API ===========================
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config) {
+    esp_http_client_handle_t client = calloc(1, sizeof(struct esp_http_client));
+    if (client == NULL) {
+        return NULL;
+    }
+    client->fd = -1;
+    client->method = config->method;
+    client->timeout_ms = config->timeout_ms > 0 ? config->timeout_ms : CLIENT_DEFAULT_TIMEOUT;
+    client->keep_alive = config->keep_alive_enable;
+    client->handler = config->event_handler;
+    client->user_data = config->user_data;
+    if (config->url != NULL) {
+        if (client_parse_url(client, config->url) != ESP_OK) {
+            free(client);
+            return NULL;
+        }
+    } else {
+        snprintf(client->host, sizeof(client->host), "%s", config->host);
+        client->port = sim_port_map(config->port > 0 ? config->port : 80);
+        snprintf(client->path, sizeof(client->path), "%s", config->path != NULL ? config->path : "/");
+    }
+    return client;
+}
+
+/**
+ * @brief Send request line and headers announcing body of content_len bytes
+ */
+static bool client_send_request(esp_http_client_handle_t client, int content_len) {
+    char request[CLIENT_URL_SIZE + CLIENT_HEADERS_SIZE + 256];
+    int len = snprintf(request, sizeof(request),
+                       "%s %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: ESP32 HTTP Client/1.0\r\nContent-Length: %d\r\n%s%s\r\n",
+                       client_methods[client->method], client->path, client->host, content_len, client->headers,
+                       client->keep_alive ? "" : "Connection: close\r\n");
+    return client_send(client, request, len);
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client) {
+    bool reused = client->fd >= 0;
+    if (!reused && !client_connect(client)) {
+        client_event(client, HTTP_EVENT_ERROR, NULL, 0, NULL, NULL);
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    if (!client_send_request(client, client->post_data != NULL ? client->post_len : 0) ||
+        (client->post_data != NULL && !client_send(client, client->post_data, client->post_len))) {
+        esp_http_client_close(client);
+        if (reused) {                       // Server may have closed idle connection, try once more
+            return esp_http_client_perform(client);
+        }
+        client_event(client, HTTP_EVENT_ERROR, NULL, 0, NULL, NULL);
+        return ESP_FAIL;
+    }
+    client_event(client, HTTP_EVENT_HEADERS_SENT, NULL, 0, NULL, NULL);
+    if (!client_read_response(client)) {
+        bool timeout = errno == EAGAIN || errno == EWOULDBLOCK;
+        esp_http_client_close(client);
+        client_event(client, HTTP_EVENT_ERROR, NULL, 0, NULL, NULL);
+        return timeout ? ESP_ERR_TIMEOUT : ESP_FAIL;
+    }
+    client_event(client, HTTP_EVENT_ON_FINISH, NULL, 0, NULL, NULL);
+    if (!client->keep_alive || client->server_close) {
+        esp_http_client_close(client);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url) {
+    return client_parse_url(client, url);
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method) {
+    client->method = method;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value) {
+    // Drop previous value of the header, then append the new one
+    size_t key_len = strlen(key);
+    char *line = client->headers;
+    while (*line != '\0') {
+        char *next = strstr(line, "\r\n") + 2;
+        if (strncasecmp(line, key, key_len) == 0 && line[key_len] == ':') {
+            memmove(line, next, strlen(next) + 1);
+        } else {
+            line = next;
+        }
+    }
+    size_t used = strlen(client->headers);
+    if (value == NULL) {
+        return ESP_OK;
+    }
+    if (snprintf(client->headers + used, sizeof(client->headers) - used, "%s: %s\r\n", key, value) >=
+        (int)(sizeof(client->headers) - used)) {
+        client->headers[used] = '\0';
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len) {
+    client->post_data = data;
+    client->post_len = len;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len) {
+    bool reused = client->fd >= 0;
+    if (!reused && !client_connect(client)) {
+        client_event(client, HTTP_EVENT_ERROR, NULL, 0, NULL, NULL);
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    if (!client_send_request(client, write_len)) {
+        esp_http_client_close(client);
+        if (reused) {                       // Server may have closed idle connection, try once more
+            return esp_http_client_open(client, write_len);
+        }
+        client_event(client, HTTP_EVENT_ERROR, NULL, 0, NULL, NULL);
+        return ESP_FAIL;
+    }
+    client_event(client, HTTP_EVENT_HEADERS_SENT, NULL, 0, NULL, NULL);
+    return ESP_OK;
+}
+
+int esp_http_client_write(esp_http_client_handle_t client, const char *buffer, int len) {
+    return client->fd >= 0 && client_send(client, buffer, len) ? len : -1;
+}
+
+int esp_http_client_fetch_headers(esp_http_client_handle_t client) {
+    if (client->fd < 0 || !client_read_headers(client)) {
+        return ESP_FAIL;
+    }
+    client->body_left = client->chunked ? -1 : client->content_length;
+    return client->content_length;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len) {
+    if (client->body_left == 0) {
+        return 0;
+    }
+    if (client->len == 0 && !client_fill(client)) {
+        return client->body_left < 0 ? 0 : -1;      // Body of unknown length ends with connection
+    }
+    size_t part = client->len < (size_t)len ? client->len : (size_t)len;
+    if (client->body_left > 0 && part > (size_t)client->body_left) {
+        part = client->body_left;
+    }
+    memcpy(buffer, client->buf, part);
+    client_consume(client, part);
+    if (client->body_left > 0) {
+        client->body_left -= part;
+    }
+    return part;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) {
+    return client->status;
+}
+
+int esp_http_client_get_content_length(esp_http_client_handle_t client) {
+    return client->content_length;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) {
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+        client->len = 0;
+        client_event(client, HTTP_EVENT_DISCONNECTED, NULL, 0, NULL, NULL);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+    esp_http_client_close(client);
+    free(client);
+    return ESP_OK;
+}
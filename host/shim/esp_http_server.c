@@ -0,0 +1,673 @@
+/**
+ * @file esp_http_server.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - HTTP server with one thread per instance serving all of its sessions
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * Behaves like esp_http_server where the firmware depends on it: handlers run in the server
+ * thread, a handler returning ESP_OK without response keeps the socket open for other tasks
+ * (httpd_socket_send), handler error closes the session and close_fn is called on every close.
+ * New connections wait in backlog while all max_open_sockets sessions are taken.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "lwip/sockets.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "sim_port.h"
+
+#define SESSION_BUF_SIZE    (HTTPD_MAX_URI_LEN + HTTPD_MAX_REQ_HDR_LEN + 512)
+#define RESP_HEADERS_SIZE   1024
+#define DISCARD_BUF_SIZE    512
+#define SIM_TCP_SND_BUF     5744                    // CONFIG_LWIP_TCP_SND_BUF_DEFAULT, slow client blocks sends like on device
+
+typedef struct {
+    int fd;
+    bool close_pending;
+    size_t len;                             // Received bytes not consumed yet
+    char buf[SESSION_BUF_SIZE];
+} httpd_session_t;
+
+typedef struct {
+    httpd_config_t config;
+    httpd_uri_t *handlers;
+    size_t handler_count;
+    httpd_session_t *sessions;
+    int listen_fd;
+    int wake[2];                            // Pipe waking select for trigger_close and stop
+    pthread_t thread;
+    pthread_mutex_t lock;                   // Guards session fds against other tasks
+    volatile bool running;
+} httpd_server_t;
+
+typedef struct {
+    httpd_session_t *session;
+    char *headers;                          // Header lines of request, NUL terminated
+    size_t body_left;
+    const char *status;
+    const char *type;
+    const char *hdr_field[16];
+    const char *hdr_value[16];
+    size_t hdr_count;
+    bool chunked;
+} httpd_req_aux_t;
+
+static const struct {
+    const char *status;
+    const char *msg;
+} httpd_errors[HTTPD_ERR_CODE_MAX] = {
+    [HTTPD_500_INTERNAL_SERVER_ERROR]     = { "500 Internal Server Error", "Server has encountered an unexpected error" },
+    [HTTPD_501_METHOD_NOT_IMPLEMENTED]    = { "501 Method Not Implemented", "Request method is not supported by server" },
+    [HTTPD_505_VERSION_NOT_SUPPORTED]     = { "505 Version Not Supported", "HTTP version not supported by server" },
+    [HTTPD_400_BAD_REQUEST]               = { "400 Bad Request", "Server unable to understand request due to invalid syntax" },
+    [HTTPD_401_UNAUTHORIZED]              = { "401 Unauthorized", "Server known the client's identify and it must authenticate itself to get he requested resource" },
+    [HTTPD_403_FORBIDDEN]                 = { "403 Forbidden", "Server is refusing to give the requested resource to the client" },
+    [HTTPD_404_NOT_FOUND]                 = { "404 Not Found", "This URI does not exist" },
+    [HTTPD_405_METHOD_NOT_ALLOWED]        = { "405 Method Not Allowed", "Request method for this URI is not handled by server" },
+    [HTTPD_408_REQ_TIMEOUT]               = { "408 Request Timeout", "Server closed this connection" },
+    [HTTPD_411_LENGTH_REQUIRED]           = { "411 Length Required", "Chunked encoding not supported by server" },
+    [HTTPD_414_URI_TOO_LONG]              = { "414 URI Too Long", "URI is too long for server to interpret" },
+    [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE]  = { "431 Request Header Fields Too Large", "Header fields are too long for server to interpret" },
+};
+
+static const char *httpd_methods[] = { "DELETE", "GET", "HEAD", "POST", "PUT" };
+
+// =========================== SOCKETS ===========================
+static bool send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, buf, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        buf += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+static httpd_session_t *session_find(httpd_server_t *server, int fd) {
+    for (size_t i = 0; i < server->config.max_open_sockets; i++) {
+        if (server->sessions[i].fd == fd) {
+            return &server->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static void session_close(httpd_server_t *server, httpd_session_t *session) {
+    int fd = session->fd;
+    pthread_mutex_lock(&server->lock);
+    session->fd = -1;
+    session->close_pending = false;
+    session->len = 0;
+    pthread_mutex_unlock(&server->lock);
+    if (server->config.close_fn != NULL) {
+        server->config.close_fn(server, fd);    // Application closes the socket itself, like on device
+    } else {
+        close(fd);
+    }
+}
+
+static void session_accept(httpd_server_t *server) {
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    struct timeval rcv = { .tv_sec = server->config.recv_wait_timeout };
+    struct timeval snd = { .tv_sec = server->config.send_wait_timeout };
+    int one = 1;
+    int snd_buf = SIM_TCP_SND_BUF;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &rcv, sizeof(rcv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &snd, sizeof(snd));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &snd_buf, sizeof(snd_buf));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    pthread_mutex_lock(&server->lock);
+    httpd_session_t *session = session_find(server, -1);
+    session->fd = fd;
+    session->len = 0;
+    session->close_pending = false;
+    pthread_mutex_unlock(&server->lock);
+    if (server->config.open_fn != NULL && server->config.open_fn(server, fd) != ESP_OK) {
+        session_close(server, session);
+    }
+}
+
+// =========================== REQUEST ===========================
+/**
+ * @brief Take body bytes of current request, buffered bytes first
+ */
+static int session_read_body(httpd_req_aux_t *aux, char *buf, size_t len) {
+    httpd_session_t *session = aux->session;
+    if (len > aux->body_left) {
+        len = aux->body_left;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    ssize_t got;
+    if (session->len > 0) {
+        got = len < session->len ? len : session->len;
+        memcpy(buf, session->buf, got);
+        memmove(session->buf, session->buf + got, session->len - got);
+        session->len -= got;
+    } else {
+        got = recv(session->fd, buf, len, 0);
+        if (got < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+        }
+        if (got == 0) {
+            return HTTPD_SOCK_ERR_FAIL;
+        }
+    }
+    aux->body_left -= got;
+    return (int)got;
+}
+
+static const httpd_uri_t *handler_find(httpd_server_t *server, const char *uri, int method, bool *method_mismatch) {
+    size_t uri_len = strcspn(uri, "?");
+    *method_mismatch = false;
+    for (size_t i = 0; i < server->handler_count; i++) {
+        const httpd_uri_t *handler = &server->handlers[i];
+        bool match = server->config.uri_match_fn != NULL
+                     ? server->config.uri_match_fn(handler->uri, uri, uri_len)
+                     : (strlen(handler->uri) == uri_len && strncmp(handler->uri, uri, uri_len) == 0);
+        if (!match) {
+            continue;
+        }
+        if ((int)handler->method == method) {
+            return handler;
+        }
+        *method_mismatch = true;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Parse and dispatch one request whose header block ends at header_len
+ * @return false when session has to be closed
+ */
+static bool request_handle(httpd_server_t *server, httpd_session_t *session, size_t header_len) {
+    char header[SESSION_BUF_SIZE + 1];
+    memcpy(header, session->buf, header_len);
+    header[header_len] = '\0';
+    memmove(session->buf, session->buf + header_len, session->len - header_len);
+    session->len -= header_len;
+
+    httpd_req_t req = { .handle = server };
+    httpd_req_aux_t aux = { .session = session, .status = "200 OK", .type = "text/html" };
+    req.aux = &aux;
+
+    char method[8] = "";
+    char *uri = (char *)req.uri;
+    char *line_end = strstr(header, "\r\n");
+    *line_end = '\0';
+    char *uri_start = strchr(header, ' ');
+    char *uri_end = uri_start != NULL ? strchr(uri_start + 1, ' ') : NULL;
+    aux.headers = line_end + 2;
+    if (uri_start == NULL || uri_end == NULL || (size_t)(uri_start - header) >= sizeof(method)) {
+        httpd_resp_send_err(&req, HTTPD_400_BAD_REQUEST, NULL);
+        return false;
+    }
+    if ((size_t)(uri_end - uri_start - 1) > HTTPD_MAX_URI_LEN) {
+        httpd_resp_send_err(&req, HTTPD_414_URI_TOO_LONG, NULL);
+        return false;
+    }
+    memcpy(method, header, uri_start - header);
+    memcpy(uri, uri_start + 1, uri_end - uri_start - 1);
+    req.method = -1;
+    for (size_t i = 0; i < sizeof(httpd_methods) / sizeof(httpd_methods[0]); i++) {
+        if (strcmp(method, httpd_methods[i]) == 0) {
+            req.method = (int)i;
+        }
+    }
+    char length[16];
+    if (httpd_req_get_hdr_value_str(&req, "Content-Length", length, sizeof(length)) == ESP_OK) {
+        req.content_len = strtoul(length, NULL, 10);
+        aux.body_left = req.content_len;
+    }
+    if (req.method < 0) {
+        httpd_resp_send_err(&req, HTTPD_501_METHOD_NOT_IMPLEMENTED, NULL);
+        return false;
+    }
+
+    bool method_mismatch;
+    const httpd_uri_t *handler = handler_find(server, uri, req.method, &method_mismatch);
+    if (handler == NULL) {
+        httpd_resp_send_err(&req, method_mismatch ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, NULL);
+        return false;
+    }
+    req.user_ctx = handler->user_ctx;
+    ESP_LOGD("httpd", "%s %s on fd %d", method, uri, session->fd);
+    if (handler->handler(&req) != ESP_OK) {
+        return false;
+    }
+
+    char discard[DISCARD_BUF_SIZE];
+    while (aux.body_left > 0) {             // Unread body must not be parsed as next request
+        if (session_read_body(&aux, discard, sizeof(discard)) <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Receive on readable session and handle every complete request in buffer
+ * @return false when session has to be closed
+ */
+static bool session_process(httpd_server_t *server, httpd_session_t *session) {
+    ssize_t got = recv(session->fd, session->buf + session->len, SESSION_BUF_SIZE - session->len, 0);
+    if (got <= 0) {
+        return false;
+    }
+    session->len += got;
+    while (session->fd >= 0 && !session->close_pending) {
+        char *end = memmem(session->buf, session->len, "\r\n\r\n", 4);
+        if (end == NULL) {
+            if (session->len == SESSION_BUF_SIZE) {
+                httpd_req_t req = { .handle = server };
+                httpd_req_aux_t aux = { .session = session };
+                req.aux = &aux;
+                httpd_resp_send_err(&req, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE, NULL);
+                return false;
+            }
+            return true;
+        }
+        if (!request_handle(server, session, end + 4 - session->buf)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *httpd_thread(void *arg) {
+    httpd_server_t *server = arg;
+    pthread_setname_np(pthread_self(), "httpd");      // Task name of the IDF server
+    while (server->running) {
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(server->wake[0], &read_set);
+        int max_fd = server->wake[0];
+        bool slot_free = false;
+        for (size_t i = 0; i < server->config.max_open_sockets; i++) {
+            httpd_session_t *session = &server->sessions[i];
+            if (session->fd >= 0 && session->close_pending) {
+                session_close(server, session);
+            }
+            if (session->fd < 0) {
+                slot_free = true;
+                continue;
+            }
+            FD_SET(session->fd, &read_set);
+            max_fd = session->fd > max_fd ? session->fd : max_fd;
+        }
+        if (slot_free) {
+            FD_SET(server->listen_fd, &read_set);
+            max_fd = server->listen_fd > max_fd ? server->listen_fd : max_fd;
+        }
+        if (select(max_fd + 1, &read_set, NULL, NULL, NULL) < 0) {
+            continue;
+        }
+        if (FD_ISSET(server->wake[0], &read_set)) {
+            char drain[16];
+            while (read(server->wake[0], drain, sizeof(drain)) == sizeof(drain)) {
+            }
+        }
+        for (size_t i = 0; i < server->config.max_open_sockets; i++) {
+            httpd_session_t *session = &server->sessions[i];
+            if (session->fd >= 0 && !session->close_pending && FD_ISSET(session->fd, &read_set) &&
+                !session_process(server, session)) {
+                session_close(server, session);
+            }
+        }
+        if (slot_free && FD_ISSET(server->listen_fd, &read_set)) {
+            session_accept(server);
+        }
+    }
+    return NULL;
+}
+
+// =========================== SERVER ===========================
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    httpd_server_t *server = calloc(1, sizeof(httpd_server_t));
+    if (server == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    server->config = *config;
+    server->handlers = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+    server->sessions = calloc(config->max_open_sockets, sizeof(httpd_session_t));
+    if (server->handlers == NULL || server->sessions == NULL) {
+        free(server->handlers);
+        free(server->sessions);
+        free(server);
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < config->max_open_sockets; i++) {
+        server->sessions[i].fd = -1;
+    }
+    pthread_mutex_init(&server->lock, NULL);
+
+    uint16_t port = sim_port_map(config->server_port);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    int one = 1;
+    server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(server->listen_fd, config->backlog_conn) != 0 || pipe(server->wake) != 0) {
+        ESP_LOGE("httpd", "Can not listen on port %u: %s", port, strerror(errno));
+        close(server->listen_fd);
+        free(server->handlers);
+        free(server->sessions);
+        free(server);
+        return ESP_FAIL;
+    }
+    fcntl(server->wake[0], F_SETFL, O_NONBLOCK);
+    server->running = true;
+    pthread_create(&server->thread, NULL, httpd_thread, server);
+    ESP_LOGI("httpd", "Port %u served on %u", config->server_port, port);
+    *handle = server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    httpd_server_t *server = handle;
+    if (server == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    server->running = false;
+    if (write(server->wake[1], "s", 1) != 1) {
+        return ESP_FAIL;
+    }
+    pthread_join(server->thread, NULL);
+    for (size_t i = 0; i < server->config.max_open_sockets; i++) {
+        if (server->sessions[i].fd >= 0) {
+            session_close(server, &server->sessions[i]);
+        }
+    }
+    close(server->listen_fd);
+    close(server->wake[0]);
+    close(server->wake[1]);
+    pthread_mutex_destroy(&server->lock);
+    free(server->handlers);
+    free(server->sessions);
+    free(server);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    httpd_server_t *server = handle;
+    for (size_t i = 0; i < server->handler_count; i++) {
+        if (server->handlers[i].method == uri_handler->method && strcmp(server->handlers[i].uri, uri_handler->uri) == 0) {
+            return ESP_FAIL;
+        }
+    }
+    if (server->handler_count == server->config.max_uri_handlers) {
+        ESP_LOGW("httpd", "No slots left for registering handler %s", uri_handler->uri);
+        return ESP_ERR_NO_MEM;
+    }
+    server->handlers[server->handler_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto) {
+    size_t tpl_len = strlen(uri_template);
+    char last = tpl_len > 0 ? uri_template[tpl_len - 1] : 0;
+    char prevlast = tpl_len > 1 ? uri_template[tpl_len - 2] : 0;
+    bool asterisk = last == '*' || (prevlast == '*' && last == '?');
+    bool quest = last == '?' || (prevlast == '?' && last == '*');
+    size_t exact = tpl_len - asterisk - quest;      // Template part that has to match exactly
+    if (tpl_len < (size_t)asterisk + (size_t)quest * 2) {
+        return false;
+    }
+    if (match_upto < exact) {
+        if (!quest || match_upto != exact - 1) {    // Only the character before '?' may be missing
+            return false;
+        }
+        exact--;
+    } else if (match_upto > exact && !asterisk) {
+        return false;
+    }
+    return strncmp(uri_template, uri_to_match, exact) == 0;
+}
+
+// =========================== REQUEST API ===========================
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+    return session_read_body(r->aux, buf, buf_len);
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) {
+    return ((httpd_req_aux_t *)r->aux)->session->fd;
+}
+
+/**
+ * @brief Find header value in request, NULL when missing
+ */
+static const char *header_find(httpd_req_t *r, const char *field, size_t *len) {
+    size_t field_len = strlen(field);
+    for (const char *line = ((httpd_req_aux_t *)r->aux)->headers; *line != '\0';) {
+        const char *end = strstr(line, "\r\n");
+        if (end == NULL) {
+            end = line + strlen(line);
+        }
+        if ((size_t)(end - line) > field_len && strncasecmp(line, field, field_len) == 0 && line[field_len] == ':') {
+            const char *value = line + field_len + 1;
+            while (value < end && isspace((unsigned char)*value)) {
+                value++;
+            }
+            while (end > value && isspace((unsigned char)end[-1])) {
+                end--;
+            }
+            *len = end - value;
+            return value;
+        }
+        line = *end != '\0' ? end + 2 : end;
+    }
+    return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field) {
+    size_t len = 0;
+    header_find(r, field, &len);
+    return len;
+}
+
+/**
+ * @brief Copy string with truncation to val_size - 1 characters
+ */
+static esp_err_t copy_value(char *val, size_t val_size, const char *src, size_t len) {
+    if (val_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool truncated = len >= val_size;
+    if (truncated) {
+        len = val_size - 1;
+    }
+    memcpy(val, src, len);
+    val[len] = '\0';
+    return truncated ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size) {
+    size_t len;
+    const char *value = header_find(r, field, &len);
+    if (value == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return copy_value(val, val_size, value, len);
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r) {
+    const char *query = strchr(r->uri, '?');
+    return query != NULL ? strlen(query + 1) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len) {
+    const char *query = strchr(r->uri, '?');
+    if (query == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return copy_value(buf, buf_len, query + 1, strlen(query + 1));
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+    size_t key_len = strlen(key);
+    for (const char *pair = qry; *pair != '\0';) {
+        size_t pair_len = strcspn(pair, "&");
+        if (pair_len > key_len && strncmp(pair, key, key_len) == 0 && pair[key_len] == '=') {
+            return copy_value(val, val_size, pair + key_len + 1, pair_len - key_len - 1);
+        }
+        pair += pair_len + (pair[pair_len] == '&');
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+// =========================== RESPONSE API ===========================
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+    ((httpd_req_aux_t *)r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+    ((httpd_req_aux_t *)r->aux)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+    httpd_req_aux_t *aux = r->aux;
+    httpd_server_t *server = r->handle;
+    if (aux->hdr_count == server->config.max_resp_headers ||
+        aux->hdr_count == sizeof(aux->hdr_field) / sizeof(aux->hdr_field[0])) {
+        return ESP_ERR_NO_MEM;
+    }
+    aux->hdr_field[aux->hdr_count] = field;
+    aux->hdr_value[aux->hdr_count] = value;
+    aux->hdr_count++;
+    return ESP_OK;
+}
+
+/**
+ * @brief Send status line and headers, content_len below zero means chunked body
+ */
+static bool resp_send_headers(httpd_req_t *r, ssize_t content_len) {
+    httpd_req_aux_t *aux = r->aux;
+    char headers[RESP_HEADERS_SIZE];
+    int len = snprintf(headers, sizeof(headers), "HTTP/1.1 %s\r\nContent-Type: %s\r\n", aux->status, aux->type);
+    if (content_len < 0) {
+        len += snprintf(headers + len, sizeof(headers) - len, "Transfer-Encoding: chunked\r\n");
+    } else {
+        len += snprintf(headers + len, sizeof(headers) - len, "Content-Length: %zd\r\n", content_len);
+    }
+    for (size_t i = 0; i < aux->hdr_count && len < (int)sizeof(headers); i++) {
+        len += snprintf(headers + len, sizeof(headers) - len, "%s: %s\r\n", aux->hdr_field[i], aux->hdr_value[i]);
+    }
+    len += snprintf(headers + len, sizeof(headers) - len, "\r\n");
+    if (len >= (int)sizeof(headers)) {
+        return false;
+    }
+    return send_all(aux->session->fd, headers, len);
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf != NULL ? strlen(buf) : 0;
+    }
+    if (!resp_send_headers(r, buf_len) || !send_all(((httpd_req_aux_t *)r->aux)->session->fd, buf, buf_len)) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    httpd_req_aux_t *aux = r->aux;
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf != NULL ? strlen(buf) : 0;
+    }
+    if (!aux->chunked) {
+        if (!resp_send_headers(r, -1)) {
+            return ESP_FAIL;
+        }
+        aux->chunked = true;
+    }
+    char size[16];
+    int size_len = snprintf(size, sizeof(size), "%zx\r\n", buf_len);
+    if (!send_all(aux->session->fd, size, size_len) ||
+        (buf_len > 0 && !send_all(aux->session->fd, buf, buf_len)) ||
+        !send_all(aux->session->fd, "\r\n", 2)) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+    if (error < 0 || error >= HTTPD_ERR_CODE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_req_aux_t *aux = req->aux;
+    aux->status = httpd_errors[error].status;
+    aux->type = "text/html";
+    aux->hdr_count = 0;
+    return httpd_resp_send(req, msg != NULL ? msg : httpd_errors[error].msg, HTTPD_RESP_USE_STRLEN);
+}
+
+// =========================== SOCKET API ===========================
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags) {
+    httpd_server_t *server = hd;
+    pthread_mutex_lock(&server->lock);
+    bool open = session_find(server, sockfd) != NULL;
+    pthread_mutex_unlock(&server->lock);
+    if (!open) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    ssize_t sent = send(sockfd, buf, buf_len, flags | MSG_NOSIGNAL);
+    if (sent < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT
+                                                                             : HTTPD_SOCK_ERR_FAIL;
+    }
+    return (int)sent;
+}
+
+int httpd_socket_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len, int flags) {
+    httpd_server_t *server = hd;
+    pthread_mutex_lock(&server->lock);
+    bool open = session_find(server, sockfd) != NULL;
+    pthread_mutex_unlock(&server->lock);
+    if (!open) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    ssize_t got = recv(sockfd, buf, buf_len, flags);
+    if (got < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT
+                                                                             : HTTPD_SOCK_ERR_FAIL;
+    }
+    return (int)got;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    httpd_server_t *server = handle;
+    pthread_mutex_lock(&server->lock);
+    httpd_session_t *session = session_find(server, sockfd);
+    if (session != NULL) {
+        session->close_pending = true;
+    }
+    pthread_mutex_unlock(&server->lock);
+    if (session == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return write(server->wake[1], "c", 1) == 1 ? ESP_OK : ESP_FAIL;
+}
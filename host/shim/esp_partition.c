@@ -0,0 +1,125 @@
+/**
+ * @file esp_partition.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - data partition in a file, writes only clear bits and erase sets sectors to 0xFF
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+
+#define SIM_FLASH_DEFAULT_FILE  "sim-flash.bin"
+#define SIM_FLASH_ADDRESS       0x110000            // Same place as "spiffs" in partitions_custom.csv
+#define SIM_FLASH_SIZE          0x2F0000
+
+static esp_partition_t storage = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = ESP_PARTITION_SUBTYPE_DATA_SPIFFS,
+    .address = SIM_FLASH_ADDRESS,
+    .size = SIM_FLASH_SIZE,
+    .label = "spiffs",
+};
+static int flash_fd = -1;
+static pthread_mutex_t flash_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Open backing file, missing or short file is padded with erased sectors
+ */
+static bool flash_open(void) {
+    if (flash_fd >= 0) {
+        return true;
+    }
+    const char *path = getenv("SIM_FLASH_FILE");
+    if (path == NULL) {
+        path = SIM_FLASH_DEFAULT_FILE;
+    }
+    flash_fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (flash_fd < 0) {
+        ESP_LOGE("sim", "Can not open flash file %s", path);
+        return false;
+    }
+    struct stat st;
+    fstat(flash_fd, &st);
+    if (st.st_size < SIM_FLASH_SIZE) {
+        uint8_t erased[SPI_FLASH_SEC_SIZE];
+        memset(erased, 0xFF, sizeof(erased));
+        for (off_t offset = st.st_size; offset < SIM_FLASH_SIZE; offset += sizeof(erased)) {
+            size_t len = SIM_FLASH_SIZE - offset < (off_t)sizeof(erased) ? (size_t)(SIM_FLASH_SIZE - offset) : sizeof(erased);
+            if (pwrite(flash_fd, erased, len, offset) != (ssize_t)len) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+    if (type != storage.type || (subtype != storage.subtype && subtype != ESP_PARTITION_SUBTYPE_ANY) ||
+        (label != NULL && strcmp(label, storage.label) != 0)) {
+        return NULL;
+    }
+    pthread_mutex_lock(&flash_lock);
+    bool ok = flash_open();
+    pthread_mutex_unlock(&flash_lock);
+    return ok ? &storage : NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    if (partition != &storage || src_offset > partition->size || size > partition->size - src_offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return pread(flash_fd, dst, size, src_offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+    if (partition != &storage || dst_offset > partition->size || size > partition->size - dst_offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *current = malloc(size);
+    if (current == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = ESP_FAIL;
+    pthread_mutex_lock(&flash_lock);
+    if (pread(flash_fd, current, size, dst_offset) == (ssize_t)size) {
+        for (size_t i = 0; i < size; i++) {
+            current[i] &= ((const uint8_t *)src)[i];
+        }
+        if (pwrite(flash_fd, current, size, dst_offset) == (ssize_t)size) {
+            err = ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&flash_lock);
+    free(current);
+    return err;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    if (partition != &storage || offset > partition->size || size > partition->size - offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t erased[SPI_FLASH_SEC_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&flash_lock);
+    for (size_t done = 0; done < size && err == ESP_OK; done += SPI_FLASH_SEC_SIZE) {
+        if (pwrite(flash_fd, erased, SPI_FLASH_SEC_SIZE, offset + done) != SPI_FLASH_SEC_SIZE) {
+            err = ESP_FAIL;
+        }
+    }
+    pthread_mutex_unlock(&flash_lock);
+    return err;
+}
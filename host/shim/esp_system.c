@@ -0,0 +1,141 @@
+/**
+ * @file esp_system.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - logging, error names, heap and the components with nothing to simulate
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "nvs_flash.h"
+#include "sim_port.h"
+
+// Memory figures of ESP32-CAM reported by heap statistics, the host allocator is not tracked
+#define SIM_INTERNAL_FREE   (160 * 1024)
+#define SIM_INTERNAL_BLOCK  (110 * 1024)
+#define SIM_SPIRAM_FREE     (4 * 1024 * 1024)
+
+// =========================== LOG ===========================
+uint32_t esp_log_timestamp(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+bool sim_log_debug(void) {
+    static int enabled = -1;
+    if (enabled < 0) {
+        enabled = getenv("SIM_LOG_DEBUG") != NULL;
+    }
+    return enabled;
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:                        return "ESP_OK";
+        case ESP_FAIL:                      return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:                return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:           return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:         return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:          return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:             return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:         return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:               return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE:      return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_HTTPD_RESULT_TRUNC:    return "ESP_ERR_HTTPD_RESULT_TRUNC";
+        case ESP_ERR_HTTP_CONNECT:          return "ESP_ERR_HTTP_CONNECT";
+        default:                            return "UNKNOWN ERROR";
+    }
+}
+
+// =========================== SYSTEM ===========================
+void esp_restart(void) {
+    fflush(stdout);
+    exit(3);
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return SIM_INTERNAL_FREE + SIM_SPIRAM_FREE;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return esp_get_free_heap_size();
+}
+
+uint32_t esp_random(void) {
+    static bool seeded = false;
+    if (!seeded) {
+        srandom((unsigned)time(NULL) ^ (unsigned)getpid());
+        seeded = true;
+    }
+    return (uint32_t)random() << 16 ^ (uint32_t)random();
+}
+
+uint16_t sim_port_map(uint16_t port) {
+    static int offset = -1;
+    if (offset < 0) {
+        const char *env = getenv("SIM_PORT_OFFSET");
+        offset = env != NULL ? atoi(env) : SIM_DEFAULT_PORT_OFFSET;
+    }
+    return port < 1024 ? port + offset : port;
+}
+
+// =========================== HEAP ===========================
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+    (void)caps;
+    return malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    (void)caps;
+    return calloc(n, size);
+}
+
+void heap_caps_free(void *ptr) {
+    free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return (caps & MALLOC_CAP_SPIRAM) ? SIM_SPIRAM_FREE : SIM_INTERNAL_FREE;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return heap_caps_get_free_size(caps);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return (caps & MALLOC_CAP_SPIRAM) ? SIM_SPIRAM_FREE : SIM_INTERNAL_BLOCK;
+}
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+    return heap_caps_get_free_size(caps);
+}
+
+// =========================== NVS / TLS ===========================
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_tls_get_and_clear_last_error(void *handle, int *esp_tls_code, int *esp_tls_flags) {
+    (void)handle;
+    if (esp_tls_code != NULL) {
+        *esp_tls_code = 0;
+    }
+    if (esp_tls_flags != NULL) {
+        *esp_tls_flags = 0;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,193 @@
+/**
+ * @file esp_wifi.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - default event loop, network interfaces and WiFi driver
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+
+#define EVENT_QUEUE_LEN     16
+#define EVENT_HANDLERS      16
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    void *data;
+} event_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} event_handler_t;
+
+static QueueHandle_t event_queue = NULL;
+static event_handler_t event_handlers[EVENT_HANDLERS];
+static size_t event_handler_count = 0;
+static wifi_mode_t wifi_mode = WIFI_MODE_NULL;
+
+// =========================== EVENT LOOP ===========================
+static void event_task(void *arg) {
+    event_t event;
+    while (1) {
+        if (xQueueReceive(event_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        for (size_t i = 0; i < event_handler_count; i++) {
+            event_handler_t *h = &event_handlers[i];
+            if ((h->base == ESP_EVENT_ANY_BASE || h->base == event.base) &&
+                (h->id == ESP_EVENT_ANY_ID || h->id == event.id)) {
+                h->handler(h->arg, event.base, event.id, event.data);
+            }
+        }
+        free(event.data);
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void) {
+    if (event_queue != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    event_queue = xQueueCreate(EVENT_QUEUE_LEN, sizeof(event_t));
+    if (event_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    return xTaskCreate(event_task, "sys_evt", 2304, NULL, 20, NULL) == pdPASS ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg) {
+    if (event_handler_count == EVENT_HANDLERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    event_handlers[event_handler_count++] = (event_handler_t){ event_base, event_id, event_handler, event_handler_arg };
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t event_handler, void *event_handler_arg,
+                                              esp_event_handler_instance_t *instance) {
+    if (instance != NULL) {
+        *instance = &event_handlers[event_handler_count];
+    }
+    return esp_event_handler_register(event_base, event_id, event_handler, event_handler_arg);
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait) {
+    if (event_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    event_t event = { event_base, event_id, NULL };
+    if (event_data_size > 0) {
+        event.data = malloc(event_data_size);
+        if (event.data == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(event.data, event_data, event_data_size);
+    }
+    if (xQueueSend(event_queue, &event, ticks_to_wait) != pdTRUE) {
+        free(event.data);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+// =========================== NETIF ===========================
+struct esp_netif_obj {
+    int unused;
+};
+
+static esp_netif_t netif_ap;
+static esp_netif_t netif_sta;
+
+esp_err_t esp_netif_init(void) {
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_ap(void) {
+    return &netif_ap;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void) {
+    return &netif_sta;
+}
+
+// =========================== WIFI ===========================
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) {
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    wifi_mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf) {
+    (void)interface;
+    (void)conf;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) {
+    (void)type;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+    if (wifi_mode == WIFI_MODE_AP || wifi_mode == WIFI_MODE_APSTA) {
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_AP_START, NULL, 0, portMAX_DELAY);
+    }
+    if (wifi_mode == WIFI_MODE_STA || wifi_mode == WIFI_MODE_APSTA) {
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Association always succeeds, gateway (camera address) comes from SIM_GATEWAY
+ */
+esp_err_t esp_wifi_connect(void) {
+    const char *gateway = getenv("SIM_GATEWAY");
+    ip_event_got_ip_t got_ip = { 0 };
+    got_ip.esp_netif = &netif_sta;
+    got_ip.ip_info.ip.addr = inet_addr("127.0.0.1");
+    got_ip.ip_info.netmask.addr = inet_addr("255.0.0.0");
+    got_ip.ip_info.gw.addr = inet_addr(gateway != NULL ? gateway : "127.0.0.1");
+    got_ip.ip_changed = true;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, NULL, 0, portMAX_DELAY);
+    return esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip), portMAX_DELAY);
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+    return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, NULL, 0, portMAX_DELAY);
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6]) {
+    uint32_t pid = (uint32_t)getpid();
+    mac[0] = 0x24;                          // Espressif OUI
+    mac[1] = 0x0a;
+    mac[2] = 0xc4;
+    mac[3] = (uint8_t)(pid >> 16);
+    mac[4] = (uint8_t)(pid >> 8);
+    mac[5] = (uint8_t)pid + (ifx == WIFI_IF_AP);
+    return ESP_OK;
+}
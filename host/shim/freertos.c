@@ -0,0 +1,495 @@
+/**
+ * @file freertos.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - FreeRTOS tasks, queues, event groups and notifications on POSIX threads
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+
+// =========================== TIME ===========================
+/**
+ * Injected clock error - SIM_CLOCK_OFFSET_MS shifts esp_timer_get_time, SIM_CLOCK_DRIFT_PPM makes it run
+ * fast (slow when negative), so two simulated devices disagree the way two crystals do. Ticks keep real
+ * time, tasks are paced the same with or without it.
+ */
+static int64_t clock_offset_us = 0;
+static int64_t clock_drift_ppm = 0;
+
+static int64_t boot_ns(void) {
+    static int64_t boot = 0;
+    if (boot == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        boot = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+    return boot;
+}
+
+/**
+ * @brief Real time since start (us)
+ */
+static int64_t uptime_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec - boot_ns()) / 1000;
+}
+
+__attribute__((constructor)) static void sim_clock_start(void) {
+    boot_ns();
+    const char *offset = getenv("SIM_CLOCK_OFFSET_MS");
+    const char *drift = getenv("SIM_CLOCK_DRIFT_PPM");
+    clock_offset_us = offset != NULL ? strtoll(offset, NULL, 10) * 1000 : 0;
+    clock_drift_ppm = drift != NULL ? strtoll(drift, NULL, 10) : 0;
+    // Start on host CLOCK_MONOTONIC lets tools map times of several simulated devices onto each other
+    ESP_LOGI("sim", "Clock {boot=%lld ns, offset=%lld ms, drift=%lld ppm}", (long long)boot_ns(),
+             (long long)(clock_offset_us / 1000), (long long)clock_drift_ppm);
+}
+
+int64_t esp_timer_get_time(void) {
+    int64_t uptime = uptime_us();
+    return uptime + uptime * clock_drift_ppm / 1000000 + clock_offset_us;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(uptime_us() / (portTICK_PERIOD_MS * 1000));
+}
+
+TickType_t xTaskGetTickCountFromISR(void) {
+    return xTaskGetTickCount();
+}
+
+/**
+ * @brief Absolute CLOCK_MONOTONIC deadline of given tick count
+ */
+static struct timespec tick_deadline(TickType_t tick) {
+    int64_t ns = boot_ns() + (int64_t)tick * portTICK_PERIOD_MS * 1000000LL;
+    struct timespec ts = { .tv_sec = ns / 1000000000LL, .tv_nsec = ns % 1000000000LL };
+    return ts;
+}
+
+/**
+ * @brief Absolute CLOCK_MONOTONIC deadline ticks from now
+ */
+static struct timespec timeout_deadline(TickType_t ticks) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t ns = ts.tv_nsec + (int64_t)ticks * portTICK_PERIOD_MS * 1000000LL;
+    ts.tv_sec += ns / 1000000000LL;
+    ts.tv_nsec = ns % 1000000000LL;
+    return ts;
+}
+
+static void cond_init(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/**
+ * @brief Wait on condition until deadline, portMAX_DELAY waits forever
+ * @return false on timeout
+ */
+static bool cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline) {
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+// =========================== CRITICAL SECTION ===========================
+static pthread_mutex_t critical_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+void sim_critical_enter(void) {
+    pthread_mutex_lock(&critical_lock);
+}
+
+void sim_critical_exit(void) {
+    pthread_mutex_unlock(&critical_lock);
+}
+
+// =========================== TASKS ===========================
+struct sim_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    char name[16];
+    uint32_t stack_depth;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+};
+
+static __thread struct sim_task *current_task;
+static volatile UBaseType_t task_count;
+
+static struct sim_task *task_alloc(const char *name, uint32_t stack_depth) {
+    struct sim_task *task = calloc(1, sizeof(struct sim_task));
+    if (task == NULL) {
+        return NULL;
+    }
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    task->stack_depth = stack_depth;
+    pthread_mutex_init(&task->lock, NULL);
+    cond_init(&task->cond);
+    return task;
+}
+
+static void *task_trampoline(void *arg) {
+    current_task = arg;
+    pthread_setname_np(pthread_self(), current_task->name);    // Tasks show by name in top -H & debuggers
+    __atomic_add_fetch(&task_count, 1, __ATOMIC_RELAXED);
+    current_task->fn(current_task->arg);
+    __atomic_sub_fetch(&task_count, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+    (void)priority;
+    struct sim_task *task = task_alloc(name, stack_depth);
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    if (handle != NULL) {
+        *handle = task;                 // Before start, task may use its handle right away
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&task->thread, &attr, task_trampoline, task);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        if (handle != NULL) {
+            *handle = NULL;
+        }
+        free(task);
+        return pdFAIL;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id) {
+    (void)core_id;
+    return xTaskCreate(fn, name, stack_depth, arg, priority, handle);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (current_task == NULL) {             // Thread not started by xTaskCreate (main, HTTP server)
+        current_task = task_alloc("thread", 0);
+        current_task->thread = pthread_self();
+    }
+    return current_task;
+}
+
+const char *pcTaskGetName(TaskHandle_t task) {
+    return (task != NULL ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL || task == current_task) {
+        __atomic_sub_fetch(&task_count, 1, __ATOMIC_RELAXED);
+        pthread_exit(NULL);
+    }
+    abort();                                // Deleting other tasks is not used by the firmware
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec deadline = timeout_deadline(ticks);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment) {
+    *previous_wake += increment;
+    struct timespec deadline = tick_deadline(*previous_wake);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return (task != NULL ? task : xTaskGetCurrentTaskHandle())->stack_depth;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void) {
+    return __atomic_load_n(&task_count, __ATOMIC_RELAXED);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    struct sim_task *task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = timeout_deadline(ticks == portMAX_DELAY ? 0 : ticks);
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0 && ticks != 0) {
+        if (!cond_wait(&task->cond, &task->lock, ticks, &deadline)) {
+            break;
+        }
+    }
+    uint32_t value = task->notify;
+    if (value != 0) {
+        task->notify = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+    xTaskNotifyGive(task);
+    if (woken != NULL) {
+        *woken = pdFALSE;
+    }
+}
+
+// =========================== QUEUES ===========================
+struct sim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint8_t *items;
+    size_t item_size;
+    size_t length;
+    size_t head;
+    size_t count;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct sim_queue *queue = calloc(1, sizeof(struct sim_queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    if (item_size > 0) {
+        queue->items = malloc((size_t)length * item_size);
+        if (queue->items == NULL) {
+            free(queue);
+            return NULL;
+        }
+    }
+    queue->item_size = item_size;
+    queue->length = length;
+    pthread_mutex_init(&queue->lock, NULL);
+    cond_init(&queue->not_empty);
+    cond_init(&queue->not_full);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (queue == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->items);
+    free(queue);
+}
+
+static BaseType_t queue_put(QueueHandle_t queue, const void *item, TickType_t ticks, bool overwrite) {
+    struct timespec deadline = timeout_deadline(ticks == portMAX_DELAY ? 0 : ticks);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length && !overwrite) {
+        if (ticks == 0 || !cond_wait(&queue->not_full, &queue->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return errQUEUE_FULL;
+        }
+    }
+    if (queue->count == queue->length) {            // Overwrite is meant for queues of length one
+        queue->count--;
+        queue->head = (queue->head + 1) % queue->length;
+    }
+    if (queue->item_size > 0) {
+        size_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+static BaseType_t queue_get(QueueHandle_t queue, void *item, TickType_t ticks, bool remove) {
+    struct timespec deadline = timeout_deadline(ticks == portMAX_DELAY ? 0 : ticks);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (ticks == 0 || !cond_wait(&queue->not_empty, &queue->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    if (queue->item_size > 0 && item != NULL) {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    }
+    if (remove) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    } else {
+        pthread_cond_signal(&queue->not_empty);     // Let other peekers and receivers see it too
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    return queue_put(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    return queue_put(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken) {
+    if (woken != NULL) {
+        *woken = pdFALSE;
+    }
+    return queue_put(queue, item, 0, false);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) {
+    return queue_put(queue, item, 0, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    return queue_get(queue, item, ticks, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks) {
+    return queue_get(queue, item, ticks, false);
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t spaces = queue->length - queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return spaces;
+}
+
+// =========================== SEMAPHORES ===========================
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    if (sem != NULL) {
+        xSemaphoreGive(sem);
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+    SemaphoreHandle_t sem = xQueueCreate(max_count, 0);
+    for (UBaseType_t i = 0; sem != NULL && i < initial_count; i++) {
+        xSemaphoreGive(sem);
+    }
+    return sem;
+}
+
+// =========================== EVENT GROUPS ===========================
+struct sim_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    EventBits_t bits;
+};
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    struct sim_event_group *group = calloc(1, sizeof(struct sim_event_group));
+    if (group == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&group->lock, NULL);
+    cond_init(&group->changed);
+    return group;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    if (group == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&group->lock);
+    pthread_cond_destroy(&group->changed);
+    free(group);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t value = group->bits;
+    pthread_cond_broadcast(&group->changed);
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    pthread_mutex_lock(&group->lock);
+    EventBits_t value = group->bits;            // Bits before clearing, like the kernel returns
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    pthread_mutex_lock(&group->lock);
+    EventBits_t value = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks) {
+    struct timespec deadline = timeout_deadline(ticks == portMAX_DELAY ? 0 : ticks);
+    pthread_mutex_lock(&group->lock);
+    while (!(wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0) && ticks != 0) {
+        if (!cond_wait(&group->changed, &group->lock, ticks, &deadline)) {
+            break;
+        }
+    }
+    EventBits_t value = group->bits;
+    bool met = wait_for_all ? (value & bits) == bits : (value & bits) != 0;
+    if (met && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
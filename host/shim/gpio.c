@@ -0,0 +1,201 @@
+/**
+ * @file gpio.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - GPIO driver, input edges are replayed from trace file
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * Trace file (SIM_PIR_TRACE) has one edge per line: "<ms since boot> <gpio> <level>",
+ * empty lines and lines starting with # are skipped. Setting SIM_PIR_TRACE_LOOP to period
+ * in milliseconds replays the trace again every period.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+
+#define TRACE_MAX_EDGES     1024
+
+typedef struct {
+    uint32_t at_ms;
+    gpio_num_t gpio;
+    uint32_t level;
+} trace_edge_t;
+
+typedef struct {
+    gpio_int_type_t type;
+    gpio_isr_t handler;
+    void *arg;
+    bool enabled;
+} gpio_pin_t;
+
+static gpio_pin_t pins[GPIO_NUM_MAX];
+static volatile uint32_t levels[GPIO_NUM_MAX];
+static pthread_mutex_t isr_lock = PTHREAD_MUTEX_INITIALIZER;    // ISRs never run concurrently
+static trace_edge_t trace[TRACE_MAX_EDGES];
+static size_t trace_len = 0;
+
+static bool gpio_valid(gpio_num_t gpio_num) {
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX;
+}
+
+/**
+ * @brief Change input level like the outside world would, runs ISR on matching edge
+ */
+static void gpio_drive(gpio_num_t gpio_num, uint32_t level) {
+    if (!gpio_valid(gpio_num)) {
+        return;
+    }
+    uint32_t previous = levels[gpio_num];
+    levels[gpio_num] = level;
+    gpio_pin_t *pin = &pins[gpio_num];
+    bool fire = false;
+    switch (pin->type) {
+        case GPIO_INTR_POSEDGE:     fire = !previous && level; break;
+        case GPIO_INTR_NEGEDGE:     fire = previous && !level; break;
+        case GPIO_INTR_ANYEDGE:     fire = previous != level; break;
+        case GPIO_INTR_HIGH_LEVEL:  fire = level; break;
+        case GPIO_INTR_LOW_LEVEL:   fire = !level; break;
+        default:                    break;
+    }
+    if (fire && pin->enabled && pin->handler != NULL) {
+        pthread_mutex_lock(&isr_lock);
+        pin->handler(pin->arg);
+        pthread_mutex_unlock(&isr_lock);
+    }
+}
+
+static bool trace_load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        ESP_LOGE("sim", "Can not open trace %s", path);
+        return false;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL && trace_len < TRACE_MAX_EDGES) {
+        unsigned at_ms, gpio, level;
+        if (line[0] == '#' || sscanf(line, "%u %u %u", &at_ms, &gpio, &level) != 3) {
+            continue;
+        }
+        trace[trace_len++] = (trace_edge_t){ at_ms, (gpio_num_t)gpio, level ? 1 : 0 };
+    }
+    fclose(file);
+    ESP_LOGI("sim", "Replaying %u edges from %s", (unsigned)trace_len, path);
+    return true;
+}
+
+static void trace_task(void *arg) {
+    const char *loop = getenv("SIM_PIR_TRACE_LOOP");
+    uint32_t period_ms = loop != NULL ? (uint32_t)atoi(loop) : 0;
+    uint32_t base_ms = 0;
+    do {
+        for (size_t i = 0; i < trace_len; i++) {
+            // Ticks, not esp_timer_get_time, so injected clock error does not move the trace
+            int64_t wait_ms = (int64_t)base_ms + trace[i].at_ms - (int64_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+            if (wait_ms > 0) {
+                vTaskDelay(pdMS_TO_TICKS(wait_ms));
+            }
+            gpio_drive(trace[i].gpio, trace[i].level);
+        }
+        base_ms += period_ms;
+    } while (period_ms > 0);
+    vTaskDelete(NULL);
+}
+
+// =========================== DRIVER API ===========================
+void gpio_pad_select_gpio(uint8_t gpio_num) {
+    (void)gpio_num;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num) {
+    if (!gpio_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(&pins[gpio_num], 0, sizeof(gpio_pin_t));
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode) {
+    (void)mode;
+    return gpio_valid(gpio_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    if (!gpio_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    levels[gpio_num] = level ? 1 : 0;
+    ESP_LOGD("sim", "GPIO%d -> %u", gpio_num, (unsigned)levels[gpio_num]);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    return gpio_valid(gpio_num) ? (int)levels[gpio_num] : 0;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+    if (!gpio_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pins[gpio_num].type = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num) {
+    if (!gpio_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pins[gpio_num].enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num) {
+    if (!gpio_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pins[gpio_num].enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+    (void)intr_alloc_flags;
+    static bool installed = false;
+    if (installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    installed = true;
+    const char *path = getenv("SIM_PIR_TRACE");
+    if (path != NULL && trace_load(path) && trace_len > 0) {
+        xTaskCreate(trace_task, "sim_trace", 2048, NULL, 5, NULL);
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args) {
+    if (!gpio_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&isr_lock);
+    pins[gpio_num].handler = isr_handler;
+    pins[gpio_num].arg = args;
+    pins[gpio_num].enabled = true;          // Adding handler enables the interrupt, like on device
+    pthread_mutex_unlock(&isr_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num) {
+    if (!gpio_valid(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&isr_lock);
+    pins[gpio_num].handler = NULL;
+    pthread_mutex_unlock(&isr_lock);
+    return ESP_OK;
+}
@@ -0,0 +1,19 @@
+/**
+ * @file esp_attr.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - placement attributes have no meaning off-device
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_ESP_ATTR_H
+#define SIM_ESP_ATTR_H
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+#endif
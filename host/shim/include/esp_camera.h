@@ -0,0 +1,166 @@
+/**
+ * @file esp_camera.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - camera driver serving JPEG files from directory (SIM_FRAMES_DIR) at SIM_CAMERA_FPS
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_ESP_CAMERA_H
+#define SIM_ESP_CAMERA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+typedef enum {
+    PIXFORMAT_RGB565,
+    PIXFORMAT_YUV422,
+    PIXFORMAT_GRAYSCALE,
+    PIXFORMAT_JPEG,
+    PIXFORMAT_RGB888,
+    PIXFORMAT_RAW,
+    PIXFORMAT_RGB444,
+    PIXFORMAT_RGB555,
+} pixformat_t;
+
+typedef enum {
+    FRAMESIZE_96X96,
+    FRAMESIZE_QQVGA,
+    FRAMESIZE_QCIF,
+    FRAMESIZE_HQVGA,
+    FRAMESIZE_240X240,
+    FRAMESIZE_QVGA,
+    FRAMESIZE_CIF,
+    FRAMESIZE_HVGA,
+    FRAMESIZE_VGA,
+    FRAMESIZE_SVGA,
+    FRAMESIZE_XGA,
+    FRAMESIZE_HD,
+    FRAMESIZE_SXGA,
+    FRAMESIZE_UXGA,
+    FRAMESIZE_INVALID
+} framesize_t;
+
+typedef enum {
+    LEDC_TIMER_0 = 0,
+    LEDC_TIMER_1,
+} ledc_timer_t;
+
+typedef enum {
+    LEDC_CHANNEL_0 = 0,
+    LEDC_CHANNEL_1,
+} ledc_channel_t;
+
+typedef enum {
+    CAMERA_FB_IN_PSRAM,
+    CAMERA_FB_IN_DRAM
+} camera_fb_location_t;
+
+typedef enum {
+    CAMERA_GRAB_WHEN_EMPTY,
+    CAMERA_GRAB_LATEST
+} camera_grab_mode_t;
+
+typedef struct {
+    int pin_pwdn;
+    int pin_reset;
+    int pin_xclk;
+    int pin_sscb_sda;
+    int pin_sscb_scl;
+    int pin_d7;
+    int pin_d6;
+    int pin_d5;
+    int pin_d4;
+    int pin_d3;
+    int pin_d2;
+    int pin_d1;
+    int pin_d0;
+    int pin_vsync;
+    int pin_href;
+    int pin_pclk;
+    int xclk_freq_hz;
+    ledc_timer_t ledc_timer;
+    ledc_channel_t ledc_channel;
+    pixformat_t pixel_format;
+    framesize_t frame_size;
+    int jpeg_quality;
+    size_t fb_count;
+    camera_fb_location_t fb_location;
+    camera_grab_mode_t grab_mode;
+} camera_config_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t width;
+    size_t height;
+    pixformat_t format;
+    struct timeval timestamp;
+} camera_fb_t;
+
+typedef struct {
+    framesize_t framesize;
+    uint8_t quality;
+    int8_t brightness;
+    int8_t contrast;
+    int8_t saturation;
+    int8_t sharpness;
+    uint8_t denoise;
+    uint8_t special_effect;
+    uint8_t wb_mode;
+    uint8_t awb;
+    uint8_t awb_gain;
+    uint8_t aec;
+    uint8_t aec2;
+    int8_t ae_level;
+    uint16_t aec_value;
+    uint8_t agc;
+    uint8_t agc_gain;
+    uint8_t gainceiling;
+} camera_status_t;
+
+typedef struct _sensor sensor_t;
+
+/**
+ * @brief Setters only store the value into status, the frames on disk do not change
+ * get_reg reads OV2640 exposure & gain registers (bank select 0x100 = sensor bank) of the simulated
+ * AEC, other registers read as 0.
+ */
+struct _sensor {
+    camera_status_t status;
+    pixformat_t pixformat;
+    int (*set_pixformat)(sensor_t *sensor, pixformat_t pixformat);
+    int (*set_framesize)(sensor_t *sensor, framesize_t framesize);
+    int (*set_quality)(sensor_t *sensor, int quality);
+    int (*set_brightness)(sensor_t *sensor, int level);
+    int (*set_contrast)(sensor_t *sensor, int level);
+    int (*set_saturation)(sensor_t *sensor, int level);
+    int (*set_exposure_ctrl)(sensor_t *sensor, int enable);
+    int (*set_aec2)(sensor_t *sensor, int enable);
+    int (*set_ae_level)(sensor_t *sensor, int level);
+    int (*set_aec_value)(sensor_t *sensor, int value);
+    int (*set_gain_ctrl)(sensor_t *sensor, int enable);
+    int (*set_agc_gain)(sensor_t *sensor, int gain);
+    int (*set_whitebal)(sensor_t *sensor, int enable);
+    int (*set_awb_gain)(sensor_t *sensor, int enable);
+    int (*get_reg)(sensor_t *sensor, int reg, int mask);
+};
+
+esp_err_t esp_camera_init(const camera_config_t *config);
+esp_err_t esp_camera_deinit(void);
+/**
+ * @brief Blocks until next frame is due, frames cycle through the directory in name order
+ */
+camera_fb_t *esp_camera_fb_get(void);
+void esp_camera_fb_return(camera_fb_t *fb);
+sensor_t *esp_camera_sensor_get(void);
+
+#include "img_converters.h"
+
+#endif
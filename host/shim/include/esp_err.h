@@ -0,0 +1,45 @@
+/**
+ * @file esp_err.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - ESP-IDF error codes
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_ESP_ERR_H
+#define SIM_ESP_ERR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                          0
+#define ESP_FAIL                        -1
+#define ESP_ERR_NO_MEM                  0x101
+#define ESP_ERR_INVALID_ARG             0x102
+#define ESP_ERR_INVALID_STATE           0x103
+#define ESP_ERR_INVALID_SIZE            0x104
+#define ESP_ERR_NOT_FOUND               0x105
+#define ESP_ERR_NOT_SUPPORTED           0x106
+#define ESP_ERR_TIMEOUT                 0x107
+#define ESP_ERR_INVALID_RESPONSE        0x108
+#define ESP_ERR_NVS_NO_FREE_PAGES       0x110d
+#define ESP_ERR_NVS_NEW_VERSION_FOUND   0x1110
+#define ESP_ERR_HTTPD_RESULT_TRUNC      0xb003
+#define ESP_ERR_HTTP_CONNECT            0x7002
+
+const char *esp_err_to_name(esp_err_t code);
+
+#define ESP_ERROR_CHECK(x) do {                                                         \
+        esp_err_t err_rc_ = (x);                                                        \
+        if (err_rc_ != ESP_OK) {                                                        \
+            fprintf(stderr, "ESP_ERROR_CHECK failed: %s at %s:%d\n",                   \
+                    esp_err_to_name(err_rc_), __FILE__, __LINE__);                      \
+            abort();                                                                    \
+        }                                                                               \
+    } while (0)
+
+#endif
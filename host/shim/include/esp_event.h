@@ -0,0 +1,40 @@
+/**
+ * @file esp_event.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - default event loop runs in its own thread
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_ESP_EVENT_H
+#define SIM_ESP_EVENT_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+typedef const char *esp_event_base_t;
+typedef void *esp_event_handler_instance_t;
+typedef void (*esp_event_handler_t)(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+
+#define ESP_EVENT_DECLARE_BASE(id)  extern esp_event_base_t id
+#define ESP_EVENT_DEFINE_BASE(id)   esp_event_base_t id = #id
+#define ESP_EVENT_ANY_BASE          NULL
+#define ESP_EVENT_ANY_ID            -1
+
+esp_err_t esp_event_loop_create_default(void);
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg);
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t event_handler, void *event_handler_arg,
+                                              esp_event_handler_instance_t *instance);
+/**
+ * @brief Event data are copied, handlers run later in the event loop thread
+ */
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait);
+
+#endif
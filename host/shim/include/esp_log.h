@@ -0,0 +1,30 @@
+/**
+ * @file esp_log.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - logging to stdout, debug level enabled by SIM_LOG_DEBUG environment variable
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_ESP_LOG_H
+#define SIM_ESP_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+uint32_t esp_log_timestamp(void);
+bool sim_log_debug(void);
+
+#define SIM_LOG(letter, tag, format, ...) \
+    printf(letter " (%u) %s: " format "\n", (unsigned)esp_log_timestamp(), tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) SIM_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) SIM_LOG("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) SIM_LOG("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { if (sim_log_debug()) SIM_LOG("D", tag, format, ##__VA_ARGS__); } while (0)
+#define ESP_LOGV(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+
+#endif
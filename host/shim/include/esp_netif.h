@@ -0,0 +1,57 @@
+/**
+ * @file esp_netif.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - network interfaces, everything is loopback
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_ESP_NETIF_H
+#define SIM_ESP_NETIF_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+typedef struct {
+    uint32_t addr;                  // Network byte order like lwIP
+} esp_ip4_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef struct {
+    int if_index;
+    esp_netif_t *esp_netif;
+    esp_netif_ip_info_t ip_info;
+    bool ip_changed;
+} ip_event_got_ip_t;
+
+typedef enum {
+    IP_EVENT_STA_GOT_IP,
+    IP_EVENT_STA_LOST_IP,
+    IP_EVENT_AP_STAIPASSIGNED,
+} ip_event_t;
+
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+#define esp_ip4_addr_get_byte(ipaddr, idx)  (((const uint8_t *)(&(ipaddr)->addr))[idx])
+#define esp_ip4_addr1(ipaddr)               esp_ip4_addr_get_byte(ipaddr, 0)
+#define esp_ip4_addr2(ipaddr)               esp_ip4_addr_get_byte(ipaddr, 1)
+#define esp_ip4_addr3(ipaddr)               esp_ip4_addr_get_byte(ipaddr, 2)
+#define esp_ip4_addr4(ipaddr)               esp_ip4_addr_get_byte(ipaddr, 3)
+#define IP2STR(ipaddr)  esp_ip4_addr1(ipaddr), esp_ip4_addr2(ipaddr), esp_ip4_addr3(ipaddr), esp_ip4_addr4(ipaddr)
+#define IPSTR           "%d.%d.%d.%d"
+
+esp_err_t esp_netif_init(void);
+esp_netif_t *esp_netif_create_default_wifi_ap(void);
+esp_netif_t *esp_netif_create_default_wifi_sta(void);
+
+#endif
@@ -0,0 +1,27 @@
+/**
+ * @file esp_system.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - system functions
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_ESP_SYSTEM_H
+#define SIM_ESP_SYSTEM_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+/**
+ * @brief Simulated restart ends the process, the runner is expected to start it again
+ */
+void esp_restart(void) __attribute__((noreturn));
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+uint32_t esp_random(void);
+
+#endif
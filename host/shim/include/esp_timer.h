@@ -0,0 +1,18 @@
+/**
+ * @file esp_timer.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - microseconds since process start
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_ESP_TIMER_H
+#define SIM_ESP_TIMER_H
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * @file esp_tls.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - no TLS, last error is always none
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_ESP_TLS_H
+#define SIM_ESP_TLS_H
+
+#include "esp_err.h"
+
+esp_err_t esp_tls_get_and_clear_last_error(void *handle, int *esp_tls_code, int *esp_tls_flags);
+
+#endif
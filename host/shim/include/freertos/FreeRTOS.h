@@ -0,0 +1,57 @@
+/**
+ * @file FreeRTOS.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - FreeRTOS kernel types, tasks are POSIX threads and a tick is 10 ms
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_FREERTOS_H
+#define SIM_FREERTOS_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ      100
+#define portTICK_PERIOD_MS      (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define pdTICKS_TO_MS(ticks)    ((uint32_t)(ticks) * portTICK_PERIOD_MS)
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define errQUEUE_FULL           0
+#define tskNO_AFFINITY          0x7FFFFFFF
+#define tskIDLE_PRIORITY        0
+
+/**
+ * @brief Critical sections are one process wide recursive lock, there are no interrupts to mask
+ */
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+
+void sim_critical_enter(void);
+void sim_critical_exit(void);
+
+#define portENTER_CRITICAL(mux)         ((void)(mux), sim_critical_enter())
+#define portEXIT_CRITICAL(mux)          ((void)(mux), sim_critical_exit())
+#define portENTER_CRITICAL_ISR(mux)     portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux)      portEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR(...)         ((void)0)
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ * @file semphr.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - FreeRTOS semaphores, built on queues with zero sized items like the real kernel
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_FREERTOS_SEMPHR_H
+#define SIM_FREERTOS_SEMPHR_H
+
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+/**
+ * @brief Mutex has no priority inheritance, host scheduler does not honour priorities anyway
+ */
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+
+#define xSemaphoreTake(sem, ticks)          xQueueReceive((sem), NULL, (ticks))
+#define xSemaphoreGive(sem)                 xQueueSend((sem), NULL, 0)
+#define xSemaphoreGiveFromISR(sem, woken)   xQueueSendFromISR((sem), NULL, (woken))
+#define uxSemaphoreGetCount(sem)            uxQueueMessagesWaiting(sem)
+#define vSemaphoreDelete(sem)               vQueueDelete(sem)
+
+#endif
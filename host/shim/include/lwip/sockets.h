@@ -0,0 +1,25 @@
+/**
+ * @file sockets.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - lwIP socket API is the BSD socket API
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_LWIP_SOCKETS_H
+#define SIM_LWIP_SOCKETS_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#endif
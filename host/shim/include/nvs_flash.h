@@ -0,0 +1,19 @@
+/**
+ * @file nvs_flash.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - NVS is not used by the applications, init always succeeds
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef SIM_NVS_FLASH_H
+#define SIM_NVS_FLASH_H
+
+#include "esp_err.h"
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+
+#endif
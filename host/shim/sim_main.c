@@ -0,0 +1,39 @@
+/**
+ * @file sim_main.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - process entry running app_main like the ESP-IDF main task
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+
+extern void app_main(void);
+
+/**
+ * @brief Main task, ends once app_main returns like it does on the device
+ */
+static void *main_task(void *arg) {
+    (void)arg;
+    pthread_setname_np(pthread_self(), "main");
+    app_main();
+    return NULL;
+}
+
+int main(void) {
+    signal(SIGPIPE, SIG_IGN);               // Peer closing socket is reported by send, like lwIP does
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, main_task, NULL) != 0) {
+        perror("main task");
+        return 1;
+    }
+    while (1) {                             // Other tasks keep running after app_main returns
+        pause();
+    }
+}
@@ -0,0 +1,23 @@
+/**
+ * @file sim_port.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host simulation - mapping of device ports onto unprivileged host ports
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef SIM_PORT_H
+#define SIM_PORT_H
+
+#include <stdint.h>
+
+#define SIM_DEFAULT_PORT_OFFSET     8000
+
+/**
+ * @brief Ports below 1024 are moved up by SIM_PORT_OFFSET (80 -> 8080), others stay
+ */
+uint16_t sim_port_map(uint16_t port);
+
+#endif
@@ -0,0 +1,32 @@
+/**
+ * @file test.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host tests - checks of the dependency-free firmware modules, run by ctest
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * Every test is a plain executable. Failed CHECK prints where it failed and the test goes on,
+ * TEST_RESULT makes the exit code 1 when any check failed.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+static int test_checks = 0;
+static int test_failures = 0;
+
+#define CHECK(cond) do {                                                        \
+        test_checks++;                                                          \
+        if (!(cond)) {                                                          \
+            test_failures++;                                                    \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        }                                                                       \
+    } while (0)
+
+#define TEST_RESULT() (printf("%d checks, %d failed\n", test_checks, test_failures), test_failures ? 1 : 0)
+
+#endif
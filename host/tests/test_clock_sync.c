@@ -0,0 +1,159 @@
+/**
+ * @file test_clock_sync.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - clock offset estimate with asymmetric delays, aged samples and drifting camera clock
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * Simulated camera clock is node clock + offset + drift, exchanges get separate delays each way and
+ * camera processing time, so the true offset at any moment is known.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdlib.h>
+#include "clock_sync.h"
+#include "test.h"
+
+#define OFFSET          -123456789LL        // Camera booted earlier
+#define PROCESSING      700                 // Camera time between request and reply (us)
+
+typedef struct {
+    int64_t offset;
+    int64_t drift_ppm;
+} camera_t;
+
+static int64_t camera_time(const camera_t *camera, int64_t node) {
+    return node + camera->offset + node * camera->drift_ppm / 1000000;
+}
+
+/**
+ * @brief Request sent at node time t1, forward and back delays in us
+ */
+static bool exchange(clock_sync_t *sync, const camera_t *camera, int64_t t1, int64_t forward, int64_t back) {
+    int64_t t2 = camera_time(camera, t1 + forward);
+    int64_t t3 = t2 + PROCESSING;
+    int64_t t4 = t1 + forward + PROCESSING + back;
+    return clock_sync_sample(sync, t1, t2, t3, t4);
+}
+
+/**
+ * @brief Estimate at now is within its error bound of the true offset
+ * Offset is halved with integer division, so 1 us of rounding is allowed on top.
+ */
+static bool within_bound(const clock_sync_t *sync, const camera_t *camera, int64_t now, int64_t *error) {
+    int64_t offset;
+    if (!clock_sync_offset(sync, now, &offset, error)) {
+        return false;
+    }
+    return llabs(offset - (camera_time(camera, now) - now)) <= *error + 1;
+}
+
+static void test_asymmetric(void) {
+    clock_sync_t sync;
+    camera_t camera = {OFFSET, 0};
+    int64_t offset;
+    int64_t error;
+    clock_sync_init(&sync);
+    CHECK(!clock_sync_offset(&sync, 0, &offset, &error));
+
+    // Symmetric delay gives the exact offset, error is still half of the round trip
+    CHECK(exchange(&sync, &camera, 1000000, 3000, 3000));
+    CHECK(clock_sync_offset(&sync, 1006700, &offset, &error));
+    CHECK(offset == OFFSET && error == 3000);
+
+    // All of the delay one way - the estimate is off by exactly the bound, in either direction
+    clock_sync_init(&sync);
+    CHECK(exchange(&sync, &camera, 1000000, 8000, 0));
+    CHECK(clock_sync_offset(&sync, 1008700, &offset, &error));
+    CHECK(offset == OFFSET + 4000 && error == 4000);
+    clock_sync_init(&sync);
+    CHECK(exchange(&sync, &camera, 1000000, 0, 8000));
+    CHECK(clock_sync_offset(&sync, 1008700, &offset, &error));
+    CHECK(offset == OFFSET - 4000 && error == 4000);
+
+    // Random split of random delays never leaves the bound
+    srand(7);
+    bool held = true;
+    for (int i = 0; i < 1000; i++) {
+        clock_sync_init(&sync);
+        exchange(&sync, &camera, 1000000 + i * 10000LL, rand() % 50000, rand() % 50000);
+        held &= within_bound(&sync, &camera, 1100000 + i * 10000LL, &error);
+    }
+    CHECK(held);
+
+    // Impossible timestamps are dropped - reply before request, camera processing longer than round trip
+    clock_sync_init(&sync);
+    CHECK(!clock_sync_sample(&sync, 1000, 5000, 6000, 900));
+    CHECK(!clock_sync_sample(&sync, 1000, 5000, 4000, 2000));
+    CHECK(!clock_sync_sample(&sync, 1000, 5000, 7000, 2000));
+    CHECK(sync.rejected == 3 && sync.count == 0);
+    CHECK(!clock_sync_offset(&sync, 2000, &offset, &error));
+}
+
+static void test_aged_samples(void) {
+    clock_sync_t sync;
+    camera_t camera = {OFFSET, 0};
+    int64_t offset;
+    int64_t error;
+
+    // Clean exchange, then one delayed in the air 50 s later
+    clock_sync_init(&sync);
+    CHECK(exchange(&sync, &camera, 0, 1000, 1000));
+    CHECK(exchange(&sync, &camera, 50000000, 9000, 1000));
+    int64_t delayed_at = 50000000 + 9000 + PROCESSING + 1000;
+
+    // Right after it the old clean one is still better - 1000 us + 50 s * 50 ppm = 3500 us
+    CHECK(clock_sync_offset(&sync, delayed_at, &offset, &error));
+    CHECK(offset == OFFSET && error == 1000 + (delayed_at - 2700) * CLOCK_SYNC_DRIFT_PPM / 1000000);
+
+    // Same delay 100 s after the clean one - by now the clocks could have drifted apart more than
+    // the delayed exchange is off
+    CHECK(exchange(&sync, &camera, 100000000, 9000, 1000));
+    CHECK(clock_sync_offset(&sync, 100000000 + 10700, &offset, &error));
+    CHECK(offset == OFFSET + 4000 && error == 5000);
+
+    // Only the newest CLOCK_SYNC_SAMPLES are kept - the clean one falls out of the window
+    clock_sync_init(&sync);
+    CHECK(exchange(&sync, &camera, 0, 500, 500));
+    for (int i = 1; i < CLOCK_SYNC_SAMPLES; i++) {
+        CHECK(exchange(&sync, &camera, i * 1000000LL, 6000, 2000));
+    }
+    CHECK(clock_sync_offset(&sync, CLOCK_SYNC_SAMPLES * 1000000LL, &offset, &error) && offset == OFFSET);
+    CHECK(exchange(&sync, &camera, CLOCK_SYNC_SAMPLES * 1000000LL, 6000, 2000));
+    CHECK(clock_sync_offset(&sync, CLOCK_SYNC_SAMPLES * 1000000LL + 9000, &offset, &error));
+    CHECK(offset == OFFSET + 2000 && error == 4000 && sync.count == CLOCK_SYNC_SAMPLES + 1);
+}
+
+static void test_drift(void) {
+    clock_sync_t sync;
+    int64_t error;
+    srand(11);
+
+    // Camera crystal 40 ppm slow and fast (within assumed worst), exchange every 10 s with jittery delays,
+    // estimate checked every second in between
+    for (int64_t drift = -40; drift <= 40; drift += 80) {
+        camera_t camera = {OFFSET, drift};
+        clock_sync_init(&sync);
+        bool held = true;
+        int64_t worst = 0;
+        for (int64_t s = 0; s < 600; s++) {
+            int64_t now = s * 1000000;
+            if (s % 10 == 0) {
+                int64_t jitter = rand() % 4 == 0 ? 40000 : 0;   // About every fourth one is delayed
+                exchange(&sync, &camera, now, 1000 + rand() % 2000 + jitter, 1000 + rand() % 2000);
+            }
+            held &= within_bound(&sync, &camera, now + 100000, &error);
+            worst = error > worst ? error : worst;
+        }
+        CHECK(held);
+        CHECK(worst < 10000);               // Delayed exchanges never become the estimate
+    }
+}
+
+int main(void) {
+    test_asymmetric();
+    test_aged_samples();
+    test_drift();
+    return TEST_RESULT();
+}
@@ -0,0 +1,107 @@
+/**
+ * @file test_event_feed.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - SSE event feed format, subscribers catching up, falling behind and oversized events
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include "event_feed.h"
+#include "test.h"
+
+/**
+ * @brief Read everything from seq on like an SSE subscriber does
+ * @return events read, -1 when subscriber fell behind
+ */
+static int drain(const event_feed_t *feed, uint32_t *seq) {
+    int count = 0;
+    bool expired;
+    const event_feed_msg_t *msg;
+    while ((msg = event_feed_get(feed, *seq, &expired)) != NULL) {
+        count++;
+        (*seq)++;
+    }
+    return expired ? -1 : count;
+}
+
+static void test_format(void) {
+    event_feed_t feed;
+    event_feed_init(&feed);
+    bool expired = true;
+    CHECK(event_feed_get(&feed, 1, &expired) == NULL && !expired);
+    CHECK(event_feed_get(&feed, 0, &expired) == NULL && !expired);
+
+    CHECK(event_feed_push(&feed, "motion", "{\"event\":1}") == 1);
+    const event_feed_msg_t *msg = event_feed_get(&feed, 1, &expired);
+    const char *text = "id: 1\nevent: motion\ndata: {\"event\":1}\n\n";
+    CHECK(msg != NULL && !expired && msg->seq == 1);
+    CHECK(msg != NULL && msg->len == strlen(text) && strcmp(msg->text, text) == 0);
+    CHECK(event_feed_get(&feed, 2, &expired) == NULL && !expired);
+}
+
+static void test_subscribers(void) {
+    event_feed_t feed;
+    event_feed_init(&feed);
+    char data[32];
+
+    // Subscriber keeping up reads every event once, in order
+    uint32_t fast = 1;
+    uint32_t slow = 1;
+    for (int i = 1; i <= 3 * EVENT_FEED_DEPTH; i++) {
+        snprintf(data, sizeof(data), "{\"event\":%d}", i);
+        CHECK(event_feed_push(&feed, "motion", data) == (uint32_t)i);
+        CHECK(drain(&feed, &fast) == 1);
+    }
+    CHECK(fast == 3 * EVENT_FEED_DEPTH + 1);
+
+    // Subscriber that never read is told it fell behind, newest DEPTH events are still there
+    CHECK(drain(&feed, &slow) == -1 && slow == 1);
+    slow = 2 * EVENT_FEED_DEPTH;
+    CHECK(drain(&feed, &slow) == -1);
+    slow = 2 * EVENT_FEED_DEPTH + 1;
+    CHECK(drain(&feed, &slow) == EVENT_FEED_DEPTH);
+
+    // Subscriber exactly DEPTH behind still gets everything
+    uint32_t edge = feed.next_seq;
+    for (int i = 0; i < EVENT_FEED_DEPTH; i++) {
+        event_feed_push(&feed, "status", "{}");
+    }
+    CHECK(drain(&feed, &edge) == EVENT_FEED_DEPTH);
+}
+
+static void test_oversized(void) {
+    event_feed_t feed;
+    event_feed_init(&feed);
+    char big[EVENT_FEED_MSG_SIZE];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+
+    for (int i = 0; i < EVENT_FEED_DEPTH; i++) {
+        event_feed_push(&feed, "motion", "{}");
+    }
+
+    // Too big is dropped without taking a sequence number, but the oldest event in its slot is gone
+    bool expired;
+    CHECK(event_feed_push(&feed, "motion", big) == 0);
+    CHECK(feed.next_seq == EVENT_FEED_DEPTH + 1);
+    CHECK(event_feed_get(&feed, 1, &expired) == NULL && expired);
+    CHECK(event_feed_get(&feed, 2, &expired) != NULL && !expired);
+
+    // Largest event that fits, terminator included
+    size_t overhead = strlen("id: 9\nevent: motion\ndata: \n\n");
+    big[EVENT_FEED_MSG_SIZE - 1 - overhead] = '\0';
+    CHECK(event_feed_push(&feed, "motion", big) == EVENT_FEED_DEPTH + 1);
+    const event_feed_msg_t *msg = event_feed_get(&feed, EVENT_FEED_DEPTH + 1, &expired);
+    CHECK(msg != NULL && msg->len == EVENT_FEED_MSG_SIZE - 1);
+}
+
+int main(void) {
+    test_format();
+    test_subscribers();
+    test_oversized();
+    return TEST_RESULT();
+}
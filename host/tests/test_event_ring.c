@@ -0,0 +1,77 @@
+/**
+ * @file test_event_ring.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - pending PIR event ring over camera outage and soft reset
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#include "event_ring.h"
+#include "test.h"
+
+/**
+ * @brief Store motion events like pir_sender_task does while camera is unreachable
+ * @return events stored
+ */
+static int store(event_ring_t *ring, int64_t start_ms, int64_t period_ms, int count, uint32_t *seq) {
+    for (int i = 0; i < count; i++) {
+        event_ring_push(ring, ++*seq, (start_ms + i * period_ms) * 1000);
+    }
+    return count;
+}
+
+static void test_outage_and_reboot(void) {
+    static event_ring_t ring;               // RTC_NOINIT on the node
+
+    // Power up - memory holds garbage
+    memset(&ring, 0xA5, sizeof(ring));
+    CHECK(!event_ring_restore(&ring, 1000));
+    CHECK(ring.count == 0 && ring.boot == 0 && ring.seq == 1000);
+
+    // Camera unreachable the whole boot - newest EVENT_RING_MAX events are kept
+    uint32_t seq = ring.seq;
+    CHECK(store(&ring, 1000, 1500, 20, &seq) == 20);
+    CHECK(ring.count == EVENT_RING_MAX && ring.stored == 20 && ring.overwritten == 20 - EVENT_RING_MAX);
+    event_ring_entry_t pending[EVENT_RING_MAX];
+    CHECK(event_ring_peek(&ring, pending, EVENT_RING_MAX) == EVENT_RING_MAX);
+    CHECK(pending[0].seq == 1005 && pending[0].timestamp == (1000 + 4 * 1500) * 1000LL);
+    CHECK(pending[EVENT_RING_MAX - 1].seq == 1020);
+
+    // Soft reset keeps ring, counters and sequence, events of the old boot lose their time base
+    CHECK(event_ring_restore(&ring, 5));
+    CHECK(ring.boot == 1 && ring.seq == 1020 && ring.count == EVENT_RING_MAX);
+    seq = ring.seq;
+    CHECK(store(&ring, 3000, 6000, 3, &seq) == 3);
+    CHECK(ring.overwritten == 20 + 3 - EVENT_RING_MAX);
+    CHECK(event_ring_peek(&ring, pending, EVENT_RING_MAX) == EVENT_RING_MAX);
+    CHECK(pending[0].seq == 1008 && pending[0].boot == 0);
+    CHECK(pending[EVENT_RING_MAX - 3].seq == 1021 && pending[EVENT_RING_MAX - 3].boot == 1);
+    CHECK(pending[EVENT_RING_MAX - 1].timestamp == 15000 * 1000LL);
+
+    // Link back - pending events go out as batches, oldest first
+    CHECK(event_ring_peek(&ring, pending, 10) == 10);
+    event_ring_drop(&ring, 10, true);
+    CHECK(ring.stale == 10 && ring.delivered == 10 && ring.replayed == 10);
+    size_t left = event_ring_peek(&ring, pending, EVENT_RING_MAX);
+    CHECK(left == EVENT_RING_MAX - 10 && pending[0].seq == 1018);
+    event_ring_drop(&ring, left, true);
+    CHECK(ring.stale == EVENT_RING_MAX - 3 && ring.delivered == EVENT_RING_MAX && ring.count == 0);
+
+    // Live event acked right away is neither stale nor replayed, drop past the end is clamped
+    event_ring_push(&ring, ++seq, 16000 * 1000LL);
+    event_ring_drop(&ring, 5, false);
+    CHECK(ring.delivered == EVENT_RING_MAX + 1 && ring.replayed == EVENT_RING_MAX);
+    CHECK(ring.stale == EVENT_RING_MAX - 3 && ring.count == 0);
+
+    // Second soft reset - counters still there, empty ring stays empty
+    CHECK(event_ring_restore(&ring, 5));
+    CHECK(ring.boot == 2 && ring.stored == 24 && ring.seq == 1024 && ring.count == 0);
+}
+
+int main(void) {
+    test_outage_and_reboot();
+    return TEST_RESULT();
+}
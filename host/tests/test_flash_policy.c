@@ -0,0 +1,170 @@
+/**
+ * @file test_flash_policy.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - flash policy dark / light thresholds with hysteresis and flash settle measurement
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include "flash_policy.h"
+#include "test.h"
+
+#define DARK_LEVEL      5000                // Same as security-cam
+#define LIGHT_LEVEL     2500
+#define STABLE_PERMILLE 200
+#define SETTLE_DEFAULT  250000
+#define SETTLE_MIN      50000
+#define SETTLE_MAX      1000000
+#define FRAME_US        40000               // 25 fps
+
+static void init(flash_policy_t *policy) {
+    flash_policy_init(policy, DARK_LEVEL, LIGHT_LEVEL, STABLE_PERMILLE, SETTLE_DEFAULT, SETTLE_MIN, SETTLE_MAX);
+}
+
+/**
+ * @brief Feed frames of one exposure index
+ * @return timestamp after the last frame
+ */
+static int64_t frames(flash_policy_t *policy, uint32_t level, int count, int64_t at) {
+    for (int i = 0; i < count; i++, at += FRAME_US) {
+        flash_policy_frame(policy, level, at);
+    }
+    return at;
+}
+
+/**
+ * @brief Flash on at at, then frames with given exposure indexes
+ * @return timestamp after the last frame
+ */
+static int64_t flash(flash_policy_t *policy, const uint32_t *levels, int count, int64_t at) {
+    flash_policy_flash_on(policy, at);
+    for (int i = 0; i < count; i++) {
+        at += FRAME_US;
+        flash_policy_frame(policy, levels[i], at);
+    }
+    return at;
+}
+
+static void test_level(void) {
+    CHECK(flash_policy_level(1200, 16) == 1200);
+    CHECK(flash_policy_level(1200, 64) == 4800);
+    CHECK(flash_policy_level(0, 16) == 1);              // 0 means no level yet
+    CHECK(flash_policy_level(UINT32_MAX, 255) == UINT32_MAX);
+}
+
+static void test_thresholds(void) {
+    flash_policy_t policy;
+    init(&policy);
+
+    // Nothing seen yet - flash is used
+    CHECK(flash_policy_decide(&policy));
+
+    // First frame sets the level, bright scene skips flash
+    int64_t at = frames(&policy, 1000, 1, 1000000);
+    CHECK(policy.level == 1000 && !flash_policy_decide(&policy));
+
+    // Getting dark - average moves a quarter per frame, crosses dark_level only after a few frames
+    at = frames(&policy, 8000, 2, at);
+    CHECK(policy.level < DARK_LEVEL && !policy.dark);
+    at = frames(&policy, 8000, 20, at);
+    CHECK(policy.level > DARK_LEVEL && policy.dark && flash_policy_decide(&policy));
+
+    // Between the levels it stays dark, below light_level it is light again
+    at = frames(&policy, 3000, 40, at);
+    CHECK(policy.level > LIGHT_LEVEL && policy.level < DARK_LEVEL && policy.dark);
+    at = frames(&policy, 2000, 40, at);
+    CHECK(policy.level < LIGHT_LEVEL && !policy.dark && !flash_policy_decide(&policy));
+
+    // ...and between the levels from below it stays light, exactly at dark_level too
+    at = frames(&policy, 4000, 40, at);
+    CHECK(!policy.dark);
+    policy.level = DARK_LEVEL;
+    frames(&policy, DARK_LEVEL, 1, at);
+    CHECK(!policy.dark);
+    CHECK(policy.used == 2 && policy.skipped == 2);
+
+    // Light level above dark level is clamped, no hysteresis then
+    flash_policy_init(&policy, DARK_LEVEL, DARK_LEVEL * 2, STABLE_PERMILLE, SETTLE_DEFAULT, SETTLE_MIN, SETTLE_MAX);
+    CHECK(policy.light_level == DARK_LEVEL);
+}
+
+static void test_flash_off_ignored(void) {
+    flash_policy_t policy;
+    init(&policy);
+    int64_t at = frames(&policy, 8000, 1, 1000000);
+    CHECK(policy.dark);
+
+    // AEC still adapted to the flash - frames within settle_max after it went off do not count
+    const uint32_t lit[] = {8000, 500, 500};
+    at = flash(&policy, lit, 3, at);
+    flash_policy_flash_off(&policy, at);
+    frames(&policy, 500, SETTLE_MAX / FRAME_US, at);
+    CHECK(policy.level == 8000 && policy.dark);
+    frames(&policy, 500, 1, at + SETTLE_MAX);
+    CHECK(policy.level < 8000);
+}
+
+static void test_settle(void) {
+    flash_policy_t policy;
+    init(&policy);
+    int64_t at = frames(&policy, 8000, 1, 1000000);
+    CHECK(flash_policy_settle(&policy) == SETTLE_DEFAULT);
+
+    // First frame is before settle_min, index drops until it changes by at most 20 %
+    const uint32_t lit[] = {8000, 3000, 1500, 1400};
+    int64_t on = at;
+    at = flash(&policy, lit, 4, on);
+    CHECK(policy.settle_count == 1 && !policy.measuring);
+    CHECK(flash_policy_settle(&policy) == 3 * FRAME_US);
+    flash_policy_flash_off(&policy, at);
+
+    // Flash changing nothing settles at the first counted frame, which is settle_min at the earliest
+    at += SETTLE_MAX;
+    const uint32_t unlit[] = {8000, 8000};
+    at = flash(&policy, unlit, 2, at);
+    CHECK(policy.settle_count == 2 && policy.settles[1] == 2 * FRAME_US);
+    CHECK(flash_policy_settle(&policy) == 2 * FRAME_US);
+    flash_policy_flash_off(&policy, at);
+    init(&policy);
+    policy.level = 8000;
+    policy.dark = true;
+    flash_policy_flash_on(&policy, 1000000);
+    flash_policy_frame(&policy, 8000, 1000000 + SETTLE_MIN);
+    CHECK(policy.settle_count == 1 && flash_policy_settle(&policy) == SETTLE_MIN);
+    flash_policy_flash_off(&policy, 2000000);
+
+    // Never settling is a timeout at settle_max
+    at = 4000000;
+    flash_policy_flash_on(&policy, at);
+    for (uint32_t level = 8000; policy.measuring; level = level == 8000 ? 2000 : 8000) {
+        at += FRAME_US;
+        flash_policy_frame(&policy, level, at);
+    }
+    CHECK(policy.timeouts == 1 && policy.settles[1] == SETTLE_MAX && at - 4000000 == SETTLE_MAX);
+    flash_policy_flash_off(&policy, at);
+
+    // Off before settling drops the measurement, only the newest samples count for the wait
+    flash_policy_flash_on(&policy, 8000000);
+    flash_policy_frame(&policy, 2000, 8000000 + 2 * FRAME_US);
+    flash_policy_flash_off(&policy, 8000000 + 3 * FRAME_US);
+    CHECK(policy.settle_count == 2);
+    at = 10000000;
+    for (int i = 0; i < FLASH_POLICY_SETTLE_SAMPLES; i++) {
+        const uint32_t slow[] = {8000, 6000, 4000, 2500, 2000, 1900};
+        at = flash(&policy, slow, 6, at);
+        flash_policy_flash_off(&policy, at);
+        at += SETTLE_MAX;
+    }
+    CHECK(policy.settle_count == 2 + FLASH_POLICY_SETTLE_SAMPLES);
+    CHECK(flash_policy_settle(&policy) == 4 * FRAME_US);
+}
+
+int main(void) {
+    test_level();
+    test_thresholds();
+    test_flash_off_ignored();
+    test_settle();
+    return TEST_RESULT();
+}
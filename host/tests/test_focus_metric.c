@@ -0,0 +1,146 @@
+/**
+ * @file test_focus_metric.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - focus metric on known patterns, blur ordering and decoder-sized blocks
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#include "focus_metric.h"
+#include "test.h"
+
+#define SIZE            64
+#define BLOCK           16                  // MCU-sized blocks like the JPEG decoder hands out
+
+static uint8_t image[SIZE * SIZE * 3];
+static uint8_t blurred[SIZE * SIZE * 3];
+static uint8_t block[BLOCK * BLOCK * 3];
+
+static void set_gray(uint8_t *rgb, size_t width, size_t x, size_t y, uint8_t value) {
+    memset(rgb + (y * width + x) * 3, value, 3);
+}
+
+/**
+ * @brief Checkerboard of squares of side cell, 30 / 220 gray
+ */
+static void checkerboard(size_t cell) {
+    for (size_t y = 0; y < SIZE; y++) {
+        for (size_t x = 0; x < SIZE; x++) {
+            set_gray(image, SIZE, x, y, (x / cell + y / cell) % 2 ? 220 : 30);
+        }
+    }
+}
+
+/**
+ * @brief Horizontal box blur of given radius, edges clamped
+ */
+static void blur(size_t radius) {
+    for (size_t y = 0; y < SIZE; y++) {
+        for (size_t x = 0; x < SIZE; x++) {
+            unsigned sum = 0;
+            for (int dx = -(int)radius; dx <= (int)radius; dx++) {
+                int sx = (int)x + dx;
+                sx = sx < 0 ? 0 : sx >= SIZE ? SIZE - 1 : sx;
+                sum += image[(y * SIZE + (size_t)sx) * 3];
+            }
+            set_gray(blurred, SIZE, x, y, (uint8_t)(sum / (2 * radius + 1)));
+        }
+    }
+}
+
+/**
+ * @brief Score of image fed in BLOCK x BLOCK pieces, as the decoder callback does
+ */
+static uint32_t score_blocks(const uint8_t *rgb) {
+    focus_metric_t focus;
+    focus_metric_init(&focus);
+    for (size_t by = 0; by < SIZE; by += BLOCK) {
+        for (size_t bx = 0; bx < SIZE; bx += BLOCK) {
+            for (size_t y = 0; y < BLOCK; y++) {
+                memcpy(block + y * BLOCK * 3, rgb + ((by + y) * SIZE + bx) * 3, BLOCK * 3);
+            }
+            focus_metric_add_rgb888(&focus, block, BLOCK, BLOCK);
+        }
+    }
+    return focus_metric_score(&focus);
+}
+
+static void test_known_patterns(void) {
+    focus_metric_t focus;
+    focus_metric_init(&focus);
+    CHECK(focus_metric_score(&focus) == 0);
+
+    // Single pixel has no gradient, flat image has zero energy
+    uint8_t pixel[3] = {255, 255, 255};
+    focus_metric_add_rgb888(&focus, pixel, 1, 1);
+    CHECK(focus.samples == 0 && focus_metric_score(&focus) == 0);
+    memset(image, 128, sizeof(image));
+    focus_metric_add_rgb888(&focus, image, SIZE, SIZE);
+    CHECK(focus.samples == 2 * SIZE * (SIZE - 1) && focus_metric_score(&focus) == 0);
+
+    // Vertical stripes 0 / 255 - every horizontal difference is 255, no vertical one
+    focus_metric_init(&focus);
+    for (size_t y = 0; y < 4; y++) {
+        for (size_t x = 0; x < 5; x++) {
+            set_gray(image, 5, x, y, x % 2 ? 255 : 0);
+        }
+    }
+    focus_metric_add_rgb888(&focus, image, 5, 4);
+    CHECK(focus.energy == 4 * 4 * 255 * 255 && focus.samples == 4 * 4 + 3 * 5);
+    CHECK(focus_metric_score(&focus) == 4 * 4 * 255 * 255 / 31);
+
+    // Luma weights - green counts most, blue least
+    uint8_t pair[6] = {0, 0, 0, 0, 255, 0};
+    focus_metric_init(&focus);
+    focus_metric_add_rgb888(&focus, pair, 2, 1);
+    CHECK(focus_metric_score(&focus) == 149 * 149);
+    pair[4] = 0;
+    pair[5] = 255;
+    focus_metric_init(&focus);
+    focus_metric_add_rgb888(&focus, pair, 2, 1);
+    CHECK(focus_metric_score(&focus) == 28 * 28);
+
+    // Blocks accumulate - score is the mean over all of them, not the mean of block scores
+    focus_metric_init(&focus);
+    focus_metric_add_rgb888(&focus, pair, 2, 1);
+    memset(image, 0, 3 * 10);
+    focus_metric_add_rgb888(&focus, image, 10, 1);
+    CHECK(focus.samples == 10 && focus_metric_score(&focus) == 28 * 28 / 10);
+}
+
+static void test_blur(void) {
+    // Sharper is higher - each wider blur of the same scene scores lower
+    checkerboard(6);
+    uint32_t previous = score_blocks(image);
+    CHECK(previous > 0);
+    for (size_t radius = 1; radius <= 4; radius++) {
+        blur(radius);
+        uint32_t score = score_blocks(blurred);
+        CHECK(score < previous);
+        previous = score;
+    }
+
+    // Half the contrast is a quarter of the score, the brightness offset does not matter
+    checkerboard(6);
+    uint32_t sharp = score_blocks(image);
+    for (size_t i = 0; i < sizeof(image); i++) {
+        image[i] = (uint8_t)(image[i] / 2 + 20);
+    }
+    uint32_t low_contrast = score_blocks(image);
+    CHECK(low_contrast > sharp / 5 && low_contrast < sharp / 3);
+
+    // Edges on block borders are left out - cells of block size show up only inside blocks
+    checkerboard(BLOCK);
+    CHECK(score_blocks(image) == 0);
+    checkerboard(BLOCK / 2);
+    CHECK(score_blocks(image) > 0);
+}
+
+int main(void) {
+    test_known_patterns();
+    test_blur();
+    return TEST_RESULT();
+}
@@ -0,0 +1,225 @@
+/**
+ * @file test_frame_ring.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - pre-roll frame ring ordering, eviction, trigger freeze, frame references and heap use of burst
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#include "frame_ring.h"
+#include "test.h"
+
+#define DEPTH       4
+#define SLOT_SIZE   16
+#define CAMERA_FB   2           // Frame buffers of fake camera, fb_count of camera_config
+
+static uint8_t pool[DEPTH * SLOT_SIZE];
+
+// Heap calls of the test and the ring go through these, test is linked with --wrap (CMakeLists.txt)
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+static unsigned allocations = 0;
+
+void *__wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+/**
+ * @brief Fake camera driver - frames come from preallocated buffers like esp_camera_fb_get gives them
+ */
+typedef struct {
+    uint8_t buf[SLOT_SIZE];
+    size_t len;
+    int64_t timestamp;
+} fake_fb_t;
+
+static fake_fb_t camera_fb[CAMERA_FB];
+static uint8_t camera_frame = 0;
+
+static fake_fb_t *fake_fb_get(void) {
+    camera_frame++;
+    fake_fb_t *fb = &camera_fb[camera_frame % CAMERA_FB];
+    memset(fb->buf, camera_frame, sizeof(fb->buf));
+    fb->len = 1 + camera_frame % SLOT_SIZE;
+    fb->timestamp = camera_frame * 1000LL;
+    return fb;
+}
+
+/**
+ * @brief Push frame whose bytes all equal its number, timestamp is number * 1000
+ */
+static bool push(frame_ring_t *ring, uint8_t number) {
+    uint8_t frame[SLOT_SIZE];
+    memset(frame, number, sizeof(frame));
+    return frame_ring_push(ring, frame, 1 + number % SLOT_SIZE, 320, 240, number * 1000LL);
+}
+
+static bool holds(const frame_ring_slot_t *slot, uint8_t number) {
+    return slot != NULL && slot->timestamp == number * 1000LL && slot->len == 1u + number % SLOT_SIZE &&
+           slot->buf[0] == number && slot->buf[slot->len - 1] == number;
+}
+
+static void test_order_and_eviction(void) {
+    frame_ring_t ring;
+    CHECK(!frame_ring_init(&ring, pool, 1, SLOT_SIZE));
+    CHECK(!frame_ring_init(&ring, pool, FRAME_RING_MAX_DEPTH + 1, SLOT_SIZE));
+    CHECK(frame_ring_init(&ring, pool, DEPTH, SLOT_SIZE));
+    CHECK(frame_ring_get(&ring, 0) == NULL);
+    CHECK(frame_ring_closest(&ring, 0) == NULL);
+
+    for (uint8_t i = 1; i <= 2; i++) {
+        CHECK(push(&ring, i));
+    }
+    CHECK(ring.count == 2);
+    CHECK(holds(frame_ring_get(&ring, 0), 1));
+    CHECK(holds(frame_ring_get(&ring, 1), 2));
+    CHECK(frame_ring_get(&ring, 2) == NULL);
+
+    // Wrapped ring keeps the newest DEPTH frames, oldest first
+    for (uint8_t i = 3; i <= 9; i++) {
+        CHECK(push(&ring, i));
+    }
+    CHECK(ring.count == DEPTH);
+    for (size_t i = 0; i < DEPTH; i++) {
+        CHECK(holds(frame_ring_get(&ring, i), 6 + i));
+        if (i > 0) {
+            CHECK(frame_ring_get(&ring, i)->seq == frame_ring_get(&ring, i - 1)->seq + 1);
+        }
+    }
+    CHECK(frame_ring_get(&ring, DEPTH) == NULL);
+    CHECK(holds(frame_ring_closest(&ring, 7400), 7));
+    CHECK(holds(frame_ring_closest(&ring, 100000), 9));
+
+    uint8_t big[SLOT_SIZE + 1] = {0};
+    CHECK(!frame_ring_push(&ring, big, sizeof(big), 320, 240, 10000));
+    CHECK(ring.dropped_oversize == 1);
+    CHECK(holds(frame_ring_get(&ring, DEPTH - 1), 9));
+}
+
+static void test_trigger_freeze(void) {
+    frame_ring_t ring;
+    frame_ring_init(&ring, pool, DEPTH, SLOT_SIZE);
+    for (uint8_t i = 1; i <= 3; i++) {
+        push(&ring, i);
+    }
+    CHECK(!frame_ring_trigger(&ring, 3500, DEPTH));        // Leaves no pre-trigger frame
+    CHECK(frame_ring_trigger(&ring, 3500, 2));
+    CHECK(!frame_ring_trigger(&ring, 3600, 2));            // Already triggered
+    CHECK(ring.trigger_seq == frame_ring_get(&ring, 2)->seq + 1);
+    CHECK(push(&ring, 4));
+    CHECK(!ring.frozen);
+    CHECK(push(&ring, 5));
+    CHECK(ring.frozen);
+    CHECK(!push(&ring, 6));
+    // Frozen sequence: two frames before the trigger, two burst frames
+    CHECK(holds(frame_ring_get(&ring, 0), 2));
+    CHECK(holds(frame_ring_get(&ring, 3), 5));
+    CHECK(frame_ring_get(&ring, 2)->seq == ring.trigger_seq);
+
+    frame_ring_release(&ring);
+    CHECK(!ring.triggered && !ring.frozen && ring.count == 0);
+    CHECK(push(&ring, 7));
+    CHECK(holds(frame_ring_get(&ring, 0), 7));
+
+    // Trigger without burst frames freezes right away
+    CHECK(frame_ring_trigger(&ring, 7500, 0));
+    CHECK(ring.frozen);
+}
+
+static void test_references(void) {
+    frame_ring_t ring;
+    frame_ring_init(&ring, pool, DEPTH, SLOT_SIZE);
+    for (uint8_t i = 1; i <= DEPTH; i++) {
+        push(&ring, i);
+    }
+    CHECK(frame_ring_ref(&ring, DEPTH) == NULL);
+    const frame_ring_slot_t *oldest = frame_ring_ref(&ring, 0);
+    const frame_ring_slot_t *newest = frame_ring_ref(&ring, DEPTH - 1);
+    CHECK(holds(oldest, 1) && holds(newest, DEPTH));
+
+    // Referenced oldest frame is not overwritten, the new frame is dropped instead
+    CHECK(!push(&ring, 20));
+    CHECK(ring.dropped_busy == 1);
+    CHECK(holds(oldest, 1));
+    frame_ring_unref(&ring, oldest);
+    CHECK(push(&ring, 21));
+    CHECK(holds(frame_ring_get(&ring, DEPTH - 1), 21));
+
+    // Reference outlives release of the frozen sequence, new frames go around it
+    frame_ring_release(&ring);
+    CHECK(push(&ring, 22));                                 // Slot 0, was the oldest frame
+    for (uint8_t i = 23; ring.dropped_busy == 1 && i < 40; i++) {
+        push(&ring, i);
+    }
+    CHECK(ring.dropped_busy == 2);
+    CHECK(holds(newest, DEPTH));
+    frame_ring_unref(&ring, newest);
+    CHECK(ring.slots[0].refs == 0 && ring.slots[DEPTH - 1].refs == 0);
+    CHECK(push(&ring, 41));
+}
+
+static void test_burst_allocations(void) {
+    frame_ring_t ring;
+    frame_ring_init(&ring, pool, DEPTH, SLOT_SIZE);
+    uint8_t *frozen[2][DEPTH];
+    for (int trigger = 0; trigger < 2; trigger++) {
+        for (int i = 0; i < DEPTH; i++) {
+            fake_fb_t *fb = fake_fb_get();
+            frame_ring_push(&ring, fb->buf, fb->len, 320, 240, fb->timestamp);
+        }
+        // Same steps as camera task does for every burst frame
+        unsigned before = allocations;
+        CHECK(frame_ring_trigger(&ring, camera_frame * 1000LL + 500, 2));
+        unsigned burst = 0;
+        while (!ring.frozen && burst < 2 * DEPTH) {
+            fake_fb_t *fb = fake_fb_get();
+            burst += frame_ring_push(&ring, fb->buf, fb->len, 320, 240, fb->timestamp);
+            CHECK(allocations == before);
+        }
+        CHECK(ring.frozen && burst == 2);
+        const frame_ring_slot_t *refs[DEPTH];
+        for (size_t i = 0; i < ring.count; i++) {
+            refs[i] = frame_ring_ref(&ring, i);
+            frozen[trigger][i] = refs[i]->buf;
+            CHECK(refs[i]->buf[0] == (uint8_t)(camera_frame - DEPTH + 1 + i));
+        }
+        for (size_t i = 0; i < ring.count; i++) {
+            frame_ring_unref(&ring, refs[i]);
+        }
+        frame_ring_release(&ring);
+        CHECK(allocations == before);
+    }
+
+    // Both sequences sit in the slots of the pool, nothing was moved elsewhere
+    for (int i = 0; i < DEPTH; i++) {
+        bool reused = false;
+        for (int j = 0; j < DEPTH; j++) {
+            reused |= frozen[1][i] == frozen[0][j];
+        }
+        CHECK(reused);
+        CHECK(frozen[0][i] >= pool && frozen[0][i] < pool + sizeof(pool) && (frozen[0][i] - pool) % SLOT_SIZE == 0);
+    }
+}
+
+int main(void) {
+    test_order_and_eviction();
+    test_trigger_freeze();
+    test_references();
+    test_burst_allocations();
+    return TEST_RESULT();
+}
@@ -0,0 +1,108 @@
+/**
+ * @file test_image_scale.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - RGB888 halving against plain reference, odd sizes, rounding and in-place use
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image_scale.h"
+#include "test.h"
+
+#define MAX_WIDTH       64
+#define MAX_HEIGHT      48
+
+static uint8_t src[MAX_WIDTH * MAX_HEIGHT * 3];
+static uint8_t dst[MAX_WIDTH * MAX_HEIGHT * 3];
+static uint8_t expected[MAX_WIDTH * MAX_HEIGHT * 3];
+
+static uint8_t pixel(const uint8_t *image, size_t width, size_t x, size_t y, size_t c) {
+    return image[(y * width + x) * 3 + c];
+}
+
+/**
+ * @brief Box average rounded half up, written without the pointer walking of the module
+ */
+static size_t reference(const uint8_t *image, size_t width, size_t height, uint8_t *out) {
+    size_t n = 0;
+    for (size_t y = 0; y + 1 < height; y += 2) {
+        for (size_t x = 0; x + 1 < width; x += 2) {
+            for (size_t c = 0; c < 3; c++) {
+                unsigned sum = pixel(image, width, x, y, c) + pixel(image, width, x + 1, y, c) +
+                               pixel(image, width, x, y + 1, c) + pixel(image, width, x + 1, y + 1, c);
+                out[n++] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+    return n;
+}
+
+static void fill_random(size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        src[i] = (uint8_t)rand();
+    }
+}
+
+static void test_against_reference(void) {
+    const size_t sizes[][2] = {{2, 2}, {4, 2}, {3, 3}, {5, 7}, {1, 9}, {MAX_WIDTH, MAX_HEIGHT}, {63, 47}};
+    srand(1);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t width = sizes[i][0];
+        size_t height = sizes[i][1];
+        fill_random(width * height * 3);
+        size_t expected_len = reference(src, width, height, expected);
+        CHECK(expected_len == (width / 2) * (height / 2) * 3);
+        memset(dst, 0xEE, sizeof(dst));
+        CHECK(image_scale_halve_rgb888(src, width, height, dst) == expected_len);
+        CHECK(memcmp(dst, expected, expected_len) == 0);
+        CHECK(dst[expected_len] == 0xEE);          // Nothing written past the result
+
+        // In place gives the same result over the start of the image
+        CHECK(image_scale_halve_rgb888(src, width, height, src) == expected_len);
+        CHECK(memcmp(src, expected, expected_len) == 0);
+    }
+}
+
+static void test_rounding_and_range(void) {
+    // One box per channel: 0 0 0 1 rounds down, 1 1 1 0 rounds up, 255 does not overflow
+    const uint8_t box[4][3] = {{0, 1, 255}, {0, 1, 255}, {0, 1, 255}, {1, 0, 255}};
+    memcpy(src, box[0], 3);
+    memcpy(src + 3, box[1], 3);
+    memcpy(src + 6, box[2], 3);
+    memcpy(src + 9, box[3], 3);
+    CHECK(image_scale_halve_rgb888(src, 2, 2, dst) == 3);
+    CHECK(dst[0] == 0 && dst[1] == 1 && dst[2] == 255);
+
+    // Thumbnail is several halvings in place - flat colour stays exact, empty when too small
+    for (size_t i = 0; i < MAX_WIDTH * MAX_HEIGHT; i++) {
+        src[i * 3] = 200;
+        src[i * 3 + 1] = 17;
+        src[i * 3 + 2] = 3;
+    }
+    size_t width = MAX_WIDTH;
+    size_t height = MAX_HEIGHT;
+    for (int step = 0; step < 4; step++) {
+        image_scale_halve_rgb888(src, width, height, src);
+        width /= 2;
+        height /= 2;
+    }
+    CHECK(width == 4 && height == 3);
+    bool flat = true;
+    for (size_t i = 0; i < width * height; i++) {
+        flat &= src[i * 3] == 200 && src[i * 3 + 1] == 17 && src[i * 3 + 2] == 3;
+    }
+    CHECK(flat);
+    CHECK(image_scale_halve_rgb888(src, 1, 1, dst) == 0);
+    CHECK(image_scale_halve_rgb888(src, 0, 0, dst) == 0);
+}
+
+int main(void) {
+    test_against_reference();
+    test_rounding_and_range();
+    return TEST_RESULT();
+}
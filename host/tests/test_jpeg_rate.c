@@ -0,0 +1,195 @@
+/**
+ * @file test_jpeg_rate.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - JPEG rate control fed by synthetic sensor, convergence to budget and scene steps
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * Synthetic sensor makes frames of complexity * pixels / (quality + 6) bytes with up to 8 % noise,
+ * new settings reach it only after the settle frames already in flight, as on OV2640.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdlib.h>
+#include "jpeg_rate.h"
+#include "test.h"
+
+#define BUDGET          (96 * 1024)         // Same as security-cam
+#define QUALITY_BEST    8
+#define QUALITY_WORST   40
+#define SETTLE          2
+#define NOISE_MILLI     80
+#define CALM            1600000             // Scene making ~ budget at quality 10-11, full size
+
+static const uint32_t pixels[] = {800 * 600, 1024 * 768, 1280 * 1024, 1600 * 1200};   // SVGA-UXGA
+
+typedef struct {
+    jpeg_rate_t rate;
+    int pipeline_quality[SETTLE];           // Settings of frames already in flight
+    int pipeline_size[SETTLE];
+    uint32_t seed;
+    uint32_t complexity;
+    uint32_t frames;
+    uint64_t bytes;                         // Sum of frame lengths since sensor_reset_stats
+    uint32_t max_frame;
+} sensor_t;
+
+static void sensor_init(sensor_t *sensor, int quality, int size, int size_min, int size_max, uint32_t complexity) {
+    jpeg_rate_init(&sensor->rate, BUDGET, quality, QUALITY_BEST, QUALITY_WORST, size, size_min, size_max, SETTLE);
+    for (int i = 0; i < SETTLE; i++) {
+        sensor->pipeline_quality[i] = sensor->rate.quality;
+        sensor->pipeline_size[i] = sensor->rate.size;
+    }
+    sensor->seed = 12345;
+    sensor->complexity = complexity;
+}
+
+static void sensor_reset_stats(sensor_t *sensor) {
+    sensor->frames = 0;
+    sensor->bytes = 0;
+    sensor->max_frame = 0;
+}
+
+/**
+ * @brief Capture one frame with the oldest settings in flight and feed it to rate control
+ * @return true when rate control changed settings
+ */
+static bool sensor_frame(sensor_t *sensor) {
+    int quality = sensor->pipeline_quality[0];
+    int size = sensor->pipeline_size[0];
+    sensor->seed = sensor->seed * 1103515245u + 12345u;
+    int noise = (int)((sensor->seed >> 16) % (2 * NOISE_MILLI + 1)) - NOISE_MILLI;
+    uint64_t len = (uint64_t)sensor->complexity * pixels[size] / pixels[3] / (uint32_t)(quality + 6);
+    len = len * (uint64_t)(1000 + noise) / 1000;
+
+    sensor->frames++;
+    sensor->bytes += len;
+    if (len > sensor->max_frame) {
+        sensor->max_frame = (uint32_t)len;
+    }
+    bool changed = jpeg_rate_update(&sensor->rate, len);
+    for (int i = 0; i + 1 < SETTLE; i++) {
+        sensor->pipeline_quality[i] = sensor->pipeline_quality[i + 1];
+        sensor->pipeline_size[i] = sensor->pipeline_size[i + 1];
+    }
+    sensor->pipeline_quality[SETTLE - 1] = sensor->rate.quality;
+    sensor->pipeline_size[SETTLE - 1] = sensor->rate.size;
+    return changed;
+}
+
+/**
+ * @brief Run frames, counting changes and direction reversals of quality
+ * @return frame (from 1) of the last change, 0 when nothing changed
+ */
+static uint32_t run(sensor_t *sensor, uint32_t frames, uint32_t *changes, uint32_t *reversals) {
+    uint32_t last = 0;
+    int direction = 0;
+    *changes = 0;
+    *reversals = 0;
+    for (uint32_t i = 1; i <= frames; i++) {
+        int quality = sensor->rate.quality;
+        if (sensor_frame(sensor)) {
+            (*changes)++;
+            last = i;
+            int now = sensor->rate.quality > quality ? 1 : sensor->rate.quality < quality ? -1 : 0;
+            if (now != 0 && direction != 0 && now != direction) {
+                (*reversals)++;
+            }
+            direction = now != 0 ? now : direction;
+        }
+    }
+    return last;
+}
+
+/**
+ * @brief Average frame length is within deadband of the budget
+ */
+static bool near_budget(const sensor_t *sensor) {
+    uint64_t average = sensor->bytes / sensor->frames;
+    return average * 1000 >= (uint64_t)BUDGET * (1000 - JPEG_RATE_DEADBAND) &&
+           average * 1000 <= (uint64_t)BUDGET * (1000 + JPEG_RATE_DEADBAND);
+}
+
+static void test_convergence(void) {
+    uint32_t changes;
+    uint32_t reversals;
+
+    // Starting far too good - frames overflow the budget, quality gets worse in a few big steps
+    sensor_t sensor;
+    sensor_init(&sensor, QUALITY_BEST, 3, 3, 3, CALM * 2);
+    uint32_t last = run(&sensor, 40, &changes, &reversals);
+    CHECK(changes > 0 && changes <= 6 && reversals == 0 && last <= 20);
+    sensor_reset_stats(&sensor);
+    CHECK(run(&sensor, 300, &changes, &reversals) == 0);
+    CHECK(near_budget(&sensor));
+
+    // Starting far too poor - quality improves in smaller steps, so it takes longer
+    sensor_init(&sensor, QUALITY_WORST, 3, 3, 3, CALM);
+    last = run(&sensor, 100, &changes, &reversals);
+    CHECK(changes > 0 && changes <= 20 && reversals == 0 && last <= 80);
+    sensor_reset_stats(&sensor);
+    CHECK(run(&sensor, 300, &changes, &reversals) == 0);
+    CHECK(near_budget(&sensor));
+}
+
+static void test_step_change(void) {
+    uint32_t changes;
+    uint32_t reversals;
+    sensor_t sensor;
+    sensor_init(&sensor, 12, 3, 3, 3, CALM);
+    run(&sensor, 100, &changes, &reversals);
+    int calm_quality = sensor.rate.quality;
+
+    // Lights on / someone in front of the lens - frame length doubles at once
+    sensor.complexity = CALM * 2;
+    sensor_reset_stats(&sensor);
+    uint32_t last = run(&sensor, 100, &changes, &reversals);
+    CHECK(changes > 0 && changes <= 8 && reversals == 0 && last <= 30);
+    CHECK(sensor.rate.quality > calm_quality);
+    CHECK(sensor.rate.over <= changes + 2);         // Only the frames that triggered a change
+    sensor_reset_stats(&sensor);
+    CHECK(run(&sensor, 300, &changes, &reversals) == 0);
+    CHECK(near_budget(&sensor));
+
+    // Back to calm - quality recovers without overshoot
+    sensor.complexity = CALM;
+    last = run(&sensor, 100, &changes, &reversals);
+    CHECK(changes > 0 && reversals == 0 && last <= 80);
+    CHECK(abs(sensor.rate.quality - calm_quality) <= 2);
+    sensor_reset_stats(&sensor);
+    CHECK(run(&sensor, 300, &changes, &reversals) == 0);
+    CHECK(near_budget(&sensor));
+}
+
+static void test_frame_size(void) {
+    uint32_t changes;
+    uint32_t reversals;
+    sensor_t sensor;
+
+    // Dark scene fits the budget at best quality on SVGA - frame grows until it would not fit twice
+    sensor_init(&sensor, QUALITY_BEST, 0, 0, 3, CALM / 4);
+    run(&sensor, 200, &changes, &reversals);
+    CHECK(sensor.rate.size_changes > 0 && sensor.rate.size == 3);
+    CHECK(run(&sensor, 200, &changes, &reversals) == 0);
+
+    // Scene too busy even at worst quality - frame gets smaller, quality may improve again, then it holds
+    sensor_init(&sensor, 20, 3, 0, 3, CALM * 8);
+    run(&sensor, 200, &changes, &reversals);
+    CHECK(sensor.rate.size_changes > 0 && sensor.rate.size < 3 && sensor.rate.quality < QUALITY_WORST);
+    sensor_reset_stats(&sensor);
+    CHECK(run(&sensor, 200, &changes, &reversals) == 0);
+    CHECK(sensor.max_frame * 1000ULL <= (uint64_t)BUDGET * (1000 + JPEG_RATE_DEADBAND));
+
+    // Fixed frame size is never touched
+    sensor_init(&sensor, 20, 2, 2, 2, CALM * 8);
+    run(&sensor, 200, &changes, &reversals);
+    CHECK(sensor.rate.size == 2 && sensor.rate.size_changes == 0 && sensor.rate.quality == QUALITY_WORST);
+}
+
+int main(void) {
+    test_convergence();
+    test_step_change();
+    test_frame_size();
+    return TEST_RESULT();
+}
@@ -0,0 +1,137 @@
+/**
+ * @file test_motion_detect.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - frame-difference motion score on synthetic scenes, brightness change and learning
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "motion_detect.h"
+#include "test.h"
+
+#define WIDTH           80
+#define HEIGHT          60                  // Last block row is only 4 pixels high
+#define BLOCKS          (10 * 8)
+#define THRESHOLD       12
+#define LEARN_SHIFT     3
+
+static uint8_t background[WIDTH * HEIGHT];
+static uint8_t scene[WIDTH * HEIGHT];
+static uint8_t frame[WIDTH * HEIGHT];
+
+/**
+ * @brief Textured scene - gradient with a pattern, so blocks are not flat
+ */
+static void make_scene(void) {
+    for (size_t y = 0; y < HEIGHT; y++) {
+        for (size_t x = 0; x < WIDTH; x++) {
+            scene[y * WIDTH + x] = (uint8_t)(40 + x + y + ((x * 7 + y * 13) % 23));
+        }
+    }
+}
+
+/**
+ * @brief Scene with sensor noise up to +-noise, brightness added and a flat object
+ */
+static void make_frame(int noise, int brightness, size_t ox, size_t oy, size_t ow, size_t oh) {
+    for (size_t i = 0; i < WIDTH * HEIGHT; i++) {
+        int value = scene[i] + brightness + (noise ? rand() % (2 * noise + 1) - noise : 0);
+        frame[i] = (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+    }
+    for (size_t y = oy; y < oy + oh; y++) {
+        memset(frame + y * WIDTH + ox, 250, ow);
+    }
+}
+
+static void test_init(void) {
+    motion_detect_t motion;
+    CHECK(!motion_detect_init(&motion, NULL, sizeof(background), THRESHOLD, LEARN_SHIFT));
+    CHECK(!motion_detect_init(&motion, background, 0, THRESHOLD, LEARN_SHIFT));
+    CHECK(!motion_detect_init(&motion, background, sizeof(background), THRESHOLD, 8));
+    CHECK(motion_detect_init(&motion, background, sizeof(background), THRESHOLD, LEARN_SHIFT));
+
+    // No background yet, then a frame of another size
+    make_scene();
+    CHECK(motion_detect_score(&motion, scene, WIDTH, HEIGHT) == -1);
+    CHECK(!motion_detect_learn(&motion, scene, WIDTH, HEIGHT + 1));
+    CHECK(!motion_detect_learn(&motion, scene, 0, HEIGHT));
+    CHECK(motion_detect_learn(&motion, scene, WIDTH, HEIGHT));
+    CHECK(motion_detect_score(&motion, scene, WIDTH / 2, HEIGHT) == -1);
+    CHECK(motion_detect_score(&motion, scene, WIDTH, HEIGHT) == 0);
+}
+
+static void test_score(void) {
+    motion_detect_t motion;
+    motion_detect_init(&motion, background, sizeof(background), THRESHOLD, LEARN_SHIFT);
+    make_scene();
+    motion_detect_learn(&motion, scene, WIDTH, HEIGHT);
+    srand(3);
+
+    // Sensor noise alone is not motion
+    make_frame(6, 0, 0, 0, 0, 0);
+    CHECK(motion_detect_score(&motion, frame, WIDTH, HEIGHT) == 0);
+
+    // Whole scene brighter or darker (exposure, cloud) is compensated
+    make_frame(6, 40, 0, 0, 0, 0);
+    CHECK(motion_detect_score(&motion, frame, WIDTH, HEIGHT) == 0);
+    make_frame(6, -40, 0, 0, 0, 0);
+    CHECK(motion_detect_score(&motion, frame, WIDTH, HEIGHT) == 0);
+
+    // Object over 2x2 aligned blocks, then the same object straddling 3x3 blocks
+    make_frame(6, 0, 16, 16, 16, 16);
+    CHECK(motion_detect_score(&motion, frame, WIDTH, HEIGHT) == 4 * 1000 / BLOCKS);
+    make_frame(6, 0, 20, 20, 16, 16);
+    CHECK(motion_detect_score(&motion, frame, WIDTH, HEIGHT) == 9 * 1000 / BLOCKS);
+
+    // Short last block row is judged by its own size
+    make_frame(0, 0, 0, HEIGHT - 4, WIDTH, 4);
+    CHECK(motion_detect_score(&motion, frame, WIDTH, HEIGHT) == 10 * 1000 / BLOCKS);
+
+    // Object covering everything but a few blocks still counts, brightness offset does not hide it
+    make_frame(0, 0, 0, 0, WIDTH, 48);
+    CHECK(motion_detect_score(&motion, frame, WIDTH, HEIGHT) >= 700);
+}
+
+static void test_learn(void) {
+    motion_detect_t motion;
+    motion_detect_init(&motion, background, sizeof(background), THRESHOLD, LEARN_SHIFT);
+    make_scene();
+    motion_detect_learn(&motion, scene, WIDTH, HEIGHT);
+
+    // Parked car - changed at first, blended into background after some frames, reached exactly
+    make_frame(0, 0, 24, 24, 16, 16);
+    CHECK(motion_detect_score(&motion, frame, WIDTH, HEIGHT) == 4 * 1000 / BLOCKS);
+    int learned = 0;
+    while (motion_detect_score(&motion, frame, WIDTH, HEIGHT) > 0 && learned < 100) {
+        motion_detect_learn(&motion, frame, WIDTH, HEIGHT);
+        learned++;
+    }
+    CHECK(learned > 3 && learned < 40);
+    for (int i = 0; i < 100; i++) {
+        motion_detect_learn(&motion, frame, WIDTH, HEIGHT);
+    }
+    CHECK(memcmp(background, frame, sizeof(frame)) == 0);
+
+    // Darker frames pull background down and reach the frame too
+    make_frame(0, -30, 0, 0, 0, 0);
+    for (int i = 0; i < 100; i++) {
+        motion_detect_learn(&motion, frame, WIDTH, HEIGHT);
+    }
+    CHECK(memcmp(background, frame, sizeof(frame)) == 0);
+
+    // Change of size replaces background at once
+    CHECK(motion_detect_learn(&motion, scene, WIDTH / 2, HEIGHT / 2));
+    CHECK(memcmp(background, scene, WIDTH / 2 * HEIGHT / 2) == 0);
+    CHECK(motion_detect_score(&motion, scene, WIDTH / 2, HEIGHT / 2) == 0);
+}
+
+int main(void) {
+    test_init();
+    test_score();
+    test_learn();
+    return TEST_RESULT();
+}
@@ -0,0 +1,176 @@
+/**
+ * @file test_node_table.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - node token buckets (refill rounding, burst), capture episode window & table eviction
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include "node_table.h"
+#include "test.h"
+
+/**
+ * @brief Trigger node and start episode when table says so, like the trigger task does
+ */
+static node_trigger_t fire(node_table_t *table, uint16_t node_id, int64_t now, uint32_t *episode_id) {
+    node_trigger_t res = node_table_trigger(table, node_id, now, episode_id);
+    if (res == NODE_TRIGGER_NEW) {
+        *episode_id = table->episode_id + 1;
+        node_table_open(table, node_id, *episode_id, now);
+    }
+    return res;
+}
+
+static const node_entry_t *find(const node_table_t *table, uint16_t node_id) {
+    for (size_t i = 0; i < NODE_TABLE_MAX; i++) {
+        if (table->nodes[i].used && table->nodes[i].node_id == node_id) {
+            return &table->nodes[i];
+        }
+    }
+    return NULL;
+}
+
+static void test_refill_rounding(void) {
+    node_table_t table;
+    uint32_t episode;
+
+    // Limited triggers store partial refill, time that did not earn a whole 1/1000 token is not lost
+    node_table_init(&table, 1, 3000, 0);
+    CHECK(fire(&table, 1, 0, &episode) == NODE_TRIGGER_NEW);
+    const node_entry_t *node = find(&table, 1);
+    CHECK(node != NULL && node_table_tokens(&table, node, 0) == 0);
+    bool early = false;
+    for (int64_t t = 1; t < 3000; t++) {
+        early |= fire(&table, 1, t, &episode) != NODE_TRIGGER_LIMITED;
+    }
+    CHECK(!early);
+    CHECK(node->limited == 2999);
+    CHECK(node_table_tokens(&table, node, 2999) == 999);
+    CHECK(fire(&table, 1, 3000, &episode) == NODE_TRIGGER_NEW);
+    CHECK(node_table_tokens(&table, node, 3000) == 0);
+
+    // Refill not in whole ms is rounded up, triggers in any step never earn the token early
+    node_table_init(&table, 1, 1500, 0);
+    CHECK(table.refill_us == 2000);
+    CHECK(fire(&table, 1, 0, &episode) == NODE_TRIGGER_NEW);
+    early = false;
+    for (int64_t t = 2; t < 2000; t += 2) {
+        early |= fire(&table, 1, t, &episode) != NODE_TRIGGER_LIMITED;
+    }
+    CHECK(!early);
+    CHECK(fire(&table, 1, 2000, &episode) == NODE_TRIGGER_NEW);
+
+    // Bucket never fills over burst, however long node stays quiet
+    node_table_init(&table, 2, 1000, 0);
+    CHECK(fire(&table, 1, 0, &episode) == NODE_TRIGGER_NEW);
+    node = find(&table, 1);
+    CHECK(node_table_tokens(&table, node, 500) == 1500);
+    CHECK(node_table_tokens(&table, node, 1000000) == 2000);
+}
+
+static void test_burst(void) {
+    node_table_t table;
+    uint32_t episode = 0;
+    node_table_init(&table, 3, 10000000, 0);
+
+    // Burst episodes back to back, then node waits for refill while others keep their budget
+    CHECK(fire(&table, 1, 0, &episode) == NODE_TRIGGER_NEW && episode == 1);
+    CHECK(fire(&table, 1, 1, &episode) == NODE_TRIGGER_NEW && episode == 2);
+    CHECK(fire(&table, 1, 2, &episode) == NODE_TRIGGER_NEW && episode == 3);
+    CHECK(fire(&table, 1, 3, &episode) == NODE_TRIGGER_LIMITED);
+    CHECK(fire(&table, 1, 9999999, &episode) == NODE_TRIGGER_LIMITED);
+    CHECK(fire(&table, 2, 4, &episode) == NODE_TRIGGER_NEW && episode == 4);
+    CHECK(fire(&table, 1, 10000000, &episode) == NODE_TRIGGER_NEW && episode == 5);
+    CHECK(fire(&table, 1, 10000001, &episode) == NODE_TRIGGER_LIMITED);
+
+    const node_entry_t *node = find(&table, 1);
+    CHECK(node != NULL && node->triggers == 7 && node->opened == 4 && node->limited == 3);
+
+    // NEW not followed by open (capture queue full) leaves the token
+    node_table_init(&table, 1, 10000000, 0);
+    CHECK(node_table_trigger(&table, 1, 0, &episode) == NODE_TRIGGER_NEW);
+    CHECK(node_table_trigger(&table, 1, 1, &episode) == NODE_TRIGGER_NEW);
+
+    // Late events cost nothing
+    node_table_late(&table, 1, 5, 2);
+    node = find(&table, 1);
+    CHECK(node->late == 5 && node_table_tokens(&table, node, 2) == 1000);
+}
+
+static void test_episode_window(void) {
+    node_table_t table;
+    uint32_t episode = 0;
+    node_table_init(&table, 1, 10000000, 1000);
+
+    // No episode yet, trigger at time 0 is not merged into episode 0
+    CHECK(fire(&table, 1, 0, &episode) == NODE_TRIGGER_NEW && episode == 1);
+    CHECK(table.episode_nodes == 1);
+
+    // Window is [start, start + episode_us), merged triggers take no token
+    uint32_t merged = 0;
+    CHECK(fire(&table, 2, 999, &merged) == NODE_TRIGGER_MERGED && merged == 1);
+    CHECK(fire(&table, 2, 999, &merged) == NODE_TRIGGER_MERGED && merged == 1);
+    CHECK(fire(&table, 1, 999, &merged) == NODE_TRIGGER_MERGED && merged == 1);
+    CHECK(table.episode_nodes == 2);
+    const node_entry_t *node = find(&table, 2);
+    CHECK(node != NULL && node->joined == 2 && node->last_episode == 1 && node_table_tokens(&table, node, 999) == 1000);
+
+    CHECK(fire(&table, 2, 1000, &episode) == NODE_TRIGGER_NEW && episode == 2);
+    CHECK(table.episode_start == 1000 && table.episode_nodes == 1);
+    // Node 1 has no token left, but joining needs none
+    CHECK(fire(&table, 1, 1999, &merged) == NODE_TRIGGER_MERGED && merged == 2);
+    CHECK(fire(&table, 1, 2000, &episode) == NODE_TRIGGER_LIMITED);
+}
+
+static void test_eviction(void) {
+    node_table_t table;
+    uint32_t episode = 0;
+    node_table_init(&table, 1, 10000000, 0);
+
+    for (uint16_t id = 1; id <= NODE_TABLE_MAX; id++) {
+        node_table_trigger(&table, id, id, &episode);
+    }
+    CHECK(table.count == NODE_TABLE_MAX && table.evicted == 0);
+
+    // Seen again is not least recently seen anymore, node 2 goes first
+    node_table_trigger(&table, 1, 100, &episode);
+    node_table_trigger(&table, 1000, 101, &episode);
+    CHECK(table.count == NODE_TABLE_MAX && table.evicted == 1);
+    CHECK(find(&table, 1) != NULL && find(&table, 2) == NULL && find(&table, 1000) != NULL);
+    node_table_trigger(&table, 1001, 102, &episode);
+    CHECK(table.evicted == 2 && find(&table, 3) == NULL);
+
+    // Evicted node comes back as new one with full bucket
+    node_table_init(&table, 1, 10000000, 0);
+    CHECK(fire(&table, 1, 0, &episode) == NODE_TRIGGER_NEW);
+    CHECK(fire(&table, 1, 1, &episode) == NODE_TRIGGER_LIMITED);
+    for (uint16_t id = 2; id <= NODE_TABLE_MAX + 1; id++) {
+        node_table_trigger(&table, id, 1 + id, &episode);
+    }
+    CHECK(find(&table, 1) == NULL && table.evicted == 1);
+    CHECK(fire(&table, 1, 100, &episode) == NODE_TRIGGER_NEW);
+    CHECK(find(&table, 1)->limited == 0);
+
+    // List is newest first and stops at max
+    node_entry_t list[NODE_TABLE_MAX];
+    CHECK(node_table_list(&table, list, NODE_TABLE_MAX) == NODE_TABLE_MAX);
+    bool ordered = true;
+    for (size_t i = 1; i < NODE_TABLE_MAX; i++) {
+        ordered &= list[i - 1].last_seen >= list[i].last_seen;
+    }
+    CHECK(ordered && list[0].node_id == 1);
+    CHECK(node_table_list(&table, list, 3) == 3);
+    CHECK(list[0].node_id == 1 && list[1].node_id == NODE_TABLE_MAX + 1 && list[2].node_id == NODE_TABLE_MAX);
+}
+
+int main(void) {
+    test_refill_rounding();
+    test_burst();
+    test_episode_window();
+    test_eviction();
+    return TEST_RESULT();
+}
@@ -0,0 +1,240 @@
+/**
+ * @file test_photo_archive.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - photo archive on file-backed flash image, wrap-around and recovery after reboot
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include "photo_archive.h"
+#include "test.h"
+
+#define ERASE_SIZE      256
+#define SEGMENT_SIZE    1024
+#define SEGMENTS        4
+#define PHOTO_LEN       200                 // 4 photos per segment
+#define PER_SEGMENT     4
+#define MAX_ENTRIES     32
+
+/**
+ * @brief Flash image in a file, behaves like NOR flash - write only clears bits, erase sets them
+ */
+typedef struct {
+    FILE *file;
+    int writes_left;                        // Writes until power loss, -1 never
+} image_t;
+
+static bool image_read(void *ctx, size_t offset, void *dst, size_t len) {
+    image_t *image = ctx;
+    return fseek(image->file, (long)offset, SEEK_SET) == 0 && fread(dst, 1, len, image->file) == len;
+}
+
+static bool image_write(void *ctx, size_t offset, const void *src, size_t len) {
+    image_t *image = ctx;
+    if (image->writes_left == 0) {
+        return false;
+    }
+    if (image->writes_left > 0) {
+        image->writes_left--;
+    }
+    uint8_t cells[SEGMENT_SIZE];
+    if (len > sizeof(cells) || !image_read(ctx, offset, cells, len)) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        cells[i] &= ((const uint8_t *)src)[i];
+    }
+    return fseek(image->file, (long)offset, SEEK_SET) == 0 && fwrite(cells, 1, len, image->file) == len &&
+           fflush(image->file) == 0;
+}
+
+static bool image_erase(void *ctx, size_t offset, size_t len) {
+    image_t *image = ctx;
+    if (offset % ERASE_SIZE != 0 || len % ERASE_SIZE != 0) {
+        return false;
+    }
+    uint8_t blank[ERASE_SIZE];
+    memset(blank, 0xFF, sizeof(blank));
+    if (fseek(image->file, (long)offset, SEEK_SET) != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i += ERASE_SIZE) {
+        if (fwrite(blank, 1, sizeof(blank), image->file) != sizeof(blank)) {
+            return false;
+        }
+    }
+    return fflush(image->file) == 0;
+}
+
+static image_t image;
+static const archive_flash_t flash = {
+    .ctx = &image,
+    .size = SEGMENTS * SEGMENT_SIZE,
+    .erase_size = ERASE_SIZE,
+    .read = image_read,
+    .write = image_write,
+    .erase = image_erase,
+};
+static archive_entry_t entries[MAX_ENTRIES];
+
+static bool append(photo_archive_t *archive, uint32_t id) {
+    uint8_t photo[PHOTO_LEN];
+    memset(photo, (uint8_t)id, sizeof(photo));
+    return photo_archive_append(archive, id, photo, sizeof(photo), id * 1000LL, 320, 240);
+}
+
+/**
+ * @brief Photo is archived and its data reads back as written
+ */
+static bool holds(const photo_archive_t *archive, uint32_t id) {
+    const archive_entry_t *entry = photo_archive_find(archive, id);
+    uint8_t photo[PHOTO_LEN];
+    if (entry == NULL || entry->len != PHOTO_LEN || entry->timestamp != id * 1000LL ||
+        !photo_archive_read(archive, entry, 0, photo, sizeof(photo))) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(photo); i++) {
+        if (photo[i] != (uint8_t)id) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Index holds exactly photos first..last in order
+ */
+static bool holds_range(const photo_archive_t *archive, uint32_t first, uint32_t last) {
+    if (archive->count != last - first + 1) {
+        return false;
+    }
+    for (uint32_t id = first; id <= last; id++) {
+        if (photo_archive_at(archive, id - first)->id != id || !holds(archive, id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_append_and_find(void) {
+    photo_archive_t archive;
+    CHECK(!photo_archive_mount(&archive, &flash, SEGMENT_SIZE + 1, entries, MAX_ENTRIES));
+    CHECK(!photo_archive_mount(&archive, &flash, SEGMENT_SIZE * SEGMENTS, entries, MAX_ENTRIES));
+    CHECK(photo_archive_mount(&archive, &flash, SEGMENT_SIZE, entries, MAX_ENTRIES));
+    CHECK(archive.count == 0 && archive.next_id == 1);
+
+    for (uint32_t id = 1; id <= 3; id++) {
+        CHECK(append(&archive, id));
+    }
+    CHECK(holds_range(&archive, 1, 3));
+    CHECK(photo_archive_find(&archive, 4) == NULL);
+
+    // Ids must not go back, gaps are fine
+    CHECK(!append(&archive, 2));
+    CHECK(append(&archive, 5));
+    CHECK(photo_archive_find(&archive, 4) == NULL && holds(&archive, 5));
+    static uint8_t big[SEGMENT_SIZE];
+    CHECK(!photo_archive_append(&archive, 6, big, sizeof(big), 0, 320, 240));
+    CHECK(archive.next_id == 6);
+
+    uint8_t part[4];
+    const archive_entry_t *entry = photo_archive_find(&archive, 5);
+    CHECK(photo_archive_read(&archive, entry, PHOTO_LEN - 4, part, sizeof(part)) && part[3] == 5);
+    CHECK(!photo_archive_read(&archive, entry, PHOTO_LEN - 3, part, sizeof(part)));
+}
+
+static void test_wrap(void) {
+    photo_archive_t archive;
+    image_erase(&image, 0, SEGMENTS * SEGMENT_SIZE);
+    CHECK(photo_archive_mount(&archive, &flash, SEGMENT_SIZE, entries, MAX_ENTRIES));
+    for (uint32_t id = 1; id <= SEGMENTS * PER_SEGMENT; id++) {
+        CHECK(append(&archive, id));
+    }
+    CHECK(holds_range(&archive, 1, SEGMENTS * PER_SEGMENT));
+
+    // Next photo reclaims the oldest segment together with its photos
+    CHECK(append(&archive, SEGMENTS * PER_SEGMENT + 1));
+    CHECK(archive.active == 0 && archive.segment_erases[0] == 2 && archive.segment_erases[1] == 1);
+    CHECK(holds_range(&archive, PER_SEGMENT + 1, SEGMENTS * PER_SEGMENT + 1));
+
+    // Several laps around the log
+    for (uint32_t id = SEGMENTS * PER_SEGMENT + 2; id <= 5 * SEGMENTS * PER_SEGMENT; id++) {
+        CHECK(append(&archive, id));
+    }
+    CHECK(holds_range(&archive, 4 * SEGMENTS * PER_SEGMENT + 1, 5 * SEGMENTS * PER_SEGMENT));
+    CHECK(archive.segment_erases[0] == 5 && archive.segment_erases[SEGMENTS - 1] == 5);
+
+    // Remount rebuilds the same index from flash
+    photo_archive_t remounted;
+    archive_entry_t remounted_entries[MAX_ENTRIES];
+    CHECK(photo_archive_mount(&remounted, &flash, SEGMENT_SIZE, remounted_entries, MAX_ENTRIES));
+    CHECK(holds_range(&remounted, 4 * SEGMENTS * PER_SEGMENT + 1, 5 * SEGMENTS * PER_SEGMENT));
+    CHECK(remounted.next_id == archive.next_id && remounted.active == archive.active);
+    CHECK(remounted.write_offset == archive.write_offset);
+    CHECK(memcmp(remounted.segment_erases, archive.segment_erases, sizeof(archive.segment_erases)) == 0);
+
+    // Small index keeps only the newest photos
+    archive_entry_t few[3];
+    CHECK(photo_archive_mount(&remounted, &flash, SEGMENT_SIZE, few, 3));
+    CHECK(holds_range(&remounted, 5 * SEGMENTS * PER_SEGMENT - 2, 5 * SEGMENTS * PER_SEGMENT));
+}
+
+static void test_power_loss(void) {
+    photo_archive_t archive;
+    image_erase(&image, 0, SEGMENTS * SEGMENT_SIZE);
+    CHECK(photo_archive_mount(&archive, &flash, SEGMENT_SIZE, entries, MAX_ENTRIES));
+    CHECK(append(&archive, 1));
+    CHECK(append(&archive, 2));
+
+    // Header and data written, power lost before the commit mark
+    image.writes_left = 2;
+    CHECK(!append(&archive, 3));
+    image.writes_left = -1;
+    CHECK(photo_archive_mount(&archive, &flash, SEGMENT_SIZE, entries, MAX_ENTRIES));
+    CHECK(holds_range(&archive, 1, 2));
+    CHECK(archive.next_id == 3);
+    CHECK(archive.write_offset > 16 + 2 * (32 + PHOTO_LEN));    // Uncommitted record keeps its space
+    CHECK(append(&archive, 3));
+    CHECK(holds_range(&archive, 1, 3));
+
+    // Power lost in the middle of record header - garbage can not be programmed over
+    size_t active = archive.active;
+    uint32_t garbage = 0x12345678u;
+    CHECK(image_write(&image, active * SEGMENT_SIZE + archive.write_offset, &garbage, sizeof(garbage)));
+    CHECK(photo_archive_mount(&archive, &flash, SEGMENT_SIZE, entries, MAX_ENTRIES));
+    CHECK(holds_range(&archive, 1, 3));
+    CHECK(append(&archive, 4));
+    CHECK(archive.active == active + 1);
+    CHECK(holds_range(&archive, 1, 4));
+
+    // Power lost during segment header write after erase - segment holds no data
+    for (uint32_t id = 5; id < 2 * PER_SEGMENT; id++) {
+        CHECK(append(&archive, id));
+    }
+    image.writes_left = 0;
+    CHECK(!append(&archive, 2 * PER_SEGMENT));
+    image.writes_left = -1;
+    CHECK(photo_archive_mount(&archive, &flash, SEGMENT_SIZE, entries, MAX_ENTRIES));
+    CHECK(holds_range(&archive, 1, 2 * PER_SEGMENT - 1));
+    CHECK(append(&archive, 2 * PER_SEGMENT));
+    CHECK(archive.active == active + 2);
+    CHECK(holds_range(&archive, 1, 2 * PER_SEGMENT));
+}
+
+int main(void) {
+    image.file = tmpfile();
+    image.writes_left = -1;
+    if (image.file == NULL || !image_erase(&image, 0, SEGMENTS * SEGMENT_SIZE)) {
+        fprintf(stderr, "flash image not created\n");
+        return 1;
+    }
+    test_append_and_find();
+    test_wrap();
+    test_power_loss();
+    fclose(image.file);
+    return TEST_RESULT();
+}
@@ -0,0 +1,176 @@
+/**
+ * @file test_photo_slots.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - photo slots under concurrent writer and readers (pthreads)
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * One writer publishes photos as fast as it can while readers take references and check
+ * the photo does not change under them. Every reader also marks the slots it holds, so the
+ * writer can tell when it was handed a slot that is still referenced.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include "photo_slots.h"
+#include "test.h"
+
+#define CAPACITY        256
+#define READERS         4
+#define DURATION_MS     2000            // Writer keeps publishing this long
+
+static photo_slots_t store;
+static uint8_t pool[PHOTO_SLOTS_COUNT * CAPACITY];
+static atomic_int holders[PHOTO_SLOTS_COUNT];       // Readers holding each slot, kept by the readers themselves
+static atomic_bool done;
+
+// Failures seen by the threads, CHECK itself is not thread safe
+static atomic_int reused_while_held;
+static atomic_int negative_refs;
+static atomic_int torn_photos;
+static atomic_int writer_starved;
+static atomic_long reads;
+static uint32_t last_published;
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static size_t slot_index(const photo_slot_t *slot) {
+    return (size_t)(slot - store.slots);
+}
+
+static void *writer(void *arg) {
+    (void)arg;
+    int64_t end = now_ms() + DURATION_MS;
+    for (uint32_t n = 1; now_ms() < end; n++) {
+        photo_slot_t *slot = photo_slots_begin_write(&store);
+        if (slot == NULL) {
+            // Every slot held by readers - allowed, the capture just tries again
+            atomic_fetch_add(&writer_starved, 1);
+            n--;
+            sched_yield();
+            continue;
+        }
+        // Published latest photo holds a reference too
+        if (atomic_load(&holders[slot_index(slot)]) != 0 || slot == atomic_load(&store.latest)) {
+            atomic_fetch_add(&reused_while_held, 1);
+        }
+        // Written in pieces, so a reader still holding the slot would see a mix
+        slot->len = 1 + n % CAPACITY;
+        for (size_t i = 0; i < slot->len; i += 16) {
+            memset(slot->buf + i, (uint8_t)n, slot->len - i < 16 ? slot->len - i : 16);
+        }
+        slot->event_id = n;
+        if (n % 7 == 0) {
+            photo_slots_abort(&store, slot);
+        } else {
+            photo_slots_publish(&store, slot);
+            last_published = n;
+        }
+        if (n % 64 == 0) {
+            sched_yield();
+        }
+    }
+    atomic_store(&done, true);
+    return NULL;
+}
+
+static bool intact(const photo_slot_t *slot, uint32_t event_id, size_t len) {
+    if (slot->event_id != event_id || slot->len != len) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (slot->buf[i] != (uint8_t)event_id) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *reader(void *arg) {
+    size_t id = (size_t)arg;
+    while (!atomic_load(&done)) {
+        photo_slot_t *first = photo_slots_acquire(&store);
+        if (first == NULL) {
+            continue;
+        }
+        atomic_fetch_add(&holders[slot_index(first)], 1);
+        uint32_t event_id = first->event_id;
+        size_t len = first->len;
+        // Some readers hold two references at once, like a sender next to the archive
+        photo_slot_t *second = NULL;
+        if (id % 2 == 1) {
+            second = photo_slots_acquire(&store);
+            atomic_fetch_add(&holders[slot_index(second)], 1);
+        }
+        for (int pass = 0; pass < 3; pass++) {
+            if (atomic_load(&first->refs) <= 0) {
+                atomic_fetch_add(&negative_refs, 1);
+            }
+            if (!intact(first, event_id, len)) {
+                atomic_fetch_add(&torn_photos, 1);
+            }
+            sched_yield();
+        }
+        if (second != NULL) {
+            atomic_fetch_sub(&holders[slot_index(second)], 1);
+            photo_slots_release(&store, second);
+        }
+        atomic_fetch_sub(&holders[slot_index(first)], 1);
+        photo_slots_release(&store, first);
+        atomic_fetch_add(&reads, 1);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Sample reference counts the whole time, nothing but the writer mark may be below zero
+ */
+static void *monitor(void *arg) {
+    (void)arg;
+    while (!atomic_load(&done)) {
+        for (size_t i = 0; i < PHOTO_SLOTS_COUNT; i++) {
+            if (atomic_load(&store.slots[i].refs) < PHOTO_SLOT_WRITING) {
+                atomic_fetch_add(&negative_refs, 1);
+            }
+        }
+        sched_yield();
+    }
+    return NULL;
+}
+
+int main(void) {
+    CHECK(photo_slots_init(&store, pool, CAPACITY));
+    CHECK(photo_slots_acquire(&store) == NULL);
+
+    pthread_t threads[READERS + 2];
+    pthread_create(&threads[0], NULL, writer, NULL);
+    pthread_create(&threads[1], NULL, monitor, NULL);
+    for (size_t i = 0; i < READERS; i++) {
+        pthread_create(&threads[2 + i], NULL, reader, (void *)i);
+    }
+    for (size_t i = 0; i < READERS + 2; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    printf("%u photos, %ld reads, writer found every slot held %d times\n", (unsigned)last_published, atomic_load(&reads), atomic_load(&writer_starved));
+
+    CHECK(atomic_load(&reused_while_held) == 0);
+    CHECK(atomic_load(&negative_refs) == 0);
+    CHECK(atomic_load(&torn_photos) == 0);
+    CHECK(atomic_load(&reads) > 0);
+
+    // Quiet again: only the latest photo keeps its reference
+    photo_slot_t *latest = atomic_load(&store.latest);
+    CHECK(latest != NULL && latest->event_id == last_published);
+    for (size_t i = 0; i < PHOTO_SLOTS_COUNT; i++) {
+        CHECK(atomic_load(&store.slots[i].refs) == (&store.slots[i] == latest ? 1 : 0));
+    }
+    return TEST_RESULT();
+}
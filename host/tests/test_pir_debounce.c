@@ -0,0 +1,238 @@
+/**
+ * @file test_pir_debounce.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - PIR debouncer on synthetic and recorded edge traces, glitch, spike and holdoff limits
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * Recorded traces are the host/traces files pir-sim replays, edges go through pir_debounce the same
+ * way as from the debounce task of security-pir.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include "pir_debounce.h"
+#include "test.h"
+
+#define PIR_GPIO        39
+#define GLITCH_US       2000                // Same as security-pir
+#define HOLDOFF_US      1000000
+#define MAX_EVENTS      64
+
+/**
+ * @brief Edge, settled when the pin keeps its level until the next edge at next (-1 for never)
+ * @return motion events reported
+ */
+static int edge(pir_debounce_t *db, int level, int64_t at, int64_t next) {
+    pir_debounce_edge(db, level, at);
+    int64_t deadline = pir_debounce_deadline(db);
+    return deadline >= 0 && (next < 0 || deadline <= next) && pir_debounce_settle(db, level, deadline);
+}
+
+/**
+ * @brief Feed pulses (rising edge at start + i * period, falling after width), every edge followed
+ *        by even number of bounce edges spaced bounce_us apart
+ * @return motion events reported
+ */
+static int pulses(pir_debounce_t *db, int64_t start, int count, int64_t period, int64_t width, int bounces,
+                  int64_t bounce_us) {
+    int events = 0;
+    for (int i = 0; i < count; i++) {
+        for (int level = 1; level >= 0; level--) {
+            int64_t t = start + i * period + (level ? 0 : width);
+            int64_t next = level ? start + i * period + width : i + 1 < count ? start + (i + 1) * period : -1;
+            for (int b = 0; b <= bounces; b++) {
+                events += edge(db, b % 2 ? !level : level, t + b * bounce_us, b < bounces ? t + (b + 1) * bounce_us : next);
+            }
+        }
+    }
+    return events;
+}
+
+static void test_clean_pulses(void) {
+    pir_debounce_t db;
+    pir_debounce_init(&db, GLITCH_US, HOLDOFF_US);
+    CHECK(pulses(&db, 1000000, 10, 2000000, 500000, 0, 0) == 10);
+    CHECK(db.ignored == 0 && db.level == 0 && db.pending == -1);
+    CHECK(db.has_event && db.last_event == 1000000 + 9 * 2000000LL);
+
+    // Nothing pending - settle does nothing, rising level is reported only once it held glitch_us
+    CHECK(!pir_debounce_settle(&db, 1, 30000000));
+    CHECK(pir_debounce_edge(&db, 1, 30000000));
+    CHECK(pir_debounce_deadline(&db) == 30000000 + GLITCH_US);
+    CHECK(!pir_debounce_settle(&db, 1, 30000000 + GLITCH_US - 1));
+    CHECK(db.level == 0);
+    CHECK(pir_debounce_settle(&db, 1, 30000000 + GLITCH_US + 500));
+    CHECK(db.level == 1 && db.last_event == 30000000 && pir_debounce_deadline(&db) == -1);
+}
+
+static void test_bounce(void) {
+    pir_debounce_t db;
+
+    // Bounce faster than glitch limit ending on the edge level - every pulse counts once, at its first edge
+    pir_debounce_init(&db, GLITCH_US, HOLDOFF_US);
+    CHECK(pulses(&db, 1000000, 10, 2000000, 500000, 4, 300) == 10);
+    CHECK(db.ignored == 10 * 2 * 4);
+    CHECK(db.level == 0 && db.last_event == 1000000 + 9 * 2000000LL);
+
+    // Pulses shorter than glitch limit are spikes - pin never changed
+    pir_debounce_init(&db, GLITCH_US, HOLDOFF_US);
+    CHECK(pulses(&db, 1000000, 10, 2000000, GLITCH_US - 1, 0, 0) == 0);
+    CHECK(db.level == 0 && !db.has_event && db.ignored == 10 * 2);
+
+    // Edge exactly at glitch limit is real
+    pir_debounce_init(&db, GLITCH_US, HOLDOFF_US);
+    CHECK(edge(&db, 1, 1000000, 1000000 + GLITCH_US) == 1);
+    CHECK(edge(&db, 0, 1000000 + GLITCH_US, 1000000 + 2 * GLITCH_US - 1) == 0);
+    CHECK(db.level == 1 && db.ignored == 0);
+    CHECK(edge(&db, 1, 1000000 + 2 * GLITCH_US - 1, -1) == 0);
+    CHECK(db.level == 1 && db.ignored == 2);
+
+    // Any non-zero GPIO level is high
+    CHECK(edge(&db, 0, 2000000, -1) == 0);
+    CHECK(edge(&db, 5, 3000000, -1) == 1);
+    CHECK(db.level == 1);
+}
+
+static void test_spike(void) {
+    pir_debounce_t db;
+
+    // Spike of 0.5 ms on a quiet line is no motion and leaves the level low
+    pir_debounce_init(&db, GLITCH_US, HOLDOFF_US);
+    CHECK(edge(&db, 1, 1000000, 1000500) == 0);
+    CHECK(edge(&db, 0, 1000500, -1) == 0);
+    CHECK(db.level == 0 && db.pin == 0 && db.pending == -1 && db.ignored == 2);
+    CHECK(!db.has_event);
+
+    // ...so the real rising edge 9 s later is reported
+    CHECK(edge(&db, 1, 10000000, -1) == 1);
+    CHECK(db.level == 1 && db.last_event == 10000000);
+
+    // Falling spike while high does not end the motion level either
+    CHECK(edge(&db, 0, 11000000, 11000300) == 0);
+    CHECK(edge(&db, 1, 11000300, -1) == 0);
+    CHECK(db.level == 1 && db.ignored == 4);
+    CHECK(edge(&db, 0, 12000000, -1) == 0);
+    CHECK(db.level == 0);
+
+    // Back edge of the spike lost - pin re-read at the deadline is low, nothing happens
+    CHECK(pir_debounce_edge(&db, 1, 20000000));
+    CHECK(!pir_debounce_settle(&db, 0, pir_debounce_deadline(&db)));
+    CHECK(db.level == 0 && db.pin == 0 && pir_debounce_deadline(&db) == -1);
+
+    // Repeated level after a lost edge is a new transition - second rising edge is a new motion
+    CHECK(edge(&db, 1, 30000000, -1) == 1);
+    CHECK(edge(&db, 1, 35000000, -1) == 1);
+    CHECK(db.last_event == 35000000);
+
+    // Lost falling edge found at the deadline of a repeated rising level - low has to hold from then on
+    CHECK(pir_debounce_edge(&db, 1, 40000000));
+    CHECK(!pir_debounce_settle(&db, 0, 40000000 + GLITCH_US));
+    CHECK(db.level == 1 && pir_debounce_deadline(&db) == 40000000 + 2 * GLITCH_US);
+    CHECK(!pir_debounce_settle(&db, 0, 40000000 + 2 * GLITCH_US));
+    CHECK(db.level == 0);
+}
+
+static void test_holdoff(void) {
+    pir_debounce_t db;
+
+    // Pulses closer than holdoff - only every other one starts an event
+    pir_debounce_init(&db, GLITCH_US, HOLDOFF_US);
+    CHECK(pulses(&db, 1000000, 10, 600000, 100000, 0, 0) == 5);
+    CHECK(db.ignored == 5);
+
+    // Boundary - rising edge exactly holdoff after the last event counts, one us earlier it does not
+    pir_debounce_init(&db, GLITCH_US, HOLDOFF_US);
+    CHECK(edge(&db, 1, 1000000, 1100000) == 1);
+    CHECK(edge(&db, 0, 1100000, 1000000 + HOLDOFF_US - 1) == 0);
+    CHECK(edge(&db, 1, 1000000 + HOLDOFF_US - 1, -1) == 0);
+    CHECK(db.level == 1 && db.last_event == 1000000);
+    pir_debounce_init(&db, GLITCH_US, HOLDOFF_US);
+    CHECK(edge(&db, 1, 1000000, 1100000) == 1);
+    CHECK(edge(&db, 0, 1100000, 1000000 + HOLDOFF_US) == 0);
+    CHECK(edge(&db, 1, 1000000 + HOLDOFF_US, -1) == 1);
+
+    // Rejected rising edge does not restart holdoff
+    pir_debounce_init(&db, GLITCH_US, HOLDOFF_US);
+    CHECK(pulses(&db, 1000000, 1, 0, 50000, 0, 0) == 1);
+    CHECK(pulses(&db, 1900000, 1, 0, 50000, 0, 0) == 0);
+    CHECK(pulses(&db, 2000000, 1, 0, 50000, 0, 0) == 1);
+
+    // Zero holdoff reports every clean pulse
+    pir_debounce_init(&db, GLITCH_US, 0);
+    CHECK(pulses(&db, 1000000, 20, 10000, 5000, 0, 0) == 20);
+}
+
+/**
+ * @brief Replay trace through debouncer
+ * @param events times of reported motion events (ms)
+ * @return number of motion events, -1 when the trace can not be read
+ */
+static int replay(const char *name, pir_debounce_t *db, int64_t *events) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", TRACE_DIR, name);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "%s: can not open\n", path);
+        return -1;
+    }
+    int count = 0;
+    char line[128];
+    bool more = true;
+    while (more) {
+        long long ms = INT64_MAX / 1000;
+        int gpio;
+        int level;
+        more = fgets(line, sizeof(line), file) != NULL;
+        if (more && (line[0] == '#' || sscanf(line, "%lld %d %d", &ms, &gpio, &level) != 3 || gpio != PIR_GPIO)) {
+            continue;
+        }
+        // Pin kept the level of the previous edge until this one
+        int64_t deadline = pir_debounce_deadline(db);
+        if (deadline >= 0 && deadline <= ms * 1000 && pir_debounce_settle(db, db->pin, deadline) && count < MAX_EVENTS) {
+            events[count++] = db->last_event / 1000;
+        }
+        if (more) {
+            pir_debounce_edge(db, level, ms * 1000);
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+static void test_traces(void) {
+    pir_debounce_t db;
+    int64_t events[MAX_EVENTS];
+
+    // Bounce of 2 ms is an edge already, bounce of 1 ms is not
+    pir_debounce_init(&db, GLITCH_US, HOLDOFF_US);
+    CHECK(replay("walk_by.trace", &db, events) == 3);
+    CHECK(events[0] == 3000 && events[1] == 9000 && events[2] == 15000);
+    CHECK(db.ignored == 2);
+
+    pir_debounce_init(&db, GLITCH_US, HOLDOFF_US);
+    CHECK(replay("chatter.trace", &db, events) == 3);
+    CHECK(events[0] == 1000 && events[1] == 3000 && events[2] == 4500);
+    CHECK(db.ignored == 6);                 // 4 bounce / repeated level, 1 holdoff, 1 missed edge
+
+    // Shorter holdoff lets the retrigger at 3700 ms through
+    pir_debounce_init(&db, GLITCH_US, 500000);
+    CHECK(replay("chatter.trace", &db, events) == 4);
+    CHECK(events[2] == 3700 && events[3] == 4500);
+
+    pir_debounce_init(&db, GLITCH_US, HOLDOFF_US);
+    CHECK(replay("outage.trace", &db, events) == 20);
+    CHECK(events[19] - events[0] == 19 * 1500);
+    CHECK(db.ignored == 8);
+}
+
+int main(void) {
+    test_clean_pulses();
+    test_bounce();
+    test_spike();
+    test_holdoff();
+    test_traces();
+    return TEST_RESULT();
+}
@@ -0,0 +1,198 @@
+/**
+ * @file test_rendition.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - renditions of UXGA photo through libjpeg shim, sizes, content and heap peak
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_jpg_decode.h"
+#include "img_converters.h"
+#include "rendition.h"
+#include "test.h"
+
+#define PHOTO_WIDTH     1600
+#define PHOTO_HEIGHT    1200
+#define MEDIUM_SIZE     (48 * 1024)     // RENDITION_MEDIUM_SIZE of main.c
+#define THUMB_SIZE      (16 * 1024)     // RENDITION_THUMB_SIZE of main.c
+#define MAX_BLOCKS      8
+
+// Device heap use of the module goes through heap_caps_malloc, test is linked with --wrap (CMakeLists.txt)
+void *__real_heap_caps_malloc(size_t size, uint32_t caps);
+void __real_free(void *ptr);
+
+static struct {
+    void *ptr;
+    size_t size;
+} blocks[MAX_BLOCKS];
+static size_t heap_live = 0;
+static size_t heap_peak = 0;
+static unsigned heap_allocations = 0;
+
+void *__wrap_heap_caps_malloc(size_t size, uint32_t caps) {
+    void *ptr = __real_heap_caps_malloc(size, caps);
+    for (size_t i = 0; ptr != NULL && i < MAX_BLOCKS; i++) {
+        if (blocks[i].ptr == NULL) {
+            blocks[i].ptr = ptr;
+            blocks[i].size = size;
+            heap_allocations++;
+            heap_live += size;
+            heap_peak = heap_live > heap_peak ? heap_live : heap_peak;
+            break;
+        }
+    }
+    return ptr;
+}
+
+void __wrap_free(void *ptr) {
+    for (size_t i = 0; ptr != NULL && i < MAX_BLOCKS; i++) {
+        if (blocks[i].ptr == ptr) {
+            heap_live -= blocks[i].size;
+            blocks[i].ptr = NULL;
+            break;
+        }
+    }
+    __real_free(ptr);
+}
+
+static void heap_reset(void) {
+    heap_peak = heap_live;
+    heap_allocations = 0;
+}
+
+typedef struct {
+    const uint8_t *jpg;
+    size_t len;
+    uint8_t *out;
+    size_t width;
+    size_t height;
+} decoded_t;
+
+static size_t read_jpg(void *arg, size_t index, uint8_t *buf, size_t len) {
+    decoded_t *decoded = arg;
+    if (index + len > decoded->len) {
+        len = decoded->len - index;
+    }
+    if (buf != NULL) {
+        memcpy(buf, decoded->jpg + index, len);
+    }
+    return len;
+}
+
+static bool write_rgb(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+    decoded_t *decoded = arg;
+    if (data == NULL) {
+        if (x == 0 && y == 0) {
+            decoded->width = w;
+            decoded->height = h;
+            decoded->out = malloc((size_t)w * h * 3);
+        }
+        return decoded->out != NULL;
+    }
+    memcpy(decoded->out + (y * decoded->width + x) * 3, data, (size_t)w * h * 3);
+    return true;
+}
+
+/**
+ * @brief Decode rendition back at full scale
+ */
+static bool decode(const photo_rendition_t *rendition, decoded_t *decoded) {
+    memset(decoded, 0, sizeof(*decoded));
+    decoded->jpg = rendition->buf;
+    decoded->len = rendition->len;
+    return esp_jpg_decode(rendition->len, JPG_SCALE_NONE, read_jpg, write_rgb, decoded) == ESP_OK;
+}
+
+/**
+ * @brief Left half dark, right half light - survives scaling and JPEG, so renditions can be told apart
+ */
+static uint8_t *make_photo(size_t *len) {
+    uint8_t *rgb = malloc(PHOTO_WIDTH * PHOTO_HEIGHT * 3);
+    for (size_t y = 0; y < PHOTO_HEIGHT; y++) {
+        for (size_t x = 0; x < PHOTO_WIDTH; x++) {
+            uint8_t *px = rgb + (y * PHOTO_WIDTH + x) * 3;
+            px[0] = x < PHOTO_WIDTH / 2 ? 30 : 220;
+            px[1] = (uint8_t)(y * 255 / PHOTO_HEIGHT);
+            px[2] = 128;
+        }
+    }
+    uint8_t *jpg = NULL;
+    fmt2jpg(rgb, PHOTO_WIDTH * PHOTO_HEIGHT * 3, PHOTO_WIDTH, PHOTO_HEIGHT, PIXFORMAT_RGB888, 80, &jpg, len);
+    free(rgb);
+    return jpg;
+}
+
+static bool near(int a, int b) {
+    return abs(a - b) <= 12;
+}
+
+static void test_renditions(const uint8_t *jpg, size_t len) {
+    static uint8_t medium_buf[MEDIUM_SIZE];
+    static uint8_t thumb_buf[THUMB_SIZE];
+    photo_rendition_t medium = {.buf = medium_buf, .capacity = sizeof(medium_buf)};
+    photo_rendition_t thumb = {.buf = thumb_buf, .capacity = sizeof(thumb_buf)};
+
+    heap_reset();
+    CHECK(rendition_make(jpg, len, &medium, &thumb) == ESP_OK);
+    // One decoded image at 1/4 scale is all the heap it takes, returned before rendition_make does
+    CHECK(heap_allocations == 1);
+    CHECK(heap_peak == (PHOTO_WIDTH / 4) * (PHOTO_HEIGHT / 4) * 3);
+    CHECK(heap_peak == 360000);
+    CHECK(heap_live == 0);
+
+    CHECK(medium.width == PHOTO_WIDTH / 4 && medium.height == PHOTO_HEIGHT / 4);
+    CHECK(thumb.width == PHOTO_WIDTH / 8 && thumb.height == PHOTO_HEIGHT / 8);
+    CHECK(medium.len > 0 && medium.len <= MEDIUM_SIZE && thumb.len > 0 && thumb.len <= THUMB_SIZE);
+
+    decoded_t out;
+    CHECK(decode(&medium, &out) && out.width == medium.width && out.height == medium.height);
+    if (out.out != NULL) {
+        CHECK(near(out.out[(150 * out.width + 50) * 3], 30) && near(out.out[(150 * out.width + 350) * 3], 220));
+        CHECK(near(out.out[(299 * out.width + 50) * 3 + 1], 254) && near(out.out[(0 * out.width + 50) * 3 + 1], 0));
+        free(out.out);
+    }
+    CHECK(decode(&thumb, &out) && out.width == thumb.width && out.height == thumb.height);
+    if (out.out != NULL) {
+        CHECK(near(out.out[(75 * out.width + 25) * 3], 30) && near(out.out[(75 * out.width + 175) * 3], 220));
+        free(out.out);
+    }
+}
+
+static void test_no_room(const uint8_t *jpg, size_t len) {
+    static uint8_t medium_buf[MEDIUM_SIZE];
+    static uint8_t thumb_buf[64];
+    photo_rendition_t medium = {.buf = medium_buf, .capacity = sizeof(medium_buf)};
+    photo_rendition_t thumb = {.buf = thumb_buf, .capacity = sizeof(thumb_buf), .len = 1};
+
+    // Thumbnail that does not fit is left empty, medium is still made
+    heap_reset();
+    CHECK(rendition_make(jpg, len, &medium, &thumb) == ESP_OK);
+    CHECK(medium.len > 0 && thumb.len == 0);
+    CHECK(heap_live == 0);
+
+    // Broken photo makes nothing and leaks nothing
+    uint8_t broken[256];
+    memset(broken, 0x5a, sizeof(broken));
+    heap_reset();
+    medium.len = 0;
+    CHECK(rendition_make(broken, sizeof(broken), &medium, &thumb) != ESP_OK);
+    CHECK(medium.len == 0 && heap_live == 0 && heap_allocations == 0);
+}
+
+int main(void) {
+    size_t len = 0;
+    uint8_t *jpg = make_photo(&len);
+    CHECK(jpg != NULL && len > 0);
+    if (jpg != NULL) {
+        test_renditions(jpg, len);
+        test_no_room(jpg, len);
+        free(jpg);
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,197 @@
+/**
+ * @file test_trigger_proto.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Host test - trigger protocol encoding, rejection of broken datagrams and duplicate detection
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#include "trigger_proto.h"
+#include "test.h"
+
+static bool same(const trigger_msg_t *a, const trigger_msg_t *b) {
+    return a->type == b->type && a->node_id == b->node_id && a->flags == b->flags && a->seq == b->seq &&
+           a->timestamp == b->timestamp && a->delay_us == b->delay_us && a->receive == b->receive;
+}
+
+/**
+ * @brief Encode, check length and decode back
+ */
+static bool round_trip(const trigger_msg_t *msg, size_t expected_len) {
+    uint8_t buf[TRIGGER_BATCH_MAX_SIZE];
+    trigger_msg_t decoded;
+    size_t len = trigger_encode(msg, buf);
+    return len == expected_len && trigger_decode(buf, len, &decoded) && same(msg, &decoded);
+}
+
+static void test_round_trip(void) {
+    trigger_msg_t event = {
+        .type = TRIGGER_MSG_EVENT, .node_id = 0xBEEF, .flags = TRIGGER_FLAG_MOTION | TRIGGER_FLAG_RETRY,
+        .seq = 0xFFFFFFFEu, .timestamp = -1234567890123LL,
+    };
+    CHECK(round_trip(&event, TRIGGER_MSG_SIZE));
+
+    // Big-endian layout from the header comment
+    uint8_t buf[TRIGGER_BATCH_MAX_SIZE];
+    trigger_encode(&event, buf);
+    const uint8_t head[] = {0x54, 0x52, TRIGGER_VERSION, TRIGGER_MSG_EVENT, 0xBE, 0xEF, 0x00, 0x03,
+                            0xFF, 0xFF, 0xFF, 0xFE};
+    CHECK(memcmp(buf, head, sizeof(head)) == 0);
+    CHECK(buf[12] == 0xFF && buf[19] == (uint8_t)-1234567890123LL);
+
+    trigger_msg_t synced = event;
+    synced.flags = TRIGGER_FLAG_MOTION | TRIGGER_FLAG_SYNCED;
+    synced.timestamp = INT64_MAX;
+    synced.delay_us = 0xFFFFFFFFu;
+    CHECK(round_trip(&synced, TRIGGER_EVENT_SYNCED_SIZE));
+
+    trigger_msg_t ack;
+    trigger_make_ack(&event, 42, &ack);
+    CHECK(ack.type == TRIGGER_MSG_ACK && ack.seq == event.seq && ack.node_id == event.node_id);
+    CHECK(round_trip(&ack, TRIGGER_MSG_SIZE));
+
+    trigger_msg_t sync = {.type = TRIGGER_MSG_SYNC, .node_id = 7, .seq = 99, .timestamp = 1000};
+    CHECK(round_trip(&sync, TRIGGER_MSG_SIZE));
+    trigger_msg_t reply;
+    trigger_make_sync_reply(&sync, INT64_MIN, 2000, &reply);
+    CHECK(reply.seq == 99 && reply.timestamp == 2000 && reply.receive == INT64_MIN);
+    CHECK(round_trip(&reply, TRIGGER_SYNC_REPLY_SIZE));
+
+    // Batch - header seq is the newest event, entries oldest first
+    trigger_batch_entry_t entries[TRIGGER_BATCH_MAX];
+    for (size_t i = 0; i < TRIGGER_BATCH_MAX; i++) {
+        entries[i].seq = 100 + i;
+        entries[i].age_ms = i == 0 ? TRIGGER_AGE_UNKNOWN : (TRIGGER_BATCH_MAX - i) * 1000;
+    }
+    trigger_msg_t header = {.node_id = 3, .flags = TRIGGER_FLAG_SYNCED, .seq = 115, .timestamp = 5};
+    size_t len = trigger_encode_batch(&header, entries, TRIGGER_BATCH_MAX, buf);
+    CHECK(len == TRIGGER_BATCH_MAX_SIZE);
+    trigger_msg_t decoded;
+    trigger_batch_entry_t decoded_entries[TRIGGER_BATCH_MAX];
+    size_t count = 0;
+    CHECK(trigger_decode_batch(buf, len, &decoded, decoded_entries, &count));
+    CHECK(count == TRIGGER_BATCH_MAX && decoded.type == TRIGGER_MSG_BATCH && decoded.seq == 115);
+    CHECK(decoded.flags == TRIGGER_FLAG_SYNCED && decoded.delay_us == 0);
+    CHECK(memcmp(entries, decoded_entries, sizeof(entries)) == 0);
+    CHECK(trigger_encode_batch(&header, entries, 1, buf) == TRIGGER_MSG_SIZE + TRIGGER_BATCH_ENTRY_SIZE);
+    CHECK(trigger_encode_batch(&header, entries, 0, buf) == 0);
+    CHECK(trigger_encode_batch(&header, entries, TRIGGER_BATCH_MAX + 1, buf) == 0);
+}
+
+static void test_broken_datagrams(void) {
+    trigger_msg_t msg;
+    trigger_msg_t synced = {.type = TRIGGER_MSG_EVENT, .flags = TRIGGER_FLAG_SYNCED, .seq = 1};
+    uint8_t buf[TRIGGER_BATCH_MAX_SIZE + 1];
+    size_t len = trigger_encode(&synced, buf);
+
+    // Every truncation and one byte too many
+    bool accepted = false;
+    for (size_t cut = 0; cut < len; cut++) {
+        accepted |= trigger_decode(buf, cut, &msg);
+    }
+    CHECK(!accepted);
+    CHECK(!trigger_decode(buf, len + 1, &msg));
+    CHECK(trigger_decode(buf, len, &msg));
+
+    // Synced flag promises delay field, plain length is not enough
+    CHECK(!trigger_decode(buf, TRIGGER_MSG_SIZE, &msg));
+
+    uint8_t corrupt[TRIGGER_BATCH_MAX_SIZE];
+    const struct {
+        size_t offset;
+        uint8_t value;
+    } damage[] = {
+        {0, 0x00},                          // Magic
+        {1, 0x53},
+        {2, TRIGGER_VERSION + 1},
+        {3, 0},                             // Type
+        {3, TRIGGER_MSG_SYNC_REPLY + 1},
+        {3, TRIGGER_MSG_BATCH},             // Batch only through trigger_decode_batch
+        {3, TRIGGER_MSG_SYNC_REPLY},        // Reply is longer
+        {7, 0x00},                          // Synced flag cleared - length does not match anymore
+    };
+    for (size_t i = 0; i < sizeof(damage) / sizeof(damage[0]); i++) {
+        memcpy(corrupt, buf, len);
+        corrupt[damage[i].offset] = damage[i].value;
+        CHECK(!trigger_decode(corrupt, len, &msg));
+    }
+
+    trigger_batch_entry_t entries[TRIGGER_BATCH_MAX] = {{.seq = 1, .age_ms = 10}, {.seq = 2, .age_ms = 5}};
+    trigger_msg_t header = {.seq = 2};
+    size_t count;
+    len = trigger_encode_batch(&header, entries, 2, buf);
+    CHECK(trigger_decode_batch(buf, len, &msg, entries, &count) && count == 2);
+    CHECK(!trigger_decode_batch(buf, TRIGGER_MSG_SIZE, &msg, entries, &count));             // No entries
+    CHECK(!trigger_decode_batch(buf, len - 1, &msg, entries, &count));                       // Half entry
+    CHECK(!trigger_decode_batch(buf, TRIGGER_BATCH_MAX_SIZE + TRIGGER_BATCH_ENTRY_SIZE, &msg, entries, &count));
+    CHECK(!trigger_decode(buf, len, &msg));
+    buf[3] = TRIGGER_MSG_EVENT;
+    CHECK(!trigger_decode_batch(buf, len, &msg, entries, &count));
+    buf[3] = TRIGGER_MSG_BATCH;
+    buf[0] ^= 0x80;
+    CHECK(!trigger_decode_batch(buf, len, &msg, entries, &count));
+}
+
+static void test_dedup(void) {
+    trigger_dedup_t dedup;
+    trigger_dedup_init(&dedup);
+    CHECK(trigger_dedup_accept(&dedup, 1, 100));
+    CHECK(!trigger_dedup_accept(&dedup, 1, 100));                   // Retransmission
+    CHECK(trigger_dedup_accept(&dedup, 2, 100));                    // Other node has its own window
+    CHECK(trigger_dedup_accept(&dedup, 1, 104));
+    CHECK(dedup.missing == 3);
+
+    // Batch replays the events that got lost, once
+    CHECK(trigger_dedup_accept(&dedup, 1, 102));
+    CHECK(trigger_dedup_accept(&dedup, 1, 101));
+    CHECK(!trigger_dedup_accept(&dedup, 1, 102));
+    CHECK(dedup.reordered == 2 && dedup.missing == 1 && dedup.duplicates == 2);
+
+    // Oldest sequence number still in the window, first one out of it
+    CHECK(trigger_dedup_accept(&dedup, 1, 104 + TRIGGER_DEDUP_WINDOW - 1));
+    CHECK(!trigger_dedup_accept(&dedup, 1, 104));
+    CHECK(trigger_dedup_accept(&dedup, 1, 105));
+    CHECK(!trigger_dedup_accept(&dedup, 1, 103));                   // Fell out, counted as duplicate
+    CHECK(dedup.duplicates == 4 && dedup.missing == 30);
+
+    // Window wraps together with the sequence number
+    trigger_dedup_init(&dedup);
+    CHECK(trigger_dedup_accept(&dedup, 5, 0xFFFFFFF0u));
+    for (uint32_t seq = 0xFFFFFFF2u; seq != 0x10; seq += 2) {
+        CHECK(trigger_dedup_accept(&dedup, 5, seq));
+    }
+    for (uint32_t seq = 0xFFFFFFF0u; seq != 0x10; seq += 2) {
+        CHECK(!trigger_dedup_accept(&dedup, 5, seq));
+    }
+    for (uint32_t seq = 0xFFFFFFF1u; seq != 0x11; seq += 2) {
+        CHECK(trigger_dedup_accept(&dedup, 5, seq));
+    }
+    CHECK(dedup.missing == 0 && dedup.restarts == 0);
+
+    // Jump over the whole window leaves older events behind it, jump of restart gap starts a new sequence
+    CHECK(trigger_dedup_accept(&dedup, 5, 0x0F + TRIGGER_DEDUP_WINDOW));
+    CHECK(!trigger_dedup_accept(&dedup, 5, 0x0F));
+    CHECK(trigger_dedup_accept(&dedup, 5, 0x0F + TRIGGER_DEDUP_WINDOW + TRIGGER_RESTART_GAP));
+    CHECK(trigger_dedup_accept(&dedup, 5, 7));                      // Node rebooted to a lower number
+    CHECK(dedup.restarts == 2);
+    CHECK(!trigger_dedup_accept(&dedup, 5, 7));
+
+    // Full table still lets events of new nodes through
+    trigger_dedup_init(&dedup);
+    for (uint16_t node = 0; node < TRIGGER_MAX_NODES; node++) {
+        trigger_dedup_accept(&dedup, node, 1);
+    }
+    CHECK(trigger_dedup_accept(&dedup, TRIGGER_MAX_NODES, 1));
+    CHECK(trigger_dedup_accept(&dedup, TRIGGER_MAX_NODES, 1));
+    CHECK(!trigger_dedup_accept(&dedup, 0, 1));
+}
+
+int main(void) {
+    test_round_trip();
+    test_broken_datagrams();
+    test_dedup();
+    return TEST_RESULT();
+}
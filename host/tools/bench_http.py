@@ -0,0 +1,414 @@
+"""
+Load & latency benchmark of the camera web server.
+
+Usage: bench_http.py [--url http://localhost:8080] [--clients 4] [--duration 20]
+                     [--mix index=20,latest=60,take=5,pir=15] [--burst pir:5:2000]
+                     [--spawn host/build/cam-sim] [--json results.json] [--compare baseline.json]
+
+Every client is a thread with its own connection (keep-alive unless --no-keep-alive) picking
+endpoints from the weighted mix, think time between requests is --think ms. Bursts fire COUNT
+simultaneous requests of one endpoint every INTERVAL ms on fresh connections, like several PIR
+nodes triggering at once. Endpoint is one of the names below or a path starting with "/".
+Keep-alive clients beyond the server socket limit (5 on the cam) wait until a socket frees up,
+that shows in latency of everyone.
+
+Results per endpoint: throughput, status codes, errors and p50/p95/p99 latency of complete
+responses. --compare exits with 1 when p95 latency or throughput of any endpoint is worse than
+baseline by more than --tolerance percent.
+With --spawn the CPU time cam-sim used in the measured window is read from /proc per thread (task
+name), so time the server burns outside request handling shows up next to latency. It is compared
+with baseline for information only, it never fails the run.
+
+Author: Roman Janiczek (xjanic25@vutbr.cz)
+"""
+import argparse
+import datetime
+import http.client
+import json
+import math
+import os
+import random
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.parse
+
+ENDPOINTS = {
+    'index': '/',
+    'latest': '/latest-photo.jpg',
+    'thumb': '/latest-photo.jpg?size=thumb',
+    'take': '/take-photo',
+    'pir': '/pir',
+    'status': '/status',
+    'photos': '/photos',
+}
+
+RESULT_VERSION = 1
+
+
+def parse_mix(text):
+    mix = []
+    for item in text.split(','):
+        name, _, weight = item.partition('=')
+        path = name if name.startswith('/') else ENDPOINTS.get(name)
+        if path is None:
+            raise argparse.ArgumentTypeError('unknown endpoint %s' % name)
+        mix.append((name, path, float(weight or 1)))
+    return mix
+
+
+def parse_burst(text):
+    parts = text.split(':')
+    if len(parts) != 3:
+        raise argparse.ArgumentTypeError('burst is ENDPOINT:COUNT:INTERVAL_MS')
+    name = parts[0]
+    path = name if name.startswith('/') else ENDPOINTS.get(name)
+    if path is None:
+        raise argparse.ArgumentTypeError('unknown endpoint %s' % name)
+    return name, path, int(parts[1]), int(parts[2]) / 1000.0
+
+
+class Recorder:
+    """Samples of all threads, only those finished inside the measured window count."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.samples = []
+        self.start = None
+        self.stop = None
+
+    def add(self, name, started, latency, status, size, error):
+        with self.lock:
+            self.samples.append((name, started, latency, status, size, error))
+
+    def window(self):
+        return [s for s in self.samples if self.start <= s[1] and s[1] + s[2] <= self.stop]
+
+
+def request(conn, path, timeout):
+    """Send GET and read whole body, returns (status, size)."""
+    conn.timeout = timeout
+    conn.request('GET', path)
+    response = conn.getresponse()
+    body = response.read()
+    if response.getheader('Connection', '').lower() == 'close':
+        conn.close()
+    return response.status, len(body)
+
+
+def timed_request(recorder, conn, name, path, timeout):
+    started = time.monotonic()
+    status, size, error = 0, 0, None
+    try:
+        status, size = request(conn, path, timeout)
+    except (OSError, http.client.HTTPException) as e:
+        error = type(e).__name__
+        conn.close()                    # Next request reconnects
+    recorder.add(name, started, time.monotonic() - started, status, size, error)
+
+
+def client_thread(args, recorder, mix, seed, deadline):
+    rng = random.Random(seed)
+    names = [m[0] for m in mix]
+    paths = dict((m[0], m[1]) for m in mix)
+    weights = [m[2] for m in mix]
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+    while time.monotonic() < deadline:
+        name = rng.choices(names, weights)[0]
+        timed_request(recorder, conn, name, paths[name], args.timeout)
+        if not args.keep_alive:
+            conn.close()
+        if args.think:
+            time.sleep(rng.uniform(0, 2 * args.think / 1000.0))
+    conn.close()
+
+
+def burst_thread(args, recorder, burst, deadline):
+    name, path, count, interval = burst
+    next_burst = time.monotonic() + interval
+    while next_burst < deadline:
+        time.sleep(max(0.0, next_burst - time.monotonic()))
+        shots = []
+        for _ in range(count):
+            conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+            shot = threading.Thread(target=lambda c=conn: (timed_request(recorder, c, name, path, args.timeout),
+                                                             c.close()))
+            shot.start()
+            shots.append(shot)
+        for shot in shots:
+            shot.join()
+        next_burst += interval
+
+
+def percentile(sorted_values, p):
+    """Nearest-rank percentile."""
+    if not sorted_values:
+        return None
+    rank = max(1, math.ceil(p / 100.0 * len(sorted_values)))
+    return sorted_values[rank - 1]
+
+
+def summarize(samples, duration):
+    latencies = sorted(s[2] * 1000.0 for s in samples if s[5] is None)
+    statuses = {}
+    errors = {}
+    for s in samples:
+        if s[5] is None:
+            statuses[str(s[3])] = statuses.get(str(s[3]), 0) + 1
+        else:
+            errors[s[5]] = errors.get(s[5], 0) + 1
+    ok = sum(1 for s in samples if s[5] is None and s[3] < 400)
+    return {
+        'requests': len(samples),
+        'ok': ok,
+        'statuses': statuses,
+        'errors': errors,
+        'throughput_rps': round(len(samples) / duration, 3),
+        'bytes_per_s': round(sum(s[4] for s in samples) / duration, 1),
+        'latency_ms': {
+            'min': round(latencies[0], 3) if latencies else None,
+            'mean': round(sum(latencies) / len(latencies), 3) if latencies else None,
+            'p50': round(percentile(latencies, 50), 3) if latencies else None,
+            'p95': round(percentile(latencies, 95), 3) if latencies else None,
+            'p99': round(percentile(latencies, 99), 3) if latencies else None,
+            'max': round(latencies[-1], 3) if latencies else None,
+        },
+    }
+
+
+def scrape_metrics(args):
+    """Counters & gauges of /metrics after the run, histogram buckets are left out."""
+    try:
+        conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+        conn.request('GET', '/metrics')
+        response = conn.getresponse()
+        text = response.read().decode('utf-8', 'replace')
+        conn.close()
+        if response.status != 200:
+            return None
+    except (OSError, http.client.HTTPException):
+        return None
+    metrics = {}
+    for line in text.splitlines():
+        if line.startswith('#') or '_bucket{' in line or ' ' not in line:
+            continue
+        name, _, value = line.rpartition(' ')
+        try:
+            metrics[name] = float(value)
+        except ValueError:
+            pass
+    return metrics
+
+
+def wait_for_port(host, port, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection((host, port), timeout=0.5).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def spawn(args):
+    """Start simulated camera with its own flash file so every run starts from the same state."""
+    workdir = tempfile.mkdtemp(prefix='bench-cam-')
+    env = dict(os.environ)
+    env['SIM_FLASH_FILE'] = os.path.join(workdir, 'sim-flash.bin')
+    log = open(os.path.join(workdir, 'cam.log'), 'w')
+    process = subprocess.Popen([args.spawn], env=env, stdout=log, stderr=subprocess.STDOUT, cwd=workdir)
+    if not wait_for_port(args.host, args.port, 10):
+        process.kill()
+        sys.exit('%s did not start listening on %s:%d, see %s' % (args.spawn, args.host, args.port, log.name))
+    time.sleep(args.settle)               # Camera init & pre-roll ring fill after server start
+    print('Spawned %s (pid %d), log in %s' % (args.spawn, process.pid, log.name))
+    return process
+
+
+def cpu_snapshot(pid):
+    """CPU seconds used so far by every thread of process, keyed by thread id: (task name, seconds).
+    Run time of schedstat is exact, utime + stime of stat is sampled at clock tick and charges threads
+    waking often on the tick with time they did not use."""
+    ticks = float(os.sysconf('SC_CLK_TCK'))
+    threads = {}
+    try:
+        tids = os.listdir('/proc/%d/task' % pid)
+    except OSError:
+        return None
+    for tid in tids:
+        path = '/proc/%d/task/%s/' % (pid, tid)
+        try:
+            with open(path + 'stat') as f:
+                stat = f.read()
+            name = stat[stat.index('(') + 1:stat.rindex(')')]
+            if os.path.exists(path + 'schedstat'):
+                with open(path + 'schedstat') as f:
+                    seconds = int(f.read().split()[0]) / 1e9
+            else:
+                fields = stat[stat.rindex(')') + 2:].split()
+                seconds = (int(fields[11]) + int(fields[12])) / ticks
+        except OSError:
+            continue                        # Thread ended meanwhile
+        threads[tid] = (name, seconds)
+    return threads
+
+
+def cpu_usage(before, after, duration):
+    """CPU used between two snapshots, total and per task name in seconds and percent of one core."""
+    if before is None or after is None:
+        return None
+    tasks = {}
+    for tid, (name, seconds) in after.items():
+        used = seconds - before.get(tid, (name, 0.0))[1]
+        tasks[name] = tasks.get(name, 0.0) + used
+    total = sum(tasks.values())
+    return {
+        'seconds': total,
+        'core_percent': total * 100.0 / duration,
+        'tasks': dict((name, {'seconds': used, 'core_percent': used * 100.0 / duration})
+                      for name, used in tasks.items() if used > 0),
+    }
+
+
+def print_cpu(cpu):
+    print('\nServer CPU %.2f s, %.1f %% of one core' % (cpu['seconds'], cpu['core_percent']))
+    for name, used in sorted(cpu['tasks'].items(), key=lambda item: -item[1]['seconds'])[:8]:
+        print('  %-16s %7.2f s %6.1f %%' % (name, used['seconds'], used['core_percent']))
+
+
+def compare(result, baseline, tolerance):
+    """Print differences to baseline, returns False on regression."""
+    ok = True
+    print('\n%-10s %12s %12s %8s %12s %12s %8s' % ('endpoint', 'p95 base', 'p95 now', 'diff', 'rps base',
+                                                     'rps now', 'diff'))
+    for name, now in sorted(result['endpoints'].items()):
+        base = baseline.get('endpoints', {}).get(name)
+        if base is None or base['latency_ms']['p95'] is None or now['latency_ms']['p95'] is None:
+            print('%-10s no baseline' % name)
+            continue
+        p95_diff = (now['latency_ms']['p95'] - base['latency_ms']['p95']) * 100.0 / max(base['latency_ms']['p95'], 1e-9)
+        rps_diff = (now['throughput_rps'] - base['throughput_rps']) * 100.0 / max(base['throughput_rps'], 1e-9)
+        regressed = p95_diff > tolerance or rps_diff < -tolerance
+        ok = ok and not regressed
+        print('%-10s %12.1f %12.1f %+7.1f%% %12.2f %12.2f %+7.1f%%%s' % (
+            name, base['latency_ms']['p95'], now['latency_ms']['p95'], p95_diff,
+            base['throughput_rps'], now['throughput_rps'], rps_diff, '  REGRESSION' if regressed else ''))
+    if result.get('server_cpu') and baseline.get('server_cpu'):
+        print('%-10s %11.1f%% %11.1f%% %+7.1f%%' % (
+            'CPU', baseline['server_cpu']['core_percent'], result['server_cpu']['core_percent'],
+            result['server_cpu']['core_percent'] - baseline['server_cpu']['core_percent']))
+    return ok
+
+
+def print_table(result):
+    print('\n%-10s %8s %8s %8s %9s %9s %9s %9s %9s' % ('endpoint', 'reqs', 'errors', 'rps', 'mean ms',
+                                                        'p50 ms', 'p95 ms', 'p99 ms', 'max ms'))
+    rows = sorted(result['endpoints'].items()) + [('TOTAL', result['total'])]
+    for name, stats in rows:
+        lat = stats['latency_ms']
+        fmt = lambda v: '%9.1f' % v if v is not None else '%9s' % '-'
+        print('%-10s %8d %8d %8.2f %s %s %s %s %s' % (
+            name, stats['requests'], stats['requests'] - stats['ok'], stats['throughput_rps'],
+            fmt(lat['mean']), fmt(lat['p50']), fmt(lat['p95']), fmt(lat['p99']), fmt(lat['max'])))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Load & latency benchmark of the camera web server')
+    parser.add_argument('--url', default='http://localhost:8080', help='camera server (host simulation maps 80 to 8080)')
+    parser.add_argument('--clients', type=int, default=4, help='concurrent clients running the mix')
+    parser.add_argument('--duration', type=float, default=20, help='measured seconds')
+    parser.add_argument('--warmup', type=float, default=2, help='seconds of load before measuring')
+    parser.add_argument('--mix', type=parse_mix, default=parse_mix('index=20,latest=60,take=5,pir=15'),
+                        help='weighted endpoints, NAME=WEIGHT,... with names %s or paths' % ', '.join(ENDPOINTS))
+    parser.add_argument('--burst', type=parse_burst, action='append', default=[],
+                        help='ENDPOINT:COUNT:INTERVAL_MS simultaneous requests on fresh connections, repeatable')
+    parser.add_argument('--think', type=float, default=0, help='mean think time between requests of client in ms')
+    parser.add_argument('--timeout', type=float, default=15, help='socket timeout in seconds')
+    parser.add_argument('--no-keep-alive', dest='keep_alive', action='store_false',
+                        help='new connection for every request')
+    parser.add_argument('--seed', type=int, default=1, help='seed of endpoint choice, same seed same sequence')
+    parser.add_argument('--spawn', help='start this cam-sim binary for the run and stop it afterwards')
+    parser.add_argument('--settle', type=float, default=2, help='seconds to wait after spawned server listens')
+    parser.add_argument('--json', help='write results to this file')
+    parser.add_argument('--compare', help='baseline results to compare with')
+    parser.add_argument('--tolerance', type=float, default=20, help='allowed regression against baseline in percent')
+    args = parser.parse_args()
+
+    url = urllib.parse.urlparse(args.url)
+    args.host = url.hostname or 'localhost'
+    args.port = url.port or 80
+
+    process = spawn(args) if args.spawn else None
+    cpu = None
+    try:
+        recorder = Recorder()
+        began = time.monotonic()
+        recorder.start = began + args.warmup
+        recorder.stop = recorder.start + args.duration
+        threads = [threading.Thread(target=client_thread, args=(args, recorder, args.mix, args.seed + i, recorder.stop))
+                   for i in range(args.clients)]
+        threads += [threading.Thread(target=burst_thread, args=(args, recorder, burst, recorder.stop))
+                    for burst in args.burst]
+        print('Running %d clients%s for %.0f s (+%.0f s warmup) against %s:%d' % (
+            args.clients, ' and %d burst(s)' % len(args.burst) if args.burst else '', args.duration,
+            args.warmup, args.host, args.port))
+        for thread in threads:
+            thread.start()
+        if process is not None:
+            time.sleep(max(0.0, recorder.start - time.monotonic()))
+            before = cpu_snapshot(process.pid)
+            measured = time.monotonic()
+            time.sleep(max(0.0, recorder.stop - time.monotonic()))
+            cpu = cpu_usage(before, cpu_snapshot(process.pid), time.monotonic() - measured)
+        for thread in threads:
+            thread.join()
+        metrics = scrape_metrics(args)
+    finally:
+        if process is not None:
+            process.terminate()
+            process.wait()
+
+    samples = recorder.window()
+    by_endpoint = {}
+    for sample in samples:
+        by_endpoint.setdefault(sample[0], []).append(sample)
+    result = {
+        'version': RESULT_VERSION,
+        'date': datetime.datetime.now().isoformat(timespec='seconds'),
+        'target': '%s:%d' % (args.host, args.port),
+        'config': {
+            'clients': args.clients,
+            'duration_s': args.duration,
+            'warmup_s': args.warmup,
+            'mix': dict((name, weight) for name, _, weight in args.mix),
+            'bursts': ['%s:%d:%d' % (b[0], b[2], int(b[3] * 1000)) for b in args.burst],
+            'think_ms': args.think,
+            'keep_alive': args.keep_alive,
+            'seed': args.seed,
+        },
+        'endpoints': dict((name, summarize(s, args.duration)) for name, s in by_endpoint.items()),
+        'total': summarize(samples, args.duration),
+        'server_metrics': metrics,
+        'server_cpu': cpu,
+    }
+    print_table(result)
+    if cpu is not None:
+        print_cpu(cpu)
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(result, f, indent=2, sort_keys=True)
+            f.write('\n')
+        print('\nResults written to %s' % args.json)
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+        if not compare(result, baseline, args.tolerance):
+            sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,213 @@
+"""
+Compare photo send chunk sizes of the camera server over a throttled link.
+
+Usage: chunk_bench.py [--url http://localhost:8080] [--sizes 1024,4096,8192,16384,65536]
+                      [--rate 600] [--delay 5] [--requests 10] [--path /latest-photo.jpg]
+                      [--spawn host/build/cam-sim]
+
+Requests go through a local proxy that forwards the response at --rate kB/s in segments of --mss
+bytes with --delay ms added to each, and reads from the camera with a small receive buffer, so
+the server socket fills up the way it does on Wi-Fi instead of on fast loopback. Every size is
+passed as ?chunk= (HTTP_SEND_CHUNK of the firmware), sizes are measured interleaved so a drifting
+link or scene affects all of them alike.
+
+Results per size: client latency p50/p95, goodput, and server side send time from the
+cam_http_latest_send_seconds histogram (how long the photo slot or frame buffer stayed taken).
+
+Author: Roman Janiczek (xjanic25@vutbr.cz)
+"""
+import argparse
+import http.client
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.parse
+
+SERVER_HISTOGRAM = 'cam_http_latest_send_seconds'
+
+
+class ThrottledProxy:
+    """Accepts on a free local port, one upstream connection per client connection."""
+
+    def __init__(self, args):
+        self.args = args
+        self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.listener.bind(('127.0.0.1', 0))
+        self.listener.listen(8)
+        self.port = self.listener.getsockname()[1]
+        threading.Thread(target=self.accept_loop, daemon=True).start()
+
+    def accept_loop(self):
+        while True:
+            client, _ = self.listener.accept()
+            upstream = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            upstream.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, self.args.rcvbuf)
+            upstream.connect((self.args.host, self.args.port))
+            threading.Thread(target=self.pump, args=(client, upstream, False), daemon=True).start()
+            threading.Thread(target=self.pump, args=(upstream, client, True), daemon=True).start()
+
+    def pump(self, source, sink, throttle):
+        rate = self.args.rate * 1000.0
+        next_at = time.monotonic()
+        try:
+            while True:
+                data = source.recv(self.args.mss if throttle else 4096)
+                if not data:
+                    break
+                if throttle:
+                    next_at = max(next_at, time.monotonic()) + len(data) / rate + self.args.delay / 1000.0
+                    time.sleep(max(0.0, next_at - time.monotonic()))
+                sink.sendall(data)
+        except OSError:
+            pass
+        for sock in (source, sink):
+            try:
+                sock.shutdown(socket.SHUT_RDWR)
+            except OSError:
+                pass
+            sock.close()
+
+
+def get(host, port, path, timeout):
+    conn = http.client.HTTPConnection(host, port, timeout=timeout)
+    conn.request('GET', path)
+    response = conn.getresponse()
+    body = response.read()
+    conn.close()
+    return response.status, body
+
+
+def server_send_time(args):
+    """(sum seconds, count) of the server side send histogram."""
+    _, body = get(args.host, args.port, '/metrics', args.timeout)
+    values = {}
+    for line in body.decode('utf-8', 'replace').splitlines():
+        name, _, value = line.rpartition(' ')
+        if name in (SERVER_HISTOGRAM + '_sum', SERVER_HISTOGRAM + '_count'):
+            values[name] = float(value)
+    return values.get(SERVER_HISTOGRAM + '_sum', 0.0), values.get(SERVER_HISTOGRAM + '_count', 0.0)
+
+
+def ensure_photo(args):
+    """Latest photo exists only after a capture, ask for one over /pir when there is none yet."""
+    if get(args.host, args.port, '/latest-photo.jpg?size=thumb', args.timeout)[0] == 200:
+        return
+    get(args.host, args.port, '/pir', args.timeout)
+    deadline = time.monotonic() + 10
+    while time.monotonic() < deadline:
+        if get(args.host, args.port, '/latest-photo.jpg?size=thumb', args.timeout)[0] == 200:
+            return
+        time.sleep(0.2)
+    sys.exit('camera has no photo to send, motion check may reject the scene - try --path /take-photo')
+
+
+def wait_for_port(host, port, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection((host, port), timeout=0.5).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def spawn(args):
+    """Start simulated camera with its own flash file so every run starts from the same state."""
+    workdir = tempfile.mkdtemp(prefix='chunk-cam-')
+    env = dict(os.environ)
+    env['SIM_FLASH_FILE'] = os.path.join(workdir, 'sim-flash.bin')
+    log = open(os.path.join(workdir, 'cam.log'), 'w')
+    process = subprocess.Popen([os.path.abspath(args.spawn)], env=env, stdout=log, stderr=subprocess.STDOUT, cwd=workdir)
+    if not wait_for_port(args.host, args.port, 10):
+        process.kill()
+        sys.exit('%s did not start listening on %s:%d, see %s' % (args.spawn, args.host, args.port, log.name))
+    time.sleep(args.settle)
+    print('Spawned %s (pid %d), log in %s' % (args.spawn, process.pid, log.name))
+    return process
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    return sorted_values[min(len(sorted_values) - 1, int(len(sorted_values) * p / 100.0))]
+
+
+def run(args, proxy):
+    ensure_photo(args)
+    separator = '&' if '?' in args.path else '?'
+    samples = {size: [] for size in args.sizes}
+    server = {size: [0.0, 0] for size in args.sizes}
+    errors = 0
+    for _ in range(args.requests):
+        for size in args.sizes:
+            before = server_send_time(args)
+            started = time.monotonic()
+            try:
+                status, body = get('127.0.0.1', proxy.port, '%s%schunk=%d' % (args.path, separator, size), args.timeout)
+            except (OSError, http.client.HTTPException):
+                status, body = 0, b''
+            latency = time.monotonic() - started
+            after = server_send_time(args)
+            if status != 200:
+                errors += 1
+                continue
+            samples[size].append((latency, len(body)))
+            server[size][0] += after[0] - before[0]
+            server[size][1] += after[1] - before[1]
+
+    print('%d kB/s, %d B segments, +%g ms per segment, %d B upstream receive buffer, %s' % (
+        args.rate, args.mss, args.delay, args.rcvbuf, args.path))
+    print('%8s %9s %9s %10s %14s' % ('chunk', 'p50 ms', 'p95 ms', 'kB/s', 'server send ms'))
+    for size in args.sizes:
+        latencies = sorted(latency * 1000 for latency, _ in samples[size])
+        total = sum(latency for latency, _ in samples[size])
+        goodput = sum(length for _, length in samples[size]) / total / 1000 if total else 0.0
+        send_ms = server[size][0] / server[size][1] * 1000 if server[size][1] else 0.0
+        print('%8d %9.1f %9.1f %10.1f %14.1f' % (size, percentile(latencies, 50), percentile(latencies, 95),
+                                                 goodput, send_ms))
+    return errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare photo send chunk sizes over a throttled link')
+    parser.add_argument('--url', default='http://localhost:8080', help='camera server (host simulation maps 80 to 8080)')
+    parser.add_argument('--sizes', default='1024,4096,8192,16384,65536', help='comma separated ?chunk= values')
+    parser.add_argument('--path', default='/latest-photo.jpg', help='photo endpoint, /take-photo includes capture')
+    parser.add_argument('--requests', type=int, default=10, help='requests per chunk size')
+    parser.add_argument('--rate', type=float, default=600, help='link rate in kB/s')
+    parser.add_argument('--mss', type=int, default=1460, help='bytes forwarded at once')
+    parser.add_argument('--delay', type=float, default=0, help='ms added to every forwarded segment')
+    parser.add_argument('--rcvbuf', type=int, default=8192, help='receive buffer of proxy socket towards camera')
+    parser.add_argument('--timeout', type=float, default=30, help='HTTP timeout in seconds')
+    parser.add_argument('--spawn', help='start this cam-sim binary for the run and stop it afterwards')
+    parser.add_argument('--settle', type=float, default=2, help='seconds to wait after spawned server listens')
+    args = parser.parse_args()
+
+    url = urllib.parse.urlparse(args.url)
+    args.host = url.hostname or 'localhost'
+    args.port = url.port or 80
+    try:
+        args.sizes = [int(size) for size in args.sizes.split(',')]
+    except ValueError:
+        parser.error('--sizes is a comma separated list of bytes')
+
+    process = spawn(args) if args.spawn else None
+    try:
+        errors = run(args, ThrottledProxy(args))
+    finally:
+        if process is not None:
+            process.terminate()
+            process.wait()
+    if errors:
+        print('%d request(s) failed' % errors)
+    sys.exit(1 if errors else 0)
+
+
+if __name__ == '__main__':
+    main()
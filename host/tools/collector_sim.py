@@ -0,0 +1,269 @@
+"""
+Stand-in photo collector for the camera uploader, with injected latency and failures.
+
+Usage: collector_sim.py [--listen 9000] [--latency 200] [--fail 0.2] [--drop 0.1]
+                        [--url http://localhost:8080] [--triggers 10] [--gap 3000]
+                        [--spawn host/build/cam-sim]
+
+Accepts multipart/form-data POSTs on /upload the way UPLOAD_URL of the firmware sends them: a
+"metadata" JSON part followed by one "photo" part per archived event. Every request waits
+--latency ms, then --fail of them get 503 and --drop of them are closed without answer, so the
+camera has to retry with backoff. cam-sim must be built with -DSIM_UPLOAD_URL pointing here,
+cam-upload-sim of the host build already posts to the default --listen port.
+
+With --triggers the camera is asked for that many captures over /pir, --gap ms apart (each as
+its own node so the per-node rate limit stays out of the way), and after --drain seconds every
+photo listed by /events must have arrived exactly once with the same bytes as /photos/<id>.jpg.
+Exit code 1 when any check fails.
+
+Author: Roman Janiczek (xjanic25@vutbr.cz)
+"""
+import argparse
+import http.client
+import http.server
+import json
+import os
+import random
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.parse
+
+
+class Collector:
+    """Photos received so far, shared by handler threads."""
+
+    def __init__(self, args):
+        self.args = args
+        self.random = random.Random(args.seed)
+        self.lock = threading.Lock()
+        self.photos = {}                # event id -> list of received bodies
+        self.batches = []               # photos per accepted request
+        self.requests = 0
+        self.failed = 0
+        self.dropped = 0
+        self.malformed = 0
+
+    def outcome(self):
+        with self.lock:
+            self.requests += 1
+            roll = self.random.random()
+            if roll < self.args.drop:
+                self.dropped += 1
+                return 'drop'
+            if roll < self.args.drop + self.args.fail:
+                self.failed += 1
+                return 'fail'
+            return 'accept'
+
+    def accept(self, metadata, photos):
+        with self.lock:
+            self.batches.append(len(photos))
+            for event_id, data in photos:
+                self.photos.setdefault(event_id, []).append(data)
+        print('batch of %d: %s' % (len(photos), ', '.join(
+            '%d (%d B)' % (entry['event'], entry['size']) for entry in metadata['photos'])))
+
+
+def parse_multipart(content_type, body):
+    """(metadata dict, [(event id, jpeg bytes)]) of upload request, ValueError when malformed."""
+    params = dict(part.strip().split('=', 1) for part in content_type.split(';')[1:] if '=' in part)
+    boundary = params.get('boundary', '').strip('"').encode()
+    if not content_type.startswith('multipart/form-data') or not boundary:
+        raise ValueError('not multipart/form-data')
+    parts = body.split(b'--' + boundary)
+    if parts[0] != b'' or not parts[-1].startswith(b'--'):
+        raise ValueError('bad boundaries')
+    metadata, photos = None, []
+    for part in parts[1:-1]:
+        head, _, data = part.partition(b'\r\n\r\n')
+        if not part.startswith(b'\r\n') or not data.endswith(b'\r\n'):
+            raise ValueError('bad part framing')
+        data = data[:-2]
+        head = head.decode('utf-8', 'replace')
+        if 'name="metadata"' in head:
+            metadata = json.loads(data)
+        elif 'name="photo"' in head:
+            filename = head.split('filename="', 1)[1].split('"', 1)[0]
+            photos.append((int(filename[len('event-'):-len('.jpg')]), data))
+    if metadata is None:
+        raise ValueError('no metadata part')
+    listed = [(entry['event'], entry['size']) for entry in metadata['photos']]
+    if listed != [(event_id, len(data)) for event_id, data in photos]:
+        raise ValueError('metadata does not match photos')
+    if any(not data.startswith(b'\xff\xd8') or not data.endswith(b'\xff\xd9') for _, data in photos):
+        raise ValueError('photo is not a whole JPEG')
+    return metadata, photos
+
+
+def make_handler(collector):
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = 'HTTP/1.1'
+
+        def do_POST(self):
+            body = self.rfile.read(int(self.headers.get('Content-Length', 0)))
+            time.sleep(collector.args.latency / 1000.0)
+            outcome = collector.outcome()
+            if outcome == 'drop':
+                self.close_connection = True
+                self.connection.shutdown(socket.SHUT_RDWR)
+                return
+            if outcome == 'fail':
+                self.answer(503, b'injected failure')
+                return
+            try:
+                metadata, photos = parse_multipart(self.headers.get('Content-Type', ''), body)
+            except (ValueError, KeyError, IndexError) as error:
+                with collector.lock:
+                    collector.malformed += 1
+                print('malformed upload: %s' % error)
+                self.answer(400, str(error).encode())
+                return
+            collector.accept(metadata, photos)
+            self.answer(200, b'ok')
+
+        def answer(self, status, body):
+            self.send_response(status)
+            self.send_header('Content-Type', 'text/plain')
+            self.send_header('Content-Length', str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def log_message(self, format, *args):
+            pass
+
+    return Handler
+
+
+def get(args, path):
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+    conn.request('GET', path)
+    response = conn.getresponse()
+    body = response.read()
+    conn.close()
+    return response.status, body
+
+
+def wait_for_port(host, port, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection((host, port), timeout=0.5).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def spawn(args):
+    """Start simulated camera with its own flash file so every run starts from the same state."""
+    workdir = tempfile.mkdtemp(prefix='collector-cam-')
+    env = dict(os.environ)
+    env['SIM_FLASH_FILE'] = os.path.join(workdir, 'sim-flash.bin')
+    log = open(os.path.join(workdir, 'cam.log'), 'w')
+    process = subprocess.Popen([os.path.abspath(args.spawn)], env=env, stdout=log, stderr=subprocess.STDOUT, cwd=workdir)
+    if not wait_for_port(args.host, args.port, 10):
+        process.kill()
+        sys.exit('%s did not start listening on %s:%d, see %s' % (args.spawn, args.host, args.port, log.name))
+    time.sleep(args.settle)
+    print('Spawned %s (pid %d), log in %s' % (args.spawn, process.pid, log.name))
+    return process
+
+
+def run(args, collector):
+    """Fire triggers, wait for uploads to drain and compare collector with camera archive."""
+    for k in range(args.triggers):
+        # Own node id per trigger, so the per-node rate limit does not turn them away
+        status, _ = get(args, '/pir?node=%04x' % (0xC000 + k))
+        print('trigger %d: HTTP %d' % (k + 1, status))
+        time.sleep(args.gap / 1000.0)
+
+    failures = []
+    deadline = time.monotonic() + args.drain
+    while True:
+        archived = [entry['id'] for entry in json.loads(get(args, '/events')[1])]
+        with collector.lock:
+            waiting = [event_id for event_id in archived if event_id not in collector.photos]
+        if not waiting or time.monotonic() > deadline:
+            break
+        time.sleep(0.5)
+    if not archived:
+        failures.append('camera archived no photos')
+    if waiting:
+        failures.append('%d archived photo(s) never uploaded: %s' % (len(waiting), waiting))
+    with collector.lock:
+        received = dict(collector.photos)
+    for event_id in archived:
+        copies = received.get(event_id, [])
+        if len(copies) > 1:
+            failures.append('photo %d uploaded %d times' % (event_id, len(copies)))
+        if copies and copies[0] != get(args, '/photos/%d.jpg' % event_id)[1]:
+            failures.append('photo %d differs from archived one' % event_id)
+    if collector.malformed:
+        failures.append('%d malformed upload(s)' % collector.malformed)
+
+    _, body = get(args, '/metrics')
+    counters = {}
+    for line in body.decode('utf-8', 'replace').splitlines():
+        name, _, value = line.rpartition(' ')
+        if name.startswith('cam_upload_') and '_bucket' not in name:
+            counters[name] = value
+    print('collector: %d request(s), %d failed, %d dropped, %d batch(es) of %s photos' % (
+        collector.requests, collector.failed, collector.dropped, len(collector.batches), collector.batches))
+    print('camera: %s' % ', '.join('%s %s' % item for item in sorted(counters.items())))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Stand-in photo collector with injected latency and failures')
+    parser.add_argument('--listen', type=int, default=9000, help='port of collector, camera posts to /upload')
+    parser.add_argument('--latency', type=float, default=0, help='ms before every answer')
+    parser.add_argument('--fail', type=float, default=0, help='fraction of requests answered 503')
+    parser.add_argument('--drop', type=float, default=0, help='fraction of requests closed without answer')
+    parser.add_argument('--seed', type=int, default=1, help='seed of injected failures')
+    parser.add_argument('--url', default='http://localhost:8080', help='camera server (host simulation maps 80 to 8080)')
+    parser.add_argument('--triggers', type=int, default=0, help='captures to request, 0 only collects')
+    parser.add_argument('--gap', type=float, default=3000, help='ms between triggers')
+    parser.add_argument('--drain', type=float, default=60, help='seconds to wait for uploads after last trigger')
+    parser.add_argument('--timeout', type=float, default=10, help='HTTP timeout in seconds')
+    parser.add_argument('--spawn', help='start this cam-sim binary for the run and stop it afterwards')
+    parser.add_argument('--settle', type=float, default=2, help='seconds to wait after spawned server listens')
+    args = parser.parse_args()
+
+    url = urllib.parse.urlparse(args.url)
+    args.host = url.hostname or 'localhost'
+    args.port = url.port or 80
+    if args.fail + args.drop >= 1:
+        parser.error('--fail and --drop leave no request to accept')
+
+    collector = Collector(args)
+    server = http.server.ThreadingHTTPServer(('127.0.0.1', args.listen), make_handler(collector))
+    server.daemon_threads = True
+    if not args.triggers:
+        print('Collecting on http://127.0.0.1:%d/upload, Ctrl+C to stop' % args.listen)
+        try:
+            server.serve_forever()
+        except KeyboardInterrupt:
+            pass
+        return
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+
+    process = spawn(args) if args.spawn else None
+    try:
+        failures = run(args, collector)
+    finally:
+        if process is not None:
+            process.terminate()
+            process.wait()
+        server.shutdown()
+    for failure in failures:
+        print('FAIL: %s' % failure)
+    print('OK' if not failures else '%d check(s) failed' % len(failures))
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,269 @@
+"""
+Fan-in simulation of many PIR sensor nodes triggering one camera.
+
+Usage: fanin_sim.py [--url http://localhost:8080] [--nodes 40] [--intrusions 5] [--gap 4000]
+                    [--spread 300] [--http 0.2] [--chatter 1] [--spawn host/build/cam-sim]
+
+Every virtual node speaks the UDP trigger protocol (common/trigger_proto.h) the way security-pir
+does: event datagram, 30 ms ack timeout, 4 retransmissions, then HTTP /pir?node=<id> fallback.
+--http makes that fraction of nodes use HTTP only. An intrusion is --fanout of the nodes firing
+within --spread ms, intrusions are --gap ms apart (longer than the camera coalesce window), so
+each one must become a single capture episode. --chatter nodes also fire every --chatter-interval
+ms for the whole run like a broken sensor, the camera must rate limit them and nobody else.
+
+Checks, exit code 1 when any fails:
+  - every trigger was answered (UDP ack, HTTP 202 or 429)
+  - nodes of one intrusion ended up in one episode, different from the previous intrusion
+  - chatter nodes were rate limited, healthy nodes were not
+  - /nodes lists every node that fired, unless the table is full and reports evictions
+
+Author: Roman Janiczek (xjanic25@vutbr.cz)
+"""
+import argparse
+import http.client
+import json
+import os
+import random
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.parse
+
+TRIGGER_MAGIC = 0x5452
+TRIGGER_VERSION = 1
+TRIGGER_MSG_EVENT = 1
+TRIGGER_MSG_ACK = 2
+TRIGGER_FLAG_MOTION = 0x0001
+TRIGGER_FLAG_RETRY = 0x0002
+TRIGGER_FORMAT = '>HBBHHIq'             # 20 bytes, big endian like trigger_encode
+TRIGGER_ACK_TIMEOUT = 0.030
+TRIGGER_RETRIES = 4
+
+HEALTHY_BASE = 0x1000                  # Node ids of virtual nodes, never NODE_ID_ANONYMOUS (0)
+CHATTER_BASE = 0xBAD0
+
+
+class Node:
+    """One virtual sensor node, fire() is called from scheduler threads."""
+
+    def __init__(self, args, node_id, use_http):
+        self.args = args
+        self.node_id = node_id
+        self.use_http = use_http
+        self.seq = 0
+        self.lock = threading.Lock()
+        self.results = []               # (path, latency seconds, answered)
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.settimeout(TRIGGER_ACK_TIMEOUT)
+
+    def fire(self):
+        with self.lock:
+            self.seq += 1
+            start = time.monotonic()
+            if not self.use_http and self.send_udp():
+                self.results.append(('udp', time.monotonic() - start, True))
+                return
+            answered = self.send_http()
+            self.results.append(('http', time.monotonic() - start, answered))
+
+    def send_udp(self):
+        timestamp = int(time.monotonic() * 1e6)
+        for attempt in range(TRIGGER_RETRIES + 1):
+            flags = TRIGGER_FLAG_MOTION | (TRIGGER_FLAG_RETRY if attempt > 0 else 0)
+            self.sock.sendto(struct.pack(TRIGGER_FORMAT, TRIGGER_MAGIC, TRIGGER_VERSION, TRIGGER_MSG_EVENT,
+                                         self.node_id, flags, self.seq, timestamp),
+                             (self.args.host, self.args.trigger_port))
+            deadline = time.monotonic() + TRIGGER_ACK_TIMEOUT
+            while time.monotonic() < deadline:
+                try:
+                    data = self.sock.recv(64)
+                except socket.timeout:
+                    break
+                if len(data) != struct.calcsize(TRIGGER_FORMAT):
+                    continue
+                magic, version, kind, node_id, _, seq, _ = struct.unpack(TRIGGER_FORMAT, data)
+                if (magic, version, kind, node_id, seq) == (TRIGGER_MAGIC, TRIGGER_VERSION, TRIGGER_MSG_ACK,
+                                                            self.node_id, self.seq):
+                    return True
+        return False
+
+    def send_http(self):
+        try:
+            conn = http.client.HTTPConnection(self.args.host, self.args.port, timeout=self.args.timeout)
+            conn.request('GET', '/pir?node=%04x' % self.node_id)
+            response = conn.getresponse()
+            response.read()
+            conn.close()
+            return response.status in (202, 429)
+        except OSError:
+            return False
+
+
+def get_json(args, path):
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+    conn.request('GET', path)
+    response = conn.getresponse()
+    body = response.read()
+    conn.close()
+    return json.loads(body)
+
+
+def fire_at(node, at):
+    delay = at - time.monotonic()
+    if delay > 0:
+        time.sleep(delay)
+    node.fire()
+
+
+def chatter_thread(node, interval, stop):
+    at = time.monotonic()
+    while at < stop:
+        fire_at(node, at)
+        at += interval
+
+
+def wait_for_port(host, port, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection((host, port), timeout=0.5).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def spawn(args):
+    """Start simulated camera with its own flash file so every run starts from the same state."""
+    workdir = tempfile.mkdtemp(prefix='fanin-cam-')
+    env = dict(os.environ)
+    env['SIM_FLASH_FILE'] = os.path.join(workdir, 'sim-flash.bin')
+    log = open(os.path.join(workdir, 'cam.log'), 'w')
+    process = subprocess.Popen([os.path.abspath(args.spawn)], env=env, stdout=log, stderr=subprocess.STDOUT, cwd=workdir)
+    if not wait_for_port(args.host, args.port, 10):
+        process.kill()
+        sys.exit('%s did not start listening on %s:%d, see %s' % (args.spawn, args.host, args.port, log.name))
+    time.sleep(args.settle)
+    print('Spawned %s (pid %d), log in %s' % (args.spawn, process.pid, log.name))
+    return process
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    return sorted_values[min(len(sorted_values) - 1, int(len(sorted_values) * p / 100.0))]
+
+
+def run(args):
+    rnd = random.Random(args.seed)
+    healthy = [Node(args, HEALTHY_BASE + i, rnd.random() < args.http) for i in range(args.nodes)]
+    chatter = [Node(args, CHATTER_BASE + i, False) for i in range(args.chatter)]
+    failures = []
+
+    begin = time.monotonic() + 0.5
+    stop = begin + args.intrusions * args.gap / 1000.0
+    threads = [threading.Thread(target=chatter_thread, args=(node, args.chatter_interval / 1000.0, stop))
+               for node in chatter]
+    for thread in threads:
+        thread.start()
+
+    previous_episode = None
+    print('%d nodes (%d over HTTP), %d chatter node(s), %d intrusion(s) %d ms apart' % (
+        len(healthy), sum(node.use_http for node in healthy), len(chatter), args.intrusions, args.gap))
+    for k in range(args.intrusions):
+        at = begin + k * args.gap / 1000.0
+        fired = rnd.sample(healthy, max(1, int(round(len(healthy) * args.fanout))))
+        firing = [threading.Thread(target=fire_at, args=(node, at + rnd.uniform(0, args.spread / 1000.0)))
+                  for node in fired]
+        for thread in firing:
+            thread.start()
+        for thread in firing:
+            thread.join()
+        # Look at the table before the next intrusion starts
+        time.sleep(max(0.0, at + (args.spread + (args.gap - args.spread) / 2) / 1000.0 - time.monotonic()))
+        table = {int(entry['node'], 16): entry for entry in get_json(args, '/nodes')['nodes']}
+        episodes = set(table[node.node_id]['last_episode'] for node in fired if node.node_id in table)
+        missing = [node for node in fired if node.node_id not in table]
+        episode = episodes.pop() if len(episodes) == 1 else None
+        ok = episode is not None and not missing and episode != previous_episode
+        print('intrusion %d: %d nodes -> episode %s%s' % (
+            k + 1, len(fired), episode if episode is not None else sorted(episodes | {episode} - {None}),
+            '' if ok else '  FAIL'))
+        if not ok:
+            failures.append('intrusion %d was not one new episode' % (k + 1))
+        previous_episode = episode
+    for thread in threads:
+        thread.join()
+
+    nodes = get_json(args, '/nodes')
+    status = get_json(args, '/status')
+    table = {int(entry['node'], 16): entry for entry in nodes['nodes']}
+    results = [result for node in healthy + chatter for result in node.results]
+    unanswered = sum(1 for result in results if not result[2])
+    if unanswered:
+        failures.append('%d trigger(s) not answered' % unanswered)
+    for path in ('udp', 'http'):
+        latencies = sorted(result[1] * 1000 for result in results if result[0] == path)
+        if latencies:
+            print('%-4s triggers %4d  ack p50 %7.1f ms  p99 %7.1f ms  max %7.1f ms' % (
+                path, len(latencies), percentile(latencies, 50), percentile(latencies, 99), latencies[-1]))
+    for node in chatter:
+        entry = table.get(node.node_id)
+        print('chatter node %04x: %s' % (node.node_id, json.dumps(entry)))
+        if entry is None or entry['limited'] == 0:
+            failures.append('chatter node %04x was not rate limited' % node.node_id)
+    limited = [node for node in healthy if table.get(node.node_id, {}).get('limited', 0) > 0]
+    if limited:
+        failures.append('%d healthy node(s) rate limited' % len(limited))
+    expected = sum(1 for node in healthy + chatter if node.results)
+    if len(table) < expected and nodes['evicted'] == 0:
+        failures.append('/nodes lists %d of %d nodes without evictions' % (len(table), expected))
+    print('camera: %d triggers, %d merged, %d limited, %d dropped, %d captured; %d nodes listed, %d evicted' % (
+        status['requested'], status['merged'], status['limited'], status['dropped'], status['captured'],
+        len(table), nodes['evicted']))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Fan-in simulation of many PIR nodes triggering one camera')
+    parser.add_argument('--url', default='http://localhost:8080', help='camera server (host simulation maps 80 to 8080)')
+    parser.add_argument('--trigger-port', type=int, default=3333, help='UDP trigger port of camera')
+    parser.add_argument('--nodes', type=int, default=40, help='healthy virtual nodes')
+    parser.add_argument('--intrusions', type=int, default=5, help='simultaneous triggers of many nodes')
+    parser.add_argument('--gap', type=float, default=4000, help='ms between intrusions')
+    parser.add_argument('--spread', type=float, default=300, help='ms over which nodes of one intrusion fire')
+    parser.add_argument('--fanout', type=float, default=1.0, help='fraction of nodes firing in each intrusion')
+    parser.add_argument('--http', type=float, default=0.2, help='fraction of nodes using HTTP /pir only')
+    parser.add_argument('--chatter', type=int, default=1, help='broken nodes firing all the time')
+    parser.add_argument('--chatter-interval', type=float, default=700, help='ms between triggers of chatter node')
+    parser.add_argument('--timeout', type=float, default=10, help='HTTP timeout in seconds')
+    parser.add_argument('--seed', type=int, default=1, help='seed of node choice & firing offsets')
+    parser.add_argument('--spawn', help='start this cam-sim binary for the run and stop it afterwards')
+    parser.add_argument('--settle', type=float, default=2, help='seconds to wait after spawned server listens')
+    args = parser.parse_args()
+
+    url = urllib.parse.urlparse(args.url)
+    args.host = url.hostname or 'localhost'
+    args.port = url.port or 80
+    if args.spread >= args.gap:
+        parser.error('--spread must be shorter than --gap')
+
+    process = spawn(args) if args.spawn else None
+    try:
+        failures = run(args)
+    finally:
+        if process is not None:
+            process.terminate()
+            process.wait()
+    for failure in failures:
+        print('FAIL: %s' % failure)
+    print('OK' if not failures else '%d check(s) failed' % len(failures))
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
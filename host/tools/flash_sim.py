@@ -0,0 +1,143 @@
+"""
+Flash policy check of cam-sim under bright, dark and changing ambient light.
+
+Usage: flash_sim.py [--cam host/build/cam-sim] [--captures 6] [--interval 2.5] [--tau 40]
+
+Every scenario starts cam-sim with SIM_AMBIENT_LUX (and SIM_AMBIENT_PERIOD_MS for the changing one),
+waits for the light to be sampled and alternates /take-photo and /pir captures --interval seconds
+apart. Flash counters, settle wait and trigger-to-frame latency are read from /metrics afterwards.
+--tau is the time constant of the simulated AEC (SIM_AEC_TAU_MS), settle wait follows it in steps of
+burst frames.
+
+Checks, exit code 1 when any fails:
+  - bright scene never lights flash
+  - dark scene lights flash for every capture and measures its settle time
+  - changing scene both lights and skips flash
+  - no flash exposure timed out
+
+Author: Roman Janiczek (xjanic25@vutbr.cz)
+"""
+import argparse
+import http.client
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+FIXED_WAIT_MS = 250     # FLASH_SETTLE_DEFAULT_MS, the wait every capture had before flash policy
+SETTLE_MIN_MS = 50      # FLASH_SETTLE_MIN_MS
+SCENARIOS = [
+    # name, SIM_AMBIENT_LUX, SIM_AMBIENT_PERIOD_MS
+    ('bright', '300', None),
+    ('dark', '1', None),
+    ('changing', '300,1', '6000'),
+]
+
+
+def wait_for_port(port, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection(('localhost', port), timeout=0.5).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def get(port, path):
+    conn = http.client.HTTPConnection('localhost', port, timeout=10)
+    conn.request('GET', path)
+    response = conn.getresponse()
+    body = response.read()
+    conn.close()
+    return response.status, body
+
+
+def metrics(port):
+    values = {}
+    for line in get(port, '/metrics')[1].decode().splitlines():
+        if line and not line.startswith('#'):
+            name, value = line.rsplit(' ', 1)
+            values[name] = float(value)
+    return values
+
+
+def run(args, workdir, name, lux, period):
+    env = {'SIM_FLASH_FILE': os.path.join(workdir, name + '-flash.bin'), 'SIM_AMBIENT_LUX': lux,
+           'SIM_AEC_TAU_MS': str(args.tau)}
+    if period is not None:
+        env['SIM_AMBIENT_PERIOD_MS'] = period
+    log_path = os.path.join(workdir, name + '.log')
+    cam = subprocess.Popen([os.path.abspath(args.cam)], env=dict(os.environ, **env), cwd=workdir,
+                           stdout=open(log_path, 'w'), stderr=subprocess.STDOUT)
+    try:
+        if not wait_for_port(args.port, 10):
+            sys.exit('cam-sim did not start listening on %d, see %s' % (args.port, log_path))
+        # Pre-roll frames tell the camera how bright the scene is
+        time.sleep(2)
+        for i in range(args.captures):
+            path = '/take-photo' if i % 2 == 0 else '/pir?node=1'
+            status, _ = get(args.port, path)
+            if status not in (200, 202):
+                print('%s: %s answered %d' % (name, path, status))
+            time.sleep(args.interval)
+        return metrics(args.port)
+    finally:
+        cam.terminate()
+        cam.wait()
+
+
+def check(name, values, captures):
+    used = int(values.get('cam_flash_used_total', 0))
+    skipped = int(values.get('cam_flash_skipped_total', 0))
+    timeouts = int(values.get('cam_flash_settle_timeouts_total', 0))
+    settle = values.get('cam_flash_settle_milliseconds', 0)
+    frames = values.get('cam_trigger_to_frame_seconds_count', 0)
+    latency = values.get('cam_trigger_to_frame_seconds_sum', 0) / frames * 1000 if frames else 0
+    saved = values.get('cam_flash_wait_saved_milliseconds_total', 0)
+    print('%-9s flash %d/%d, settle %4d ms (fixed %d), trigger -> frame avg %6.1f ms, wait saved %5d ms, '
+          'exposure index %d' % (name, used, used + skipped, settle, FIXED_WAIT_MS, latency, saved,
+                                 values.get('cam_light_exposure_index', 0)))
+
+    failures = []
+    if used + skipped < captures:
+        failures.append('%s: only %d of %d captures decided flash' % (name, used + skipped, captures))
+    if name == 'bright' and used:
+        failures.append('bright: flash lit %d times' % used)
+    if name == 'dark' and skipped:
+        failures.append('dark: flash skipped %d times' % skipped)
+    # Measured settle time never lands exactly on the default wait, burst frames are never at flash on
+    if name == 'dark' and (settle == FIXED_WAIT_MS or settle < SETTLE_MIN_MS):
+        failures.append('dark: settle wait %d ms was not measured' % settle)
+    if name == 'changing' and (not used or not skipped):
+        failures.append('changing: flash lit %d and skipped %d times, expected both' % (used, skipped))
+    if timeouts:
+        failures.append('%s: %d flash exposure(s) did not settle' % (name, timeouts))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Flash policy check under bright, dark and changing light')
+    parser.add_argument('--cam', default='host/build/cam-sim', help='cam-sim binary')
+    parser.add_argument('--captures', type=int, default=6, help='captures per scenario')
+    parser.add_argument('--interval', type=float, default=2.5, help='seconds between captures')
+    parser.add_argument('--tau', type=int, default=40, help='ms time constant of simulated sensor AEC')
+    parser.add_argument('--port', type=int, default=8080, help='camera server (host simulation maps 80 to 8080)')
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp(prefix='flash-sim-')
+    print('logs in %s' % workdir)
+    failures = []
+    for name, lux, period in SCENARIOS:
+        failures += check(name, run(args, workdir, name, lux, period), args.captures)
+    for failure in failures:
+        print('FAIL: %s' % failure)
+    print('OK' if not failures else '%d check(s) failed' % len(failures))
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
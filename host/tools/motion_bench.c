@@ -0,0 +1,198 @@
+/**
+ * @file motion_bench.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Motion check cost & scores on recorded frames - 1/8 decode, background compare and learn
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * Usage: motion_bench [frames_dir] [rounds]
+ *
+ * Frames are all *.jpg files of frames_dir (default SIM_FRAMES_DIR) in name order, e.g. recorded by
+ * record_frames.py. Every round plays them in order through the same steps as motion_check of the
+ * camera: decode at 1/8 scale to grayscale, score against background, learn every MOTION_LEARN_EVERY
+ * frame. Prints decode and compare time per frame and how many frames would keep their photo.
+ * Fails when a frame can not be decoded.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <esp_jpg_decode.h>
+#include "motion_detect.h"
+
+// Same as MOTION_* of security-cam main.c
+#define MOTION_MAX_PIXELS       (200 * 150)
+#define MOTION_BLOCK_THRESHOLD  20
+#define MOTION_MIN_CHANGE       15
+#define MOTION_LEARN_SHIFT      3
+#define MOTION_LEARN_EVERY      4
+
+#define MAX_FRAMES              256
+#define DEFAULT_ROUNDS          20
+
+typedef struct {
+    uint8_t *jpg;
+    size_t len;
+} frame_t;
+
+typedef struct {
+    const frame_t *frame;
+    uint8_t *out;
+    size_t width;
+    size_t height;
+} decode_t;
+
+static frame_t frames[MAX_FRAMES];
+static uint8_t gray[MOTION_MAX_PIXELS];
+static uint8_t background[MOTION_MAX_PIXELS];
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @return number of frames loaded
+ */
+static size_t load_frames(const char *dir_path) {
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        return 0;
+    }
+    char *names[MAX_FRAMES];
+    size_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && count < MAX_FRAMES) {
+        size_t len = strlen(entry->d_name);
+        if (len > 4 && strcmp(entry->d_name + len - 4, ".jpg") == 0) {
+            names[count++] = strdup(entry->d_name);
+        }
+    }
+    closedir(dir);
+    qsort(names, count, sizeof(names[0]), compare_names);
+
+    size_t loaded = 0;
+    for (size_t i = 0; i < count; i++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, names[i]);
+        free(names[i]);
+        FILE *file = fopen(path, "rb");
+        if (file == NULL) {
+            continue;
+        }
+        fseek(file, 0, SEEK_END);
+        long len = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        uint8_t *jpg = len > 0 ? malloc(len) : NULL;
+        if (jpg != NULL && fread(jpg, 1, len, file) == (size_t)len) {
+            frames[loaded].jpg = jpg;
+            frames[loaded].len = len;
+            loaded++;
+        } else {
+            free(jpg);
+        }
+        fclose(file);
+    }
+    return loaded;
+}
+
+static size_t read_jpg(void *arg, size_t index, uint8_t *buf, size_t len) {
+    decode_t *decode = arg;
+    if (index + len > decode->frame->len) {
+        len = decode->frame->len - index;
+    }
+    if (buf != NULL) {
+        memcpy(buf, decode->frame->jpg + index, len);
+    }
+    return len;
+}
+
+/**
+ * @brief Luma of RGB888 block, same weights as motion_gray_write of the camera
+ */
+static bool write_gray(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+    decode_t *decode = arg;
+    if (data == NULL) {
+        if (x == 0 && y == 0) {
+            decode->width = w;
+            decode->height = h;
+        }
+        return decode->width * decode->height <= MOTION_MAX_PIXELS;
+    }
+    for (uint16_t row = 0; row < h; row++) {
+        uint8_t *out = decode->out + (y + row) * decode->width + x;
+        for (uint16_t col = 0; col < w; col++, data += 3) {
+            *out++ = (77 * data[0] + 150 * data[1] + 29 * data[2]) >> 8;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *dir_path = argc > 1 ? argv[1] : getenv("SIM_FRAMES_DIR");
+    unsigned rounds = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : DEFAULT_ROUNDS;
+    if (dir_path == NULL || rounds == 0) {
+        fprintf(stderr, "Usage: %s [frames_dir] [rounds]\n", argv[0]);
+        return 2;
+    }
+    size_t count = load_frames(dir_path);
+    if (count == 0) {
+        fprintf(stderr, "No JPEG frames in %s\n", dir_path);
+        return 1;
+    }
+
+    motion_detect_t motion;
+    motion_detect_init(&motion, background, sizeof(background), MOTION_BLOCK_THRESHOLD, MOTION_LEARN_SHIFT);
+    double decode_time = 0;
+    double compare_time = 0;
+    double decode_max = 0;
+    unsigned scored = 0;
+    unsigned kept = 0;
+    int score_max = 0;
+    size_t width = 0;
+    size_t height = 0;
+    for (unsigned round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < count; i++) {
+            decode_t decode = {.frame = &frames[i], .out = gray};
+            double start = now_s();
+            if (esp_jpg_decode(frames[i].len, JPG_SCALE_8X, read_jpg, write_gray, &decode) != ESP_OK) {
+                fprintf(stderr, "Frame %zu could not be decoded at 1/8 scale\n", i);
+                return 1;
+            }
+            double decoded = now_s();
+            int score = motion_detect_score(&motion, gray, decode.width, decode.height);
+            if ((round * count + i) % MOTION_LEARN_EVERY == 0) {
+                motion_detect_learn(&motion, gray, decode.width, decode.height);
+            }
+            double done = now_s();
+
+            decode_time += decoded - start;
+            compare_time += done - decoded;
+            decode_max = decoded - start > decode_max ? decoded - start : decode_max;
+            width = decode.width;
+            height = decode.height;
+            if (score >= 0) {
+                scored++;
+                kept += score >= MOTION_MIN_CHANGE;
+                score_max = score > score_max ? score : score_max;
+            }
+        }
+    }
+    unsigned total = rounds * count;
+    printf("frames:   %zu from %s, %u rounds, decoded at %zux%zu\n", count, dir_path, rounds, width, height);
+    printf("decode:   %.0f us per frame, max %.0f us\n", decode_time * 1e6 / total, decode_max * 1e6);
+    printf("compare:  %.1f us per frame (score and learn every %d)\n", compare_time * 1e6 / total,
+           MOTION_LEARN_EVERY);
+    printf("scores:   %u of %u frames would keep photo (>= %d per mille), max %d per mille\n", kept, scored,
+           MOTION_MIN_CHANGE, score_max);
+    return 0;
+}
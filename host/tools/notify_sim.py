@@ -0,0 +1,286 @@
+"""
+Fan-out load of /notify - many Server-Sent Events subscribers on cam-sim, latency & notify task CPU.
+
+Usage: notify_sim.py [--spawn host/build/cam-sim] [--subscribers 1,4] [--cap 2] [--events 10] [--gap 1.6]
+
+Every run opens --subscribers connections to /notify of the stream server one after another, the
+ones over the camera limit (--cap, NOTIFY_MAX_CLIENTS of the build) must get 503. Then --events PIR
+triggers from distinct nodes come --gap seconds apart (longer than the coalesce window), so each
+one is a new capture. All subscribers are read by one selector loop, every capture event gets the
+host time it arrived at each subscriber. The capture timestamp of the event is mapped onto host
+CLOCK_MONOTONIC by the Clock line of the spawned cam-sim log (like sync_sim.py).
+
+Reported per run:
+  - capture -> first subscriber: capture time to the first copy of the event (includes storing)
+  - fan-out spread: first to last copy of one event, what one more subscriber costs in latency
+  - notify task CPU per event and per event & subscriber (schedstat of the "notify" thread)
+
+Checks, exit code 1 when any fails:
+  - min(subscribers, --cap) subscribers get 200 text/event-stream, the rest 503
+  - every accepted subscriber gets every capture event, in order and exactly once
+  - fan-out spread stays under --max-spread ms
+
+Author: Roman Janiczek (xjanic25@vutbr.cz)
+"""
+import argparse
+import http.client
+import json
+import os
+import re
+import selectors
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+CLOCK_LINE = re.compile(r'sim: Clock \{boot=(-?\d+) ns, offset=(-?\d+) ms, drift=(-?\d+) ppm\}')
+NODE_BASE = 0x2000                      # Node ids of triggers, one per event so rate limit never hits
+
+
+def wait_for_port(port, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection(('localhost', port), timeout=0.5).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def get(port, path):
+    conn = http.client.HTTPConnection('localhost', port, timeout=20)
+    conn.request('GET', path)
+    response = conn.getresponse()
+    body = response.read()
+    conn.close()
+    return response, body
+
+
+def percentile(sorted_values, p):
+    return sorted_values[min(len(sorted_values) - 1, int(len(sorted_values) * p / 100.0))] if sorted_values else 0.0
+
+
+class Subscriber:
+    """One /notify connection, events are parsed from whatever the selector loop read."""
+
+    def __init__(self, port):
+        self.sock = socket.create_connection(('localhost', port), timeout=10)
+        self.sock.sendall(b'GET /notify HTTP/1.1\r\nHost: localhost\r\nAccept: text/event-stream\r\n\r\n')
+        self.buf = b''
+        self.status = None
+        self.received = []              # (event id, host arrival time s, capture timestamp ms)
+        self.read_header()
+
+    def read_header(self):
+        while b'\r\n\r\n' not in self.buf:
+            data = self.sock.recv(4096)
+            if not data:
+                break
+            self.buf += data
+        header, _, self.buf = self.buf.partition(b'\r\n\r\n')
+        status = header.split(b'\r\n', 1)[0].split()
+        self.status = int(status[1]) if len(status) > 1 else 0
+        if self.status == 200 and b'text/event-stream' not in header.lower():
+            self.status = -1
+
+    def feed(self, data, now):
+        self.buf += data
+        while b'\n\n' in self.buf:
+            message, _, self.buf = self.buf.partition(b'\n\n')
+            fields = dict(line.split(': ', 1) for line in message.decode(errors='replace').split('\n')
+                          if ': ' in line and not line.startswith(':'))
+            if fields.get('event') == 'capture':
+                data = json.loads(fields['data'])
+                self.received.append((data['event'], now, data['timestamp']))
+
+    def close(self):
+        self.sock.close()
+
+
+class CamClock:
+    """Camera esp_timer time (ms) to host CLOCK_MONOTONIC (s), from Clock line of cam-sim log."""
+
+    def __init__(self, log_path):
+        self.boot_ns = None
+        self.offset_ms = 0
+        if log_path is not None:
+            with open(log_path) as log:
+                match = CLOCK_LINE.search(log.read())
+            if match:
+                self.boot_ns, self.offset_ms, _ = (int(value) for value in match.groups())
+
+    def host_s(self, cam_ms):
+        return None if self.boot_ns is None else self.boot_ns / 1e9 + (cam_ms - self.offset_ms) / 1e3
+
+
+def notify_thread_ns(pid):
+    """CPU time of the notify task thread (ns), None when it can not be found."""
+    if pid is None:
+        return None
+    for tid in os.listdir('/proc/%d/task' % pid):
+        try:
+            with open('/proc/%d/task/%s/comm' % (pid, tid)) as comm:
+                if comm.read().strip() != 'notify':
+                    continue
+            try:
+                with open('/proc/%d/task/%s/schedstat' % (pid, tid)) as schedstat:
+                    return int(schedstat.read().split()[0])
+            except OSError:
+                with open('/proc/%d/task/%s/stat' % (pid, tid)) as stat:
+                    fields = stat.read().rsplit(')', 1)[1].split()
+                    return (int(fields[11]) + int(fields[12])) * 1000000000 // os.sysconf('SC_CLK_TCK')
+        except OSError:
+            continue
+    return None
+
+
+def trigger(args, node):
+    """PIR trigger, retried while the capture queue is full, returns event id."""
+    deadline = time.monotonic() + 10
+    while time.monotonic() < deadline:
+        response, _ = get(args.port, '/pir?node=%x' % node)
+        if response.status == 202:
+            return int(response.getheader('X-Event-Id'))
+        time.sleep(0.2)
+    return None
+
+
+def run(args, count, pid, clock, next_node):
+    failures = []
+    accepted = []
+    rejected = []
+    for _ in range(count):
+        sub = Subscriber(args.stream_port)
+        if sub.status == 200:
+            accepted.append(sub)
+            continue
+        # Rejected one holds the spare session of the stream server, the next one would wait in backlog
+        sub.close()
+        if sub.status == 503:
+            rejected.append(sub)
+    if len(accepted) != min(count, args.cap) or len(rejected) != count - len(accepted):
+        failures.append('%d subscriber(s): %d accepted, %d got 503, %d other (cap %d)' %
+                        (count, len(accepted), len(rejected), count - len(accepted) - len(rejected), args.cap))
+
+    selector = selectors.DefaultSelector()
+    for sub in accepted:
+        sub.sock.setblocking(False)
+        selector.register(sub.sock, selectors.EVENT_READ, sub)
+
+    def pump(until):
+        while True:
+            timeout = until - time.monotonic()
+            if timeout <= 0:
+                return
+            for key, _ in selector.select(timeout):
+                now = time.monotonic()
+                try:
+                    data = key.fileobj.recv(65536)
+                except BlockingIOError:
+                    continue
+                if not data:
+                    selector.unregister(key.fileobj)
+                    continue
+                key.data.feed(data, now)
+
+    cpu_before = notify_thread_ns(pid)
+    event_ids = []
+    for n in range(args.events):
+        event_id = trigger(args, next_node + n)
+        if event_id is None:
+            failures.append('%d subscriber(s): trigger %d was not accepted' % (count, n))
+        else:
+            event_ids.append(event_id)
+        pump(time.monotonic() + args.gap)
+    # Last event may still be on its way
+    deadline = time.monotonic() + 5
+    while time.monotonic() < deadline and any(len(sub.received) < len(event_ids) for sub in accepted):
+        pump(time.monotonic() + 0.1)
+    cpu_after = notify_thread_ns(pid)
+    selector.close()
+    for sub in accepted:
+        sub.close()
+
+    first = []
+    spread = []
+    for event_id in event_ids:
+        arrivals = [at for sub in accepted for received_id, at, _ in sub.received if received_id == event_id]
+        stamps = [stamp for sub in accepted for received_id, _, stamp in sub.received if received_id == event_id]
+        if len(arrivals) > 1:
+            spread.append((max(arrivals) - min(arrivals)) * 1000)
+        if arrivals and clock.host_s(stamps[0]) is not None:
+            first.append((min(arrivals) - clock.host_s(stamps[0])) * 1000)
+    for index, sub in enumerate(accepted):
+        ids = [received_id for received_id, _, _ in sub.received]
+        if ids != event_ids:
+            failures.append('%d subscriber(s): subscriber %d got events %s, expected %s' %
+                            (count, index, ids, event_ids))
+    first.sort()
+    spread.sort()
+    if spread and spread[-1] > args.max_spread:
+        failures.append('%d subscriber(s): fan-out spread %.1f ms over %.1f ms' % (count, spread[-1], args.max_spread))
+
+    print('%3d subscriber(s), %d accepted, %d rejected, %d events' % (count, len(accepted), len(rejected), len(event_ids)))
+    if first:
+        print('    capture -> first subscriber  p50 %6.1f ms  p95 %6.1f ms  max %6.1f ms' %
+              (percentile(first, 50), percentile(first, 95), first[-1]))
+    if spread:
+        print('    fan-out spread               p50 %6.1f ms  p95 %6.1f ms  max %6.1f ms' %
+              (percentile(spread, 50), percentile(spread, 95), spread[-1]))
+    if cpu_before is not None and cpu_after is not None and event_ids and accepted:
+        per_event = (cpu_after - cpu_before) / 1000.0 / len(event_ids)
+        print('    notify task CPU              %6.1f us per event, %5.1f us per event & subscriber' %
+              (per_event, per_event / len(accepted)))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Fan-out latency & CPU of /notify with many subscribers')
+    parser.add_argument('--spawn', default='host/build/cam-sim', help='cam-sim binary, empty to use a running one')
+    parser.add_argument('--subscribers', default='1,4', help='comma separated subscriber counts to run')
+    parser.add_argument('--cap', type=int, default=2, help='NOTIFY_MAX_CLIENTS of the camera build')
+    parser.add_argument('--events', type=int, default=10, help='captures per run')
+    parser.add_argument('--gap', type=float, default=1.6, help='seconds between triggers, over CAPTURE_COALESCE_MS')
+    parser.add_argument('--max-spread', type=float, default=100, help='fan-out spread allowed (ms)')
+    parser.add_argument('--port', type=int, default=8080, help='camera server (host simulation maps 80 to 8080)')
+    parser.add_argument('--stream-port', type=int, default=8081, help='stream server (host simulation maps 81 to 8081)')
+    args = parser.parse_args()
+
+    cam = None
+    log_path = None
+    if args.spawn:
+        workdir = tempfile.mkdtemp(prefix='notify-sim-')
+        log_path = os.path.join(workdir, 'cam.log')
+        cam = subprocess.Popen([os.path.abspath(args.spawn)],
+                               env=dict(os.environ, SIM_FLASH_FILE=os.path.join(workdir, 'sim-flash.bin')),
+                               cwd=workdir, stdout=open(log_path, 'w'), stderr=subprocess.STDOUT)
+        print('cam-sim log in %s' % log_path)
+    failures = []
+    try:
+        if not wait_for_port(args.port, 10) or not wait_for_port(args.stream_port, 10):
+            sys.exit('cam-sim is not listening on %d & %d' % (args.port, args.stream_port))
+        # Server listens before the camera is up, first requests get 500
+        deadline = time.monotonic() + 10
+        while get(args.port, '/take-photo')[0].status != 200:
+            if time.monotonic() > deadline:
+                sys.exit('/take-photo does not answer with photo')
+            time.sleep(0.2)
+        clock = CamClock(log_path)
+        next_node = NODE_BASE
+        for count in (int(value) for value in args.subscribers.split(',')):
+            failures += run(args, count, cam.pid if cam is not None else None, clock, next_node)
+            next_node += args.events
+    finally:
+        if cam is not None:
+            cam.terminate()
+            cam.wait()
+    for failure in failures:
+        print('FAIL: %s' % failure)
+    print('OK' if not failures else '%d check(s) failed' % len(failures))
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
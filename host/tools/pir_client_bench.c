@@ -0,0 +1,158 @@
+/**
+ * @file pir_client_bench.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief PIR trigger round trip - client per request vs one keep-alive client, against local stand-in camera
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * Runs on the host shims like pir-sim. Stand-in camera is an esp_http_server answering GET /pir the
+ * way security-cam does. BENCH_REQUESTS (default 2000) triggers are sent:
+ *  - per request: URL formatted, client created, request performed, client cleaned up (old PIR node)
+ *  - keep-alive:  one client, only the URL changes between requests (send_request_to_camera)
+ * Prints mean, p50 and p95 round trip and number of TCP connections of each, exits with 1 when a
+ * request failed or the keep-alive client opened more than one connection.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_timer.h>
+#include <esp_http_server.h>
+#include <esp_http_client.h>
+
+#define BENCH_PORT          18080           // Above 1024, not moved by SIM_PORT_OFFSET
+#define BENCH_CTRL_PORT     32790
+#define BENCH_DEFAULT       2000
+
+static int connections = 0;
+
+static esp_err_t pir_handler(httpd_req_t *req) {
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_set_hdr(req, "X-Event-Id", "1");
+    httpd_resp_send(req, "Picture requested! (event 1)", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+static esp_err_t client_event(esp_http_client_event_t *evt) {
+    if (evt->event_id == HTTP_EVENT_ON_CONNECTED) {
+        connections++;
+    }
+    return ESP_OK;
+}
+
+static int compare(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, int64_t *rtt, int count, int failed) {
+    int64_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += rtt[i];
+    }
+    qsort(rtt, count, sizeof(rtt[0]), compare);
+    printf("%-12s %d requests, %d failed, %d connections, mean %lld us, p50 %lld us, p95 %lld us\n", name, count,
+           failed, connections, (long long)(sum / count), (long long)rtt[count / 2],
+           (long long)rtt[count * 95 / 100]);
+}
+
+static esp_http_client_config_t client_config(const char *url) {
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_GET,
+        .event_handler = client_event,
+        .disable_auto_redirect = true,
+        .keep_alive_enable = true,
+        .timeout_ms = 2000,
+    };
+    return config;
+}
+
+/**
+ * @brief New client for every trigger, like the PIR node before the persistent connection
+ */
+static int bench_per_request(int64_t *rtt, int count) {
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        char url[112];
+        int64_t start = esp_timer_get_time();
+        sprintf(url, "http://127.0.0.1:%d/pir?node=%04x&seq=%d", BENCH_PORT, 0x0042, i);
+        esp_http_client_config_t config = client_config(url);
+        esp_http_client_handle_t client = esp_http_client_init(&config);
+        if (esp_http_client_perform(client) != ESP_OK || esp_http_client_get_status_code(client) != 202) {
+            failed++;
+        }
+        esp_http_client_cleanup(client);
+        rtt[i] = esp_timer_get_time() - start;
+    }
+    return failed;
+}
+
+/**
+ * @brief One client kept open, same steps as send_request_to_camera
+ */
+static int bench_keep_alive(int64_t *rtt, int count) {
+    int failed = 0;
+    esp_http_client_handle_t client = NULL;
+    for (int i = 0; i < count; i++) {
+        char url[112];
+        int64_t start = esp_timer_get_time();
+        sprintf(url, "http://127.0.0.1:%d/pir?node=%04x&seq=%d", BENCH_PORT, 0x0042, i);
+        if (client == NULL) {
+            esp_http_client_config_t config = client_config(url);
+            client = esp_http_client_init(&config);
+        } else {
+            esp_http_client_set_url(client, url);
+        }
+        esp_err_t err = esp_http_client_perform(client);
+        if (err != ESP_OK) {
+            esp_http_client_close(client);
+            err = esp_http_client_perform(client);
+        }
+        if (err != ESP_OK || esp_http_client_get_status_code(client) != 202) {
+            failed++;
+        }
+        rtt[i] = esp_timer_get_time() - start;
+    }
+    esp_http_client_cleanup(client);
+    return failed;
+}
+
+void app_main(void) {
+    const char *env = getenv("BENCH_REQUESTS");
+    int count = env != NULL ? atoi(env) : BENCH_DEFAULT;
+    int64_t *rtt = malloc(sizeof(int64_t) * (count > 0 ? count : 1));
+    if (count <= 0 || rtt == NULL) {
+        fprintf(stderr, "BENCH_REQUESTS must be a positive number\n");
+        exit(2);
+    }
+
+    httpd_handle_t server = NULL;
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = BENCH_PORT;
+    config.ctrl_port = BENCH_CTRL_PORT;
+    httpd_uri_t pir_uri = {
+        .uri = "/pir",
+        .method = HTTP_GET,
+        .handler = pir_handler,
+        .user_ctx = NULL,
+    };
+    if (httpd_start(&server, &config) != ESP_OK || httpd_register_uri_handler(server, &pir_uri) != ESP_OK) {
+        fprintf(stderr, "stand-in camera did not start on port %d\n", BENCH_PORT);
+        exit(2);
+    }
+
+    int failed = bench_per_request(rtt, count);
+    report("per request", rtt, count, failed);
+    int per_request_connections = connections;
+
+    connections = 0;
+    int keep_alive_failed = bench_keep_alive(rtt, count);
+    report("keep-alive", rtt, count, keep_alive_failed);
+
+    httpd_stop(server);
+    exit(failed == 0 && keep_alive_failed == 0 && per_request_connections == count && connections == 1 ? 0 : 1);
+}
@@ -0,0 +1,191 @@
+/**
+ * @file preroll_bench.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Pre-roll trigger-to-freeze latency - camera task loop on frame_ring with fake esp_camera_fb_get
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * Usage: preroll_bench [triggers] [sensor_fps]
+ *
+ * Camera thread runs the loop of camera_task: a frame every 1/PREROLL_FPS, every BURST_INTERVAL_MS while
+ * bursting, woken early by trigger. Fake esp_camera_fb_get behaves like the driver in CAMERA_GRAB_LATEST
+ * mode: newest frame completed since the last call, otherwise waits for the sensor to finish the next one
+ * (sensor_fps, default 6 like UXGA). Main thread triggers at random points of the pre-roll period the way
+ * take_preroll_picture does and waits for the freeze. Prints trigger to first burst frame (negative when
+ * the sensor finished that frame before the trigger) and trigger to freeze latency, fails when a freeze takes longer than the (BURST_FRAMES + 2) * BURST_INTERVAL_MS wait
+ * of take_preroll_picture.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "frame_ring.h"
+
+// Same as PREROLL_* and BURST_* of security-cam main.c
+#define PREROLL_DEPTH           7
+#define PREROLL_FPS             4
+#define BURST_FRAMES            4
+#define BURST_INTERVAL_MS       150
+
+#define SLOT_SIZE               1024
+#define DEFAULT_TRIGGERS        50
+#define DEFAULT_SENSOR_FPS      6
+
+static uint8_t pool[PREROLL_DEPTH * SLOT_SIZE];
+static uint8_t frame[SLOT_SIZE];
+static frame_ring_t ring;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake;                 // Trigger notifies camera thread, like xTaskNotifyGive
+static pthread_cond_t done;                 // Camera thread froze the ring, like preroll_done
+static bool notified = false;
+static bool stopping = false;
+static int64_t frozen_at = 0;
+static int64_t sensor_period_us;
+static int64_t sensor_start;
+static int64_t sensor_taken = -1;           // Last sensor frame handed out
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static struct timespec deadline(int64_t at_us) {
+    struct timespec ts = {.tv_sec = at_us / 1000000, .tv_nsec = at_us % 1000000 * 1000};
+    return ts;
+}
+
+static void sleep_until(int64_t at_us) {
+    struct timespec ts = deadline(at_us);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    }
+}
+
+/**
+ * @brief Fake esp_camera_fb_get in CAMERA_GRAB_LATEST mode
+ * @return completion time of the frame handed out (us)
+ */
+static int64_t fake_fb_get(void) {
+    int64_t completed = (now_us() - sensor_start) / sensor_period_us;
+    if (completed <= sensor_taken) {
+        completed = sensor_taken + 1;
+        sleep_until(sensor_start + completed * sensor_period_us);
+    }
+    sensor_taken = completed;
+    return sensor_start + completed * sensor_period_us;
+}
+
+static void *camera_thread(void *arg) {
+    int64_t last_wake = now_us();
+    bool bursting = false;
+    pthread_mutex_lock(&lock);
+    while (!stopping) {
+        int64_t period = (bursting ? BURST_INTERVAL_MS : 1000 / PREROLL_FPS) * 1000LL;
+        struct timespec until = deadline(last_wake + period);
+        while (!notified && !stopping && pthread_cond_timedwait(&wake, &lock, &until) == 0) {
+        }
+        notified = false;
+        last_wake = now_us();
+        // Frozen sequence waits for release, no frames are grabbed meanwhile
+        if (ring.frozen) {
+            continue;
+        }
+        pthread_mutex_unlock(&lock);
+
+        int64_t timestamp = fake_fb_get();
+
+        pthread_mutex_lock(&lock);
+        frame_ring_push(&ring, frame, sizeof(frame), 1600, 1200, timestamp);
+        bursting = ring.triggered && !ring.frozen;
+        if (ring.frozen) {
+            frozen_at = now_us();
+            pthread_cond_signal(&done);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+static int compare(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, int64_t *values, unsigned count) {
+    qsort(values, count, sizeof(values[0]), compare);
+    printf("%-22s p50 %6.1f ms  p95 %6.1f ms  max %6.1f ms\n", name, values[count / 2] / 1000.0,
+           values[count * 95 / 100] / 1000.0, values[count - 1] / 1000.0);
+}
+
+int main(int argc, char **argv) {
+    unsigned triggers = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : DEFAULT_TRIGGERS;
+    unsigned sensor_fps = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : DEFAULT_SENSOR_FPS;
+    if (triggers == 0 || sensor_fps == 0) {
+        fprintf(stderr, "Usage: %s [triggers] [sensor_fps]\n", argv[0]);
+        return 2;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wake, &attr);
+    pthread_cond_init(&done, &attr);
+    frame_ring_init(&ring, pool, PREROLL_DEPTH, SLOT_SIZE);
+    sensor_period_us = 1000000 / sensor_fps;
+    sensor_start = now_us();
+    pthread_t camera;
+    pthread_create(&camera, NULL, camera_thread, NULL);
+
+    int64_t *first = calloc(triggers, sizeof(int64_t));
+    int64_t *freeze = calloc(triggers, sizeof(int64_t));
+    const int64_t wait = (BURST_FRAMES + 2) * BURST_INTERVAL_MS * 1000LL;
+    unsigned late = 0;
+    srand(1);
+    for (unsigned i = 0; i < triggers; i++) {
+        // Pre-roll refills, then trigger lands anywhere in the pre-roll period
+        sleep_until(now_us() + 1000000 / PREROLL_FPS * (PREROLL_DEPTH - BURST_FRAMES) +
+                    rand() % (1000000 / PREROLL_FPS));
+
+        pthread_mutex_lock(&lock);
+        int64_t trigger = now_us();
+        frame_ring_trigger(&ring, trigger, BURST_FRAMES);
+        notified = true;
+        pthread_cond_signal(&wake);
+        struct timespec until = deadline(trigger + wait);
+        while (!ring.frozen && pthread_cond_timedwait(&done, &lock, &until) == 0) {
+        }
+        if (ring.frozen) {
+            const frame_ring_slot_t *burst = NULL;
+            for (size_t n = 0; n < ring.count && burst == NULL; n++) {
+                if (frame_ring_get(&ring, n)->seq == ring.trigger_seq) {
+                    burst = frame_ring_get(&ring, n);
+                }
+            }
+            first[i] = burst != NULL ? burst->timestamp - trigger : 0;
+            freeze[i] = frozen_at - trigger;
+        } else {
+            first[i] = freeze[i] = wait;
+            late++;
+        }
+        frame_ring_release(&ring);
+        pthread_mutex_unlock(&lock);
+    }
+
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(camera, NULL);
+
+    printf("%u triggers, sensor %u fps, %d burst frames every %d ms, %u not frozen within %lld ms\n", triggers,
+           sensor_fps, BURST_FRAMES, BURST_INTERVAL_MS, late, (long long)(wait / 1000));
+    report("trigger -> 1st burst", first, triggers);
+    report("trigger -> freeze", freeze, triggers);
+    free(first);
+    free(freeze);
+    return late == 0 ? 0 : 1;
+}
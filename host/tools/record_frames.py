@@ -0,0 +1,96 @@
+"""
+Record frames of camera MJPEG stream into a directory, for SIM_FRAMES_DIR and motion_bench.
+
+Usage: record_frames.py --out frames/ [--url http://localhost:8081/stream] [--frames 48]
+                        [--spawn host/build/cam-sim]
+
+Every part of /stream is written as frame_<n>.jpg, so name order is recording order. Point --url at
+the device (port 81) to record a real scene, or let --spawn start cam-sim and record its synthetic
+one. Exit code 1 when the stream ended before --frames parts arrived.
+
+Author: Roman Janiczek (xjanic25@vutbr.cz)
+"""
+import argparse
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+import urllib.parse
+
+
+def wait_for_port(host, port, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection((host, port), timeout=0.5).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def spawn(args, url):
+    """Start simulated camera in a scratch directory, its flash file stays out of the tree."""
+    workdir = tempfile.mkdtemp(prefix='record-cam-')
+    log = open(os.path.join(workdir, 'cam.log'), 'w')
+    process = subprocess.Popen([os.path.abspath(args.spawn)], stdout=log, stderr=subprocess.STDOUT, cwd=workdir)
+    if not wait_for_port(url.hostname, url.port, 10):
+        process.kill()
+        sys.exit('%s did not start listening on %s:%d, see %s' % (args.spawn, url.hostname, url.port, log.name))
+    return process
+
+
+def record(args, url):
+    """Read multipart parts by their Content-Length, boundary lines in between are skipped."""
+    conn = socket.create_connection((url.hostname, url.port), timeout=args.timeout)
+    conn.sendall(('GET %s HTTP/1.1\r\nHost: %s\r\n\r\n' % (url.path or '/', url.hostname)).encode())
+    stream = conn.makefile('rb')
+    status = stream.readline().split()
+    if len(status) < 2 or status[1] != b'200':
+        sys.exit('stream answered %s' % b' '.join(status).decode(errors='replace'))
+    os.makedirs(args.out, exist_ok=True)
+    count = 0
+    length = None
+    while count < args.frames:
+        line = stream.readline()
+        if not line:
+            break
+        name, _, value = line.decode(errors='replace').partition(':')
+        if name.strip().lower() == 'content-length':
+            length = int(value)
+        elif line in (b'\r\n', b'\n') and length is not None:
+            with open(os.path.join(args.out, 'frame_%04d.jpg' % count), 'wb') as frame:
+                frame.write(stream.read(length))
+            count += 1
+            length = None
+    conn.close()
+    return count
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0].strip())
+    parser.add_argument('--out', required=True, help='directory frames are written to')
+    parser.add_argument('--url', default='http://localhost:8081/stream',
+                        help='MJPEG stream (host simulation maps 81 to 8081)')
+    parser.add_argument('--frames', type=int, default=48, help='frames to record')
+    parser.add_argument('--timeout', type=float, default=10, help='socket timeout in seconds')
+    parser.add_argument('--spawn', help='start this cam-sim binary for the recording and stop it afterwards')
+    args = parser.parse_args()
+
+    url = urllib.parse.urlparse(args.url)
+    url = url._replace(netloc='%s:%d' % (url.hostname or 'localhost', url.port or 80))
+    process = spawn(args, url) if args.spawn else None
+    try:
+        count = record(args, url)
+    finally:
+        if process is not None:
+            process.terminate()
+            process.wait()
+    print('%d frame(s) recorded into %s' % (count, args.out))
+    sys.exit(0 if count == args.frames else 1)
+
+
+if __name__ == '__main__':
+    main()
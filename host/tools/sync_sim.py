@@ -0,0 +1,192 @@
+"""
+Clock sync & trigger-to-photo trace check of one PIR node and the camera with injected clock error.
+
+Usage: sync_sim.py [--cam host/build/cam-sim] [--pir host/build/pir-sim] [--duration 60]
+                   [--cam-offset 1000] [--cam-drift -15] [--pir-offset 7000] [--pir-drift 20]
+                   [--tolerance 1.0]
+
+Starts cam-sim and pir-sim with SIM_CLOCK_OFFSET_MS & SIM_CLOCK_DRIFT_PPM, so their esp_timer clocks
+disagree by seconds and drift apart, and lets the node replay --trace (looped every --loop ms). Both
+simulations log their start on host CLOCK_MONOTONIC, which gives the true camera clock time of every
+detection the node logs. That is compared with the detection time the node sent over its synced
+clock and the camera shows at /traces.
+
+Checks, exit code 1 when any fails:
+  - at least --min-traces captures carry a detection time
+  - detection time on camera clock is within --tolerance ms of the true one
+  - stages of every trace are in order (detected, sent, received) within --tolerance ms
+
+Author: Roman Janiczek (xjanic25@vutbr.cz)
+"""
+import argparse
+import http.client
+import json
+import os
+import re
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+CLOCK_LINE = re.compile(r'sim: Clock \{boot=(-?\d+) ns, offset=(-?\d+) ms, drift=(-?\d+) ppm\}')
+MOTION_LINE = re.compile(r'Motion #(\d+) detected at (-?\d+)')
+STAGES = ['detected', 'sent', 'received', 'flash_on', 'grabbed', 'stored']
+
+
+class Clock:
+    """esp_timer_get_time of one simulation, see host/shim/freertos.c"""
+
+    def __init__(self, log_path):
+        with open(log_path) as log:
+            match = CLOCK_LINE.search(log.read())
+        if match is None:
+            raise ValueError('no clock line in %s' % log_path)
+        self.boot_ns, offset_ms, self.drift_ppm = (int(value) for value in match.groups())
+        self.offset_us = offset_ms * 1000
+
+    def to_host_ns(self, device_us):
+        uptime_us = (device_us - self.offset_us) / (1 + self.drift_ppm / 1e6)
+        return self.boot_ns + uptime_us * 1000
+
+    def from_host_ns(self, host_ns):
+        uptime_us = (host_ns - self.boot_ns) / 1000
+        return uptime_us + uptime_us * self.drift_ppm / 1e6 + self.offset_us
+
+
+def wait_for_port(port, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection(('localhost', port), timeout=0.5).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def spawn(binary, workdir, name, env):
+    log_path = os.path.join(workdir, name + '.log')
+    process = subprocess.Popen([os.path.abspath(binary)], env=dict(os.environ, **env), cwd=workdir,
+                               stdout=open(log_path, 'w'), stderr=subprocess.STDOUT)
+    return process, log_path
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    return sorted_values[min(len(sorted_values) - 1, int(len(sorted_values) * p / 100.0))]
+
+
+def summary(values):
+    values = sorted(values)
+    return 'p50 %7.3f  max %7.3f  (%d)' % (percentile(values, 50), values[-1], len(values)) if values else '-'
+
+
+def run(args, workdir):
+    cam, cam_log = spawn(args.cam, workdir, 'cam', {
+        'SIM_FLASH_FILE': os.path.join(workdir, 'sim-flash.bin'),
+        'SIM_CLOCK_OFFSET_MS': str(args.cam_offset),
+        'SIM_CLOCK_DRIFT_PPM': str(args.cam_drift),
+    })
+    pir = None
+    try:
+        if not wait_for_port(args.port, 10):
+            sys.exit('cam-sim did not start listening on %d, see %s' % (args.port, cam_log))
+        pir, pir_log = spawn(args.pir, workdir, 'pir', {
+            'SIM_GATEWAY': '127.0.0.1',
+            'SIM_PIR_TRACE': os.path.abspath(args.trace),
+            'SIM_PIR_TRACE_LOOP': str(args.loop),
+            'SIM_CLOCK_OFFSET_MS': str(args.pir_offset),
+            'SIM_CLOCK_DRIFT_PPM': str(args.pir_drift),
+        })
+        print('cam clock +%d ms %+d ppm, node clock +%d ms %+d ppm, running %d s, logs in %s' % (
+            args.cam_offset, args.cam_drift, args.pir_offset, args.pir_drift, args.duration, workdir))
+        time.sleep(args.duration)
+        # Let the last capture finish before reading traces
+        time.sleep(2)
+        conn = http.client.HTTPConnection('localhost', args.port, timeout=10)
+        conn.request('GET', '/traces')
+        traces = json.loads(conn.getresponse().read())
+        conn.close()
+    finally:
+        for process in (pir, cam):
+            if process is not None:
+                process.terminate()
+                process.wait()
+    return traces, Clock(cam_log), Clock(pir_log), pir_log
+
+
+def check(args, traces, cam_clock, pir_clock, pir_log):
+    detections = {}
+    with open(pir_log) as log:
+        for match in MOTION_LINE.finditer(log.read()):
+            detections[int(match.group(1))] = int(match.group(2))
+
+    failures = []
+    errors_ms = []
+    stages_ms = {}
+    synced = 0
+    for trace in traces:
+        at = trace
+        for first, second in zip(STAGES, STAGES[1:]):
+            if at[first] is not None and at[second] is not None:
+                stages_ms.setdefault('%s -> %s' % (first, second), []).append((at[second] - at[first]) / 1000.0)
+        if at['detected'] is not None and at['stored'] is not None:
+            stages_ms.setdefault('detected -> stored', []).append((at['stored'] - at['detected']) / 1000.0)
+        if at['detected'] is None:
+            continue
+        synced += 1
+        for first, second in zip(STAGES[:2], STAGES[1:3]):
+            if at[second] - at[first] < -args.tolerance * 1000:
+                failures.append('event %d: %s %.3f ms after %s' % (
+                    trace['event'], first, (at[first] - at[second]) / 1000.0, second))
+        if trace['seq'] not in detections:
+            failures.append('event %d: node never logged detection #%d' % (trace['event'], trace['seq']))
+            continue
+        truth = cam_clock.from_host_ns(pir_clock.to_host_ns(detections[trace['seq']]))
+        error_ms = (at['detected'] - truth) / 1000.0
+        errors_ms.append(abs(error_ms))
+        print('event %3d  node #%d  detection %+8.3f ms off, detected -> stored %s ms' % (
+            trace['event'], trace['seq'], error_ms, trace['detect_to_stored_ms']))
+
+    print('\n%d trace(s), %d with detection time' % (len(traces), synced))
+    print('%-24s %s' % ('sync error (ms)', summary(errors_ms)))
+    for name, values in sorted(stages_ms.items(), key=lambda item: STAGES.index(item[0].split(' ')[0])):
+        print('%-24s %s' % (name, summary(values)))
+
+    if synced < args.min_traces:
+        failures.append('only %d trace(s) with detection time, expected %d' % (synced, args.min_traces))
+    if errors_ms and max(errors_ms) > args.tolerance:
+        failures.append('sync error %.3f ms over tolerance %.3f ms' % (max(errors_ms), args.tolerance))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Clock sync & capture trace check with injected clock error')
+    parser.add_argument('--cam', default='host/build/cam-sim', help='cam-sim binary')
+    parser.add_argument('--pir', default='host/build/pir-sim', help='pir-sim binary')
+    parser.add_argument('--trace', default=os.path.join(os.path.dirname(__file__), '..', 'traces', 'walk_by.trace'),
+                        help='PIR trace replayed by the node')
+    parser.add_argument('--loop', type=int, default=20000, help='ms after which the trace starts over')
+    parser.add_argument('--duration', type=int, default=60, help='seconds to run')
+    parser.add_argument('--cam-offset', type=int, default=1000, help='ms added to camera clock')
+    parser.add_argument('--cam-drift', type=int, default=-15, help='ppm camera clock runs fast')
+    parser.add_argument('--pir-offset', type=int, default=7000, help='ms added to node clock')
+    parser.add_argument('--pir-drift', type=int, default=20, help='ppm node clock runs fast')
+    parser.add_argument('--tolerance', type=float, default=1.0, help='ms detection time may be off')
+    parser.add_argument('--min-traces', type=int, default=3, help='captures with detection time needed')
+    parser.add_argument('--port', type=int, default=8080, help='camera server (host simulation maps 80 to 8080)')
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp(prefix='sync-sim-')
+    traces, cam_clock, pir_clock, pir_log = run(args, workdir)
+    failures = check(args, traces, cam_clock, pir_clock, pir_log)
+    for failure in failures:
+        print('FAIL: %s' % failure)
+    print('OK' if not failures else '%d check(s) failed' % len(failures))
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,208 @@
+"""
+Concurrency check of /take-photo - how many captures cam-sim makes for requests of many clients.
+
+Usage: take_sim.py [--spawn host/build/cam-sim] [--clients 1,2,4] [--requests 8] [--think 0.1] [--pir 0.4]
+
+Every run has --clients threads, each sending --requests /take-photo requests one after another
+with --think seconds between them. Requests that come while a capture is running join it, so with
+more clients there should be clearly fewer captures than requests. cam_take_captures_total and
+cam_take_requests_total of /metrics give captures per request, responses sharing X-Photo-Generation
+must carry the same bytes and the last one has to be /latest-photo.jpg afterwards. Meanwhile PIR
+triggers come every --pir seconds, so take and PIR captures interleave in the capture queue.
+
+Checks, exit code 1 when any fails:
+  - every request gets 200 (503 is counted when the waiter table is full)
+  - responses of one capture are identical
+  - captures per request is 1 for a single client and at most --max-ratio with more clients
+  - /latest-photo.jpg is the photo of the last capture (only checked without --pir)
+  - every captured take & PIR event ends up in /events, which lists them in id order
+
+Author: Roman Janiczek (xjanic25@vutbr.cz)
+"""
+import argparse
+import hashlib
+import http.client
+import json
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+
+def wait_for_port(port, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection(('localhost', port), timeout=0.5).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def get(port, path):
+    conn = http.client.HTTPConnection('localhost', port, timeout=20)
+    conn.request('GET', path)
+    response = conn.getresponse()
+    body = response.read()
+    conn.close()
+    return response, body
+
+
+def metrics(port):
+    values = {}
+    for line in get(port, '/metrics')[1].decode().splitlines():
+        if line and not line.startswith('#'):
+            name, value = line.rsplit(' ', 1)
+            values[name] = float(value)
+    return values
+
+
+def client(port, requests, think, results, lock):
+    for _ in range(requests):
+        start = time.monotonic()
+        try:
+            response, body = get(port, '/take-photo')
+            result = (response.status, response.getheader('X-Photo-Generation'), hashlib.md5(body).hexdigest(),
+                      time.monotonic() - start, response.getheader('X-Event-Id'))
+        except (OSError, http.client.HTTPException) as error:
+            result = (str(error), None, None, time.monotonic() - start, None)
+        with lock:
+            results.append(result)
+        time.sleep(think)
+
+
+def pir_trigger(port, interval, stop, event_ids):
+    node = 0
+    while not stop.wait(interval):
+        node = node % 0xFF + 1
+        try:
+            response, _ = get(port, '/pir?node=%x' % node)
+            if response.status == 202:
+                event_ids.append(int(response.getheader('X-Event-Id')))
+        except (OSError, http.client.HTTPException):
+            pass
+
+
+def archived(port, event_ids, timeout):
+    """Wait until archive task caught up, return traces & archive listing"""
+    deadline = time.monotonic() + timeout
+    while True:
+        traces = {trace['event']: trace for trace in json.loads(get(port, '/traces')[1])}
+        events = [event['id'] for event in json.loads(get(port, '/events')[1])]
+        pending = [event_id for event_id in event_ids
+                   if traces.get(event_id, {}).get('result') == 'captured' and event_id not in events]
+        if not pending or time.monotonic() > deadline:
+            return traces, events, pending
+        time.sleep(0.2)
+
+
+def percentile(sorted_values, p):
+    return sorted_values[min(len(sorted_values) - 1, int(len(sorted_values) * p / 100.0))] if sorted_values else 0.0
+
+
+def run(args, clients):
+    before = metrics(args.port)
+    results = []
+    lock = threading.Lock()
+    threads = [threading.Thread(target=client, args=(args.port, args.requests, args.think, results, lock))
+               for _ in range(clients)]
+    pir_ids = []
+    stop = threading.Event()
+    pir = threading.Thread(target=pir_trigger, args=(args.port, args.pir, stop, pir_ids))
+    start = time.monotonic()
+    if args.pir > 0:
+        pir.start()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    stop.set()
+    if args.pir > 0:
+        pir.join()
+    duration = time.monotonic() - start
+    after = metrics(args.port)
+    latest_response, latest = get(args.port, '/latest-photo.jpg')
+
+    captures = after['cam_take_captures_total'] - before.get('cam_take_captures_total', 0)
+    answered = after['cam_take_requests_total'] - before.get('cam_take_requests_total', 0)
+    ok = [result for result in results if result[0] == 200]
+    busy = [result for result in results if result[0] == 503]
+    failed = [result for result in results if result[0] not in (200, 503)]
+    latencies = sorted(result[3] * 1000 for result in ok)
+    ratio = captures / answered if answered else 0.0
+    take_ids = sorted(set(int(result[4]) for result in ok))
+    traces, events, pending = archived(args.port, take_ids + pir_ids, 5)
+    pir_captured = [event_id for event_id in pir_ids if traces.get(event_id, {}).get('result') == 'captured']
+    print('%2d client(s)  %3d requests  %3d captures  %.2f captures/request  %3d busy  '
+          'latency p50 %6.1f  p95 %6.1f ms  %5.1f s  %d/%d PIR captured' % (
+              clients, len(results), captures, ratio, len(busy),
+              percentile(latencies, 50), percentile(latencies, 95), duration, len(pir_captured), len(pir_ids)))
+
+    failures = ['%d client(s): request failed {%s}' % (clients, result[0]) for result in failed]
+    bodies = {}
+    for _, generation, digest, _, _ in ok:
+        if bodies.setdefault(generation, digest) != digest:
+            failures.append('%d client(s): generation %s sent with different bodies' % (clients, generation))
+    if clients == 1 and ratio != 1.0:
+        failures.append('single client: %.2f captures per request, expected 1' % ratio)
+    if clients > 1 and ratio > args.max_ratio:
+        failures.append('%d clients: %.2f captures per request over %.2f' % (clients, ratio, args.max_ratio))
+    newest = max(ok, key=lambda result: int(result[1])) if ok else None
+    if newest is not None and args.pir == 0 and (latest_response.status != 200 or
+                               not latest_response.getheader('ETag', '').endswith('-%s-full"' % newest[1]) or
+                               hashlib.md5(latest).hexdigest() != newest[2]):
+        failures.append('%d client(s): latest photo is not the one of the last capture' % clients)
+    for event_id in pending:
+        failures.append('%d client(s): captured event %d is not archived' % (clients, event_id))
+    if events != sorted(events):
+        failures.append('%d client(s): archive lists events out of order' % clients)
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Captures per /take-photo request under contention')
+    parser.add_argument('--spawn', default='host/build/cam-sim', help='cam-sim binary, empty to use a running one')
+    parser.add_argument('--clients', default='1,2,4', help='comma separated client counts to run')
+    parser.add_argument('--requests', type=int, default=8, help='requests per client')
+    parser.add_argument('--think', type=float, default=0.1, help='seconds a client waits between requests')
+    parser.add_argument('--pir', type=float, default=0.4, help='seconds between PIR triggers, 0 for none')
+    parser.add_argument('--max-ratio', type=float, default=0.75, help='captures per request allowed with more clients')
+    parser.add_argument('--port', type=int, default=8080, help='camera server (host simulation maps 80 to 8080)')
+    args = parser.parse_args()
+
+    cam = None
+    if args.spawn:
+        workdir = tempfile.mkdtemp(prefix='take-sim-')
+        log_path = os.path.join(workdir, 'cam.log')
+        cam = subprocess.Popen([os.path.abspath(args.spawn)],
+                               env=dict(os.environ, SIM_FLASH_FILE=os.path.join(workdir, 'sim-flash.bin')),
+                               cwd=workdir, stdout=open(log_path, 'w'), stderr=subprocess.STDOUT)
+        print('cam-sim log in %s' % log_path)
+    failures = []
+    try:
+        if not wait_for_port(args.port, 10):
+            sys.exit('cam-sim is not listening on %d' % args.port)
+        # Server listens before the camera is up, first requests get 500
+        deadline = time.monotonic() + 10
+        while get(args.port, '/take-photo')[0].status != 200:
+            if time.monotonic() > deadline:
+                sys.exit('/take-photo does not answer with photo')
+            time.sleep(0.2)
+        for clients in (int(value) for value in args.clients.split(',')):
+            failures += run(args, clients)
+    finally:
+        if cam is not None:
+            cam.terminate()
+            cam.wait()
+    for failure in failures:
+        print('FAIL: %s' % failure)
+    print('OK' if not failures else '%d check(s) failed' % len(failures))
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
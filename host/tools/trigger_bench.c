@@ -0,0 +1,154 @@
+/**
+ * @file trigger_bench.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Trigger protocol throughput - codec alone and node/camera exchange over UDP loopback
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * Usage: trigger_bench [events] [window]
+ *
+ * Node socket sends window events at a time, camera socket decodes them, runs duplicate detection
+ * and acks every event, node checks each ack. Fails when an ack is lost, wrong or late by a second.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include "trigger_proto.h"
+
+#define DEFAULT_EVENTS      200000
+#define DEFAULT_WINDOW      16
+#define NODE_ID             0x0042
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief UDP socket on loopback with ephemeral port and receive timeout of one second
+ */
+static int open_socket(struct sockaddr_in *addr) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(*addr);
+    struct timeval timeout = {.tv_sec = 1};
+    if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) != 0 || getsockname(fd, (struct sockaddr *)addr, &len) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Encode, decode & duplicate check of synced events, no sockets
+ */
+static void bench_codec(unsigned events) {
+    uint8_t buf[TRIGGER_BATCH_MAX_SIZE];
+    trigger_msg_t event = {.type = TRIGGER_MSG_EVENT, .node_id = NODE_ID, .flags = TRIGGER_FLAG_MOTION |
+                           TRIGGER_FLAG_SYNCED};
+    trigger_msg_t decoded;
+    trigger_dedup_t dedup;
+    trigger_dedup_init(&dedup);
+    unsigned accepted = 0;
+    double start = now_s();
+    for (unsigned i = 0; i < events; i++) {
+        event.seq = i;
+        event.timestamp = i * 1000LL;
+        size_t len = trigger_encode(&event, buf);
+        if (trigger_decode(buf, len, &decoded) && trigger_dedup_accept(&dedup, decoded.node_id, decoded.seq)) {
+            accepted++;
+        }
+    }
+    double elapsed = now_s() - start;
+    printf("codec:    %u events, %.0f ns per encode+decode+dedup, %u accepted\n", events, elapsed * 1e9 / events,
+           accepted);
+}
+
+/**
+ * @return false when any ack went missing or did not match its event
+ */
+static bool bench_loopback(unsigned events, unsigned window) {
+    struct sockaddr_in node_addr;
+    struct sockaddr_in cam_addr;
+    int node = open_socket(&node_addr);
+    int cam = open_socket(&cam_addr);
+    if (node < 0 || cam < 0) {
+        perror("socket");
+        return false;
+    }
+
+    uint8_t buf[TRIGGER_BATCH_MAX_SIZE];
+    trigger_msg_t event = {.type = TRIGGER_MSG_EVENT, .node_id = NODE_ID, .flags = TRIGGER_FLAG_MOTION};
+    trigger_msg_t msg;
+    trigger_dedup_t dedup;
+    trigger_dedup_init(&dedup);
+    unsigned acked = 0;
+    bool ok = true;
+    double start = now_s();
+    for (unsigned sent = 0; sent < events && ok; ) {
+        unsigned burst = events - sent < window ? events - sent : window;
+        for (unsigned i = 0; i < burst; i++) {
+            event.seq = sent + i;
+            event.timestamp = (int64_t)(now_s() * 1e6);
+            size_t len = trigger_encode(&event, buf);
+            sendto(node, buf, len, 0, (struct sockaddr *)&cam_addr, sizeof(cam_addr));
+        }
+        // Camera side - same steps as trigger_task
+        for (unsigned i = 0; i < burst && ok; i++) {
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            ssize_t len = recvfrom(cam, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+            if (len < 0 || !trigger_decode(buf, len, &msg)) {
+                ok = false;
+                break;
+            }
+            trigger_dedup_accept(&dedup, msg.node_id, msg.seq);
+            trigger_msg_t ack;
+            trigger_make_ack(&msg, (int64_t)(now_s() * 1e6), &ack);
+            len = trigger_encode(&ack, buf);
+            sendto(cam, buf, len, 0, (struct sockaddr *)&from, from_len);
+        }
+        for (unsigned i = 0; i < burst && ok; i++) {
+            ssize_t len = recv(node, buf, sizeof(buf), 0);
+            if (len < 0 || !trigger_decode(buf, len, &msg) || msg.type != TRIGGER_MSG_ACK ||
+                msg.seq != sent + i) {
+                ok = false;
+                break;
+            }
+            acked++;
+        }
+        sent += burst;
+    }
+    double elapsed = now_s() - start;
+    close(node);
+    close(cam);
+    printf("loopback: %u of %u events acked in %.2f s, %.0f events/s, window %u, %u duplicates\n", acked, events,
+           elapsed, acked / elapsed, window, dedup.duplicates);
+    return ok && dedup.duplicates == 0;
+}
+
+int main(int argc, char **argv) {
+    unsigned events = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : DEFAULT_EVENTS;
+    unsigned window = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : DEFAULT_WINDOW;
+    if (events == 0 || window == 0) {
+        fprintf(stderr, "Usage: %s [events] [window]\n", argv[0]);
+        return 2;
+    }
+    bench_codec(events * 10);
+    return bench_loopback(events, window) ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file capture_trace.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Trigger-to-photo traces - when each stage of recent capture events happened
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#include "capture_trace.h"
+
+static const char *stage_names[CAPTURE_TRACE_STAGES] = {
+    "detected", "sent", "received", "flash_on", "grabbed", "stored",
+};
+
+static const char *result_names[] = {
+    "pending", "captured", "rejected", "failed",
+};
+
+bool capture_trace_init(capture_trace_ring_t *ring, size_t depth) {
+    memset(ring, 0, sizeof(*ring));
+    if (depth == 0 || depth > CAPTURE_TRACE_MAX_DEPTH) {
+        return false;
+    }
+    ring->depth = depth;
+    return true;
+}
+
+capture_trace_t *capture_trace_open(capture_trace_ring_t *ring, uint32_t event_id, uint16_t node_id, uint32_t seq) {
+    capture_trace_t *trace = &ring->traces[ring->head];
+    trace->event_id = event_id;
+    trace->node_id = node_id;
+    trace->seq = seq;
+    for (size_t i = 0; i < CAPTURE_TRACE_STAGES; i++) {
+        trace->at[i] = CAPTURE_TRACE_UNKNOWN;
+    }
+    trace->result = CAPTURE_TRACE_PENDING;
+    ring->head = (ring->head + 1) % ring->depth;
+    if (ring->count < ring->depth) {
+        ring->count++;
+    }
+    return trace;
+}
+
+capture_trace_t *capture_trace_find(capture_trace_ring_t *ring, uint32_t event_id) {
+    // Newest first, the event being captured is almost always the last one opened
+    for (size_t i = 0; i < ring->count; i++) {
+        capture_trace_t *trace = &ring->traces[(ring->head + ring->depth - 1 - i) % ring->depth];
+        if (trace->event_id == event_id) {
+            return trace;
+        }
+    }
+    return NULL;
+}
+
+bool capture_trace_mark(capture_trace_ring_t *ring, uint32_t event_id, capture_trace_stage_t stage, int64_t at) {
+    capture_trace_t *trace = capture_trace_find(ring, event_id);
+    if (trace == NULL || stage >= CAPTURE_TRACE_STAGES) {
+        return false;
+    }
+    if (trace->at[stage] == CAPTURE_TRACE_UNKNOWN) {
+        trace->at[stage] = at;
+    }
+    return true;
+}
+
+const capture_trace_t *capture_trace_at(const capture_trace_ring_t *ring, size_t index) {
+    if (index >= ring->count) {
+        return NULL;
+    }
+    return &ring->traces[(ring->head + ring->depth - ring->count + index) % ring->depth];
+}
+
+const char *capture_trace_stage_name(capture_trace_stage_t stage) {
+    return stage < CAPTURE_TRACE_STAGES ? stage_names[stage] : "unknown";
+}
+
+const char *capture_trace_result_name(capture_trace_result_t result) {
+    return result <= CAPTURE_TRACE_FAILED ? result_names[result] : "unknown";
+}
@@ -0,0 +1,104 @@
+/**
+ * @file capture_trace.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Trigger-to-photo traces - when each stage of recent capture events happened
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef CAPTURE_TRACE_H
+#define CAPTURE_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAPTURE_TRACE_MAX_DEPTH 64
+#define CAPTURE_TRACE_UNKNOWN   INT64_MIN       // Stage did not happen (yet) or its time is not known
+
+/**
+ * @brief Stages of a capture event, in the order they normally happen
+ * Detection and sending happen on the node, their times are known only when the node clock is synced.
+ */
+typedef enum {
+    CAPTURE_TRACE_DETECTED = 0,
+    CAPTURE_TRACE_SENT,
+    CAPTURE_TRACE_RECEIVED,
+    CAPTURE_TRACE_FLASH_ON,
+    CAPTURE_TRACE_GRABBED,
+    CAPTURE_TRACE_STORED,
+    CAPTURE_TRACE_STAGES,
+} capture_trace_stage_t;
+
+typedef enum {
+    CAPTURE_TRACE_PENDING = 0,
+    CAPTURE_TRACE_CAPTURED,
+    CAPTURE_TRACE_REJECTED,                     // No motion in view
+    CAPTURE_TRACE_FAILED,
+} capture_trace_result_t;
+
+/**
+ * @brief Trace of one capture event, all times on camera clock (us)
+ */
+typedef struct {
+    uint32_t event_id;
+    uint16_t node_id;
+    uint32_t seq;               // Node event that started it, 0 for plain HTTP trigger
+    int64_t at[CAPTURE_TRACE_STAGES];
+    capture_trace_result_t result;
+} capture_trace_t;
+
+/**
+ * @brief Ring of the latest traces, a new event overwrites the oldest one
+ * Not thread safe - caller is expected to guard it with mutex.
+ */
+typedef struct {
+    capture_trace_t traces[CAPTURE_TRACE_MAX_DEPTH];
+    size_t depth;
+    size_t head;                // Next trace to be written
+    size_t count;
+} capture_trace_ring_t;
+
+/**
+ * @brief Empty ring keeping depth traces
+ * @return false when depth is out of range
+ */
+bool capture_trace_init(capture_trace_ring_t *ring, size_t depth);
+
+/**
+ * @brief Start trace of new event, all stages unknown
+ * @return the trace, stays valid until depth more events are opened
+ */
+capture_trace_t *capture_trace_open(capture_trace_ring_t *ring, uint32_t event_id, uint16_t node_id, uint32_t seq);
+
+/**
+ * @brief Find trace of event
+ * @return NULL when event is not (or no longer) traced
+ */
+capture_trace_t *capture_trace_find(capture_trace_ring_t *ring, uint32_t event_id);
+
+/**
+ * @brief Record time of stage, the first time a stage happens is kept
+ * @return false when event is not traced
+ */
+bool capture_trace_mark(capture_trace_ring_t *ring, uint32_t event_id, capture_trace_stage_t stage, int64_t at);
+
+/**
+ * @brief Get trace by age, index 0 is the oldest one
+ * @return NULL when index is out of range
+ */
+const capture_trace_t *capture_trace_at(const capture_trace_ring_t *ring, size_t index);
+
+/**
+ * @brief Name of stage used in exported traces
+ */
+const char *capture_trace_stage_name(capture_trace_stage_t stage);
+
+/**
+ * @brief Name of result used in exported traces
+ */
+const char *capture_trace_result_name(capture_trace_result_t result);
+
+#endif
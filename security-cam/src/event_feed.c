@@ -0,0 +1,43 @@
+/**
+ * @file event_feed.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Server-Sent Events feed - latest formatted events shared by every subscriber
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include <stdio.h>
+#include <string.h>
+#include "event_feed.h"
+
+void event_feed_init(event_feed_t *feed) {
+    memset(feed, 0, sizeof(*feed));
+    feed->next_seq = 1;
+}
+
+uint32_t event_feed_push(event_feed_t *feed, const char *event, const char *data) {
+    event_feed_msg_t *msg = &feed->msgs[feed->next_seq % EVENT_FEED_DEPTH];
+    int len = snprintf(msg->text, sizeof(msg->text), "id: %u\nevent: %s\ndata: %s\n\n",
+                       (unsigned)feed->next_seq, event, data);
+    if (len < 0 || (size_t)len >= sizeof(msg->text)) {
+        // Event is lost, so is the oldest one which was in the slot
+        msg->seq = 0;
+        return 0;
+    }
+    msg->len = len;
+    msg->seq = feed->next_seq++;
+    return msg->seq;
+}
+
+const event_feed_msg_t *event_feed_get(const event_feed_t *feed, uint32_t seq, bool *expired) {
+    *expired = false;
+    if (seq == 0 || seq >= feed->next_seq) {
+        return NULL;
+    }
+    // Slot of older event was reused by a newer one (or cleared by oversized push)
+    const event_feed_msg_t *msg = &feed->msgs[seq % EVENT_FEED_DEPTH];
+    *expired = msg->seq != seq;
+    return *expired ? NULL : msg;
+}
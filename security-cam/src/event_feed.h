@@ -0,0 +1,58 @@
+/**
+ * @file event_feed.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Server-Sent Events feed - latest formatted events shared by every subscriber
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef EVENT_FEED_H
+#define EVENT_FEED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define EVENT_FEED_DEPTH        8               // Events kept for subscribers that are behind
+#define EVENT_FEED_MSG_SIZE     192             // Largest formatted event (bytes)
+
+/**
+ * @brief One event in text/event-stream format
+ */
+typedef struct {
+    uint32_t seq;               // Also sent as SSE id, 0 means empty
+    size_t len;
+    char text[EVENT_FEED_MSG_SIZE];
+} event_feed_msg_t;
+
+/**
+ * @brief Ring of events, subscriber only keeps sequence number of the next event it wants
+ * Not thread safe - caller is expected to guard it with mutex.
+ */
+typedef struct {
+    event_feed_msg_t msgs[EVENT_FEED_DEPTH];
+    uint32_t next_seq;
+} event_feed_t;
+
+/**
+ * @brief Empty feed, first event gets sequence number 1
+ */
+void event_feed_init(event_feed_t *feed);
+
+/**
+ * @brief Format event and add it to the feed, overwriting the oldest one
+ * @param data single line of data (JSON)
+ * @return sequence number of event, 0 when it does not fit into EVENT_FEED_MSG_SIZE
+ */
+uint32_t event_feed_push(event_feed_t *feed, const char *event, const char *data);
+
+/**
+ * @brief Get event by sequence number
+ * @param expired set when the event was already overwritten - subscriber is too slow
+ * @return NULL when event does not exist (yet)
+ */
+const event_feed_msg_t *event_feed_get(const event_feed_t *feed, uint32_t seq, bool *expired);
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * @file flash_policy.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Light-aware flash policy - flash only in the dark, wait only as long as exposure takes to settle
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#include "flash_policy.h"
+
+void flash_policy_init(flash_policy_t *policy, uint32_t dark_level, uint32_t light_level, uint32_t stable_permille,
+                       int64_t settle_default, int64_t settle_min, int64_t settle_max) {
+    memset(policy, 0, sizeof(*policy));
+    policy->dark_level = dark_level;
+    policy->light_level = light_level < dark_level ? light_level : dark_level;
+    policy->stable_permille = stable_permille;
+    policy->settle_min = settle_min;
+    policy->settle_max = settle_max > settle_min ? settle_max : settle_min;
+    policy->settle_default = settle_default < policy->settle_min ? policy->settle_min
+                           : settle_default > policy->settle_max ? policy->settle_max : settle_default;
+}
+
+uint32_t flash_policy_level(uint32_t exposure_lines, uint32_t gain_x16) {
+    uint64_t level = (uint64_t)exposure_lines * gain_x16 / 16;
+    return level == 0 ? 1 : level < UINT32_MAX ? (uint32_t)level : UINT32_MAX;
+}
+
+/**
+ * @brief Keep finished measurement
+ */
+static void settle_measured(flash_policy_t *policy, int64_t settle) {
+    policy->settles[policy->settle_count % FLASH_POLICY_SETTLE_SAMPLES] = settle;
+    policy->settle_count++;
+    policy->measuring = false;
+}
+
+void flash_policy_frame(flash_policy_t *policy, uint32_t level, int64_t timestamp) {
+    policy->frames++;
+    if (policy->flash_on_at == 0) {
+        if (policy->flash_off_at != 0 && timestamp - policy->flash_off_at < policy->settle_max) {
+            return;
+        }
+        if (policy->level == 0) {
+            policy->level = level;
+        } else {
+            policy->level = policy->level - (policy->level >> FLASH_POLICY_AVG_SHIFT) + (level >> FLASH_POLICY_AVG_SHIFT);
+        }
+        if (!policy->dark && policy->level > policy->dark_level) {
+            policy->dark = true;
+        } else if (policy->dark && policy->level < policy->light_level) {
+            policy->dark = false;
+        }
+        return;
+    }
+    int64_t elapsed = timestamp - policy->flash_on_at;
+    // Frame grabbed right after flash went on was exposed before it
+    if (!policy->measuring || elapsed < policy->settle_min) {
+        return;
+    }
+    uint32_t diff = level > policy->last_level ? level - policy->last_level : policy->last_level - level;
+    if ((uint64_t)diff * 1000 <= (uint64_t)policy->stable_permille * policy->last_level) {
+        // Previous frame was settled already, unless it is the ambient one and flash changed nothing
+        int64_t settle = policy->last_at > policy->flash_on_at ? policy->last_at - policy->flash_on_at : elapsed;
+        settle_measured(policy, settle < policy->settle_max ? settle : policy->settle_max);
+        return;
+    }
+    if (elapsed >= policy->settle_max) {
+        policy->timeouts++;
+        settle_measured(policy, policy->settle_max);
+        return;
+    }
+    policy->last_level = level;
+    policy->last_at = timestamp;
+}
+
+bool flash_policy_decide(flash_policy_t *policy) {
+    // No frame seen yet, flash is the safe guess
+    bool needed = policy->level == 0 || policy->dark;
+    if (needed) {
+        policy->used++;
+    } else {
+        policy->skipped++;
+    }
+    return needed;
+}
+
+void flash_policy_flash_on(flash_policy_t *policy, int64_t timestamp) {
+    if (policy->flash_on_at != 0) {
+        return;
+    }
+    policy->flash_on_at = timestamp != 0 ? timestamp : 1;
+    policy->measuring = true;
+    policy->last_level = policy->level;
+    policy->last_at = policy->flash_on_at;
+}
+
+void flash_policy_flash_off(flash_policy_t *policy, int64_t timestamp) {
+    if (policy->flash_on_at == 0) {
+        return;
+    }
+    policy->flash_on_at = 0;
+    policy->flash_off_at = timestamp;
+    policy->measuring = false;
+}
+
+int64_t flash_policy_settle(const flash_policy_t *policy) {
+    uint32_t kept = policy->settle_count < FLASH_POLICY_SETTLE_SAMPLES ? policy->settle_count
+                                                                       : FLASH_POLICY_SETTLE_SAMPLES;
+    if (kept == 0) {
+        return policy->settle_default;
+    }
+    int64_t shortest = policy->settles[0];
+    for (uint32_t i = 1; i < kept; i++) {
+        shortest = policy->settles[i] < shortest ? policy->settles[i] : shortest;
+    }
+    return shortest < policy->settle_min ? policy->settle_min : shortest;
+}
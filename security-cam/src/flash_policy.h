@@ -0,0 +1,98 @@
+/**
+ * @file flash_policy.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Light-aware flash policy - flash only in the dark, wait only as long as exposure takes to settle
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef FLASH_POLICY_H
+#define FLASH_POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FLASH_POLICY_SETTLE_SAMPLES 8           // Settle times the wait is picked from
+#define FLASH_POLICY_AVG_SHIFT      2           // Ambient level moves 1/4 towards each frame
+
+/**
+ * @brief Policy state
+ * Light is judged by exposure index - exposure time in sensor lines times analog gain - the sensor AEC
+ * settles at for recent frames: bright scene needs short exposure at unity gain, dark scene runs both
+ * up. Ambient level is averaged over frames taken without flash, flash is used above dark_level and
+ * skipped again only below light_level, so a scene near the threshold does not flip every frame.
+ * Frames are ignored for settle_max after flash went off, AEC is still adapted to the flash meanwhile.
+ * With flash on, exposure index drops until AEC settles. Frames within settle_min of flash on were
+ * exposed before it and are skipped. The first frame whose index is within
+ * stable_permille of the previous one ends a settle measurement, the shortest of the recent
+ * measurements is the wait before the next flash frame is grabbed.
+ * Not thread safe - caller is expected to guard it with mutex.
+ */
+typedef struct {
+    uint32_t dark_level;        // Exposure index over which flash is used
+    uint32_t light_level;       // Exposure index under which flash is skipped again
+    uint32_t stable_permille;   // Frame to frame change of exposure index counted as settled
+    int64_t settle_default;     // Wait until the first settle time is measured (us)
+    int64_t settle_min;         // Also shortest time a frame needs to show flash
+    int64_t settle_max;         // Also longest measurement
+    // Ambient light
+    uint32_t level;             // Average exposure index without flash, 0 none yet
+    bool dark;
+    int64_t flash_off_at;       // Last time flash went off
+    // Settle measurement
+    int64_t flash_on_at;        // 0 while flash is off
+    bool measuring;
+    uint32_t last_level;        // Exposure index of previous frame
+    int64_t last_at;            // Its timestamp, flash_on_at for the ambient one
+    int64_t settles[FLASH_POLICY_SETTLE_SAMPLES];
+    uint32_t settle_count;      // Measurements taken, the newest FLASH_POLICY_SETTLE_SAMPLES are kept
+    // Statistics
+    uint32_t frames;            // Frames accounted
+    uint32_t used;              // Captures that used flash
+    uint32_t skipped;           // Captures without flash because there was enough light
+    uint32_t timeouts;          // Measurements that did not settle within settle_max
+} flash_policy_t;
+
+/**
+ * @brief Start without ambient level, flash is used until the first frames are seen
+ * @param settle_default, settle_min, settle_max waits in us
+ */
+void flash_policy_init(flash_policy_t *policy, uint32_t dark_level, uint32_t light_level, uint32_t stable_permille,
+                       int64_t settle_default, int64_t settle_min, int64_t settle_max);
+
+/**
+ * @brief Exposure index of frame
+ * @param exposure_lines exposure time in sensor lines
+ * @param gain_x16 analog gain times 16
+ */
+uint32_t flash_policy_level(uint32_t exposure_lines, uint32_t gain_x16);
+
+/**
+ * @brief Account exposure index of grabbed frame
+ * @param timestamp time frame was grabbed (us)
+ */
+void flash_policy_frame(flash_policy_t *policy, uint32_t level, int64_t timestamp);
+
+/**
+ * @brief Decide whether capture needs flash, counted as used or skipped
+ */
+bool flash_policy_decide(flash_policy_t *policy);
+
+/**
+ * @brief Flash went on, frames after timestamp measure settle time
+ */
+void flash_policy_flash_on(flash_policy_t *policy, int64_t timestamp);
+
+/**
+ * @brief Flash went off, unfinished measurement is dropped
+ */
+void flash_policy_flash_off(flash_policy_t *policy, int64_t timestamp);
+
+/**
+ * @brief Wait between flash on and grabbing the frame (us)
+ */
+int64_t flash_policy_settle(const flash_policy_t *policy);
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * @file focus_metric.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Focus metric - mean squared luma gradient, higher is sharper
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include "focus_metric.h"
+
+static inline int luma(const uint8_t *rgb) {
+    return (77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2]) >> 8;
+}
+
+void focus_metric_init(focus_metric_t *focus) {
+    focus->energy = 0;
+    focus->samples = 0;
+}
+
+void focus_metric_add_rgb888(focus_metric_t *focus, const uint8_t *rgb, size_t w, size_t h) {
+    size_t stride = w * 3;
+    for (size_t y = 0; y < h; y++) {
+        const uint8_t *row = rgb + y * stride;
+        for (size_t x = 0; x < w; x++) {
+            int value = luma(row + x * 3);
+            if (x > 0) {
+                int diff = value - luma(row + (x - 1) * 3);
+                focus->energy += (uint32_t)(diff * diff);
+                focus->samples++;
+            }
+            if (y > 0) {
+                int diff = value - luma(row - stride + x * 3);
+                focus->energy += (uint32_t)(diff * diff);
+                focus->samples++;
+            }
+        }
+    }
+}
+
+uint32_t focus_metric_score(const focus_metric_t *focus) {
+    return focus->samples > 0 ? (uint32_t)(focus->energy / focus->samples) : 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file focus_metric.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Focus metric - mean squared luma gradient, higher is sharper
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef FOCUS_METRIC_H
+#define FOCUS_METRIC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Gradient energy accumulated over blocks of one image
+ * Blocks come straight from JPEG decoder output, so no decoded image has to be kept. Gradients are
+ * taken inside blocks only, block borders are left out.
+ */
+typedef struct {
+    uint64_t energy;            // Sum of squared luma differences
+    uint32_t samples;           // Differences summed
+} focus_metric_t;
+
+/**
+ * @brief Start new image
+ */
+void focus_metric_init(focus_metric_t *focus);
+
+/**
+ * @brief Add block of RGB888 pixels (w * h * 3 bytes, rows without padding)
+ */
+void focus_metric_add_rgb888(focus_metric_t *focus, const uint8_t *rgb, size_t w, size_t h);
+
+/**
+ * @brief Mean squared gradient of everything added so far, 0 for empty image
+ */
+uint32_t focus_metric_score(const focus_metric_t *focus);
+
+#endif
@@ -0,0 +1,121 @@
+/**
+ * @file frame_ring.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Pre-trigger frame ring - keeps N latest JPEG frames so PIR event can look back in time
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include <string.h>
+#include "frame_ring.h"
+
+bool frame_ring_init(frame_ring_t *ring, uint8_t *pool, size_t depth, size_t slot_size) {
+    if (ring == NULL || pool == NULL || depth < 2 || depth > FRAME_RING_MAX_DEPTH || slot_size == 0) {
+        return false;
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->depth = depth;
+    ring->slot_size = slot_size;
+    for (size_t i = 0; i < depth; i++) {
+        ring->slots[i].buf = pool + i * slot_size;
+    }
+    return true;
+}
+
+bool frame_ring_push(frame_ring_t *ring, const uint8_t *data, size_t len,
+                     size_t width, size_t height, int64_t timestamp) {
+    if (ring->frozen) {
+        return false;
+    }
+    if (len > ring->slot_size) {
+        ring->dropped_oversize++;
+        return false;
+    }
+
+    frame_ring_slot_t *slot = &ring->slots[ring->head];
+    if (slot->refs > 0) {
+        ring->dropped_busy++;
+        return false;
+    }
+    memcpy(slot->buf, data, len);
+    slot->len = len;
+    slot->width = width;
+    slot->height = height;
+    slot->timestamp = timestamp;
+    slot->seq = ring->next_seq++;
+
+    ring->head = (ring->head + 1) % ring->depth;
+    if (ring->count < ring->depth) {
+        ring->count++;
+    }
+
+    if (ring->triggered) {
+        if (ring->post_remaining > 0) {
+            ring->post_remaining--;
+        }
+        if (ring->post_remaining == 0) {
+            ring->frozen = true;
+        }
+    }
+    return true;
+}
+
+bool frame_ring_trigger(frame_ring_t *ring, int64_t timestamp, size_t post_frames) {
+    if (ring->triggered || post_frames >= ring->depth) {
+        return false;
+    }
+    ring->triggered = true;
+    ring->trigger_time = timestamp;
+    ring->trigger_seq = ring->next_seq;
+    ring->post_remaining = post_frames;
+    ring->frozen = (post_frames == 0);
+    return true;
+}
+
+void frame_ring_release(frame_ring_t *ring) {
+    ring->triggered = false;
+    ring->frozen = false;
+    ring->post_remaining = 0;
+    ring->count = 0;
+    ring->head = 0;
+}
+
+const frame_ring_slot_t *frame_ring_get(const frame_ring_t *ring, size_t index) {
+    if (index >= ring->count) {
+        return NULL;
+    }
+    // Oldest frame sits right after head once the ring wrapped around
+    size_t oldest = (ring->head + ring->depth - ring->count) % ring->depth;
+    return &ring->slots[(oldest + index) % ring->depth];
+}
+
+const frame_ring_slot_t *frame_ring_ref(frame_ring_t *ring, size_t index) {
+    frame_ring_slot_t *slot = (frame_ring_slot_t *)frame_ring_get(ring, index);
+    if (slot != NULL) {
+        slot->refs++;
+    }
+    return slot;
+}
+
+void frame_ring_unref(frame_ring_t *ring, const frame_ring_slot_t *slot) {
+    ring->slots[slot - ring->slots].refs--;
+}
+
+const frame_ring_slot_t *frame_ring_closest(const frame_ring_t *ring, int64_t timestamp) {
+    const frame_ring_slot_t *best = NULL;
+    int64_t best_diff = INT64_MAX;
+    for (size_t i = 0; i < ring->count; i++) {
+        const frame_ring_slot_t *slot = frame_ring_get(ring, i);
+        int64_t diff = slot->timestamp - timestamp;
+        if (diff < 0) {
+            diff = -diff;
+        }
+        if (diff < best_diff) {
+            best_diff = diff;
+            best = slot;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file frame_ring.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Pre-trigger frame ring - keeps N latest JPEG frames so PIR event can look back in time
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAME_RING_MAX_DEPTH    16
+
+/**
+ * @brief One frame stored in the ring
+ */
+typedef struct {
+    uint8_t *buf;               // Points into the ring pool, slot_size bytes available
+    size_t len;
+    size_t width;
+    size_t height;
+    int64_t timestamp;          // Time of capture (us)
+    uint32_t seq;               // Monotonic frame number
+    uint32_t refs;              // Readers using the frame outside the lock, it is not overwritten meanwhile
+} frame_ring_slot_t;
+
+/**
+ * @brief Fixed size frame ring
+ * Not thread safe - caller is expected to guard it with mutex.
+ */
+typedef struct {
+    frame_ring_slot_t slots[FRAME_RING_MAX_DEPTH];
+    size_t depth;
+    size_t slot_size;
+    size_t head;                // Next slot to be written
+    size_t count;               // Number of valid slots
+    uint32_t next_seq;
+    // Trigger state
+    bool triggered;
+    bool frozen;
+    size_t post_remaining;      // Frames still to be captured after trigger
+    int64_t trigger_time;
+    uint32_t trigger_seq;       // First frame captured after trigger
+    // Statistics
+    uint32_t dropped_oversize;
+    uint32_t dropped_busy;      // Frames not stored because the slot to overwrite was referenced
+} frame_ring_t;
+
+/**
+ * @brief Prepare ring on top of preallocated pool of depth * slot_size bytes
+ * @return false when depth is out of range or pool is missing
+ */
+bool frame_ring_init(frame_ring_t *ring, uint8_t *pool, size_t depth, size_t slot_size);
+
+/**
+ * @brief Copy frame into the ring, overwriting the oldest one
+ * @return false when ring is frozen, frame does not fit into slot or the oldest slot is referenced
+ */
+bool frame_ring_push(frame_ring_t *ring, const uint8_t *data, size_t len,
+                     size_t width, size_t height, int64_t timestamp);
+
+/**
+ * @brief Mark trigger - ring freezes after post_frames more frames are pushed
+ * @return false when ring is already triggered or post_frames does not leave room for pre-trigger frames
+ */
+bool frame_ring_trigger(frame_ring_t *ring, int64_t timestamp, size_t post_frames);
+
+/**
+ * @brief Forget frozen sequence and continue collecting frames
+ */
+void frame_ring_release(frame_ring_t *ring);
+
+/**
+ * @brief Get frame by age, index 0 is the oldest frame in the ring
+ * @return NULL when index is out of range
+ */
+const frame_ring_slot_t *frame_ring_get(const frame_ring_t *ring, size_t index);
+
+/**
+ * @brief Get frame by age like frame_ring_get and keep it from being overwritten until frame_ring_unref
+ * Frame data may then be read without the lock, metadata stays the same as well.
+ * @return NULL when index is out of range
+ */
+const frame_ring_slot_t *frame_ring_ref(frame_ring_t *ring, size_t index);
+
+/**
+ * @brief Drop reference obtained by frame_ring_ref
+ */
+void frame_ring_unref(frame_ring_t *ring, const frame_ring_slot_t *slot);
+
+/**
+ * @brief Get frame with timestamp closest to the trigger time
+ * @return NULL when ring is empty
+ */
+const frame_ring_slot_t *frame_ring_closest(const frame_ring_t *ring, int64_t timestamp);
+
+#endif
@@ -0,0 +1,28 @@
+/**
+ * @file image_scale.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Downscaling of decoded RGB888 images used for photo renditions
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include "image_scale.h"
+
+size_t image_scale_halve_rgb888(const uint8_t *src, size_t width, size_t height, uint8_t *dst) {
+    size_t out_width = width / 2;
+    size_t out_height = height / 2;
+    size_t stride = width * 3;
+    // Output pixel never lies after the input pixels it is made of, so going forward works in place
+    for (size_t y = 0; y < out_height; y++) {
+        const uint8_t *top = src + 2 * y * stride;
+        const uint8_t *bottom = top + stride;
+        for (size_t x = 0; x < out_width; x++, top += 6, bottom += 6) {
+            for (size_t c = 0; c < 3; c++) {
+                *dst++ = (top[c] + top[c + 3] + bottom[c] + bottom[c + 3] + 2) >> 2;
+            }
+        }
+    }
+    return out_width * out_height * 3;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file image_scale.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Downscaling of decoded RGB888 images used for photo renditions
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef IMAGE_SCALE_H
+#define IMAGE_SCALE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Halve RGB888 image by averaging 2x2 pixel boxes, odd last row/column is dropped
+ * dst may be the same buffer as src, result is then written over the start of the image.
+ * @return size of result in bytes
+ */
+size_t image_scale_halve_rgb888(const uint8_t *src, size_t width, size_t height, uint8_t *dst);
+
+#endif
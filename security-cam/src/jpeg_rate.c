@@ -0,0 +1,91 @@
+/**
+ * @file jpeg_rate.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief JPEG rate control - steers sensor quality (and frame size) so frames stay near byte budget
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#include "jpeg_rate.h"
+
+#define STEP_OVER_MILLI     200             // One more quality step per 20 % over budget
+#define STEP_UNDER_MILLI    400             // One more quality step per 40 % under budget
+#define STEP_OVER_MAX       8
+#define STEP_UNDER_MAX      4
+
+void jpeg_rate_init(jpeg_rate_t *rate, uint32_t budget, int quality, int quality_best, int quality_worst,
+                    int size, int size_min, int size_max, uint32_t settle) {
+    memset(rate, 0, sizeof(*rate));
+    rate->budget = budget > 0 ? budget : 1;
+    rate->quality_best = quality_best;
+    rate->quality_worst = quality_worst > quality_best ? quality_worst : quality_best;
+    rate->quality = quality < rate->quality_best ? rate->quality_best
+                  : quality > rate->quality_worst ? rate->quality_worst : quality;
+    rate->size_min = size_min;
+    rate->size_max = size_max > size_min ? size_max : size_min;
+    rate->size = size < rate->size_min ? rate->size_min : size > rate->size_max ? rate->size_max : size;
+    rate->settle = settle;
+}
+
+/**
+ * @brief New settings were chosen, frames in flight still have the old ones
+ */
+static bool rate_changed(jpeg_rate_t *rate) {
+    rate->skip = rate->settle;
+    rate->average = 0;
+    return true;
+}
+
+bool jpeg_rate_update(jpeg_rate_t *rate, size_t len) {
+    rate->frames++;
+    if (rate->skip > 0) {
+        rate->skip--;
+        return false;
+    }
+    uint32_t frame = len < UINT32_MAX ? (uint32_t)len : UINT32_MAX;
+    if (rate->average == 0) {
+        rate->average = frame;
+    } else {
+        rate->average = rate->average - (rate->average >> JPEG_RATE_AVG_SHIFT) + (frame >> JPEG_RATE_AVG_SHIFT);
+    }
+    // Single frame far over budget counts at once, average alone would react to it only after a few frames
+    uint32_t level = frame > rate->average ? frame : rate->average;
+    uint64_t milli = (uint64_t)level * 1000 / rate->budget;
+
+    if (milli > 1000 + JPEG_RATE_DEADBAND) {
+        rate->over++;
+        if (rate->quality < rate->quality_worst) {
+            uint64_t step = 1 + (milli - 1000) / STEP_OVER_MILLI;
+            step = step < STEP_OVER_MAX ? step : STEP_OVER_MAX;
+            rate->quality = rate->quality + (int)step < rate->quality_worst ? rate->quality + (int)step
+                                                                            : rate->quality_worst;
+            rate->quality_changes++;
+            return rate_changed(rate);
+        }
+        if (rate->size > rate->size_min) {
+            rate->size--;
+            rate->size_changes++;
+            return rate_changed(rate);
+        }
+        return false;
+    }
+    if (milli < 1000 - JPEG_RATE_DEADBAND) {
+        if (rate->quality > rate->quality_best) {
+            uint64_t step = 1 + (1000 - milli) / STEP_UNDER_MILLI;
+            step = step < STEP_UNDER_MAX ? step : STEP_UNDER_MAX;
+            rate->quality = rate->quality - (int)step > rate->quality_best ? rate->quality - (int)step
+                                                                           : rate->quality_best;
+            rate->quality_changes++;
+            return rate_changed(rate);
+        }
+        if (milli < JPEG_RATE_SIZE_UP && rate->size < rate->size_max) {
+            rate->size++;
+            rate->size_changes++;
+            return rate_changed(rate);
+        }
+    }
+    return false;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file jpeg_rate.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief JPEG rate control - steers sensor quality (and frame size) so frames stay near byte budget
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef JPEG_RATE_H
+#define JPEG_RATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JPEG_RATE_DEADBAND      150             // Per mille off budget tolerated without change
+#define JPEG_RATE_SIZE_UP       550             // Per mille of budget used at best quality that allows bigger frame
+#define JPEG_RATE_AVG_SHIFT     2               // Frame length average moves 1/4 towards each frame
+
+/**
+ * @brief Controller state
+ * Quality is the sensor one (0-63, lower number means higher quality and bigger frame), size is
+ * a frame size level where higher means more pixels. Over budget the quality gets worse first and
+ * the frame smaller only once quality is at its worst; with headroom the quality gets better first
+ * and the frame bigger only once quality is at its best and frame would fit at least twice. Steps
+ * grow with the distance from budget, steps towards better quality are half as big, so a busy
+ * scene is caught fast and a calm one does not make it oscillate.
+ * Sensor applies new settings a few frames later, so settle frames are ignored after every change.
+ * Not thread safe - caller is expected to guard it with mutex.
+ */
+typedef struct {
+    uint32_t budget;            // Target frame length (bytes)
+    int quality;                // Current sensor quality
+    int quality_best;           // Lowest quality number allowed
+    int quality_worst;          // Highest quality number allowed
+    int size;                   // Current frame size level
+    int size_min;
+    int size_max;               // Equal to size_min keeps frame size fixed
+    uint32_t settle;            // Frames ignored after change
+    uint32_t skip;              // Frames still to be ignored
+    uint32_t average;           // Average frame length since last change, 0 none yet
+    uint32_t frames;            // Frames accounted
+    uint32_t quality_changes;
+    uint32_t size_changes;
+    uint32_t over;              // Frames over budget by more than deadband
+} jpeg_rate_t;
+
+/**
+ * @brief Start controller at the settings camera was initialized with
+ * @param budget target frame length in bytes
+ * @param settle frames to ignore after every change
+ */
+void jpeg_rate_init(jpeg_rate_t *rate, uint32_t budget, int quality, int quality_best, int quality_worst,
+                    int size, int size_min, int size_max, uint32_t settle);
+
+/**
+ * @brief Account length of captured frame
+ * @return true when quality or size changed and has to be set on sensor
+ */
+bool jpeg_rate_update(jpeg_rate_t *rate, size_t len);
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * @file longpoll.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Parked requests - responses written after their handler returned, long-poll for newer photo
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+#include <lwip/sockets.h>
+#include "longpoll.h"
+
+#define DEVICE          "[ESP32 CAM]"
+
+/**
+ * @brief Request waiting for newer photo, answered by longpoll_task
+ */
+typedef struct {
+    httpd_handle_t server;
+    int fd;                     // -1 when the entry is free
+    uint32_t generation;        // Client already has this photo
+    int rendition;
+    int64_t deadline;
+} longpoll_waiter_t;
+
+static longpoll_waiter_t longpoll_waiters[LONGPOLL_MAX_WAITERS];
+static parked_reply_t longpoll_replies[LONGPOLL_MAX_WAITERS];
+static size_t longpoll_sending = 0;                     // Replies being sent by longpoll_task
+static SemaphoreHandle_t longpoll_lock = NULL;          // Guards longpoll_waiters & longpoll_sending, writes of replies
+static TaskHandle_t longpoll_task_handle = NULL;
+static photo_slots_t *longpoll_store = NULL;
+static longpoll_format_t longpoll_format = NULL;
+
+size_t parked_send_all(parked_reply_t *replies, size_t count, SemaphoreHandle_t lock) {
+    size_t done = 0;
+    int64_t now = esp_timer_get_time();
+    for (size_t i = 0; i < count; i++) {
+        replies[i].sent = 0;
+        replies[i].deadline = now + PARKED_SEND_TIMEOUT_MS * 1000LL;
+        replies[i].failed = false;
+    }
+    size_t pending = count;
+    while (pending > 0) {
+        bool progress = false;
+        now = esp_timer_get_time();
+        for (size_t i = 0; i < count; i++) {
+            parked_reply_t *reply = &replies[i];
+            size_t total = reply->header_len + reply->body_len;
+            if (reply->failed || reply->sent == total) {
+                continue;
+            }
+            const char *data = reply->sent < reply->header_len ? reply->header + reply->sent
+                             : (const char *)reply->body + (reply->sent - reply->header_len);
+            size_t len = reply->sent < reply->header_len ? reply->header_len - reply->sent : total - reply->sent;
+            xSemaphoreTake(lock, portMAX_DELAY);
+            int sent = reply->closed ? HTTPD_SOCK_ERR_FAIL : httpd_socket_send(reply->server, reply->fd, data, len,
+                                                                              MSG_DONTWAIT);
+            if (sent > 0) {
+                reply->sent += sent;
+                reply->deadline = now + PARKED_SEND_TIMEOUT_MS * 1000LL;
+                progress = true;
+                if (reply->sent == total) {
+                    done++;
+                    pending--;
+                }
+            } else if (reply->closed) {
+                ESP_LOGE(DEVICE, "[HTTP] Parked request closed by client {fd=%d}", reply->fd);
+                reply->failed = true;
+                pending--;
+            } else if (sent != HTTPD_SOCK_ERR_TIMEOUT || now >= reply->deadline) {
+                ESP_LOGE(DEVICE, "[HTTP] Parked request not answered, closing {fd=%d}", reply->fd);
+                httpd_sess_trigger_close(reply->server, reply->fd);
+                reply->failed = true;
+                pending--;
+            }
+            xSemaphoreGive(lock);
+        }
+        if (pending > 0 && !progress) {
+            vTaskDelay(pdMS_TO_TICKS(PARKED_SEND_POLL_MS));
+        }
+    }
+    return done;
+}
+
+void parked_forget(parked_reply_t *replies, size_t count, int fd) {
+    for (size_t i = 0; i < count; i++) {
+        if (replies[i].fd == fd) {
+            replies[i].closed = true;
+        }
+    }
+}
+
+/**
+ * @brief Response to parked long-poll request
+ * @param photo newer photo, NULL when the wait timed out
+ */
+static void longpoll_reply(parked_reply_t *reply, const longpoll_waiter_t *waiter, const photo_slot_t *photo) {
+    reply->server = waiter->server;
+    reply->fd = waiter->fd;
+    reply->body = NULL;
+    reply->body_len = 0;
+    reply->closed = false;
+    if (photo == NULL) {
+        reply->header_len = sprintf(reply->header, "HTTP/1.1 304 Not Modified\r\nCache-Control: no-cache\r\n\r\n");
+        return;
+    }
+    longpoll_format(reply, photo, waiter->rendition);
+}
+
+/**
+ * @brief Long-poll task - answers parked requests once newer photo is published or they time out
+ */
+static void longpoll_task(void *arg) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, 1000 / portTICK_PERIOD_MS);
+        int64_t now = esp_timer_get_time();
+        photo_slot_t *photo = photo_slots_acquire(longpoll_store);
+        size_t count = 0;
+        // Answered waiters move to longpoll_replies, session close still finds them there while they are sent
+        xSemaphoreTake(longpoll_lock, portMAX_DELAY);
+        for (size_t i = 0; i < LONGPOLL_MAX_WAITERS; i++) {
+            longpoll_waiter_t *waiter = &longpoll_waiters[i];
+            bool newer = photo != NULL && photo->generation > waiter->generation;
+            if (waiter->fd >= 0 && (newer || now >= waiter->deadline)) {
+                longpoll_reply(&longpoll_replies[count++], waiter, newer ? photo : NULL);
+                waiter->fd = -1;
+            }
+        }
+        longpoll_sending = count;
+        xSemaphoreGive(longpoll_lock);
+        parked_send_all(longpoll_replies, count, longpoll_lock);
+        xSemaphoreTake(longpoll_lock, portMAX_DELAY);
+        longpoll_sending = 0;
+        xSemaphoreGive(longpoll_lock);
+        if (photo != NULL) {
+            photo_slots_release(longpoll_store, photo);
+        }
+    }
+}
+
+esp_err_t longpoll_init(photo_slots_t *store, longpoll_format_t format) {
+    for (size_t i = 0; i < LONGPOLL_MAX_WAITERS; i++) {
+        longpoll_waiters[i].fd = -1;
+    }
+    longpoll_store = store;
+    longpoll_format = format;
+    longpoll_lock = xSemaphoreCreateMutex();
+    if (longpoll_lock == NULL ||
+        xTaskCreate(longpoll_task, "longpoll", 4096, NULL, 4, &longpoll_task_handle) != pdPASS) {
+        longpoll_lock = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool longpoll_enabled(void) {
+    return longpoll_lock != NULL;
+}
+
+bool longpoll_park(httpd_req_t *req, uint32_t generation, int rendition) {
+    bool parked = false;
+    xSemaphoreTake(longpoll_lock, portMAX_DELAY);
+    for (size_t i = 0; i < LONGPOLL_MAX_WAITERS && !parked; i++) {
+        if (longpoll_waiters[i].fd < 0) {
+            longpoll_waiters[i] = (longpoll_waiter_t) {
+                .server = req->handle,
+                .fd = httpd_req_to_sockfd(req),
+                .generation = generation,
+                .rendition = rendition,
+                .deadline = esp_timer_get_time() + LONGPOLL_TIMEOUT_MS * 1000LL,
+            };
+            parked = true;
+        }
+    }
+    xSemaphoreGive(longpoll_lock);
+    // Photo may have been published meanwhile
+    xTaskNotifyGive(longpoll_task_handle);
+    return parked;
+}
+
+void longpoll_wake(void) {
+    if (longpoll_task_handle != NULL) {
+        xTaskNotifyGive(longpoll_task_handle);
+    }
+}
+
+void longpoll_forget(int fd) {
+    if (longpoll_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(longpoll_lock, portMAX_DELAY);
+    for (size_t i = 0; i < LONGPOLL_MAX_WAITERS; i++) {
+        if (longpoll_waiters[i].fd == fd) {
+            longpoll_waiters[i].fd = -1;
+        }
+    }
+    parked_forget(longpoll_replies, longpoll_sending, fd);
+    xSemaphoreGive(longpoll_lock);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file longpoll.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Parked requests - responses written after their handler returned, long-poll for newer photo
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef LONGPOLL_H
+#define LONGPOLL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "photo_slots.h"
+
+#define LONGPOLL_MAX_WAITERS    2               // Parked /latest-photo.jpg?wait= requests, each keeps a socket open
+#define LONGPOLL_TIMEOUT_MS     20000           // Parked request gets 304 when no newer photo comes in time
+#define PARKED_SEND_TIMEOUT_MS  5000            // Parked request whose client takes no data this long is closed
+#define PARKED_SEND_POLL_MS     10              // Wait when no parked client could take data
+
+/**
+ * @brief Parked request response - written to the socket after its handler returned, see parked_send_all
+ */
+typedef struct {
+    httpd_handle_t server;
+    int fd;
+    char header[320];
+    size_t header_len;
+    const uint8_t *body;        // Photo the caller holds until the response is written, NULL for none
+    size_t body_len;
+    size_t sent;                // Header and body bytes written
+    int64_t deadline;           // Client not taking data by then is dropped
+    bool failed;
+    bool closed;                // Session closed meanwhile, set by parked_forget under the lock of the sender
+} parked_reply_t;
+
+/**
+ * @brief Fill header and body of 200 response with photo, server and fd are set already
+ * @param rendition rendition the waiter asked for, -1 for full photo
+ */
+typedef void (*longpoll_format_t)(parked_reply_t *reply, const photo_slot_t *photo, int rendition);
+
+/**
+ * @brief Write whole HTTP responses to parked requests, one slow client only delays itself
+ * Sockets are written without blocking, round robin, each gets what its buffer takes. Response whose
+ * client takes no data for PARKED_SEND_TIMEOUT_MS or whose socket fails is cut and the session closed.
+ * Replies stay reachable by parked_forget of the session close callback while they are sent, every
+ * write is done holding lock, so a closed (and maybe reused) descriptor is never written.
+ * @param replies filled with closed false under lock
+ * @return responses written completely, sent of the others stays short of header_len + body_len
+ */
+size_t parked_send_all(parked_reply_t *replies, size_t count, SemaphoreHandle_t lock);
+
+/**
+ * @brief Mark replies of closed session, call holding the lock given to parked_send_all
+ */
+void parked_forget(parked_reply_t *replies, size_t count, int fd);
+
+/**
+ * @brief Start long-poll task
+ * @param store photo store waiters are answered from
+ */
+esp_err_t longpoll_init(photo_slots_t *store, longpoll_format_t format);
+
+/**
+ * @brief Long-poll task is running, ?wait= is answered right away otherwise
+ */
+bool longpoll_enabled(void);
+
+/**
+ * @brief Park request until photo newer than generation is published
+ * @return false when every waiter slot is taken
+ */
+bool longpoll_park(httpd_req_t *req, uint32_t generation, int rendition);
+
+/**
+ * @brief New photo was published
+ */
+void longpoll_wake(void);
+
+/**
+ * @brief Forget waiter of closed session, so its descriptor is not written after reuse
+ */
+void longpoll_forget(int fd);
+
+#endif
@@ -1,472 +1,3160 @@
-/**
- * @file main.c
- * @author Roman Janiczek (xjanic25@vutbr.cz)
- * @brief Camera capture & Web server & AP point
- * @version 0.1
- * @date 2021-11-30
- * 
- * @copyright Copyright (c) 2021
- * 
- */
-// ============================ SYSTEM ============================
-#include <stdio.h>
-#include <string.h>
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
-#include <esp_system.h>
-#include <esp_event.h>
-#include <esp_log.h>
-#include <nvs_flash.h>
-// ============================= WIFI =============================
-#include <esp_wifi.h>
-// ============================= HTTP =============================
-#include <esp_http_server.h>
-// ============================ CAMERA ============================
-#include "esp_camera.h"
-// ================================================================
-
-
-// ============================ SYSTEM ============================
-#define DEVICE          "[ESP32 CAM]"
-// ============================= WIFI =============================
-#define WIFI_SSID       "ESP32-Cam AP"
-#define WIFI_CHAN       7
-#define WIFI_MSCO       4
-// ============================ CAMERA ============================
-/**
- * @brief Camera function - take picture and save on SPIFFS
- */
-esp_err_t take_picture();
-
-#define CAM_PIN_PWDN    32
-#define CAM_PIN_RESET   -1              //software reset will be performed
-#define CAM_PIN_XCLK    0
-#define CAM_PIN_SIOD    26
-#define CAM_PIN_SIOC    27
-#define CAM_PIN_D7      35
-#define CAM_PIN_D6      34
-#define CAM_PIN_D5      39
-#define CAM_PIN_D4      36
-#define CAM_PIN_D3      21
-#define CAM_PIN_D2      19
-#define CAM_PIN_D1      18
-#define CAM_PIN_D0      5
-#define CAM_PIN_VSYNC   25
-#define CAM_PIN_HREF    23
-#define CAM_PIN_PCLK    22
-
-static camera_config_t camera_config = {
-        .pin_pwdn =     CAM_PIN_PWDN,
-        .pin_reset =    CAM_PIN_RESET,
-        .pin_xclk =     CAM_PIN_XCLK,
-        .pin_sscb_sda = CAM_PIN_SIOD,
-        .pin_sscb_scl = CAM_PIN_SIOC,
-
-        .pin_d7 =       CAM_PIN_D7,
-        .pin_d6 =       CAM_PIN_D6,
-        .pin_d5 =       CAM_PIN_D5,
-        .pin_d4 =       CAM_PIN_D4,
-        .pin_d3 =       CAM_PIN_D3,
-        .pin_d2 =       CAM_PIN_D2,
-        .pin_d1 =       CAM_PIN_D1,
-        .pin_d0 =       CAM_PIN_D0,
-        .pin_vsync =    CAM_PIN_VSYNC,
-        .pin_href =     CAM_PIN_HREF,
-        .pin_pclk =     CAM_PIN_PCLK,
-
-        //XCLK 20MHz or 10MHz
-        .xclk_freq_hz = 20000000,
-        .ledc_timer =   LEDC_TIMER_0,
-        .ledc_channel = LEDC_CHANNEL_0,
-
-        .pixel_format = PIXFORMAT_JPEG,     //YUV422,GRAYSCALE,RGB565,JPEG
-        .frame_size =   FRAMESIZE_UXGA,     //QQVGA-UXGA Do not use sizes above QVGA when not JPEG
-
-        .jpeg_quality = 12, //0-63 lower number means higher quality
-        .fb_count = 1       //if more than one, i2s runs in continuous mode. Use only with JPEG
-    };
-
-/**
- * Latest photo store 
- */
-size_t taken_photo_len = 0;
-size_t taken_photo_width = 0;
-size_t taken_photo_height = 0;
-pixformat_t taken_photo_format = PIXFORMAT_JPEG;
-uint8_t *taken_photo_buf = NULL; 
-// ================================================================
-
-
-const TickType_t delay = 250 / portTICK_PERIOD_MS;              // 0.25s
-
-
-// ============================= WIFI =============================
-/**
- * @brief Handle WiFi connect & disconnect event
- * source: https://github.com/espressif/esp-idf/blob/42cce06704a24b01721cd34920f25b2e48b88c55/examples/wifi/getting_started/softAP/main/softap_example_main.c
- */
-static void wifi_event_handler(void* arg, esp_event_base_t event_base,
-                                    int32_t event_id, void* event_data)
-{
-    if (event_id == WIFI_EVENT_AP_STACONNECTED) {
-        wifi_event_ap_staconnected_t* event = (wifi_event_ap_staconnected_t*) event_data;
-        ESP_LOGI(DEVICE, "[WIFI] Station "MACSTR" joined {AID=%d}",
-                 MAC2STR(event->mac), event->aid);
-    } else if (event_id == WIFI_EVENT_AP_STADISCONNECTED) {
-        wifi_event_ap_stadisconnected_t* event = (wifi_event_ap_stadisconnected_t*) event_data;
-        ESP_LOGI(DEVICE, "[WIFI] Station "MACSTR" left {AID=%d}",
-                 MAC2STR(event->mac), event->aid);
-    }
-}
-
-/**
- * @brief Configure and start WiFi AP
- * source: https://github.com/espressif/esp-idf/blob/42cce06704a24b01721cd34920f25b2e48b88c55/examples/wifi/getting_started/softAP/main/softap_example_main.c
- */
-void wifi_config_ap(void) {
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_ap();
-
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &wifi_event_handler,
-                                                        NULL,
-                                                        NULL));
-
-    wifi_config_t custom_config = {
-        .ap = {
-            .ssid = WIFI_SSID,
-            .ssid_len = strlen(WIFI_SSID),
-            .channel = WIFI_CHAN,
-            .max_connection = WIFI_MSCO,
-            .authmode = WIFI_AUTH_OPEN      // Do not require password
-        },
-    };
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &custom_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
-}
-// ================================================================
-
-// ============================= HTTP =============================
-/**
- * @brief Get Handler for Webserver - index.html
- * source: https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/protocols/esp_http_server.html
- */
-esp_err_t get_handler(httpd_req_t *req) {
-    ESP_LOGI(DEVICE, "[HTTP] GET index.html");
-    const char resp[] = "\\
-    <!DOCTYPE HTML>\\
-    <html>\\
-        <head>\\
-            <title>ESP32-Cam WebInterface</title>\\
-            <meta name='viewport' content='width=device-width, initial-scale=1'>\\
-            <style>\\
-                .main {\\
-                    margin: auto;\\
-                    width: 75%;\\
-                }\\
-                .title {\\
-                    text-align: center;\\
-                    display: flex;\\
-                    justify-content: center;\\
-                }\\
-                .camera {\\
-                    display: flex;\\
-                    justify-content: center;\\
-                }\\
-                .camera image {\\
-                    width: 100%;\\
-                }\\
-                .refresh {\\
-                    padding-top: 2rem;\\
-                    display: flex;\\
-                    justify-content: center;\\
-                }\\
-            </style>\\
-            <script>\\
-                function refreshPhoto() {\\
-                    var source = 'latest-photo.jpg',\\
-                    timestamp = (new Date()).getTime(),\\
-                    newUrl = source + '?_=' + timestamp;\\
-                    document.getElementById('photo').src = newUrl;\\
-                }\\
-                setInterval(refreshPhoto, 5000);\\
-            </script>\\
-        </head>\\
-        <body>\\
-            <div class='main'>\\
-                <div class='title'>\\
-                    <h1>Latest photo captured by ESP32 Camera</h1>\\
-                </div>\\
-                <div class='camera'>\\
-                    <image id='photo' src='latest-photo.jpg' width='75%' />\\
-                </div>\\
-                <div class='refresh'>\\
-                    <button onclick='refreshPhoto();'>Refresh (auto every 5s)</button>\\
-                </div>\\
-            </div>\\
-        </body>\\
-    </html>";
-    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
-}
-
-/**
- * @brief Get Handler for Webserver - latest-photo - gets latest photo taken
- * source: https://github.com/espressif/esp-idf/blob/master/examples/protocols/http_server/file_serving/main/file_server.c
- */
-esp_err_t img_handler(httpd_req_t *req) {
-    ESP_LOGI(DEVICE, "[HTTP] GET latest-photo");
-    if (taken_photo_buf == NULL) {
-        ESP_LOGE(DEVICE, "[HTTP] CMD latest-photo no picture found");
-        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No picture found!");
-        return ESP_FAIL;
-    }
-    ESP_LOGI(DEVICE, "[CAM] Sending photo");
-    esp_err_t res = httpd_resp_set_type(req, "image/jpeg");
-    if(res == ESP_OK){
-        res = httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
-    }
-
-    if(res == ESP_OK){
-        if(taken_photo_format == PIXFORMAT_JPEG){
-            res = httpd_resp_send(req, (const char *)taken_photo_buf, taken_photo_len);
-        } else {
-            ESP_LOGE(DEVICE, "[HTTP] CMD latest-photo failed to send");
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to send picture!");
-            return ESP_FAIL;
-        }
-    }
-    return ESP_OK;
-}
-
-/**
- * @brief Get Handler for Webserver - pir-event - due to problem with POST signal for taking photo implemented as GET
- */
-esp_err_t pir_handler(httpd_req_t *req) {
-    ESP_LOGI(DEVICE, "[HTTP] GET take-photo");
-    esp_err_t ret = take_picture();
-    if (ret == ESP_OK) {
-        ESP_LOGI(DEVICE, "[HTTP] CMD take-photo success");
-        char msg_buffer[127];
-        sprintf(msg_buffer, "Picture taken! (%zu x %zu, size: %zu bytes)", taken_photo_width, taken_photo_height, taken_photo_len);
-        httpd_resp_send(req, msg_buffer, HTTPD_RESP_USE_STRLEN);
-        return ESP_OK;
-    } else {
-        ESP_LOGI(DEVICE, "[HTTP] CMD take-photo failure");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to take picture!");
-        return ESP_FAIL;
-    }
-}
-
-/**
- * @brief For HTTP TAKE PHOTO request
- * source: https://github.com/espressif/esp32-camera/blob/master/README.md
- */
-typedef struct {
-        httpd_req_t *req;
-        size_t len;
-} jpg_chunking_t;
-
-/**
- * @brief For HTTP TAKE PHOTO request
- * source: https://github.com/espressif/esp32-camera/blob/master/README.md
- */
-static size_t jpg_encode_stream(void * arg, size_t index, const void* data, size_t len){
-    jpg_chunking_t *j = (jpg_chunking_t *)arg;
-    if(!index){
-        j->len = 0;
-    }
-    if(httpd_resp_send_chunk(j->req, (const char *)data, len) != ESP_OK){
-        return 0;
-    }
-    j->len += len;
-    return len;
-}
-
-/**
- * @brief Get Handler for Webserver - take-photo - due to problem with POST signal for taking photo implemented as GET
- * source: https://github.com/espressif/esp32-camera/blob/master/README.md
- */
-esp_err_t take_handler(httpd_req_t *req){
-    ESP_LOGI(DEVICE, "[CAM] Taking photo");
-    
-    gpio_set_level(4, 1);
-    vTaskDelay(delay);
-    camera_fb_t *photo = esp_camera_fb_get();
-    gpio_set_level(4, 0);
-    if (!photo) {
-        ESP_LOGE(DEVICE, "[CAM] Photo capture failed");
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
-    }
-    
-    ESP_LOGI(DEVICE, "[CAM] Sending photo");
-    esp_err_t res = httpd_resp_set_type(req, "image/jpeg");
-    if(res == ESP_OK){
-        res = httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
-    }
-
-    if(res == ESP_OK){
-        if(photo->format == PIXFORMAT_JPEG){
-            res = httpd_resp_send(req, (const char *)photo->buf, photo->len);
-        } else {
-            jpg_chunking_t jchunk = {req, 0};
-            res = frame2jpg_cb(photo, 80, jpg_encode_stream, &jchunk)?ESP_OK:ESP_FAIL;
-            httpd_resp_send_chunk(req, NULL, 0);
-        }
-    }
-    
-    taken_photo_len = photo->len;
-    taken_photo_width = photo->width;
-    taken_photo_height = photo->height;
-
-    ESP_LOGI(DEVICE, "[CAM] Photo taken! Its size was: %zu bytes\n", photo->len);
-    esp_camera_fb_return(photo);
-    return ESP_OK;
-}
-
-/**
- * @brief Webserver Start
- * source: https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/protocols/esp_http_server.html
- */
-httpd_handle_t start_webserver(void) {
-    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    httpd_handle_t server = NULL;
-
-    if (httpd_start(&server, &config) == ESP_OK) {
-        ESP_LOGI(DEVICE, "[HTTP] Server start success");
-        ESP_LOGI(DEVICE, "[HTTP] Registering endpoints");
-        // Register availiable paths and requests
-        // MAIN PAGE - INDEX.HTML
-        httpd_uri_t index_get = {
-            .uri      = "/",
-            .method   = HTTP_GET,
-            .handler  = get_handler,
-            .user_ctx = NULL
-        };
-        // GET LATEST PHOTO
-        httpd_register_uri_handler(server, &index_get);
-        httpd_uri_t latest_get = {
-            .uri      = "/latest-photo.jpg",
-            .method   = HTTP_GET,
-            .handler  = img_handler,
-            .user_ctx = NULL
-        };
-        httpd_register_uri_handler(server, &latest_get);
-        // PIR EVENT - TAKE PHOTO
-        httpd_uri_t pir_post = {
-            .uri      = "/pir",
-            .method   = HTTP_GET,
-            .handler  = pir_handler,
-            .user_ctx = NULL
-        };
-        httpd_register_uri_handler(server, &pir_post);
-        // MANUAL REQUEST FOR PHOTO (NOT SAVED)
-        httpd_uri_t take_post = {
-            .uri      = "/take-photo",
-            .method   = HTTP_GET,
-            .handler  = take_handler,
-            .user_ctx = NULL
-        };
-        httpd_register_uri_handler(server, &take_post);
-    }
-
-    return server;
-}
-
-/**
- * @brief Webserver stop
- * source: https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/protocols/esp_http_server.html
- */
-void stop_webserver(httpd_handle_t server) {
-    if (server) {
-        httpd_stop(server);
-    }
-}
-// ================================================================
-
-// ============================ CAMERA ============================
-/**
- * @brief Prepare camera for taking picture
- * source: https://github.com/espressif/esp32-camera/blob/master/examples/main/take_picture.c
- */
-esp_err_t init_camera()
-{   
-    esp_err_t err = esp_camera_init(&camera_config);
-    if (err != ESP_OK)
-    {
-        ESP_LOGE(DEVICE, "[CAM] Initialization failed");
-        return err;
-    }
-    
-    ESP_LOGI(DEVICE, "[CAM] Camera initialized");
-    return ESP_OK;
-}
-
-/**
- * @brief Takes a picture and saves it to temp memory
- */
-esp_err_t take_picture() {
-    ESP_LOGI(DEVICE, "[CAM] Taking photo");
-    
-    gpio_set_level(4, 1);
-    vTaskDelay(delay);
-    camera_fb_t *photo = esp_camera_fb_get();
-    gpio_set_level(4, 0);
-
-    if (taken_photo_buf != NULL) {
-        free(taken_photo_buf);
-    }
-    taken_photo_buf = malloc(photo->len);
-    mempcpy(taken_photo_buf, photo->buf, photo->len);
-
-    taken_photo_format = photo->format;
-    taken_photo_len = photo->len;
-    taken_photo_width = photo->width;
-    taken_photo_height = photo->height;
-
-    ESP_LOGI(DEVICE, "[CAM] Photo taken! Its size was: %zu bytes\n", photo->len);
-    esp_camera_fb_return(photo);
-    return ESP_OK;
-}
-
-// ============================ MAIN ==============================
-void app_main() {
-    // ====================== CONFIGURATION PART ======================
-    // Initialize NVS
-    // Taken from https://github.com/espressif/esp-idf/blob/42cce06704a24b01721cd34920f25b2e48b88c55/examples/wifi/getting_started/softAP/main/softap_example_main.c
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(ret);
-
-    // Call WiFi AP setup & start
-    wifi_config_ap();
-    // Start Webserver
-    httpd_handle_t server = start_webserver();
-    // Initialize camera
-    if (ESP_OK != init_camera()) {
-        return;
-    }
-    // Init Flash LED
-    gpio_pad_select_gpio(4);
-    gpio_set_direction(4, GPIO_MODE_OUTPUT);
-    gpio_set_level(4, 0);
-    // ================================================================
-
-    // ========================== EXECUTION ===========================
-    // Infinite loop, waiting for incoming request on web server
-    while(1) {}
-    // Unreachable due to infinite loop
-    stop_webserver(server);
-    // ================================================================
-}
+/**
+ * @file main.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Camera capture & Web server & AP point
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+// ============================ SYSTEM ============================
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <esp_partition.h>
+// ============================= UDP ==============================
+#include <lwip/sockets.h>
+#include <esp_event.h>
+#include <esp_log.h>
+#include <nvs_flash.h>
+// ============================= WIFI =============================
+#include <esp_wifi.h>
+// ============================= HTTP =============================
+#include <esp_http_server.h>
+// ============================ CAMERA ============================
+#include "esp_camera.h"
+#include "esp_jpg_decode.h"
+#include "frame_ring.h"
+#include "photo_slots.h"
+#include "photo_archive.h"
+#include "trigger_proto.h"
+#include "node_table.h"
+#include "metrics.h"
+#include "motion_detect.h"
+#include "focus_metric.h"
+#include "jpeg_rate.h"
+#include "flash_policy.h"
+#include "capture_trace.h"
+#include "notify.h"
+#include "longpoll.h"
+#include "upload.h"
+#include "supervisor.h"
+#include "rendition.h"
+#include "static_assets.h"
+// ================================================================
+
+
+// ============================ SYSTEM ============================
+#define DEVICE          "[ESP32 CAM]"
+// ============================= WIFI =============================
+#define WIFI_SSID       "ESP32-Cam AP"
+#define WIFI_CHAN       7
+#define WIFI_MSCO       10                                      // Stations allowed on AP (1-10, ESP32 soft-AP limit)
+#if WIFI_MSCO < 1 || WIFI_MSCO > 10
+#error "WIFI_MSCO must be 1-10"
+#endif
+// ============================= HTTP =============================
+#define HTTP_SEND_CHUNK         (8 * 1024)      // Photos are written to the socket in pieces of this size, ?chunk= overrides
+#define HTTP_SEND_CHUNK_MIN     512
+#define HTTP_SEND_CHUNK_MAX     (64 * 1024)
+#define HTTP_RECV_RETRIES       2               // Receive timeouts (recv_wait_timeout each) tolerated while reading request body
+// ============================= TAKE =============================
+#define TAKE_MAX_WAITERS        2               // /take-photo requests sharing one capture, each keeps a socket open
+// ============================ PRE-ROLL ==========================
+#define PREROLL_ENABLED         1               // Keep recent frames so PIR event contains moment before trigger
+#define PREROLL_DEPTH           7               // Frames kept in ring (max FRAME_RING_MAX_DEPTH), burst included
+#define PREROLL_FPS             4               // Pre-roll capture rate (frames per second)
+#define PREROLL_SLOT_SIZE       (256 * 1024)    // Largest JPEG accepted into ring (bytes)
+#define PREROLL_HOLD_MS         10000           // How long frozen sequence stays downloadable
+// ============================= BURST ============================
+#define BURST_FRAMES            4               // Frames captured after trigger into the pre-roll ring
+#define BURST_INTERVAL_MS       150             // Interval of burst frames (UXGA sensor gives ~6 fps)
+#define BURST_PICK_SHARPEST     1               // Store the sharpest burst frame instead of the one closest to trigger
+#if BURST_FRAMES >= PREROLL_DEPTH
+#error "BURST_FRAMES must leave room for pre-trigger frames in PREROLL_DEPTH"
+#endif
+// ============================= STREAM ===========================
+#define STREAM_PORT             81              // Separate server so streams never block /pir
+#define STREAM_CTRL_PORT        32769           // Control port of the stream server (main server uses default 32768)
+#define STREAM_MAX_CLIENTS      2               // Concurrent MJPEG viewers
+#define STREAM_MAX_FPS          10              // Frame rate cap for viewers
+#define STREAM_SLOT_SIZE        PREROLL_SLOT_SIZE
+#define STREAM_BOUNDARY         "frame-boundary"
+// Sockets (CONFIG_LWIP_MAX_SOCKETS=17): main server 2 + 6, stream server 2 + STREAM + NOTIFY + 1, UDP trigger 1, upload 1
+#define WEB_MAX_SOCKETS         6               // Open connections of main server, parked requests included
+#if TAKE_MAX_WAITERS + LONGPOLL_MAX_WAITERS > WEB_MAX_SOCKETS - 2
+#error "Parked requests must leave WEB_MAX_SOCKETS room for 2 ordinary requests (/pir, /status)"
+#endif
+// ============================ ARCHIVE ===========================
+#define ARCHIVE_ENABLED         1               // Keep every PIR photo in the spiffs partition
+#define ARCHIVE_SEGMENT_SIZE    (320 * 1024)    // Must hold the largest photo, multiple of flash sector
+#define ARCHIVE_MAX_ENTRIES     128             // Photos kept in RAM index
+#define ARCHIVE_QUEUE_LEN       4               // Photos waiting to be written to flash
+#define ARCHIVE_STAGE_SIZE      (256 * 1024)    // Copies of waiting photos (PSRAM), photo that does not fit is not archived
+#define ARCHIVE_CHUNK_SIZE      4096            // Read buffer when serving archived photo
+// ============================ CAPTURE ===========================
+#define CAPTURE_QUEUE_LEN       4               // Triggers waiting for the capture task
+#define CAPTURE_COALESCE_MS     1500            // Triggers from any node this long after episode start share its capture
+#define REPLAY_CAPTURE_MAX_AGE_MS 2000          // Newest event of a replayed batch younger than this still gets a picture
+// ============================= NODES ============================
+#define NODE_RATE_BURST         3               // Episodes one sensor node may start back to back
+#define NODE_RATE_REFILL_MS     20000           // Node earns one more episode this often
+// ============================ MOTION ============================
+#define MOTION_VERIFY_ENABLED   1               // Keep PIR photo only when the scene differs from background
+#define MOTION_MAX_PIXELS       (200 * 150)     // Grayscale frame decoded at 1/8 scale (UXGA)
+#define MOTION_BLOCK_THRESHOLD  20              // Mean difference of 8x8 block counted as change
+#define MOTION_MIN_CHANGE       15              // Changed blocks per mille needed to keep photo
+#define MOTION_LEARN_SHIFT      3               // Background moves 1/8 towards each learned frame
+#define MOTION_LEARN_EVERY      4               // Pre-roll frames between background updates
+// ============================= RATE =============================
+#define RATE_CONTROL_ENABLED    1               // Adapt sensor JPEG quality so frames stay near RATE_BUDGET
+#ifndef RATE_BUDGET                             // May come from build flags (host simulation)
+#define RATE_BUDGET             (96 * 1024)     // Target frame length (bytes), well below PREROLL_SLOT_SIZE
+#endif
+#define RATE_QUALITY_BEST       8               // Lower numbers overflow JPEG buffer on busy scenes
+#define RATE_QUALITY_WORST      40
+#define RATE_ADAPT_FRAMESIZE    0               // Step frame size (SVGA-UXGA) too once quality alone can not hold budget
+#define RATE_SETTLE_FRAMES      2               // Frames still coming with old settings after change
+// ============================= FLASH ============================
+#define FLASH_POLICY_ENABLED    1               // Light flash only in the dark and wait only until exposure settles
+#define FLASH_DARK_LEVEL        5000            // Exposure index (lines x gain) over which flash is used - full frame at 4x gain
+#define FLASH_LIGHT_LEVEL       2500            // Exposure index under which flash is skipped again
+#define FLASH_STABLE_PERMILLE   200             // Frame to frame exposure change counted as settled
+#define FLASH_SETTLE_DEFAULT_MS 250             // Wait with flash lit until settle time is measured
+#define FLASH_SETTLE_MIN_MS     50
+#define FLASH_SETTLE_MAX_MS     1000            // Longest wait, flash exposure not settled by then counts as timeout
+#define FLASH_PROBE_MS          5000            // Light is sampled this often while no frames are grabbed otherwise
+// ============================= TRACE ============================
+#define TRACE_DEPTH             32              // Capture events whose stage times are kept for /traces
+// ============================ METRICS ===========================
+#define METRICS_LINE_SIZE       1024            // Buffer for one formatted metric, each is sent as its own chunk
+// ============================ CAMERA ============================
+/**
+ * @brief Camera function - take picture and hand it to store_photo, which publishes it in the photo slots
+ * @return ESP_ERR_NOT_FOUND when motion check dropped the photo
+ */
+esp_err_t take_picture(uint32_t event_id);
+/**
+ * @brief Where trigger came from, times on camera clock (us)
+ */
+typedef struct {
+    uint32_t seq;               // Node event, 0 for plain HTTP trigger
+    int64_t detected;           // Motion on the node, CAPTURE_TRACE_UNKNOWN unless node clock is synced
+    int64_t sent;               // Node sent the trigger, CAPTURE_TRACE_UNKNOWN unless node clock is synced
+    int64_t received;
+} trigger_origin_t;
+/**
+ * @brief Camera function - queue picture for trigger of node, returns event id (0 when rejected)
+ */
+uint32_t request_capture(uint16_t node_id, int64_t trigger_time, const trigger_origin_t *origin, bool *limited);
+/**
+ * @brief Camera function - queue capture for /take-photo behind pending triggers, returns event id (0 when queue is full)
+ */
+uint32_t request_take(void);
+/**
+ * @brief Camera function - account batch of replayed events of node, returns event id of capture (0 when none)
+ */
+uint32_t replay_events(const trigger_msg_t *batch, const trigger_batch_entry_t *entries, size_t count, bool *limited);
+/**
+ * @brief Camera function - grab frame from driver and record its latency
+ */
+static camera_fb_t *grab_frame();
+/**
+ * @brief Camera function - light flash when the scene needs it, returns true when lit
+ */
+static bool flash_prepare(int64_t *settle);
+/**
+ * @brief Camera function - switch flash LED
+ */
+static void flash_set(bool on);
+/**
+ * @brief Take-photo - hand photo of finished capture (NULL when it failed) to parked requests
+ * @param busy capture could not even be queued
+ */
+static void take_done(photo_slot_t *photo, bool busy);
+/**
+ * @brief Archive function - copy published photo for the archive task
+ */
+static void archive_submit(const photo_slot_t *photo);
+
+#define PHOTO_SLOT_SIZE (256 * 1024)    // Largest photo kept as latest (bytes), PHOTO_SLOTS_COUNT slots in PSRAM
+
+#define RENDITION_ENABLED       1               // Keep medium & thumbnail version of every photo
+#define RENDITION_MEDIUM        0               // Index of photo_slot_t renditions - 1/4 scale (400x300 for UXGA)
+#define RENDITION_THUMB         1               // 1/8 scale (200x150 for UXGA)
+#define RENDITION_MEDIUM_SIZE   (48 * 1024)     // Largest medium JPEG kept (bytes)
+#define RENDITION_THUMB_SIZE    (16 * 1024)     // Largest thumbnail JPEG kept (bytes)
+
+#define CAM_PIN_PWDN    32
+#define CAM_PIN_RESET   -1              //software reset will be performed
+#define CAM_PIN_XCLK    0
+#define CAM_PIN_SIOD    26
+#define CAM_PIN_SIOC    27
+#define CAM_PIN_D7      35
+#define CAM_PIN_D6      34
+#define CAM_PIN_D5      39
+#define CAM_PIN_D4      36
+#define CAM_PIN_D3      21
+#define CAM_PIN_D2      19
+#define CAM_PIN_D1      18
+#define CAM_PIN_D0      5
+#define CAM_PIN_VSYNC   25
+#define CAM_PIN_HREF    23
+#define CAM_PIN_PCLK    22
+
+static camera_config_t camera_config = {
+        .pin_pwdn =     CAM_PIN_PWDN,
+        .pin_reset =    CAM_PIN_RESET,
+        .pin_xclk =     CAM_PIN_XCLK,
+        .pin_sscb_sda = CAM_PIN_SIOD,
+        .pin_sscb_scl = CAM_PIN_SIOC,
+
+        .pin_d7 =       CAM_PIN_D7,
+        .pin_d6 =       CAM_PIN_D6,
+        .pin_d5 =       CAM_PIN_D5,
+        .pin_d4 =       CAM_PIN_D4,
+        .pin_d3 =       CAM_PIN_D3,
+        .pin_d2 =       CAM_PIN_D2,
+        .pin_d1 =       CAM_PIN_D1,
+        .pin_d0 =       CAM_PIN_D0,
+        .pin_vsync =    CAM_PIN_VSYNC,
+        .pin_href =     CAM_PIN_HREF,
+        .pin_pclk =     CAM_PIN_PCLK,
+
+        //XCLK 20MHz or 10MHz
+        .xclk_freq_hz = 20000000,
+        .ledc_timer =   LEDC_TIMER_0,
+        .ledc_channel = LEDC_CHANNEL_0,
+
+        .pixel_format = PIXFORMAT_JPEG,     //YUV422,GRAYSCALE,RGB565,JPEG
+        .frame_size =   FRAMESIZE_UXGA,     //QQVGA-UXGA Do not use sizes above QVGA when not JPEG
+
+        .jpeg_quality = 12, //0-63 lower number means higher quality
+        .fb_count = PREROLL_ENABLED ? 2 : 1, //if more than one, i2s runs in continuous mode. Use only with JPEG
+        .grab_mode = CAMERA_GRAB_LATEST     //burst frames must be fresh, not the one waiting in the other buffer
+    };
+
+/**
+ * Latest photo store - readers hold a reference instead of copying
+ */
+static photo_slots_t photo_store;
+/**
+ * Random per boot - generation restarts at 1 after reboot, so ETag alone would repeat across boots
+ */
+static uint32_t photo_boot_id;
+
+/**
+ * Take-photo - requests parked until the queued capture is done, all answered with its photo by take_task
+ */
+typedef struct {
+    httpd_handle_t server;
+    int fd;                     // -1 when the entry is free
+    int64_t parked_at;
+} take_waiter_t;
+
+static take_waiter_t take_waiters[TAKE_MAX_WAITERS];
+static parked_reply_t take_replies[TAKE_MAX_WAITERS];
+static size_t take_sending = 0;                         // Replies being sent by take_task
+static bool take_running = false;                       // Capture queued or in progress, new requests join it
+static photo_slot_t *take_photo = NULL;                 // Reference to photo of finished capture, for take_task
+static bool take_busy = false;                          // Capture of finished round could not be queued
+static SemaphoreHandle_t take_lock = NULL;              // Guards take_*, writes of take_replies
+static TaskHandle_t take_task_handle = NULL;
+
+/**
+ * Pre-roll ring (frames before and after latest PIR trigger)
+ */
+static frame_ring_t preroll_ring;
+static SemaphoreHandle_t preroll_lock = NULL;          // Guards preroll_ring
+static SemaphoreHandle_t preroll_done = NULL;          // Given when ring freezes after trigger
+static int64_t preroll_frozen_at = 0;
+static uint32_t preroll_event_id = 0;                   // Event of frozen sequence, served at /events/<id>
+static uint32_t preroll_focus[FRAME_RING_MAX_DEPTH];    // Focus of frozen frames by index, 0 = not measured
+static size_t preroll_stored = 0;                       // Index of frozen frame stored as photo
+static TaskHandle_t camera_task_handle = NULL;          // Woken on trigger so burst starts right away
+
+/**
+ * Live frame for MJPEG stream viewers
+ */
+static uint8_t *live_buf = NULL;
+static size_t live_len = 0;
+static uint32_t live_seq = 0;                           // 0 means no frame yet
+static SemaphoreHandle_t live_lock = NULL;              // Guards live_*
+static atomic_int stream_clients = 0;                   // Stream tasks running
+static atomic_uint stream_dropped = 0;                  // Frames skipped by slow viewers
+
+/**
+ * Motion verification - background learned from pre-roll frames (or from PIR photos without pre-roll)
+ */
+static motion_detect_t motion;
+static uint8_t *motion_frame = NULL;                    // Decoded grayscale frame
+static SemaphoreHandle_t motion_lock = NULL;            // Guards motion & motion_frame
+
+/**
+ * Photo archive on flash
+ */
+static photo_archive_t archive;
+static archive_entry_t archive_entries[ARCHIVE_MAX_ENTRIES];
+static SemaphoreHandle_t archive_lock = NULL;           // Guards archive
+
+/**
+ * Archive staging - photos waiting for flash are copied, so the archive never holds a photo slot
+ */
+typedef struct {
+    uint32_t event_id;
+    size_t offset;              // Copy of the photo in archive_stage
+    size_t len;
+    int64_t timestamp;
+    uint16_t width;
+    uint16_t height;
+} archive_job_t;
+
+static QueueHandle_t archive_queue = NULL;              // Staged photos waiting to be archived, oldest first
+static uint8_t *archive_stage = NULL;
+static size_t archive_stage_head = 0;                   // Next copy starts here
+static size_t archive_stage_tail = 0;                   // Copies not archived yet lie from here to head (wrapping)
+static size_t archive_stage_pending = 0;                // Copies not archived yet
+static SemaphoreHandle_t archive_stage_lock = NULL;     // Guards archive_stage_*
+
+/**
+ * Capture task - triggers from HTTP and UDP are queued and handled one by one
+ */
+typedef struct {
+    uint32_t event_id;
+    uint16_t node_id;           // Node that started the episode
+    int64_t trigger_time;       // Arrival of the first trigger (us)
+    bool take;                  // Capture for /take-photo, no motion check and answered by take_task
+} capture_request_t;
+
+typedef struct {
+    uint32_t requested;         // Triggers received
+    uint32_t merged;            // Triggers folded into previous event
+    uint32_t dropped;           // Triggers rejected because queue was full
+    uint32_t limited;           // Triggers rejected by per-node rate limit
+    uint32_t late;              // Replayed events too old for a picture, only accounted
+    uint32_t captured;
+    uint32_t failed;
+    uint32_t rejected;          // Captures without motion in view
+    uint32_t last_event;
+    int64_t last_wait_us;       // Trigger to capture start
+    int64_t last_capture_us;
+    int64_t max_capture_us;
+    int64_t total_capture_us;
+} capture_stats_t;
+
+static QueueHandle_t capture_queue = NULL;
+static SemaphoreHandle_t capture_state_lock = NULL;     // Guards event ids, capture_stats, nodes & trigger_dedup
+static uint32_t next_event_id = 1;
+static capture_stats_t capture_stats;
+static node_table_t nodes;                              // Sensor nodes & running capture episode
+static trigger_dedup_t trigger_dedup;                   // Sequence numbers seen over UDP & in batches
+
+/**
+ * Capture traces - stage times of recent events, served at /traces
+ */
+static capture_trace_ring_t traces;
+static SemaphoreHandle_t trace_lock = NULL;             // Guards traces, never held while taking another lock
+
+/**
+ * JPEG rate control - sensor quality follows length of grabbed frames
+ */
+static jpeg_rate_t jpeg_rate;
+static SemaphoreHandle_t rate_lock = NULL;              // Guards jpeg_rate & the sensor settings it owns
+static const framesize_t rate_framesizes[] = {FRAMESIZE_SVGA, FRAMESIZE_XGA, FRAMESIZE_SXGA, FRAMESIZE_UXGA};
+
+/**
+ * Flash policy - fed with sensor exposure of every grabbed frame
+ */
+static flash_policy_t flash_policy;
+static SemaphoreHandle_t flash_lock = NULL;             // Guards flash_policy, never held while taking another lock
+
+/**
+ * Camera driver users - re-init waits until every frame is back with the driver
+ */
+static SemaphoreHandle_t camera_lock = NULL;            // Guards camera_users & camera_reinit
+static int camera_users = 0;                            // Grabs in progress and frames not returned yet
+static bool camera_reinit = false;                      // Driver is being initialized again, grabs wait
+static atomic_uint camera_errors = 0;                   // Failed grabs in a row
+static atomic_bool camera_delivered = false;            // Frame grabbed since last re-init
+
+static httpd_handle_t web_servers[2];                   // Stopped by supervisor before restart
+
+/**
+ * Metrics - updated lock-free from hot paths, served at /metrics
+ */
+static METRICS_HISTOGRAM(metric_detect_to_stored, "cam_detect_to_stored_seconds",
+                         "Time from motion detected by synced node until photo was published as latest");
+static METRICS_HISTOGRAM(metric_capture_wait, "cam_capture_queue_wait_seconds",
+                         "Time from trigger arrival until capture task picked it up");
+static METRICS_HISTOGRAM(metric_trigger_to_stored, "cam_trigger_to_stored_seconds",
+                         "Time from trigger arrival until photo was published as latest");
+static METRICS_HISTOGRAM(metric_flash_warmup, "cam_flash_warmup_seconds",
+                         "Time flash was lit before grabbing frame");
+static METRICS_HISTOGRAM(metric_trigger_to_frame, "cam_trigger_to_frame_seconds",
+                         "Time from start of capture until the stored frame was grabbed");
+static METRICS_HISTOGRAM(metric_preroll_freeze, "cam_preroll_freeze_seconds",
+                         "Time from trigger until pre-roll ring froze");
+static METRICS_HISTOGRAM(metric_frame_grab, "cam_frame_grab_seconds",
+                         "Duration of esp_camera_fb_get");
+static METRICS_HISTOGRAM(metric_focus_check, "cam_focus_check_seconds",
+                         "Decoding burst frame to measure its focus");
+static METRICS_HISTOGRAM(metric_motion_check, "cam_motion_check_seconds",
+                         "Decoding frame at 1/8 scale and comparing it with background");
+static METRICS_HISTOGRAM(metric_rendition, "cam_rendition_seconds",
+                         "Decoding photo at 1/4 scale and encoding medium & thumbnail version");
+static METRICS_HISTOGRAM(metric_store_copy, "cam_store_copy_seconds",
+                         "Copy of frame into photo slot");
+static METRICS_HISTOGRAM(metric_archive_write, "cam_archive_write_seconds",
+                         "Append of photo to flash archive");
+static METRICS_HISTOGRAM(metric_archive_copy, "cam_archive_copy_seconds",
+                         "Copy of published photo into archive staging buffer");
+static METRICS_HISTOGRAM(metric_http_latest, "cam_http_latest_send_seconds",
+                         "Sending body of /latest-photo.jpg");
+static METRICS_HISTOGRAM(metric_http_take, "cam_http_take_seconds",
+                         "Whole /take-photo request including wait for shared capture");
+static METRICS_COUNTER(metric_frames, "cam_frames_grabbed_total", "Frames returned by the camera driver");
+static METRICS_COUNTER(metric_frame_errors, "cam_frame_grab_errors_total", "Failed esp_camera_fb_get calls");
+static METRICS_COUNTER(metric_burst_frames, "cam_burst_frames_total", "Frames captured in bursts after trigger");
+static METRICS_COUNTER(metric_http_bytes, "cam_http_photo_bytes_sent_total",
+                       "Photo bytes sent by /latest-photo.jpg and /take-photo");
+static METRICS_COUNTER(metric_archive_errors, "cam_archive_errors_total", "Photos that could not be archived");
+static METRICS_COUNTER(metric_archive_dropped, "cam_archive_dropped_total",
+                       "Photos left out of the archive because flash writes fell behind");
+static METRICS_COUNTER(metric_http_aborted, "cam_http_photo_sends_aborted_total",
+                       "Photo responses ended early because a chunk could not be sent");
+static METRICS_COUNTER(metric_sync_replies, "cam_clock_sync_replies_total", "Clock sync requests of nodes answered");
+static METRICS_COUNTER(metric_take_requests, "cam_take_requests_total", "/take-photo requests answered with photo or error");
+static METRICS_COUNTER(metric_take_captures, "cam_take_captures_total",
+                       "Captures made for /take-photo, each one answers every request waiting for it");
+static METRICS_COUNTER(metric_take_rejected, "cam_take_rejected_total", "/take-photo requests refused, too many waiting");
+static METRICS_COUNTER(metric_flash_saved, "cam_flash_wait_saved_milliseconds_total",
+                       "Flash wait saved against fixed FLASH_SETTLE_DEFAULT_MS, by skipping flash or shorter settle time");
+// ================================================================
+
+
+// ============================= WIFI =============================
+/**
+ * @brief Handle WiFi connect & disconnect event
+ * source: https://github.com/espressif/esp-idf/blob/42cce06704a24b01721cd34920f25b2e48b88c55/examples/wifi/getting_started/softAP/main/softap_example_main.c
+ */
+static void wifi_event_handler(void* arg, esp_event_base_t event_base,
+                                    int32_t event_id, void* event_data)
+{
+    if (event_id == WIFI_EVENT_AP_STACONNECTED) {
+        wifi_event_ap_staconnected_t* event = (wifi_event_ap_staconnected_t*) event_data;
+        ESP_LOGI(DEVICE, "[WIFI] Station "MACSTR" joined {AID=%d}",
+                 MAC2STR(event->mac), event->aid);
+    } else if (event_id == WIFI_EVENT_AP_STADISCONNECTED) {
+        wifi_event_ap_stadisconnected_t* event = (wifi_event_ap_stadisconnected_t*) event_data;
+        ESP_LOGI(DEVICE, "[WIFI] Station "MACSTR" left {AID=%d}",
+                 MAC2STR(event->mac), event->aid);
+    }
+}
+
+/**
+ * @brief Configure and start WiFi AP
+ * source: https://github.com/espressif/esp-idf/blob/42cce06704a24b01721cd34920f25b2e48b88c55/examples/wifi/getting_started/softAP/main/softap_example_main.c
+ */
+void wifi_config_ap(void) {
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    esp_netif_create_default_wifi_ap();
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                        ESP_EVENT_ANY_ID,
+                                                        &wifi_event_handler,
+                                                        NULL,
+                                                        NULL));
+
+    wifi_config_t custom_config = {
+        .ap = {
+            .ssid = WIFI_SSID,
+            .ssid_len = strlen(WIFI_SSID),
+            .channel = WIFI_CHAN,
+            .max_connection = WIFI_MSCO,
+            .authmode = WIFI_AUTH_OPEN      // Do not require password
+        },
+    };
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &custom_config));
+    ESP_ERROR_CHECK(esp_wifi_start());
+}
+// ================================================================
+
+// ============================= HTTP =============================
+/**
+ * @brief Get Handler for Webserver - static files - dashboard from html/, sent as embedded gzip
+ * Dashboard pages are revalidated with ETag (answered by 304), other files are cached for a year.
+ */
+esp_err_t static_handler(httpd_req_t *req) {
+    ESP_LOGI(DEVICE, "[HTTP] GET %s", req->uri);
+    const static_asset_t *asset = static_assets_find(req->uri);
+    if (asset == NULL) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Not found!");
+        return ESP_FAIL;
+    }
+    bool page = strcmp(asset->type, "text/html") == 0;
+    httpd_resp_set_type(req, asset->type);
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", page ? "no-cache" : "public, max-age=31536000, immutable");
+
+    char if_none_match[64];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, asset->etag) != NULL) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    return httpd_resp_send(req, (const char *)asset->data, asset->len);
+}
+
+/**
+ * @brief Pick requested rendition of photo, full photo when the rendition could not be made
+ * @return name of size actually picked
+ */
+static const char *pick_rendition(const photo_slot_t *photo, int rendition, const uint8_t **buf, size_t *len) {
+    if (rendition >= 0 && photo->renditions[rendition].len > 0) {
+        *buf = photo->renditions[rendition].buf;
+        *len = photo->renditions[rendition].len;
+        return rendition == RENDITION_THUMB ? "thumb" : "medium";
+    }
+    *buf = photo->buf;
+    *len = photo->len;
+    return "full";
+}
+
+/**
+ * @brief ETag of photo rendition - boot id and generation identify the photo, so it never needs hashing
+ */
+static void photo_etag(char *etag, uint32_t generation, const char *size) {
+    sprintf(etag, "\"%08x-%u-%s\"", (unsigned)photo_boot_id, (unsigned)generation, size);
+}
+
+/**
+ * @brief 200 response of long-poll request waiting for newer photo, same headers as img_handler sends
+ */
+static void latest_reply(parked_reply_t *reply, const photo_slot_t *photo, int rendition) {
+    char etag[32];
+    const char *size = pick_rendition(photo, rendition, &reply->body, &reply->body_len);
+    photo_etag(etag, photo->generation, size);
+    reply->header_len = sprintf(reply->header, "HTTP/1.1 200 OK\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n"
+                                "ETag: %s\r\nCache-Control: no-cache\r\nX-Photo-Size: %s\r\n\r\n",
+                                reply->body_len, etag, size);
+}
+
+/**
+ * @brief Session close callback of main server - forget waiters and replies being sent, so their descriptor
+ * is not written after reuse
+ */
+static void session_close(httpd_handle_t server, int fd) {
+    longpoll_forget(fd);
+    if (take_lock != NULL) {
+        xSemaphoreTake(take_lock, portMAX_DELAY);
+        for (size_t i = 0; i < TAKE_MAX_WAITERS; i++) {
+            if (take_waiters[i].fd == fd) {
+                take_waiters[i].fd = -1;
+            }
+        }
+        parked_forget(take_replies, take_sending, fd);
+        xSemaphoreGive(take_lock);
+    }
+    close(fd);
+}
+
+/**
+ * @brief Send photo body in chunks of HTTP_SEND_CHUNK bytes (?chunk= overrides, for tuning)
+ * Every chunk is written out completely before the next one, partial socket writes are retried by
+ * the server. Chunk that fails or hits the send timeout ends the response, so the caller can give
+ * the buffer back right away instead of after a stalled client finally goes away.
+ */
+static esp_err_t send_photo_chunked(httpd_req_t *req, const uint8_t *buf, size_t len) {
+    size_t chunk = HTTP_SEND_CHUNK;
+    char query[48];
+    char param[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "chunk", param, sizeof(param)) == ESP_OK) {
+        unsigned long value = strtoul(param, NULL, 10);
+        chunk = value < HTTP_SEND_CHUNK_MIN ? HTTP_SEND_CHUNK_MIN : value > HTTP_SEND_CHUNK_MAX ? HTTP_SEND_CHUNK_MAX : value;
+    }
+    size_t sent = 0;
+    esp_err_t res = ESP_OK;
+    while (res == ESP_OK && sent < len) {
+        size_t part = len - sent < chunk ? len - sent : chunk;
+        res = httpd_resp_send_chunk(req, (const char *)buf + sent, part);
+        if (res == ESP_OK) {
+            sent += part;
+        }
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    if (res != ESP_OK) {
+        metrics_add(&metric_http_aborted, 1);
+        ESP_LOGE(DEVICE, "[HTTP] Photo send aborted after %zu of %zu bytes {%s}", sent, len, esp_err_to_name(res));
+    }
+    metrics_add(&metric_http_bytes, sent);
+    return res;
+}
+
+/**
+ * @brief Get Handler for Webserver - latest-photo - gets latest photo taken
+ * ?size=thumb|medium|full picks rendition, ?wait=<generation> waits for photo newer than generation.
+ * Generation newer than the current one was seen before reboot, such request is answered right away.
+ * Photo is tagged with ETag, request with matching If-None-Match gets 304.
+ * source: https://github.com/espressif/esp-idf/blob/master/examples/protocols/http_server/file_serving/main/file_server.c
+ */
+esp_err_t img_handler(httpd_req_t *req) {
+    ESP_LOGI(DEVICE, "[HTTP] GET latest-photo");
+    char query[48];
+    char size[8] = "full";
+    char wait[12] = "";
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "size", size, sizeof(size));
+        httpd_query_key_value(query, "wait", wait, sizeof(wait));
+    }
+    int rendition = -1;
+    if (strcmp(size, "medium") == 0) {
+        rendition = RENDITION_MEDIUM;
+    } else if (strcmp(size, "thumb") == 0) {
+        rendition = RENDITION_THUMB;
+    } else if (strcmp(size, "full") != 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Size must be thumb, medium or full!");
+        return ESP_FAIL;
+    }
+
+    photo_slot_t *photo = photo_slots_acquire(&photo_store);
+    if (wait[0] != '\0' && longpoll_enabled()) {
+        uint32_t generation = strtoul(wait, NULL, 10);
+        if (generation > atomic_load(&photo_store.generation)) {
+            generation = 0;
+        }
+        if (photo == NULL || photo->generation <= generation) {
+            if (photo != NULL) {
+                photo_slots_release(&photo_store, photo);
+            }
+            if (!longpoll_park(req, generation, rendition)) {
+                httpd_resp_set_status(req, "503 Service Unavailable");
+                httpd_resp_send(req, "Too many waiting clients!", HTTPD_RESP_USE_STRLEN);
+                return ESP_OK;
+            }
+            // Response is written by the long-poll task, the socket stays open after returning
+            return ESP_OK;
+        }
+    }
+    if (photo == NULL) {
+        ESP_LOGE(DEVICE, "[HTTP] CMD latest-photo no picture found");
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No picture found!");
+        return ESP_FAIL;
+    }
+    if (photo->format != PIXFORMAT_JPEG) {
+        ESP_LOGE(DEVICE, "[HTTP] CMD latest-photo failed to send");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to send picture!");
+        photo_slots_release(&photo_store, photo);
+        return ESP_FAIL;
+    }
+
+    const uint8_t *buf;
+    size_t len;
+    const char *picked = pick_rendition(photo, rendition, &buf, &len);
+    char etag[32];
+    char if_none_match[64];
+    photo_etag(etag, photo->generation, picked);
+    esp_err_t res = httpd_resp_set_hdr(req, "ETag", etag);
+    if (res == ESP_OK) {
+        res = httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    }
+    if (res == ESP_OK &&
+        httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, etag) != NULL) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        res = httpd_resp_send(req, NULL, 0);
+        photo_slots_release(&photo_store, photo);
+        return res;
+    }
+
+    ESP_LOGI(DEVICE, "[CAM] Sending photo");
+    if (res == ESP_OK) {
+        res = httpd_resp_set_type(req, "image/jpeg");
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_set_hdr(req, "X-Photo-Size", picked);
+    }
+    if (res == ESP_OK) {
+        int64_t start = esp_timer_get_time();
+        res = send_photo_chunked(req, buf, len);
+        metrics_observe(&metric_http_latest, esp_timer_get_time() - start);
+    }
+    photo_slots_release(&photo_store, photo);
+    return res;
+}
+
+/**
+ * @brief Get Handler for Webserver - preroll - frame of latest PIR event sequence (?n=0 is the oldest)
+ */
+esp_err_t preroll_handler(httpd_req_t *req) {
+    ESP_LOGI(DEVICE, "[HTTP] GET preroll");
+    char query[32];
+    char param[8];
+    size_t index = 0;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "n", param, sizeof(param)) == ESP_OK) {
+        index = strtoul(param, NULL, 10);
+    }
+    if (preroll_lock == NULL) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Pre-roll disabled!");
+        return ESP_FAIL;
+    }
+
+    // Referenced frame is not overwritten, it is sent without holding up the camera task
+    xSemaphoreTake(preroll_lock, portMAX_DELAY);
+    const frame_ring_slot_t *frame = preroll_ring.frozen ? frame_ring_ref(&preroll_ring, index) : NULL;
+    int64_t trigger_time = preroll_ring.trigger_time;
+    xSemaphoreGive(preroll_lock);
+    if (frame == NULL) {
+        ESP_LOGE(DEVICE, "[HTTP] CMD preroll no frame %zu", index);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such frame!");
+        return ESP_FAIL;
+    }
+    // Offset of the frame from the trigger, negative for frames captured before motion
+    char offset[24];
+    sprintf(offset, "%lld", (long long)((frame->timestamp - trigger_time) / 1000));
+    esp_err_t res = httpd_resp_set_type(req, "image/jpeg");
+    if (res == ESP_OK) {
+        res = httpd_resp_set_hdr(req, "X-Trigger-Offset-Ms", offset);
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send(req, (const char *)frame->buf, frame->len);
+    }
+    xSemaphoreTake(preroll_lock, portMAX_DELAY);
+    frame_ring_unref(&preroll_ring, frame);
+    xSemaphoreGive(preroll_lock);
+    return res;
+}
+
+/**
+ * @brief Get Handler for Webserver - photos/<id>.jpg - archived photo of given event
+ */
+esp_err_t photos_handler(httpd_req_t *req) {
+    ESP_LOGI(DEVICE, "[HTTP] GET %s", req->uri);
+    char *end = NULL;
+    uint32_t id = strtoul(req->uri + strlen("/photos/"), &end, 10);
+    if (archive_lock == NULL || end == NULL || strncmp(end, ".jpg", 4) != 0) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such photo!");
+        return ESP_FAIL;
+    }
+    char *chunk = malloc(ARCHIVE_CHUNK_SIZE);
+    if (chunk == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory!");
+        return ESP_FAIL;
+    }
+
+    esp_err_t res = httpd_resp_set_type(req, "image/jpeg");
+    size_t sent = 0;
+    while (res == ESP_OK) {
+        // Photo may get reclaimed by wraparound while sending, look it up again for every chunk
+        xSemaphoreTake(archive_lock, portMAX_DELAY);
+        const archive_entry_t *entry = photo_archive_find(&archive, id);
+        size_t len = 0;
+        bool ok = false;
+        if (entry != NULL) {
+            len = entry->len - sent < ARCHIVE_CHUNK_SIZE ? entry->len - sent : ARCHIVE_CHUNK_SIZE;
+            ok = photo_archive_read(&archive, entry, sent, chunk, len);
+        }
+        xSemaphoreGive(archive_lock);
+
+        if (!ok) {
+            if (sent == 0) {
+                free(chunk);
+                httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such photo!");
+                return ESP_FAIL;
+            }
+            res = ESP_FAIL;
+        } else if (len == 0) {
+            break;
+        } else {
+            res = httpd_resp_send_chunk(req, chunk, len);
+            sent += len;
+        }
+    }
+    free(chunk);
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return res;
+}
+
+/**
+ * @brief Get Handler for Webserver - events - JSON list of archived photos, oldest first
+ */
+esp_err_t events_handler(httpd_req_t *req) {
+    ESP_LOGI(DEVICE, "[HTTP] GET events");
+    if (archive_lock == NULL) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Archive disabled!");
+        return ESP_FAIL;
+    }
+    archive_entry_t *entries = malloc(sizeof(archive_entries));
+    if (entries == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory!");
+        return ESP_FAIL;
+    }
+    // Copy index so flash writes are not blocked while sending
+    xSemaphoreTake(archive_lock, portMAX_DELAY);
+    size_t count = archive.count;
+    for (size_t i = 0; i < count; i++) {
+        entries[i] = *photo_archive_at(&archive, i);
+    }
+    xSemaphoreGive(archive_lock);
+
+    char line[160];
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t res = httpd_resp_sendstr_chunk(req, "[");
+    for (size_t i = 0; i < count && res == ESP_OK; i++) {
+        sprintf(line, "%s{\"id\":%u,\"timestamp\":%lld,\"size\":%u,\"width\":%u,\"height\":%u,\"url\":\"/photos/%u.jpg\"}",
+                i ? "," : "", (unsigned)entries[i].id, (long long)entries[i].timestamp, (unsigned)entries[i].len,
+                entries[i].width, entries[i].height, (unsigned)entries[i].id);
+        res = httpd_resp_sendstr_chunk(req, line);
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_sendstr_chunk(req, "]");
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    free(entries);
+    return res;
+}
+
+/**
+ * @brief Get Handler for Webserver - events/<id> - JSON index of frames held for event,
+ * events/<id>/<n>.jpg - one of them (0 is the oldest). Only the latest sequence is held, for PREROLL_HOLD_MS.
+ */
+esp_err_t event_frames_handler(httpd_req_t *req) {
+    ESP_LOGI(DEVICE, "[HTTP] GET %s", req->uri);
+    char *end = NULL;
+    uint32_t id = strtoul(req->uri + strlen("/events/"), &end, 10);
+    long index = -1;                                // -1 means index of frames
+    if (*end == '/' && end[1] != '\0' && end[1] != '?') {
+        index = strtol(end + 1, &end, 10);
+        if (index < 0 || strncmp(end, ".jpg", 4) != 0) {
+            index = -2;
+        }
+    }
+    if (preroll_lock == NULL || id == 0 || index == -2) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such frame!");
+        return ESP_FAIL;
+    }
+
+    xSemaphoreTake(preroll_lock, portMAX_DELAY);
+    if (!preroll_ring.frozen || preroll_event_id != id) {
+        xSemaphoreGive(preroll_lock);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Frames of event not held!");
+        return ESP_FAIL;
+    }
+    esp_err_t res = ESP_OK;
+    if (index >= 0) {
+        // Referenced frame is sent after the lock is given back, like /preroll.jpg
+        const frame_ring_slot_t *frame = frame_ring_ref(&preroll_ring, index);
+        int64_t trigger_time = preroll_ring.trigger_time;
+        xSemaphoreGive(preroll_lock);
+        if (frame == NULL) {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such frame!");
+            return ESP_FAIL;
+        }
+        char offset[24];
+        sprintf(offset, "%lld", (long long)((frame->timestamp - trigger_time) / 1000));
+        res = httpd_resp_set_type(req, "image/jpeg");
+        if (res == ESP_OK) {
+            res = httpd_resp_set_hdr(req, "X-Trigger-Offset-Ms", offset);
+        }
+        if (res == ESP_OK) {
+            res = httpd_resp_send(req, (const char *)frame->buf, frame->len);
+        }
+        xSemaphoreTake(preroll_lock, portMAX_DELAY);
+        frame_ring_unref(&preroll_ring, frame);
+        xSemaphoreGive(preroll_lock);
+        return res;
+    }
+
+    // Index is small, it is formatted under the lock
+    char resp[96 + PREROLL_DEPTH * 128];
+    int len = sprintf(resp, "{\"event\":%u,\"stored\":%u,\"frames\":[", (unsigned)id, (unsigned)preroll_stored);
+    for (size_t i = 0; i < preroll_ring.count; i++) {
+        const frame_ring_slot_t *frame = frame_ring_get(&preroll_ring, i);
+        len += sprintf(resp + len, "%s{\"n\":%u,\"offset_ms\":%lld,\"size\":%u,\"burst\":%s,\"focus\":%u,"
+                                   "\"url\":\"/events/%u/%u.jpg\"}",
+                       i ? "," : "", (unsigned)i, (long long)((frame->timestamp - preroll_ring.trigger_time) / 1000),
+                       (unsigned)frame->len, frame->seq >= preroll_ring.trigger_seq ? "true" : "false",
+                       (unsigned)preroll_focus[i], (unsigned)id, (unsigned)i);
+    }
+    xSemaphoreGive(preroll_lock);
+    strcpy(resp + len, "]}");
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+}
+
+/**
+ * @brief Answer trigger of node - 202 with event id, 429 over rate limit, 503 when capture queue is full
+ */
+static esp_err_t pir_respond(httpd_req_t *req, uint32_t event_id, bool limited) {
+    if (limited) {
+        ESP_LOGI(DEVICE, "[HTTP] CMD pir over rate limit");
+        char retry_buffer[12];
+        sprintf(retry_buffer, "%d", NODE_RATE_REFILL_MS / 1000);
+        httpd_resp_set_status(req, "429 Too Many Requests");
+        httpd_resp_set_hdr(req, "Retry-After", retry_buffer);
+        httpd_resp_send(req, "Node over rate limit!", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    if (event_id == 0) {
+        ESP_LOGI(DEVICE, "[HTTP] CMD pir rejected");
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Capture queue full!", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    char msg_buffer[64];
+    char id_buffer[12];
+    sprintf(msg_buffer, "Picture requested! (event %u)", (unsigned)event_id);
+    sprintf(id_buffer, "%u", (unsigned)event_id);
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_set_hdr(req, "X-Event-Id", id_buffer);
+    httpd_resp_send(req, msg_buffer, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * @brief Read camera clock time (us) from query parameter
+ * @return false when parameter is missing or not a number
+ */
+static bool query_time(const char *query, const char *key, int64_t *time) {
+    char param[24];
+    if (httpd_query_key_value(query, key, param, sizeof(param)) != ESP_OK) {
+        return false;
+    }
+    char *end;
+    long long value = strtoll(param, &end, 10);
+    if (*end != '\0' || end == param) {
+        return false;
+    }
+    *time = value;
+    return true;
+}
+
+/**
+ * @brief Get Handler for Webserver - pir-event - due to problem with POST signal for taking photo implemented as GET
+ * Picture is taken by capture task, request is answered with event id right away.
+ * Node with synced clock adds &detected=<us>&sent=<us> on camera clock, they only end up in /traces.
+ */
+esp_err_t pir_handler(httpd_req_t *req) {
+    trigger_origin_t origin = {
+        .seq = 0,
+        .detected = CAPTURE_TRACE_UNKNOWN,
+        .sent = CAPTURE_TRACE_UNKNOWN,
+        .received = esp_timer_get_time(),
+    };
+    // Node sends its id as ?node=<hex>, plain /pir comes from old PIR firmware
+    uint16_t node_id = NODE_ID_ANONYMOUS;
+    char query[96];
+    char param[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "node", param, sizeof(param)) == ESP_OK) {
+            char *end;
+            unsigned long value = strtoul(param, &end, 16);
+            if (*end != '\0' || end == param || value > 0xFFFF) {
+                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid node id!");
+                return ESP_OK;
+            }
+            node_id = value;
+        }
+        if (!query_time(query, "detected", &origin.detected) || !query_time(query, "sent", &origin.sent)) {
+            origin.detected = CAPTURE_TRACE_UNKNOWN;
+            origin.sent = CAPTURE_TRACE_UNKNOWN;
+        }
+    }
+    ESP_LOGI(DEVICE, "[HTTP] GET pir {node %04x}", node_id);
+    bool limited;
+    uint32_t event_id = request_capture(node_id, origin.received, &origin, &limited);
+    return pir_respond(req, event_id, limited);
+}
+
+/**
+ * @brief Post Handler for Webserver - pir batch - events node could not deliver while camera was unreachable
+ * Body is TRIGGER_MSG_BATCH datagram, the same the node sends over UDP.
+ */
+esp_err_t pir_batch_handler(httpd_req_t *req) {
+    uint8_t body[TRIGGER_BATCH_MAX_SIZE];
+    if (req->content_len > sizeof(body)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Batch too long!");
+        return ESP_FAIL;
+    }
+    size_t len = 0;
+    int retries = 0;
+    while (len < req->content_len) {
+        int got = httpd_req_recv(req, (char *)body + len, req->content_len - len);
+        if (got == HTTPD_SOCK_ERR_TIMEOUT && retries++ < HTTP_RECV_RETRIES) {
+            continue;
+        }
+        if (got == HTTPD_SOCK_ERR_TIMEOUT) {
+            ESP_LOGE(DEVICE, "[HTTP] POST pir body not received in time");
+            httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Batch not received in time!");
+            return ESP_FAIL;
+        }
+        if (got <= 0) {
+            return ESP_FAIL;
+        }
+        len += got;
+    }
+    trigger_msg_t msg;
+    trigger_batch_entry_t entries[TRIGGER_BATCH_MAX];
+    size_t count;
+    if (!trigger_decode_batch(body, len, &msg, entries, &count)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Malformed batch!");
+        return ESP_OK;
+    }
+    ESP_LOGI(DEVICE, "[HTTP] POST pir {node %04x, events %u}", msg.node_id, (unsigned)count);
+    bool limited;
+    uint32_t event_id = replay_events(&msg, entries, count, &limited);
+    if (event_id == 0 && !limited) {
+        // Events were only late, or all of them came before
+        httpd_resp_set_status(req, "202 Accepted");
+        httpd_resp_send(req, "Events recorded!", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    return pir_respond(req, event_id, limited);
+}
+
+/**
+ * @brief Get Handler for Webserver - status - capture queue & timing statistics
+ */
+esp_err_t status_handler(httpd_req_t *req) {
+    ESP_LOGI(DEVICE, "[HTTP] GET status");
+    if (capture_state_lock == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Camera not ready!");
+        return ESP_FAIL;
+    }
+    xSemaphoreTake(capture_state_lock, portMAX_DELAY);
+    capture_stats_t stats = capture_stats;
+    size_t node_count = nodes.count;
+    uint32_t episode_nodes = nodes.episode_nodes;
+    uint32_t duplicates = trigger_dedup.duplicates;
+    uint32_t reordered = trigger_dedup.reordered;
+    uint32_t missing = trigger_dedup.missing;
+    xSemaphoreGive(capture_state_lock);
+    unsigned depth = uxQueueMessagesWaiting(capture_queue);
+    sensor_t *sensor = esp_camera_sensor_get();
+
+    char resp[768];
+    sprintf(resp, "{\"queue_depth\":%u,\"queue_capacity\":%d,\"coalesce_ms\":%d,"
+                  "\"requested\":%u,\"merged\":%u,\"dropped\":%u,\"limited\":%u,"
+                  "\"late\":%u,\"duplicates\":%u,\"reordered\":%u,\"missing\":%u,"
+                  "\"captured\":%u,\"failed\":%u,\"rejected\":%u,"
+                  "\"nodes\":%u,\"last_episode_nodes\":%u,"
+                  "\"last_event\":%u,\"last_wait_ms\":%lld,\"last_capture_ms\":%lld,"
+                  "\"max_capture_ms\":%lld,\"avg_capture_ms\":%lld,"
+                  "\"jpeg_quality\":%d,\"frame_size\":%d,\"rate_budget\":%d}",
+            depth, CAPTURE_QUEUE_LEN, CAPTURE_COALESCE_MS,
+            (unsigned)stats.requested, (unsigned)stats.merged, (unsigned)stats.dropped, (unsigned)stats.limited,
+            (unsigned)stats.late, (unsigned)duplicates, (unsigned)reordered, (unsigned)missing,
+            (unsigned)stats.captured, (unsigned)stats.failed, (unsigned)stats.rejected,
+            (unsigned)node_count, (unsigned)episode_nodes, (unsigned)stats.last_event,
+            (long long)(stats.last_wait_us / 1000), (long long)(stats.last_capture_us / 1000),
+            (long long)(stats.max_capture_us / 1000),
+            (long long)(stats.captured + stats.failed ? stats.total_capture_us / (stats.captured + stats.failed) / 1000 : 0),
+            sensor != NULL ? sensor->status.quality : -1, sensor != NULL ? (int)sensor->status.framesize : -1,
+            RATE_CONTROL_ENABLED ? RATE_BUDGET : 0);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * @brief Get Handler for Webserver - nodes - sensor nodes seen, most recent first, with rate limit state
+ */
+esp_err_t nodes_handler(httpd_req_t *req) {
+    ESP_LOGI(DEVICE, "[HTTP] GET nodes");
+    node_entry_t *entries = malloc(NODE_TABLE_MAX * sizeof(node_entry_t));
+    if (entries == NULL || capture_state_lock == NULL) {
+        free(entries);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Camera not ready!");
+        return ESP_FAIL;
+    }
+    int64_t now = esp_timer_get_time();
+    uint32_t tokens[NODE_TABLE_MAX];
+    xSemaphoreTake(capture_state_lock, portMAX_DELAY);
+    size_t count = node_table_list(&nodes, entries, NODE_TABLE_MAX);
+    for (size_t i = 0; i < count; i++) {
+        tokens[i] = node_table_tokens(&nodes, &entries[i], now);
+    }
+    uint32_t evicted = nodes.evicted;
+    xSemaphoreGive(capture_state_lock);
+
+    httpd_resp_set_type(req, "application/json");
+    char line[256];
+    sprintf(line, "{\"burst\":%d,\"refill_ms\":%d,\"evicted\":%u,\"nodes\":[",
+            NODE_RATE_BURST, NODE_RATE_REFILL_MS, (unsigned)evicted);
+    esp_err_t res = httpd_resp_sendstr_chunk(req, line);
+    for (size_t i = 0; res == ESP_OK && i < count; i++) {
+        sprintf(line, "%s{\"node\":\"%04x\",\"triggers\":%u,\"opened\":%u,\"joined\":%u,\"limited\":%u,"
+                      "\"late\":%u,\"tokens\":%u.%03u,\"last_episode\":%u,\"last_seen_ms\":%lld}",
+                i > 0 ? "," : "", entries[i].node_id, (unsigned)entries[i].triggers, (unsigned)entries[i].opened,
+                (unsigned)entries[i].joined, (unsigned)entries[i].limited, (unsigned)entries[i].late,
+                (unsigned)(tokens[i] / 1000),
+                (unsigned)(tokens[i] % 1000), (unsigned)entries[i].last_episode,
+                (long long)((now - entries[i].last_seen) / 1000));
+        res = httpd_resp_sendstr_chunk(req, line);
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_sendstr_chunk(req, "]}");
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    free(entries);
+    return res;
+}
+
+/**
+ * @brief Get Handler for Webserver - traces - stage times of recent capture events (camera clock, us), oldest first
+ * Stage that did not happen, or happened on a node whose clock is not synced, is null.
+ */
+esp_err_t traces_handler(httpd_req_t *req) {
+    ESP_LOGI(DEVICE, "[HTTP] GET traces");
+    capture_trace_t *entries = malloc(TRACE_DEPTH * sizeof(capture_trace_t));
+    if (entries == NULL || trace_lock == NULL) {
+        free(entries);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Camera not ready!");
+        return ESP_FAIL;
+    }
+    // Copy traces so capture is not blocked while sending
+    xSemaphoreTake(trace_lock, portMAX_DELAY);
+    size_t count = traces.count;
+    for (size_t i = 0; i < count; i++) {
+        entries[i] = *capture_trace_at(&traces, i);
+    }
+    xSemaphoreGive(trace_lock);
+
+    char line[384];
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t res = httpd_resp_sendstr_chunk(req, "[");
+    for (size_t i = 0; i < count && res == ESP_OK; i++) {
+        const capture_trace_t *trace = &entries[i];
+        int len = sprintf(line, "%s{\"event\":%u,\"node\":\"%04x\",\"seq\":%u,\"result\":\"%s\"",
+                          i ? "," : "", (unsigned)trace->event_id, trace->node_id, (unsigned)trace->seq,
+                          capture_trace_result_name(trace->result));
+        for (int stage = 0; stage < CAPTURE_TRACE_STAGES; stage++) {
+            if (trace->at[stage] == CAPTURE_TRACE_UNKNOWN) {
+                len += sprintf(line + len, ",\"%s\":null", capture_trace_stage_name(stage));
+            } else {
+                len += sprintf(line + len, ",\"%s\":%lld", capture_trace_stage_name(stage), (long long)trace->at[stage]);
+            }
+        }
+        const int64_t *at = trace->at;
+        if (at[CAPTURE_TRACE_DETECTED] != CAPTURE_TRACE_UNKNOWN && at[CAPTURE_TRACE_STORED] != CAPTURE_TRACE_UNKNOWN) {
+            sprintf(line + len, ",\"detect_to_stored_ms\":%lld}",
+                    (long long)((at[CAPTURE_TRACE_STORED] - at[CAPTURE_TRACE_DETECTED]) / 1000));
+        } else {
+            sprintf(line + len, ",\"detect_to_stored_ms\":null}");
+        }
+        res = httpd_resp_sendstr_chunk(req, line);
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_sendstr_chunk(req, "]");
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    free(entries);
+    return res;
+}
+
+/**
+ * @brief Get Handler for Webserver - metrics - counters, latency histograms & memory in Prometheus text format
+ */
+esp_err_t metrics_handler(httpd_req_t *req) {
+    char *line = malloc(METRICS_LINE_SIZE);
+    if (line == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory!");
+        return ESP_FAIL;
+    }
+    const metrics_histogram_t *histograms[] = {
+        &metric_detect_to_stored, &metric_capture_wait, &metric_trigger_to_stored, &metric_trigger_to_frame,
+        &metric_flash_warmup, &metric_preroll_freeze, &metric_frame_grab, &metric_motion_check, &metric_focus_check, &metric_store_copy,
+        &metric_rendition, &metric_archive_copy, &metric_archive_write, &metric_upload_batch, &metric_http_latest, &metric_http_take,
+        &metric_supervisor_busy,
+    };
+    const metrics_counter_t *counters[] = {
+        &metric_frames, &metric_frame_errors, &metric_burst_frames, &metric_http_bytes, &metric_archive_errors,
+        &metric_archive_dropped,        &metric_notify_events, &metric_notify_dropped, &metric_http_aborted, &metric_upload_photos,
+        &metric_upload_batches, &metric_upload_failures, &metric_upload_lost, &metric_sync_replies,
+        &metric_take_requests, &metric_take_captures, &metric_take_rejected, &metric_flash_saved,
+        &metric_supervisor_wakeups, &metric_camera_reinits,
+    };
+    capture_stats_t stats = {0};
+    size_t node_count = 0;
+    uint32_t nodes_evicted = 0;
+    uint32_t duplicates = 0, reordered = 0, missing = 0;
+    jpeg_rate_t rate = {0};
+    supervisor_memory_t memory = supervisor_memory();
+    if (rate_lock != NULL) {
+        xSemaphoreTake(rate_lock, portMAX_DELAY);
+        rate = jpeg_rate;
+        xSemaphoreGive(rate_lock);
+    }
+    flash_policy_t flash = {0};
+    int64_t flash_settle = FLASH_SETTLE_DEFAULT_MS * 1000LL;
+    if (flash_lock != NULL) {
+        xSemaphoreTake(flash_lock, portMAX_DELAY);
+        flash = flash_policy;
+        flash_settle = flash_policy_settle(&flash_policy);
+        xSemaphoreGive(flash_lock);
+    }
+    uint32_t preroll_busy = 0;
+    if (preroll_lock != NULL) {
+        xSemaphoreTake(preroll_lock, portMAX_DELAY);
+        preroll_busy = preroll_ring.dropped_busy;
+        xSemaphoreGive(preroll_lock);
+    }
+    if (capture_state_lock != NULL) {
+        xSemaphoreTake(capture_state_lock, portMAX_DELAY);
+        stats = capture_stats;
+        node_count = nodes.count;
+        nodes_evicted = nodes.evicted;
+        duplicates = trigger_dedup.duplicates;
+        reordered = trigger_dedup.reordered;
+        missing = trigger_dedup.missing;
+        xSemaphoreGive(capture_state_lock);
+    }
+    const struct {
+        const char *name;
+        const char *help;
+        const char *type;
+        long long value;
+    } values[] = {
+        {"cam_triggers_total", "Triggers received over HTTP and UDP", "counter", stats.requested},
+        {"cam_triggers_merged_total", "Triggers folded into previous event", "counter", stats.merged},
+        {"cam_triggers_dropped_total", "Triggers rejected because capture queue was full", "counter", stats.dropped},
+        {"cam_triggers_limited_total", "Triggers rejected by per-node rate limit", "counter", stats.limited},
+        {"cam_triggers_late_total", "Replayed events too old for a picture", "counter", stats.late},
+        {"cam_triggers_duplicate_total", "Retransmitted or replayed events seen before", "counter", duplicates},
+        {"cam_triggers_reordered_total", "Events that arrived after a newer one of the same node", "counter", reordered},
+        {"cam_trigger_seq_missing", "Sequence numbers skipped by nodes and not received", "gauge", missing},
+        {"cam_nodes", "Sensor nodes in node table", "gauge", (long long)node_count},
+        {"cam_nodes_evicted_total", "Nodes forgotten because node table was full", "counter", nodes_evicted},
+        {"cam_captures_total", "Successful captures", "counter", stats.captured},
+        {"cam_captures_failed_total", "Failed captures", "counter", stats.failed},
+        {"cam_captures_rejected_total", "PIR photos dropped because nothing moved in view", "counter", stats.rejected},
+        {"cam_stream_frames_dropped_total", "Frames skipped by slow stream viewers", "counter", stream_dropped},
+        {"cam_stream_clients", "Connected stream viewers", "gauge", stream_clients},
+        {"cam_preroll_frames_busy_total", "Pre-roll frames skipped because the oldest one was still being sent",
+         "counter", preroll_busy},
+        {"cam_capture_queue_depth", "Triggers waiting for capture task", "gauge",
+         capture_queue ? (long long)uxQueueMessagesWaiting(capture_queue) : 0},
+        {"cam_upload_queue_depth", "Archived photos waiting for upload", "gauge",
+         (long long)upload_pending()},
+        {"cam_jpeg_quality", "Sensor JPEG quality set by rate control (lower is better)", "gauge", rate.quality},
+        {"cam_jpeg_frame_average_bytes", "Average frame length since the last rate control change", "gauge",
+         rate.average},
+        {"cam_jpeg_quality_changes_total", "Sensor quality changes made by rate control", "counter",
+         rate.quality_changes},
+        {"cam_jpeg_size_changes_total", "Frame size changes made by rate control", "counter", rate.size_changes},
+        {"cam_jpeg_over_budget_total", "Frames longer than budget beyond tolerance", "counter", rate.over},
+        {"cam_flash_used_total", "Captures lit by flash", "counter", flash.used},
+        {"cam_flash_skipped_total", "Captures without flash because sensor exposure showed enough light", "counter",
+         flash.skipped},
+        {"cam_flash_settle_timeouts_total", "Flash exposure not settled within FLASH_SETTLE_MAX_MS", "counter",
+         flash.timeouts},
+        {"cam_flash_settle_milliseconds", "Wait between flash on and grabbing frame", "gauge", flash_settle / 1000},
+        {"cam_light_exposure_index", "Average exposure lines x gain of frames without flash (higher is darker)", "gauge",
+         flash.level},
+        {"cam_heap_internal_free_bytes", "Free internal heap", "gauge",
+         (long long)heap_caps_get_free_size(MALLOC_CAP_INTERNAL)},
+        {"cam_heap_internal_min_free_bytes", "Lowest free internal heap since boot", "gauge",
+         (long long)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL)},
+        {"cam_heap_internal_largest_block_bytes", "Largest free internal heap block", "gauge",
+         (long long)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL)},
+        {"cam_psram_free_bytes", "Free PSRAM", "gauge",
+         (long long)heap_caps_get_free_size(MALLOC_CAP_SPIRAM)},
+        {"cam_psram_min_free_bytes", "Lowest free PSRAM since boot", "gauge",
+         (long long)heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM)},
+        {"cam_heap_internal_fragmentation_percent", "Free internal heap outside largest block, last supervisor sample",
+         "gauge", memory.heap_fragmentation},
+        {"cam_heap_internal_min_largest_block_bytes", "Smallest largest internal block supervisor sampled", "gauge",
+         (long long)memory.heap_min_block},
+        {"cam_psram_fragmentation_percent", "Free PSRAM outside largest block, last supervisor sample", "gauge",
+         memory.psram_fragmentation},
+        {"cam_uptime_seconds", "Time since boot", "gauge", esp_timer_get_time() / 1000000},
+    };
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    esp_err_t res = ESP_OK;
+    for (size_t i = 0; res == ESP_OK && i < sizeof(histograms) / sizeof(histograms[0]); i++) {
+        metrics_format_histogram(histograms[i], line, METRICS_LINE_SIZE);
+        res = httpd_resp_sendstr_chunk(req, line);
+    }
+    for (size_t i = 0; res == ESP_OK && i < sizeof(counters) / sizeof(counters[0]); i++) {
+        metrics_format_counter(counters[i], line, METRICS_LINE_SIZE);
+        res = httpd_resp_sendstr_chunk(req, line);
+    }
+    for (size_t i = 0; res == ESP_OK && i < sizeof(values) / sizeof(values[0]); i++) {
+        metrics_format_value(values[i].name, values[i].help, values[i].type, values[i].value, line, METRICS_LINE_SIZE);
+        res = httpd_resp_sendstr_chunk(req, line);
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    free(line);
+    return res;
+}
+
+/**
+ * @brief Response to parked take-photo request
+ * @param photo shared photo, NULL when the capture failed
+ * @param shared number of requests the capture answers
+ * @param busy capture was not made because the capture queue was full
+ */
+static void take_reply(parked_reply_t *reply, const take_waiter_t *waiter, const photo_slot_t *photo, size_t shared,
+                       bool busy) {
+    reply->server = waiter->server;
+    reply->fd = waiter->fd;
+    reply->body = NULL;
+    reply->body_len = 0;
+    reply->closed = false;
+    if (photo == NULL || photo->format != PIXFORMAT_JPEG) {
+        reply->header_len = sprintf(reply->header, "HTTP/1.1 %s\r\nContent-Length: 0\r\n\r\n",
+                                    busy ? "503 Service Unavailable" : "500 Internal Server Error");
+        return;
+    }
+    // Settings rate control has the sensor at, the frame itself may be a couple of frames older
+    sensor_t *sensor = esp_camera_sensor_get();
+    reply->header_len = sprintf(reply->header, "HTTP/1.1 200 OK\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n"
+                                "Content-Disposition: inline; filename=capture.jpg\r\nCache-Control: no-cache\r\n"
+                                "X-Jpeg-Quality: %d\r\nX-Frame-Size: %zux%zu\r\nX-Photo-Generation: %u\r\n"
+                                "X-Event-Id: %u\r\nX-Take-Shared: %zu\r\n\r\n",
+                                photo->len, sensor != NULL ? sensor->status.quality : camera_config.jpeg_quality,
+                                photo->width, photo->height, (unsigned)photo->generation, (unsigned)photo->event_id,
+                                shared);
+    reply->body = photo->buf;
+    reply->body_len = photo->len;
+}
+
+/**
+ * @brief Get Handler for Webserver - take-photo - due to problem with POST signal for taking photo implemented as GET
+ * Requests that come while a capture is queued or running join it instead of starting their own, every one
+ * of them is answered with the same photo by take_task. The capture itself is made by the capture task
+ * like PIR ones, so it never overlaps their flash or burst. The photo is published as latest photo too.
+ */
+esp_err_t take_handler(httpd_req_t *req){
+    if (take_lock == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    bool parked = false;
+    bool start = false;
+    xSemaphoreTake(take_lock, portMAX_DELAY);
+    for (size_t i = 0; i < TAKE_MAX_WAITERS && !parked; i++) {
+        if (take_waiters[i].fd < 0) {
+            take_waiters[i] = (take_waiter_t) {
+                .server = req->handle,
+                .fd = httpd_req_to_sockfd(req),
+                .parked_at = esp_timer_get_time(),
+            };
+            parked = true;
+        }
+    }
+    if (parked && !take_running) {
+        take_running = true;
+        start = true;
+    }
+    xSemaphoreGive(take_lock);
+    if (!parked) {
+        metrics_add(&metric_take_rejected, 1);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Too many waiting clients!", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    if (start) {
+        ESP_LOGI(DEVICE, "[CAM] Taking photo");
+        if (request_take() == 0) {
+            take_done(NULL, true);
+        }
+    }
+    // Response is written by the take task, the socket stays open after returning
+    return ESP_OK;
+}
+
+/**
+ * @brief MJPEG viewer - state of one stream connection
+ */
+typedef struct {
+    bool used;                      // Entry belongs to a running stream task
+    httpd_handle_t server;
+    int fd;                         // -1 once the server closed the session, descriptor may be reused
+    uint8_t *buf;                   // Private copy of the frame being sent
+    SemaphoreHandle_t send_lock;    // Held while writing to fd, session close waits for the write
+} stream_client_t;
+
+static stream_client_t stream_table[STREAM_MAX_CLIENTS];
+static SemaphoreHandle_t stream_lock = NULL;            // Guards used flags of stream_table
+
+/**
+ * @brief Send whole buffer to stream socket, retrying partial sends
+ * Fails without writing when the session was closed meanwhile.
+ */
+static esp_err_t stream_send_all(stream_client_t *client, const char *data, size_t len) {
+    xSemaphoreTake(client->send_lock, portMAX_DELAY);
+    esp_err_t res = client->fd >= 0 ? ESP_OK : ESP_FAIL;
+    while (res == ESP_OK && len > 0) {
+        int sent = httpd_socket_send(client->server, client->fd, data, len, 0);
+        if (sent <= 0) {
+            res = ESP_FAIL;
+            break;
+        }
+        data += sent;
+        len -= sent;
+    }
+    xSemaphoreGive(client->send_lock);
+    return res;
+}
+
+/**
+ * @brief Stream task - one per viewer, copies latest live frame and sends it at the viewer's pace
+ * Viewer that is slower than the camera simply skips frames, capture loop never waits for it.
+ */
+void stream_client_task(void *arg) {
+    stream_client_t *client = (stream_client_t *)arg;
+    const int fd = client->fd;
+    const TickType_t period = (1000 / STREAM_MAX_FPS) / portTICK_PERIOD_MS;
+    TickType_t last_wake = xTaskGetTickCount();
+    uint32_t last_seq = 0;
+    uint32_t dropped = 0;
+    char part[96];
+
+    const char *header = "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: multipart/x-mixed-replace;boundary=" STREAM_BOUNDARY "\r\n"
+                         "Cache-Control: no-cache\r\n"
+                         "Access-Control-Allow-Origin: *\r\n\r\n";
+    esp_err_t res = stream_send_all(client, header, strlen(header));
+    while (res == ESP_OK) {
+        vTaskDelayUntil(&last_wake, period);
+
+        xSemaphoreTake(live_lock, portMAX_DELAY);
+        if (live_seq == last_seq) {
+            xSemaphoreGive(live_lock);
+            continue;
+        }
+        if (last_seq != 0) {
+            dropped += live_seq - last_seq - 1;
+        }
+        size_t len = live_len;
+        memcpy(client->buf, live_buf, len);
+        last_seq = live_seq;
+        xSemaphoreGive(live_lock);
+
+        sprintf(part, "--" STREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n\r\n", len);
+        res = stream_send_all(client, part, strlen(part));
+        if (res == ESP_OK) {
+            res = stream_send_all(client, (const char *)client->buf, len);
+        }
+        if (res == ESP_OK) {
+            res = stream_send_all(client, "\r\n", 2);
+        }
+    }
+
+    xSemaphoreTake(client->send_lock, portMAX_DELAY);
+    ESP_LOGI(DEVICE, "[HTTP] Stream viewer left {fd=%d, dropped=%u}", fd, (unsigned)dropped);
+    if (client->fd >= 0) {
+        httpd_sess_trigger_close(client->server, client->fd);
+    }
+    xSemaphoreGive(client->send_lock);
+    stream_dropped += dropped;
+    free(client->buf);
+    xSemaphoreTake(stream_lock, portMAX_DELAY);
+    client->used = false;
+    xSemaphoreGive(stream_lock);
+    stream_clients--;
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Get Handler for Stream server - stream - hands the socket over to its own stream task
+ */
+esp_err_t stream_handler(httpd_req_t *req) {
+    ESP_LOGI(DEVICE, "[HTTP] GET stream");
+    stream_client_t *client = NULL;
+    if (live_lock != NULL && stream_lock != NULL) {
+        xSemaphoreTake(stream_lock, portMAX_DELAY);
+        for (size_t i = 0; i < STREAM_MAX_CLIENTS && client == NULL; i++) {
+            if (!stream_table[i].used) {
+                client = &stream_table[i];
+                client->used = true;
+            }
+        }
+        xSemaphoreGive(stream_lock);
+    }
+    if (client == NULL) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Too many viewers!", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+
+    client->buf = heap_caps_malloc(STREAM_SLOT_SIZE, MALLOC_CAP_SPIRAM);
+    client->server = req->handle;
+    client->fd = httpd_req_to_sockfd(req);
+    stream_clients++;
+    if (client->buf == NULL || xTaskCreate(stream_client_task, "stream", 4096, client, 4, NULL) != pdPASS) {
+        stream_clients--;
+        free(client->buf);
+        xSemaphoreTake(stream_lock, portMAX_DELAY);
+        client->used = false;
+        xSemaphoreGive(stream_lock);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start stream!");
+        return ESP_FAIL;
+    }
+    // Response is written by the stream task, the socket stays open after returning
+    return ESP_OK;
+}
+
+/**
+ * @brief Publish capture event to subscribers
+ */
+static void notify_capture(const photo_slot_t *photo) {
+    char data[160];
+    sprintf(data, "{\"event\":%u,\"generation\":%u,\"timestamp\":%lld,\"size\":%zu,\"width\":%zu,\"height\":%zu}",
+            (unsigned)photo->event_id, (unsigned)photo->generation, (long long)(photo->timestamp / 1000),
+            photo->len, photo->width, photo->height);
+    notify_publish("capture", data);
+}
+
+/**
+ * @brief Session close callback of stream server - stream tasks and subscribers stop writing to the
+ * descriptor before it is closed and reused, write in progress is waited for
+ */
+static void stream_session_close(httpd_handle_t server, int fd) {
+    notify_forget(fd);
+    xSemaphoreTake(stream_lock, portMAX_DELAY);
+    for (size_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        stream_client_t *client = &stream_table[i];
+        if (client->used && client->fd == fd) {
+            xSemaphoreTake(client->send_lock, portMAX_DELAY);
+            client->fd = -1;
+            xSemaphoreGive(client->send_lock);
+        }
+    }
+    xSemaphoreGive(stream_lock);
+    close(fd);
+}
+
+/**
+ * @brief Stream server start - own httpd instance so long-lived streams do not hold the main server task
+ */
+httpd_handle_t start_stream_server(void) {
+    stream_lock = xSemaphoreCreateMutex();
+    for (size_t i = 0; i < STREAM_MAX_CLIENTS && stream_lock != NULL; i++) {
+        stream_table[i].send_lock = xSemaphoreCreateMutex();
+        if (stream_table[i].send_lock == NULL) {
+            stream_lock = NULL;
+        }
+    }
+    if (stream_lock == NULL) {
+        ESP_LOGE(DEVICE, "[HTTP] Stream table allocation failed");
+        return NULL;
+    }
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = STREAM_PORT;
+    config.ctrl_port = STREAM_CTRL_PORT;
+    config.max_open_sockets = STREAM_MAX_CLIENTS + NOTIFY_MAX_CLIENTS + 1;     // One spare to answer 503
+    config.close_fn = stream_session_close;
+    httpd_handle_t server = NULL;
+
+    if (httpd_start(&server, &config) == ESP_OK) {
+        ESP_LOGI(DEVICE, "[HTTP] Stream server start success {port=%d}", STREAM_PORT);
+        httpd_uri_t stream_get = {
+            .uri      = "/stream",
+            .method   = HTTP_GET,
+            .handler  = stream_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &stream_get);
+        httpd_uri_t notify_get = {
+            .uri      = "/notify",
+            .method   = HTTP_GET,
+            .handler  = notify_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &notify_get);
+    }
+
+    return server;
+}
+
+/**
+ * @brief Webserver Start
+ * source: https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/protocols/esp_http_server.html
+ */
+httpd_handle_t start_webserver(void) {
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_uri_handlers = 16;
+    config.uri_match_fn = httpd_uri_match_wildcard;        // Needed for /photos/*
+    config.close_fn = session_close;                        // Parked requests must not outlive their socket
+    config.max_open_sockets = WEB_MAX_SOCKETS;
+    httpd_handle_t server = NULL;
+
+    if (httpd_start(&server, &config) == ESP_OK) {
+        ESP_LOGI(DEVICE, "[HTTP] Server start success");
+        ESP_LOGI(DEVICE, "[HTTP] Registering endpoints");
+        // Register availiable paths and requests
+        // GET LATEST PHOTO
+        httpd_uri_t latest_get = {
+            .uri      = "/latest-photo.jpg",
+            .method   = HTTP_GET,
+            .handler  = img_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &latest_get);
+        // PIR EVENT - TAKE PHOTO
+        httpd_uri_t pir_post = {
+            .uri      = "/pir",
+            .method   = HTTP_GET,
+            .handler  = pir_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &pir_post);
+        // PIR EVENTS REPLAYED AFTER CAMERA WAS UNREACHABLE
+        httpd_uri_t pir_batch_post = {
+            .uri      = "/pir",
+            .method   = HTTP_POST,
+            .handler  = pir_batch_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &pir_batch_post);
+        // MANUAL REQUEST FOR PHOTO (NOT SAVED)
+        httpd_uri_t take_post = {
+            .uri      = "/take-photo",
+            .method   = HTTP_GET,
+            .handler  = take_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &take_post);
+        // PRE-ROLL SEQUENCE OF LATEST PIR EVENT
+        httpd_uri_t preroll_get = {
+            .uri      = "/preroll.jpg",
+            .method   = HTTP_GET,
+            .handler  = preroll_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &preroll_get);
+        // ARCHIVED PHOTOS
+        httpd_uri_t photos_get = {
+            .uri      = "/photos/*",
+            .method   = HTTP_GET,
+            .handler  = photos_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &photos_get);
+        httpd_uri_t events_get = {
+            .uri      = "/events",
+            .method   = HTTP_GET,
+            .handler  = events_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &events_get);
+        httpd_uri_t event_frames_get = {
+            .uri      = "/events/*",
+            .method   = HTTP_GET,
+            .handler  = event_frames_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &event_frames_get);
+        // CAPTURE STATUS
+        httpd_uri_t status_get = {
+            .uri      = "/status",
+            .method   = HTTP_GET,
+            .handler  = status_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &status_get);
+        // SENSOR NODES
+        httpd_uri_t nodes_get = {
+            .uri      = "/nodes",
+            .method   = HTTP_GET,
+            .handler  = nodes_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &nodes_get);
+        // TRIGGER-TO-PHOTO TRACES
+        httpd_uri_t traces_get = {
+            .uri      = "/traces",
+            .method   = HTTP_GET,
+            .handler  = traces_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &traces_get);
+        // METRICS FOR PROMETHEUS
+        httpd_uri_t metrics_get = {
+            .uri      = "/metrics",
+            .method   = HTTP_GET,
+            .handler  = metrics_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &metrics_get);
+        // DASHBOARD - INDEX.HTML & OTHER STATIC FILES, MUST BE REGISTERED LAST AS IT MATCHES EVERYTHING
+        httpd_uri_t static_get = {
+            .uri      = "/*",
+            .method   = HTTP_GET,
+            .handler  = static_handler,
+            .user_ctx = NULL
+        };
+        httpd_register_uri_handler(server, &static_get);
+    }
+
+    return server;
+}
+
+/**
+ * @brief Webserver stop
+ * source: https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/protocols/esp_http_server.html
+ */
+void stop_webserver(httpd_handle_t server) {
+    if (server) {
+        httpd_stop(server);
+    }
+}
+// ================================================================
+
+// ============================= TRACE ============================
+/**
+ * @brief Record time of capture stage of event, no-op for events no longer traced
+ */
+static void trace_mark(uint32_t event_id, capture_trace_stage_t stage, int64_t at) {
+    if (trace_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(trace_lock, portMAX_DELAY);
+    capture_trace_mark(&traces, event_id, stage, at);
+    xSemaphoreGive(trace_lock);
+}
+
+/**
+ * @brief Start trace of new capture event
+ */
+static void trace_open(uint32_t event_id, uint16_t node_id, const trigger_origin_t *origin) {
+    if (trace_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(trace_lock, portMAX_DELAY);
+    capture_trace_t *trace = capture_trace_open(&traces, event_id, node_id, origin->seq);
+    trace->at[CAPTURE_TRACE_DETECTED] = origin->detected;
+    trace->at[CAPTURE_TRACE_SENT] = origin->sent;
+    trace->at[CAPTURE_TRACE_RECEIVED] = origin->received;
+    xSemaphoreGive(trace_lock);
+}
+
+/**
+ * @brief Close trace with capture result, detection to photo latency goes to metrics
+ */
+static void trace_finish(uint32_t event_id, esp_err_t res) {
+    if (trace_lock == NULL) {
+        return;
+    }
+    int64_t detected = CAPTURE_TRACE_UNKNOWN;
+    int64_t stored = CAPTURE_TRACE_UNKNOWN;
+    xSemaphoreTake(trace_lock, portMAX_DELAY);
+    capture_trace_t *trace = capture_trace_find(&traces, event_id);
+    if (trace != NULL) {
+        trace->result = res == ESP_OK ? CAPTURE_TRACE_CAPTURED
+                      : res == ESP_ERR_NOT_FOUND ? CAPTURE_TRACE_REJECTED : CAPTURE_TRACE_FAILED;
+        detected = trace->at[CAPTURE_TRACE_DETECTED];
+        stored = trace->at[CAPTURE_TRACE_STORED];
+    }
+    xSemaphoreGive(trace_lock);
+    if (detected != CAPTURE_TRACE_UNKNOWN && stored != CAPTURE_TRACE_UNKNOWN) {
+        metrics_observe(&metric_detect_to_stored, stored - detected);
+    }
+}
+
+/**
+ * @brief Prepare trace ring
+ */
+esp_err_t init_trace() {
+    if (!capture_trace_init(&traces, TRACE_DEPTH)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    trace_lock = xSemaphoreCreateMutex();
+    return trace_lock != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+// ================================================================
+
+// ============================ CAMERA ============================
+/**
+ * @brief Prepare camera for taking picture
+ * source: https://github.com/espressif/esp32-camera/blob/master/examples/main/take_picture.c
+ */
+esp_err_t init_camera()
+{   
+    esp_err_t err = esp_camera_init(&camera_config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(DEVICE, "[CAM] Initialization failed");
+        return err;
+    }
+    camera_lock = xSemaphoreCreateMutex();
+    if (camera_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    ESP_LOGI(DEVICE, "[CAM] Camera initialized");
+    return ESP_OK;
+}
+
+/**
+ * @brief JPEG decoder input & output
+ */
+typedef struct {
+    const uint8_t *jpg;
+    size_t len;
+    uint8_t *out;
+    size_t width;               // Size of decoded (scaled) image, known once decoding starts
+    size_t height;
+    focus_metric_t *focus;
+} jpg_decode_t;
+
+/**
+ * @brief JPEG decoder callback - read from memory
+ */
+static size_t jpg_decode_read(void *arg, size_t index, uint8_t *buf, size_t len) {
+    jpg_decode_t *decode = arg;
+    if (index + len > decode->len) {
+        len = decode->len - index;
+    }
+    if (buf != NULL) {
+        memcpy(buf, decode->jpg + index, len);
+    }
+    return len;
+}
+
+/**
+ * @brief Make medium & thumbnail version of JPEG in slot
+ */
+static void make_renditions(photo_slot_t *slot) {
+    int64_t start = esp_timer_get_time();
+    if (rendition_make(slot->buf, slot->len, &slot->renditions[RENDITION_MEDIUM],
+                       &slot->renditions[RENDITION_THUMB]) != ESP_OK) {
+        ESP_LOGE(DEVICE, "[CAM] Renditions not made, decoding failed");
+    }
+    metrics_observe(&metric_rendition, esp_timer_get_time() - start);
+}
+
+/**
+ * @brief Start rate control at the settings camera was initialized with
+ */
+esp_err_t init_rate_control() {
+    int level = -1;
+    for (size_t i = 0; i < sizeof(rate_framesizes) / sizeof(rate_framesizes[0]); i++) {
+        if (rate_framesizes[i] == camera_config.frame_size) {
+            level = i;
+        }
+    }
+    // Frame size outside of the list stays as configured
+    int size_max = RATE_ADAPT_FRAMESIZE && level >= 0 ? (int)(sizeof(rate_framesizes) / sizeof(rate_framesizes[0])) - 1
+                                                      : level;
+    int size_min = RATE_ADAPT_FRAMESIZE && level >= 0 ? 0 : level;
+    jpeg_rate_init(&jpeg_rate, RATE_BUDGET, camera_config.jpeg_quality, RATE_QUALITY_BEST, RATE_QUALITY_WORST,
+                   level, size_min, size_max, RATE_SETTLE_FRAMES);
+    rate_lock = xSemaphoreCreateMutex();
+    if (rate_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(DEVICE, "[RATE] Holding frames near %u bytes, quality %d-%d%s", (unsigned)RATE_BUDGET,
+             RATE_QUALITY_BEST, RATE_QUALITY_WORST, size_min != size_max ? ", frame size SVGA-UXGA" : "");
+    return ESP_OK;
+}
+
+/**
+ * @brief Feed length of grabbed frame to rate control, sensor gets new settings for the next frames
+ */
+static void rate_control_frame(size_t len) {
+    xSemaphoreTake(rate_lock, portMAX_DELAY);
+    int size = jpeg_rate.size;
+    if (jpeg_rate_update(&jpeg_rate, len)) {
+        sensor_t *sensor = esp_camera_sensor_get();
+        if (sensor != NULL) {
+            sensor->set_quality(sensor, jpeg_rate.quality);
+            if (jpeg_rate.size != size) {
+                sensor->set_framesize(sensor, rate_framesizes[jpeg_rate.size]);
+            }
+        }
+        ESP_LOGI(DEVICE, "[RATE] Quality %d, frame size level %d {frame %zu bytes}",
+                 jpeg_rate.quality, jpeg_rate.size, len);
+    }
+    xSemaphoreGive(rate_lock);
+}
+
+/**
+ * @brief Put rate control settings back on sensor initialized again with camera_config
+ */
+static void rate_control_restore() {
+    if (rate_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(rate_lock, portMAX_DELAY);
+    sensor_t *sensor = esp_camera_sensor_get();
+    if (sensor != NULL) {
+        sensor->set_quality(sensor, jpeg_rate.quality);
+        if (rate_framesizes[jpeg_rate.size] != camera_config.frame_size) {
+            sensor->set_framesize(sensor, rate_framesizes[jpeg_rate.size]);
+        }
+    }
+    xSemaphoreGive(rate_lock);
+}
+
+/**
+ * @brief Start flash policy without light level, flash is used until frames show the scene
+ */
+esp_err_t init_flash_policy() {
+    flash_policy_init(&flash_policy, FLASH_DARK_LEVEL, FLASH_LIGHT_LEVEL, FLASH_STABLE_PERMILLE,
+                      FLASH_SETTLE_DEFAULT_MS * 1000LL, FLASH_SETTLE_MIN_MS * 1000LL, FLASH_SETTLE_MAX_MS * 1000LL);
+    flash_lock = xSemaphoreCreateMutex();
+    if (flash_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(DEVICE, "[FLASH] Flash over exposure index %u, settle wait %d-%d ms", (unsigned)FLASH_DARK_LEVEL,
+             FLASH_SETTLE_MIN_MS, FLASH_SETTLE_MAX_MS);
+    return ESP_OK;
+}
+
+/**
+ * @brief Exposure index sensor AEC is at, exposure lines & gain come from OV2640 sensor bank (0x100)
+ * AEC[15:10] is REG45, AEC[9:2] is AEC and AEC[1:0] is COM1, gain is (1 + GAIN[3:0] / 16) doubled
+ * for every bit set in GAIN[7:4].
+ * @return false when sensor registers can not be read
+ */
+static bool sensor_exposure(uint32_t *level) {
+    sensor_t *sensor = esp_camera_sensor_get();
+    if (sensor == NULL || sensor->get_reg == NULL) {
+        return false;
+    }
+    // Register reads switch sensor bank, rate control must not write in between
+    if (rate_lock != NULL) {
+        xSemaphoreTake(rate_lock, portMAX_DELAY);
+    }
+    int gain = sensor->get_reg(sensor, 0x100, 0xFF);
+    int com1 = sensor->get_reg(sensor, 0x103, 0x03);
+    int aec = sensor->get_reg(sensor, 0x110, 0xFF);
+    int reg45 = sensor->get_reg(sensor, 0x145, 0x3F);
+    if (rate_lock != NULL) {
+        xSemaphoreGive(rate_lock);
+    }
+    if (gain < 0 || com1 < 0 || aec < 0 || reg45 < 0) {
+        return false;
+    }
+    uint32_t lines = ((uint32_t)reg45 << 10) | ((uint32_t)aec << 2) | (uint32_t)com1;
+    uint32_t gain_x16 = (16 + (gain & 0x0F)) << __builtin_popcount((gain >> 4) & 0x0F);
+    *level = flash_policy_level(lines, gain_x16);
+    return true;
+}
+
+/**
+ * @brief Feed exposure of frame grabbed at timestamp to flash policy
+ */
+static void flash_policy_account(int64_t timestamp) {
+    uint32_t level;
+    if (!sensor_exposure(&level)) {
+        return;
+    }
+    xSemaphoreTake(flash_lock, portMAX_DELAY);
+    flash_policy_frame(&flash_policy, level, timestamp);
+    xSemaphoreGive(flash_lock);
+}
+
+/**
+ * @brief Switch flash LED, policy measures exposure settle time from the moment it went on
+ */
+static void flash_set(bool on) {
+    gpio_set_level(4, on ? 1 : 0);
+    if (flash_lock != NULL) {
+        xSemaphoreTake(flash_lock, portMAX_DELAY);
+        if (on) {
+            flash_policy_flash_on(&flash_policy, esp_timer_get_time());
+        } else {
+            flash_policy_flash_off(&flash_policy, esp_timer_get_time());
+        }
+        xSemaphoreGive(flash_lock);
+    }
+}
+
+/**
+ * @brief Light flash when the scene needs it, without flash policy always
+ * @param settle set to how long flash has to be lit before frame is grabbed (us), 0 without flash
+ * @return true when flash was lit
+ */
+static bool flash_prepare(int64_t *settle) {
+    bool needed = true;
+    *settle = FLASH_SETTLE_DEFAULT_MS * 1000LL;
+    if (flash_lock != NULL) {
+        xSemaphoreTake(flash_lock, portMAX_DELAY);
+        needed = flash_policy_decide(&flash_policy);
+        *settle = needed ? flash_policy_settle(&flash_policy) : 0;
+        xSemaphoreGive(flash_lock);
+    }
+    if (needed) {
+        flash_set(true);
+    }
+    int64_t saved = FLASH_SETTLE_DEFAULT_MS * 1000LL - *settle;
+    if (saved > 0) {
+        metrics_add(&metric_flash_saved, saved / 1000);
+    }
+    return needed;
+}
+
+/**
+ * @brief Count user of camera driver, waits while supervisor initializes it again
+ */
+static void camera_acquire() {
+    xSemaphoreTake(camera_lock, portMAX_DELAY);
+    while (camera_reinit) {
+        xSemaphoreGive(camera_lock);
+        vTaskDelay(pdMS_TO_TICKS(10));
+        xSemaphoreTake(camera_lock, portMAX_DELAY);
+    }
+    camera_users++;
+    xSemaphoreGive(camera_lock);
+}
+
+static void camera_release() {
+    xSemaphoreTake(camera_lock, portMAX_DELAY);
+    camera_users--;
+    xSemaphoreGive(camera_lock);
+}
+
+/**
+ * @brief esp_camera_fb_get with metrics, failures in a row wake the supervisor
+ * Frame has to be given back with release_frame.
+ */
+static camera_fb_t *grab_frame() {
+    camera_acquire();
+    int64_t start = esp_timer_get_time();
+    camera_fb_t *photo = esp_camera_fb_get();
+    metrics_observe(&metric_frame_grab, esp_timer_get_time() - start);
+    metrics_add(photo ? &metric_frames : &metric_frame_errors, 1);
+    if (photo == NULL) {
+        camera_release();
+        if (atomic_fetch_add(&camera_errors, 1) + 1 >= SUPERVISOR_CAMERA_ERRORS) {
+            supervisor_camera_failed();
+        }
+        return NULL;
+    }
+    atomic_store(&camera_errors, 0);
+    atomic_store(&camera_delivered, true);
+    if (photo != NULL && photo->format == PIXFORMAT_JPEG && rate_lock != NULL) {
+        rate_control_frame(photo->len);
+    }
+    if (photo != NULL && flash_lock != NULL) {
+        flash_policy_account(esp_timer_get_time());
+    }
+    return photo;
+}
+
+/**
+ * @brief Give frame of grab_frame back to the driver
+ */
+static void release_frame(camera_fb_t *photo) {
+    esp_camera_fb_return(photo);
+    camera_release();
+}
+
+/**
+ * @brief Copy frame into free slot and publish it as latest photo, never waits for readers
+ */
+esp_err_t store_photo(const uint8_t *buf, size_t len, size_t width, size_t height, pixformat_t format,
+                      int64_t timestamp, uint32_t event_id) {
+    photo_slot_t *slot = photo_slots_begin_write(&photo_store);
+    if (slot == NULL) {
+        ESP_LOGE(DEVICE, "[CAM] No free photo slot, all are being sent");
+        return ESP_ERR_NO_MEM;
+    }
+    if (len > slot->capacity) {
+        photo_slots_abort(&photo_store, slot);
+        ESP_LOGE(DEVICE, "[CAM] Photo too big for slot {%zu bytes}", len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    int64_t start = esp_timer_get_time();
+    memcpy(slot->buf, buf, len);
+    metrics_observe(&metric_store_copy, esp_timer_get_time() - start);
+    slot->len = len;
+    slot->width = width;
+    slot->height = height;
+    slot->format = format;
+    slot->timestamp = timestamp;
+    slot->event_id = event_id;
+    if (RENDITION_ENABLED && format == PIXFORMAT_JPEG) {
+        make_renditions(slot);
+    }
+    photo_slots_publish(&photo_store, slot);
+    longpoll_wake();
+    notify_capture(slot);
+    archive_submit(slot);
+    return ESP_OK;
+}
+
+/**
+ * @brief Allocate photo slots in PSRAM
+ */
+esp_err_t init_photo_store() {
+    photo_boot_id = esp_random();
+    uint8_t *pool = heap_caps_malloc(PHOTO_SLOTS_COUNT * PHOTO_SLOT_SIZE, MALLOC_CAP_SPIRAM);
+    if (pool == NULL || !photo_slots_init(&photo_store, pool, PHOTO_SLOT_SIZE)) {
+        ESP_LOGE(DEVICE, "[CAM] Photo slot allocation failed");
+        return ESP_ERR_NO_MEM;
+    }
+    if (RENDITION_ENABLED) {
+        uint8_t *medium = heap_caps_malloc(PHOTO_SLOTS_COUNT * RENDITION_MEDIUM_SIZE, MALLOC_CAP_SPIRAM);
+        uint8_t *thumb = heap_caps_malloc(PHOTO_SLOTS_COUNT * RENDITION_THUMB_SIZE, MALLOC_CAP_SPIRAM);
+        if (!photo_slots_init_rendition(&photo_store, RENDITION_MEDIUM, medium, RENDITION_MEDIUM_SIZE) ||
+            !photo_slots_init_rendition(&photo_store, RENDITION_THUMB, thumb, RENDITION_THUMB_SIZE)) {
+            ESP_LOGE(DEVICE, "[CAM] Rendition allocation failed");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Publish frame for stream viewers, skipped when a viewer is just copying the previous one
+ */
+static void publish_live_frame(const camera_fb_t *photo) {
+    if (photo->len > STREAM_SLOT_SIZE || xSemaphoreTake(live_lock, 0) != pdTRUE) {
+        return;
+    }
+    memcpy(live_buf, photo->buf, photo->len);
+    live_len = photo->len;
+    live_seq++;
+    xSemaphoreGive(live_lock);
+}
+
+/**
+ * @brief JPEG decoder callback - write luma of RGB888 block into motion_frame
+ */
+static bool motion_gray_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+    jpg_decode_t *decode = arg;
+    if (data == NULL) {
+        // Called once before decoding starts with size of the whole (scaled) image
+        if (x == 0 && y == 0) {
+            decode->width = w;
+            decode->height = h;
+        }
+        return decode->width * decode->height <= MOTION_MAX_PIXELS;
+    }
+    for (uint16_t row = 0; row < h; row++) {
+        uint8_t *out = decode->out + (y + row) * decode->width + x;
+        for (uint16_t col = 0; col < w; col++, data += 3) {
+            *out++ = (77 * data[0] + 150 * data[1] + 29 * data[2]) >> 8;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Decode JPEG at 1/8 scale, score it against background and optionally learn it
+ * @return changed blocks per mille, -1 when there is no background yet or frame could not be decoded
+ */
+static int motion_check(const uint8_t *jpg, size_t len, bool learn) {
+    int64_t start = esp_timer_get_time();
+    jpg_decode_t decode = { .jpg = jpg, .len = len, .out = motion_frame };
+    int score = -1;
+    xSemaphoreTake(motion_lock, portMAX_DELAY);
+    if (esp_jpg_decode(len, JPG_SCALE_8X, jpg_decode_read, motion_gray_write, &decode) == ESP_OK) {
+        score = motion_detect_score(&motion, motion_frame, decode.width, decode.height);
+        if (learn) {
+            motion_detect_learn(&motion, motion_frame, decode.width, decode.height);
+        }
+    }
+    xSemaphoreGive(motion_lock);
+    metrics_observe(&metric_motion_check, esp_timer_get_time() - start);
+    return score;
+}
+
+/**
+ * @brief JPEG decoder callback - add RGB888 block to focus metric, nothing is stored
+ */
+static bool focus_rgb_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+    jpg_decode_t *decode = arg;
+    if (data != NULL) {
+        focus_metric_add_rgb888(decode->focus, data, w, h);
+    }
+    return true;
+}
+
+/**
+ * @brief Decode JPEG at 1/2 scale and measure its focus, blur of few pixels vanishes at smaller scales
+ * @return focus, higher is sharper, 0 when frame could not be decoded
+ */
+static uint32_t focus_check(const uint8_t *jpg, size_t len) {
+    int64_t start = esp_timer_get_time();
+    focus_metric_t focus;
+    focus_metric_init(&focus);
+    jpg_decode_t decode = { .jpg = jpg, .len = len, .focus = &focus };
+    uint32_t score = 0;
+    if (esp_jpg_decode(len, JPG_SCALE_2X, jpg_decode_read, focus_rgb_write, &decode) == ESP_OK) {
+        score = focus_metric_score(&focus);
+    }
+    metrics_observe(&metric_focus_check, esp_timer_get_time() - start);
+    return score;
+}
+
+/**
+ * @brief Allocate background & decode buffer in PSRAM
+ */
+esp_err_t init_motion() {
+    uint8_t *background = heap_caps_malloc(MOTION_MAX_PIXELS, MALLOC_CAP_SPIRAM);
+    motion_frame = heap_caps_malloc(MOTION_MAX_PIXELS, MALLOC_CAP_SPIRAM);
+    motion_lock = xSemaphoreCreateMutex();
+    if (motion_frame == NULL || motion_lock == NULL ||
+        !motion_detect_init(&motion, background, MOTION_MAX_PIXELS, MOTION_BLOCK_THRESHOLD, MOTION_LEARN_SHIFT)) {
+        ESP_LOGE(DEVICE, "[MOTION] Allocation failed");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Camera task - feeds pre-roll ring at PREROLL_FPS (BURST_INTERVAL_MS after trigger) and live stream
+ * at STREAM_MAX_FPS while viewed
+ */
+void camera_task(void *arg) {
+    TickType_t last_wake = xTaskGetTickCount();
+    TickType_t last_probe = last_wake;
+    unsigned learn_countdown = 0;
+    bool bursting = false;
+    while (1) {
+        bool streaming = stream_clients > 0;
+        TickType_t period = (1000 / (streaming ? STREAM_MAX_FPS : PREROLL_FPS)) / portTICK_PERIOD_MS;
+        if (bursting) {
+            period = BURST_INTERVAL_MS / portTICK_PERIOD_MS;
+        }
+        // Trigger wakes the task early, first burst frame is grabbed right away
+        TickType_t elapsed = xTaskGetTickCount() - last_wake;
+        if (elapsed < period) {
+            ulTaskNotifyTake(pdTRUE, period - elapsed);
+        }
+        last_wake = xTaskGetTickCount();
+
+        // Frozen sequence is kept for a while so it can be downloaded, no need to grab frames meanwhile
+        bool frozen = true;
+        bool triggered = false;
+        if (PREROLL_ENABLED) {
+            xSemaphoreTake(preroll_lock, portMAX_DELAY);
+            frozen = preroll_ring.frozen;
+            if (frozen && esp_timer_get_time() - preroll_frozen_at > PREROLL_HOLD_MS * 1000LL) {
+                frame_ring_release(&preroll_ring);
+                frozen = false;
+            }
+            triggered = preroll_ring.triggered;
+            bursting = triggered && !frozen;
+            xSemaphoreGive(preroll_lock);
+        }
+        if (frozen && !streaming) {
+            // Flash decision needs to know current light even when nothing else grabs frames
+            if (flash_lock != NULL && last_wake - last_probe >= pdMS_TO_TICKS(FLASH_PROBE_MS)) {
+                last_probe = last_wake;
+                camera_fb_t *probe = grab_frame();
+                if (probe != NULL) {
+                    release_frame(probe);
+                }
+            }
+            continue;
+        }
+        last_probe = last_wake;
+
+        camera_fb_t *photo = grab_frame();
+        if (!photo) {
+            ESP_LOGE(DEVICE, "[CAM] Frame capture failed");
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+
+        if (streaming) {
+            publish_live_frame(photo);
+        }
+        // Background is learned only from frames nobody triggered on
+        if (MOTION_VERIFY_ENABLED && motion_lock != NULL && !triggered &&
+            learn_countdown-- == 0) {
+            motion_check(photo->buf, photo->len, true);
+            learn_countdown = MOTION_LEARN_EVERY - 1;
+        }
+        if (PREROLL_ENABLED) {
+            xSemaphoreTake(preroll_lock, portMAX_DELAY);
+            bool burst_frame = preroll_ring.triggered && !preroll_ring.frozen;
+            if (!frame_ring_push(&preroll_ring, photo->buf, photo->len, photo->width, photo->height, now)) {
+                if (!preroll_ring.frozen && photo->len > preroll_ring.slot_size) {
+                    ESP_LOGE(DEVICE, "[CAM] Pre-roll frame too big {%zu bytes}", photo->len);
+                }
+            } else if (burst_frame) {
+                metrics_add(&metric_burst_frames, 1);
+            }
+            bursting = preroll_ring.triggered && !preroll_ring.frozen;
+            if (preroll_ring.frozen && preroll_frozen_at < preroll_ring.trigger_time) {
+                preroll_frozen_at = now;
+                flash_set(false);
+                xSemaphoreGive(preroll_done);
+            }
+            xSemaphoreGive(preroll_lock);
+        }
+        release_frame(photo);
+    }
+}
+
+/**
+ * @brief Allocate pre-roll ring and live frame in PSRAM and start camera task
+ */
+esp_err_t init_camera_task() {
+    live_buf = heap_caps_malloc(STREAM_SLOT_SIZE, MALLOC_CAP_SPIRAM);
+    if (live_buf == NULL) {
+        ESP_LOGE(DEVICE, "[CAM] Live frame allocation failed");
+        return ESP_ERR_NO_MEM;
+    }
+    live_lock = xSemaphoreCreateMutex();
+
+    if (PREROLL_ENABLED) {
+        uint8_t *pool = heap_caps_malloc(PREROLL_DEPTH * PREROLL_SLOT_SIZE, MALLOC_CAP_SPIRAM);
+        if (pool == NULL || !frame_ring_init(&preroll_ring, pool, PREROLL_DEPTH, PREROLL_SLOT_SIZE)) {
+            ESP_LOGE(DEVICE, "[CAM] Pre-roll ring allocation failed");
+            return ESP_ERR_NO_MEM;
+        }
+        preroll_done = xSemaphoreCreateBinary();
+        preroll_lock = xSemaphoreCreateMutex();
+        ESP_LOGI(DEVICE, "[CAM] Pre-roll ring ready {%d frames @ %d fps}", PREROLL_DEPTH, PREROLL_FPS);
+    }
+    xTaskCreate(camera_task, "camera", 4096, NULL, 5, &camera_task_handle);
+    return ESP_OK;
+}
+
+/**
+ * @brief Freeze pre-roll ring after burst of BURST_FRAMES and store the sharpest burst frame (or the one
+ * closest to the trigger) as the latest photo
+ */
+esp_err_t take_preroll_picture(uint32_t event_id) {
+    ESP_LOGI(DEVICE, "[CAM] Freezing pre-roll");
+    int64_t trigger = esp_timer_get_time();
+    const TickType_t wait = (BURST_FRAMES + 2) * BURST_INTERVAL_MS / portTICK_PERIOD_MS;
+
+    xSemaphoreTake(preroll_lock, portMAX_DELAY);
+    if (preroll_ring.triggered) {
+        frame_ring_release(&preroll_ring);      // Newer event replaces the held one
+    }
+    xSemaphoreTake(preroll_done, 0);            // Drop stale notification
+    frame_ring_trigger(&preroll_ring, trigger, BURST_FRAMES);
+    preroll_event_id = 0;
+    memset(preroll_focus, 0, sizeof(preroll_focus));
+    bool frozen = preroll_ring.frozen;
+    int64_t settle = 0;
+    if (frozen) {
+        preroll_frozen_at = trigger;
+    } else if (flash_prepare(&settle)) {        // Light up frames captured after the trigger
+        trace_mark(event_id, CAPTURE_TRACE_FLASH_ON, esp_timer_get_time());
+    }
+    xSemaphoreGive(preroll_lock);
+    xTaskNotifyGive(camera_task_handle);
+
+    if (!frozen && xSemaphoreTake(preroll_done, wait) != pdTRUE) {
+        ESP_LOGE(DEVICE, "[CAM] Pre-roll did not freeze in time");
+        flash_set(false);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Frozen frames are referenced, decoding & storing them does not hold up camera task or downloads
+    const frame_ring_slot_t *frames[FRAME_RING_MAX_DEPTH];
+    uint32_t focus[FRAME_RING_MAX_DEPTH] = {0};
+    xSemaphoreTake(preroll_lock, portMAX_DELAY);
+    metrics_observe(&metric_preroll_freeze, preroll_frozen_at - trigger);
+    // Flash frames are usable once exposure settled
+    int64_t usable = trigger + settle;
+    const frame_ring_slot_t *closest = frame_ring_closest(&preroll_ring, usable);
+    size_t count = preroll_ring.count;
+    uint32_t trigger_seq = preroll_ring.trigger_seq;
+    size_t stored = 0;
+    for (size_t i = 0; i < count; i++) {
+        frames[i] = frame_ring_ref(&preroll_ring, i);
+        if (frames[i] == closest) {
+            stored = i;
+        }
+    }
+    xSemaphoreGive(preroll_lock);
+    if (closest == NULL) {
+        ESP_LOGE(DEVICE, "[CAM] Pre-roll ring is empty");
+        return ESP_FAIL;
+    }
+
+    esp_err_t res = ESP_OK;
+    if (MOTION_VERIFY_ENABLED && motion_lock != NULL) {
+        // Stored frame and the ones after it, someone may have just stepped into view
+        int score = -1;
+        for (size_t i = stored; i < count; i++) {
+            int candidate_score = motion_check(frames[i]->buf, frames[i]->len, false);
+            score = candidate_score > score ? candidate_score : score;
+        }
+        if (score >= 0 && score < MOTION_MIN_CHANGE) {
+            ESP_LOGI(DEVICE, "[MOTION] No motion in view {score=%d}, photo dropped", score);
+            res = ESP_ERR_NOT_FOUND;
+        } else {
+            ESP_LOGI(DEVICE, "[MOTION] Motion confirmed {score=%d}", score);
+        }
+    }
+    if (res == ESP_OK) {
+        // Flash timing makes some burst frames blurry, every one of them is measured
+        for (size_t i = 0; BURST_PICK_SHARPEST && i < count; i++) {
+            if (frames[i]->seq >= trigger_seq && frames[i]->timestamp >= usable) {
+                focus[i] = focus_check(frames[i]->buf, frames[i]->len);
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (focus[i] > focus[stored]) {
+                stored = i;
+            }
+        }
+        const frame_ring_slot_t *frame = frames[stored];
+        metrics_observe(&metric_trigger_to_frame, frame->timestamp > trigger ? frame->timestamp - trigger : 0);
+        trace_mark(event_id, CAPTURE_TRACE_GRABBED, frame->timestamp);
+        res = store_photo(frame->buf, frame->len, frame->width, frame->height, PIXFORMAT_JPEG,
+                          frame->timestamp, event_id);
+    }
+    if (res == ESP_OK) {
+        trace_mark(event_id, CAPTURE_TRACE_STORED, esp_timer_get_time());
+        ESP_LOGI(DEVICE, "[CAM] Photo taken! Its size was: %zu bytes, %lld ms from trigger, frame %zu of %zu {focus=%u}, freeze latency %lld ms\n",
+                 frames[stored]->len, (long long)((frames[stored]->timestamp - trigger) / 1000), stored, count,
+                 (unsigned)focus[stored], (long long)((preroll_frozen_at - trigger) / 1000));
+    }
+
+    xSemaphoreTake(preroll_lock, portMAX_DELAY);
+    for (size_t i = 0; i < count; i++) {
+        frame_ring_unref(&preroll_ring, frames[i]);
+    }
+    // Sequence is still the one of this trigger unless its hold ran out meanwhile
+    bool held = preroll_ring.frozen && preroll_ring.trigger_time == trigger;
+    if (held && res == ESP_ERR_NOT_FOUND) {
+        frame_ring_release(&preroll_ring);      // Nothing worth keeping, continue learning background
+    } else if (held && res == ESP_OK) {
+        memcpy(preroll_focus, focus, sizeof(preroll_focus));
+        preroll_event_id = event_id;
+        preroll_stored = stored;
+    }
+    xSemaphoreGive(preroll_lock);
+    return res;
+}
+
+/**
+ * @brief Takes a picture (from pre-roll ring when enabled) and stores it in a photo slot
+ */
+esp_err_t take_picture(uint32_t event_id) {
+    if (PREROLL_ENABLED && preroll_lock != NULL) {
+        return take_preroll_picture(event_id);
+    }
+    ESP_LOGI(DEVICE, "[CAM] Taking photo");
+    
+    int64_t start = esp_timer_get_time();
+    int64_t settle;
+    if (flash_prepare(&settle)) {
+        trace_mark(event_id, CAPTURE_TRACE_FLASH_ON, start);
+        vTaskDelay(pdMS_TO_TICKS(settle / 1000));
+        metrics_observe(&metric_flash_warmup, esp_timer_get_time() - start);
+    }
+    camera_fb_t *photo = grab_frame();
+    flash_set(false);
+    metrics_observe(&metric_trigger_to_frame, esp_timer_get_time() - start);
+    if (!photo) {
+        ESP_LOGE(DEVICE, "[CAM] Photo capture failed");
+        return ESP_FAIL;
+    }
+    trace_mark(event_id, CAPTURE_TRACE_GRABBED, esp_timer_get_time());
+    if (MOTION_VERIFY_ENABLED && motion_lock != NULL) {
+        // Without pre-roll the background is made of previous PIR photos
+        int score = motion_check(photo->buf, photo->len, true);
+        if (score >= 0 && score < MOTION_MIN_CHANGE) {
+            ESP_LOGI(DEVICE, "[MOTION] No motion in view {score=%d}, photo dropped", score);
+            release_frame(photo);
+            return ESP_ERR_NOT_FOUND;
+        }
+    }
+
+    esp_err_t res = store_photo(photo->buf, photo->len, photo->width, photo->height, photo->format,
+                                esp_timer_get_time(), event_id);
+    if (res == ESP_OK) {
+        trace_mark(event_id, CAPTURE_TRACE_STORED, esp_timer_get_time());
+    }
+
+    ESP_LOGI(DEVICE, "[CAM] Photo taken! Its size was: %zu bytes\n", photo->len);
+    release_frame(photo);
+    return res;
+}
+
+/**
+ * @brief Take photo for /take-photo and publish it as latest, without motion check - runs in capture task
+ */
+static esp_err_t take_shared_picture(uint32_t event_id) {
+    int64_t start = esp_timer_get_time();
+    int64_t settle;
+    if (flash_prepare(&settle)) {
+        trace_mark(event_id, CAPTURE_TRACE_FLASH_ON, start);
+        vTaskDelay(pdMS_TO_TICKS(settle / 1000));
+        metrics_observe(&metric_flash_warmup, esp_timer_get_time() - start);
+    }
+    camera_fb_t *photo = grab_frame();
+    flash_set(false);
+    metrics_observe(&metric_trigger_to_frame, esp_timer_get_time() - start);
+    if (!photo) {
+        ESP_LOGE(DEVICE, "[CAM] Photo capture failed");
+        return ESP_FAIL;
+    }
+    trace_mark(event_id, CAPTURE_TRACE_GRABBED, esp_timer_get_time());
+    esp_err_t res = store_photo(photo->buf, photo->len, photo->width, photo->height, photo->format,
+                                esp_timer_get_time(), event_id);
+    // Driver gets the buffer back right after the copy, requests are answered from the photo slot
+    release_frame(photo);
+    if (res == ESP_OK) {
+        trace_mark(event_id, CAPTURE_TRACE_STORED, esp_timer_get_time());
+    }
+    return res;
+}
+
+static void take_done(photo_slot_t *photo, bool busy) {
+    xSemaphoreTake(take_lock, portMAX_DELAY);
+    take_photo = photo;
+    take_busy = busy;
+    xSemaphoreGive(take_lock);
+    xTaskNotifyGive(take_task_handle);
+}
+
+/**
+ * @brief Take task - answers every request parked for the finished capture with its photo
+ * Requests parked once the capture is done start the next one, they may have asked for a newer frame.
+ */
+void take_task(void *arg) {
+    int64_t parked_at[TAKE_MAX_WAITERS];
+    parked_reply_t *replies = take_replies;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        size_t count = 0;
+        xSemaphoreTake(take_lock, portMAX_DELAY);
+        photo_slot_t *photo = take_photo;
+        bool busy = take_busy;
+        take_photo = NULL;
+        for (size_t i = 0; i < TAKE_MAX_WAITERS; i++) {
+            count += take_waiters[i].fd >= 0;
+        }
+        // Answered waiters move to take_replies, session close still finds them there while they are sent
+        for (size_t i = 0, n = 0; i < TAKE_MAX_WAITERS; i++) {
+            if (take_waiters[i].fd >= 0) {
+                parked_at[n] = take_waiters[i].parked_at;
+                take_reply(&replies[n++], &take_waiters[i], photo, count, busy);
+                take_waiters[i].fd = -1;
+            }
+        }
+        take_sending = count;
+        take_running = false;
+        xSemaphoreGive(take_lock);
+
+        parked_send_all(replies, count, take_lock);
+        xSemaphoreTake(take_lock, portMAX_DELAY);
+        take_sending = 0;
+        xSemaphoreGive(take_lock);
+        int64_t now = esp_timer_get_time();
+        for (size_t i = 0; i < count; i++) {
+            if (replies[i].failed && replies[i].body != NULL) {
+                metrics_add(&metric_http_aborted, 1);
+            }
+            if (replies[i].sent > replies[i].header_len) {
+                metrics_add(&metric_http_bytes, replies[i].sent - replies[i].header_len);
+            }
+            metrics_add(&metric_take_requests, 1);
+            metrics_observe(&metric_http_take, now - parked_at[i]);
+        }
+        if (photo != NULL) {
+            ESP_LOGI(DEVICE, "[CAM] Photo taken! Its size was: %zu bytes, sent to %zu request(s)", photo->len, count);
+            photo_slots_release(&photo_store, photo);
+        }
+    }
+}
+
+/**
+ * @brief Start take task
+ */
+esp_err_t init_take() {
+    for (size_t i = 0; i < TAKE_MAX_WAITERS; i++) {
+        take_waiters[i].fd = -1;
+    }
+    take_lock = xSemaphoreCreateMutex();
+    if (take_lock == NULL || xTaskCreate(take_task, "take", 4096, NULL, 5, &take_task_handle) != pdPASS) {
+        take_lock = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// ============================ ARCHIVE ===========================
+static bool archive_flash_read(void *ctx, size_t offset, void *dst, size_t len) {
+    return esp_partition_read(ctx, offset, dst, len) == ESP_OK;
+}
+
+static bool archive_flash_write(void *ctx, size_t offset, const void *src, size_t len) {
+    return esp_partition_write(ctx, offset, src, len) == ESP_OK;
+}
+
+static bool archive_flash_erase(void *ctx, size_t offset, size_t len) {
+    return esp_partition_erase_range(ctx, offset, len) == ESP_OK;
+}
+
+/**
+ * @brief Reserve room for copy of photo in staging buffer, copies are released in the order they were made
+ * @return offset of the room, SIZE_MAX when the buffer or queue is full
+ */
+static size_t archive_stage_alloc(size_t len) {
+    size_t offset = SIZE_MAX;
+    xSemaphoreTake(archive_stage_lock, portMAX_DELAY);
+    if (archive_stage_pending == 0) {
+        archive_stage_head = 0;
+        archive_stage_tail = 0;
+    }
+    if (archive_stage_pending == ARCHIVE_QUEUE_LEN) {
+        // Queue is full, archive_queue never blocks the capture task
+    } else if (archive_stage_pending == 0 || archive_stage_head > archive_stage_tail) {
+        if (archive_stage_head + len <= ARCHIVE_STAGE_SIZE) {
+            offset = archive_stage_head;
+        } else if (len <= archive_stage_tail) {
+            offset = 0;                         // End of buffer stays unused until the tail passes it
+        }
+    } else if (archive_stage_head + len <= archive_stage_tail) {
+        offset = archive_stage_head;
+    }
+    if (offset != SIZE_MAX) {
+        archive_stage_head = offset + len;
+        archive_stage_pending++;
+    }
+    xSemaphoreGive(archive_stage_lock);
+    return offset;
+}
+
+/**
+ * @brief Release the oldest copy in staging buffer
+ */
+static void archive_stage_free(const archive_job_t *job) {
+    xSemaphoreTake(archive_stage_lock, portMAX_DELAY);
+    archive_stage_tail = job->offset + job->len;
+    archive_stage_pending--;
+    xSemaphoreGive(archive_stage_lock);
+}
+
+/**
+ * @brief Copy published photo for the archive task, photo slot is free again right after
+ * When flash writes fall behind, the photo is left out of the archive (never the capture itself).
+ */
+static void archive_submit(const photo_slot_t *photo) {
+    if (archive_queue == NULL) {
+        return;
+    }
+    archive_job_t job = {
+        .event_id = photo->event_id,
+        .offset = archive_stage_alloc(photo->len),
+        .len = photo->len,
+        .timestamp = photo->timestamp,
+        .width = photo->width,
+        .height = photo->height,
+    };
+    if (job.offset == SIZE_MAX) {
+        metrics_add(&metric_archive_dropped, 1);
+        ESP_LOGE(DEVICE, "[ARCHIVE] Flash writes behind, photo %u not archived", (unsigned)job.event_id);
+        return;
+    }
+    int64_t start = esp_timer_get_time();
+    memcpy(archive_stage + job.offset, photo->buf, photo->len);
+    metrics_observe(&metric_archive_copy, esp_timer_get_time() - start);
+    // Queue has room for every staged copy
+    xQueueSend(archive_queue, &job, portMAX_DELAY);
+}
+
+/**
+ * @brief Archive task - writes staged photos to flash without holding up the capture
+ */
+void archive_task(void *arg) {
+    archive_job_t job;
+    while (1) {
+        xQueueReceive(archive_queue, &job, portMAX_DELAY);
+        int64_t start = esp_timer_get_time();
+        xSemaphoreTake(archive_lock, portMAX_DELAY);
+        bool ok = photo_archive_append(&archive, job.event_id, archive_stage + job.offset, job.len, job.timestamp,
+                                       job.width, job.height);
+        xSemaphoreGive(archive_lock);
+        archive_stage_free(&job);
+        int64_t duration = esp_timer_get_time() - start;
+        metrics_observe(&metric_archive_write, duration);
+        if (ok) {
+            ESP_LOGI(DEVICE, "[ARCHIVE] Photo %u stored in %lld ms", (unsigned)job.event_id, (long long)(duration / 1000));
+            upload_enqueue(job.event_id);
+        } else {
+            metrics_add(&metric_archive_errors, 1);
+            ESP_LOGE(DEVICE, "[ARCHIVE] Failed to store photo");
+        }
+    }
+}
+
+/**
+ * @brief Mount archive on the spiffs partition and start archive task
+ */
+esp_err_t init_archive() {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                                ESP_PARTITION_SUBTYPE_DATA_SPIFFS, NULL);
+    if (partition == NULL) {
+        ESP_LOGE(DEVICE, "[ARCHIVE] No spiffs partition found");
+        return ESP_ERR_NOT_FOUND;
+    }
+    archive_flash_t flash = {
+        .ctx = (void *)partition,
+        .size = partition->size,
+        .erase_size = SPI_FLASH_SEC_SIZE,
+        .read = archive_flash_read,
+        .write = archive_flash_write,
+        .erase = archive_flash_erase,
+    };
+    int64_t start = esp_timer_get_time();
+    if (!photo_archive_mount(&archive, &flash, ARCHIVE_SEGMENT_SIZE, archive_entries, ARCHIVE_MAX_ENTRIES)) {
+        ESP_LOGE(DEVICE, "[ARCHIVE] Mount failed");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(DEVICE, "[ARCHIVE] Mounted in %lld ms {photos=%zu, segments=%zu}",
+             (long long)((esp_timer_get_time() - start) / 1000), archive.count, archive.segment_count);
+
+    archive_stage = heap_caps_malloc(ARCHIVE_STAGE_SIZE, MALLOC_CAP_SPIRAM);
+    archive_stage_lock = xSemaphoreCreateMutex();
+    archive_lock = xSemaphoreCreateMutex();
+    if (archive_stage == NULL || archive_stage_lock == NULL || archive_lock == NULL) {
+        ESP_LOGE(DEVICE, "[ARCHIVE] Staging buffer allocation failed");
+        archive_lock = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    archive_queue = xQueueCreate(ARCHIVE_QUEUE_LEN, sizeof(archive_job_t));
+    xTaskCreate(archive_task, "archive", 4096, NULL, 3, NULL);
+    return ESP_OK;
+}
+// ================================================================
+
+// ============================ CAPTURE ===========================
+/**
+ * @brief Queue capture for trigger of node, or fold it into the running episode when one is open
+ * @param origin node event & its times, trace of new event starts with them
+ * @param limited set when the node is over its rate limit
+ * @return event id, 0 when the trigger was rejected
+ */
+uint32_t request_capture(uint16_t node_id, int64_t trigger_time, const trigger_origin_t *origin, bool *limited) {
+    *limited = false;
+    if (capture_queue == NULL) {
+        return 0;
+    }
+    uint32_t event_id = 0;
+    xSemaphoreTake(capture_state_lock, portMAX_DELAY);
+    capture_stats.requested++;
+    switch (node_table_trigger(&nodes, node_id, trigger_time, &event_id)) {
+        case NODE_TRIGGER_MERGED:
+            capture_stats.merged++;
+            break;
+        case NODE_TRIGGER_LIMITED:
+            capture_stats.limited++;
+            *limited = true;
+            break;
+        case NODE_TRIGGER_NEW: {
+            capture_request_t request = {
+                .event_id = next_event_id,
+                .node_id = node_id,
+                .trigger_time = trigger_time,
+            };
+            if (xQueueSend(capture_queue, &request, 0) == pdTRUE) {
+                event_id = next_event_id++;
+                node_table_open(&nodes, node_id, event_id, trigger_time);
+                trace_open(event_id, node_id, origin);
+            } else {
+                capture_stats.dropped++;
+            }
+            break;
+        }
+    }
+    xSemaphoreGive(capture_state_lock);
+    return event_id;
+}
+
+/**
+ * @brief Queue capture for /take-photo, it gets event id in queue order like triggers do
+ * @return event id, 0 when the capture queue is full
+ */
+uint32_t request_take(void) {
+    if (capture_queue == NULL) {
+        return 0;
+    }
+    trigger_origin_t origin = {
+        .seq = 0,
+        .detected = CAPTURE_TRACE_UNKNOWN,
+        .sent = CAPTURE_TRACE_UNKNOWN,
+        .received = esp_timer_get_time(),
+    };
+    uint32_t event_id = 0;
+    xSemaphoreTake(capture_state_lock, portMAX_DELAY);
+    capture_request_t request = {
+        .event_id = next_event_id,
+        .node_id = NODE_ID_ANONYMOUS,
+        .trigger_time = origin.received,
+        .take = true,
+    };
+    if (xQueueSend(capture_queue, &request, 0) == pdTRUE) {
+        event_id = next_event_id++;
+        trace_open(event_id, NODE_ID_ANONYMOUS, &origin);
+    }
+    xSemaphoreGive(capture_state_lock);
+    return event_id;
+}
+
+/**
+ * @brief Account events node replays after the camera was unreachable
+ * Events seen before are skipped. Only the newest one may still be worth a picture, the older ones
+ * are counted as late, so the node table shows what happened without a burst of stale captures.
+ * @param batch header, with TRIGGER_FLAG_SYNCED its timestamp is send time on camera clock
+ */
+uint32_t replay_events(const trigger_msg_t *batch, const trigger_batch_entry_t *entries, size_t count, bool *limited) {
+    *limited = false;
+    if (capture_state_lock == NULL) {
+        return 0;
+    }
+    uint16_t node_id = batch->node_id;
+    int64_t now = esp_timer_get_time();
+    const trigger_batch_entry_t *newest = NULL;
+    uint32_t accepted = 0;
+    xSemaphoreTake(capture_state_lock, portMAX_DELAY);
+    for (size_t i = 0; i < count; i++) {
+        if (!trigger_dedup_accept(&trigger_dedup, node_id, entries[i].seq)) {
+            continue;
+        }
+        accepted++;
+        if (newest == NULL || (int32_t)(entries[i].seq - newest->seq) > 0) {
+            newest = &entries[i];
+        }
+    }
+    bool capture = newest != NULL && newest->age_ms <= REPLAY_CAPTURE_MAX_AGE_MS;
+    uint32_t late = accepted - (capture ? 1 : 0);
+    if (late > 0) {
+        capture_stats.late += late;
+        node_table_late(&nodes, node_id, late, now);
+    }
+    xSemaphoreGive(capture_state_lock);
+
+    ESP_LOGI(DEVICE, "[TRIGGER] Replay of %u event(s) from node %04x {new=%u, late=%u, oldest age=%lld ms}",
+             (unsigned)count, node_id, (unsigned)accepted, (unsigned)late,
+             entries[0].age_ms == TRIGGER_AGE_UNKNOWN ? -1LL : (long long)entries[0].age_ms);
+    if (!capture) {
+        return 0;
+    }
+    bool synced = batch->flags & TRIGGER_FLAG_SYNCED;
+    trigger_origin_t origin = {
+        .seq = newest->seq,
+        .detected = synced ? batch->timestamp - newest->age_ms * 1000LL : CAPTURE_TRACE_UNKNOWN,
+        .sent = synced ? batch->timestamp : CAPTURE_TRACE_UNKNOWN,
+        .received = now,
+    };
+    return request_capture(node_id, now - newest->age_ms * 1000LL, &origin, limited);
+}
+
+/**
+ * @brief Capture task - takes pictures for queued triggers & /take-photo, keeps HTTP & UDP handlers free
+ * Only this task stores photos, so they reach the archive in event id order.
+ */
+void capture_task(void *arg) {
+    capture_request_t request;
+    while (1) {
+        xQueueReceive(capture_queue, &request, portMAX_DELAY);
+        int64_t start = esp_timer_get_time();
+        if (request.take) {
+            esp_err_t res = take_shared_picture(request.event_id);
+            metrics_add(&metric_take_captures, 1);
+            trace_finish(request.event_id, res);
+            // Latest photo is the one just stored, nothing else publishes meanwhile
+            take_done(res == ESP_OK ? photo_slots_acquire(&photo_store) : NULL, false);
+            ESP_LOGI(DEVICE, "[CAM] Event %u %s for take-photo {waited %lld ms, took %lld ms}",
+                     (unsigned)request.event_id, res == ESP_OK ? "captured" : "failed",
+                     (long long)((start - request.trigger_time) / 1000), (long long)((esp_timer_get_time() - start) / 1000));
+            continue;
+        }
+        esp_err_t res = take_picture(request.event_id);
+        int64_t duration = esp_timer_get_time() - start;
+        metrics_observe(&metric_capture_wait, start - request.trigger_time);
+        if (res == ESP_OK) {
+            metrics_observe(&metric_trigger_to_stored, start + duration - request.trigger_time);
+        }
+        trace_finish(request.event_id, res);
+
+        xSemaphoreTake(capture_state_lock, portMAX_DELAY);
+        if (res == ESP_OK) {
+            capture_stats.captured++;
+            capture_stats.last_event = request.event_id;
+        } else if (res == ESP_ERR_NOT_FOUND) {
+            capture_stats.rejected++;
+        } else {
+            capture_stats.failed++;
+        }
+        capture_stats.last_wait_us = start - request.trigger_time;
+        capture_stats.last_capture_us = duration;
+        capture_stats.total_capture_us += duration;
+        if (duration > capture_stats.max_capture_us) {
+            capture_stats.max_capture_us = duration;
+        }
+        xSemaphoreGive(capture_state_lock);
+
+        ESP_LOGI(DEVICE, "[CAM] Event %u %s {node %04x, waited %lld ms, took %lld ms}", (unsigned)request.event_id,
+                 res == ESP_OK ? "captured" : res == ESP_ERR_NOT_FOUND ? "rejected" : "failed", request.node_id,
+                 (long long)((start - request.trigger_time) / 1000), (long long)(duration / 1000));
+    }
+}
+
+/**
+ * @brief Start capture task, event ids continue after the newest archived photo
+ */
+esp_err_t init_capture() {
+    if (ESP_OK != init_trace()) {
+        ESP_LOGE(DEVICE, "[TRACE] Captures will not be traced");
+    }
+    capture_state_lock = xSemaphoreCreateMutex();
+    node_table_init(&nodes, NODE_RATE_BURST, NODE_RATE_REFILL_MS * 1000LL, CAPTURE_COALESCE_MS * 1000LL);
+    trigger_dedup_init(&trigger_dedup);
+    if (archive_lock != NULL) {
+        next_event_id = archive.next_id;
+    }
+    capture_queue = xQueueCreate(CAPTURE_QUEUE_LEN, sizeof(capture_request_t));
+    if (capture_queue == NULL || capture_state_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    xTaskCreate(capture_task, "capture", 4096, NULL, 5, NULL);
+    return ESP_OK;
+}
+// ================================================================
+
+// ============================ TRIGGER ===========================
+/**
+ * @brief UDP trigger task - acks PIR datagrams right away, then requests picture for new events
+ * Clock sync requests are answered here too, receive time is taken right after the datagram arrives
+ * and transmit time right before the reply leaves, so the node only sees network delay.
+ */
+void trigger_task(void *arg) {
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(TRIGGER_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        ESP_LOGE(DEVICE, "[TRIGGER] Failed to open UDP port %d", TRIGGER_UDP_PORT);
+        if (sock >= 0) {
+            close(sock);
+        }
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(DEVICE, "[TRIGGER] Listening on UDP port %d", TRIGGER_UDP_PORT);
+
+    uint8_t buf[TRIGGER_BATCH_MAX_SIZE + 1];    // One extra byte to reject oversized datagrams
+    trigger_batch_entry_t entries[TRIGGER_BATCH_MAX];
+    while (1) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        int64_t received = esp_timer_get_time();
+        if (len < 0) {
+            continue;
+        }
+        trigger_msg_t event;
+        size_t count = 0;
+        bool single = trigger_decode(buf, len, &event);
+        if (single && event.type == TRIGGER_MSG_SYNC) {
+            trigger_msg_t reply;
+            trigger_make_sync_reply(&event, received, esp_timer_get_time(), &reply);
+            size_t size = trigger_encode(&reply, buf);
+            sendto(sock, buf, size, 0, (struct sockaddr *)&from, from_len);
+            metrics_add(&metric_sync_replies, 1);
+            continue;
+        }
+        if (!(single && event.type == TRIGGER_MSG_EVENT) && !trigger_decode_batch(buf, len, &event, entries, &count)) {
+            ESP_LOGE(DEVICE, "[TRIGGER] Malformed datagram {len=%d}", len);
+            continue;
+        }
+
+        // Ack every copy, the previous ack may have been lost
+        trigger_msg_t ack;
+        trigger_make_ack(&event, esp_timer_get_time(), &ack);
+        size_t size = trigger_encode(&ack, buf);
+        sendto(sock, buf, size, 0, (struct sockaddr *)&from, from_len);
+
+        bool limited;
+        if (event.type == TRIGGER_MSG_BATCH) {
+            replay_events(&event, entries, count, &limited);
+            continue;
+        }
+        xSemaphoreTake(capture_state_lock, portMAX_DELAY);
+        bool fresh = trigger_dedup_accept(&trigger_dedup, event.node_id, event.seq);
+        uint32_t duplicates = trigger_dedup.duplicates;
+        xSemaphoreGive(capture_state_lock);
+        if (!fresh) {
+            ESP_LOGI(DEVICE, "[TRIGGER] Duplicate event #%u from node %04x {duplicates=%u}",
+                     (unsigned)event.seq, event.node_id, (unsigned)duplicates);
+            continue;
+        }
+        // Synced node tells when it saw the motion, this copy left it delay_us later
+        bool synced = event.flags & TRIGGER_FLAG_SYNCED;
+        trigger_origin_t origin = {
+            .seq = event.seq,
+            .detected = synced ? event.timestamp : CAPTURE_TRACE_UNKNOWN,
+            .sent = synced ? event.timestamp + event.delay_us : CAPTURE_TRACE_UNKNOWN,
+            .received = received,
+        };
+        uint32_t event_id = request_capture(event.node_id, received, &origin, &limited);
+        if (limited) {
+            ESP_LOGI(DEVICE, "[TRIGGER] Event #%u from node %04x over rate limit", (unsigned)event.seq, event.node_id);
+            continue;
+        }
+        ESP_LOGI(DEVICE, "[TRIGGER] Event #%u from node %04x -> capture event %u", (unsigned)event.seq,
+                 event.node_id, (unsigned)event_id);
+    }
+}
+// ================================================================
+
+// =========================== SUPERVISOR =========================
+/**
+ * @brief Initialize camera driver again once every frame is back, grabs wait meanwhile
+ */
+static esp_err_t reinit_camera() {
+    xSemaphoreTake(camera_lock, portMAX_DELAY);
+    camera_reinit = true;
+    // Grab stuck in the driver returns after its frame timeout
+    int64_t deadline = esp_timer_get_time() + SUPERVISOR_DRAIN_MS * 1000LL;
+    while (camera_users > 0 && esp_timer_get_time() < deadline) {
+        xSemaphoreGive(camera_lock);
+        vTaskDelay(pdMS_TO_TICKS(10));
+        xSemaphoreTake(camera_lock, portMAX_DELAY);
+    }
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    if (camera_users == 0) {
+        esp_camera_deinit();
+        err = esp_camera_init(&camera_config);
+    }
+    atomic_store(&camera_errors, 0);
+    atomic_store(&camera_delivered, false);
+    camera_reinit = false;
+    xSemaphoreGive(camera_lock);
+    if (err == ESP_OK) {
+        rate_control_restore();
+    }
+    return err;
+}
+
+static bool camera_delivered_since_reinit() {
+    return atomic_load(&camera_delivered);
+}
+
+/**
+ * @brief Leave nothing half done before restart - flash LED off, web servers stopped
+ */
+static void shutdown_device() {
+    flash_set(false);
+    stop_webserver(web_servers[1]);
+    stop_webserver(web_servers[0]);
+}
+// ================================================================
+
+// ============================ MAIN ==============================
+void app_main() {
+    // ====================== CONFIGURATION PART ======================
+    // Initialize NVS
+    // Taken from https://github.com/espressif/esp-idf/blob/42cce06704a24b01721cd34920f25b2e48b88c55/examples/wifi/getting_started/softAP/main/softap_example_main.c
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+
+    // Call WiFi AP setup & start
+    wifi_config_ap();
+    // Start Webserver
+    httpd_handle_t server = start_webserver();
+    // Initialize camera & photo store
+    if (ESP_OK != init_photo_store() || ESP_OK != init_camera()) {
+        return;
+    }
+    // Without rate control the sensor keeps jpeg_quality of camera_config
+    if (RATE_CONTROL_ENABLED && ESP_OK != init_rate_control()) {
+        ESP_LOGE(DEVICE, "[RATE] Frame length will not be controlled");
+    }
+    // Without flash policy every capture is lit and waits FLASH_SETTLE_DEFAULT_MS
+    if (FLASH_POLICY_ENABLED && ESP_OK != init_flash_policy()) {
+        ESP_LOGE(DEVICE, "[FLASH] Flash will be used for every capture");
+    }
+    // Push of capture events is optional, dashboard then has to be refreshed by hand
+    if (ESP_OK != notify_init()) {
+        ESP_LOGE(DEVICE, "[HTTP] Notifications not available");
+    }
+    // Long-poll is optional, ?wait= is then answered right away
+    if (ESP_OK != longpoll_init(&photo_store, latest_reply)) {
+        ESP_LOGE(DEVICE, "[HTTP] Long-poll not available");
+    }
+    // Archive is optional, camera keeps working without it
+    if (ARCHIVE_ENABLED && ESP_OK != init_archive()) {
+        ESP_LOGE(DEVICE, "[ARCHIVE] Photos will not be archived");
+    }
+    // Upload to collector is optional as well, it works from the archive
+    if (UPLOAD_URL[0] != '\0' && ESP_OK != upload_init(&archive, archive_lock)) {
+        ESP_LOGE(DEVICE, "[UPLOAD] Photos will not be uploaded");
+    }
+    // Motion verification is optional, without it every PIR photo is kept
+    if (MOTION_VERIFY_ENABLED && ESP_OK != init_motion()) {
+        ESP_LOGE(DEVICE, "[MOTION] PIR photos will not be verified");
+    }
+    // Start capture task & listen for UDP triggers
+    if (ESP_OK != init_capture()) {
+        return;
+    }
+    xTaskCreate(trigger_task, "trigger", 4096, NULL, 5, NULL);
+    // Without take task /take-photo answers 500, PIR captures keep working
+    if (ESP_OK != init_take()) {
+        ESP_LOGE(DEVICE, "[CAM] /take-photo not available");
+    }
+    // Init Flash LED
+    gpio_pad_select_gpio(4);
+    gpio_set_direction(4, GPIO_MODE_OUTPUT);
+    gpio_set_level(4, 0);
+    // Start pre-roll & live stream capture
+    if (ESP_OK != init_camera_task()) {
+        return;
+    }
+    httpd_handle_t stream_server = start_stream_server();
+    // ================================================================
+
+    // ========================== EXECUTION ===========================
+    // Requests are served by httpd tasks, supervisor sleeps until there is work and main task ends here
+    web_servers[0] = server;
+    web_servers[1] = stream_server;
+    static const supervisor_hooks_t supervisor_hooks = {
+        .reinit_camera = reinit_camera,
+        .camera_delivered = camera_delivered_since_reinit,
+        .shutdown = shutdown_device,
+    };
+    if (ESP_OK != supervisor_init(&supervisor_hooks)) {
+        ESP_LOGE(DEVICE, "[SUPERVISOR] Camera & memory will not be watched");
+    }
+    // ================================================================
+}
 // ================================================================
\ No newline at end of file
@@ -0,0 +1,72 @@
+/**
+ * @file metrics.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Lock-free counters & latency histograms exported in Prometheus text format
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include <stdio.h>
+#include "metrics.h"
+
+// Upper bounds of finite buckets (us), last bucket takes the rest
+static const uint32_t bucket_bounds[METRICS_BUCKETS - 1] = {
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000
+};
+
+void metrics_observe(metrics_histogram_t *histogram, int64_t duration_us) {
+    if (duration_us < 0) {
+        duration_us = 0;
+    }
+    size_t bucket = 0;
+    while (bucket < METRICS_BUCKETS - 1 && duration_us > bucket_bounds[bucket]) {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&histogram->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum_us, (uint32_t)duration_us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+}
+
+int metrics_format_counter(const metrics_counter_t *counter, char *buf, size_t len) {
+    return snprintf(buf, len, "# HELP %s %s\n# TYPE %s counter\n%s %u\n",
+                    counter->name, counter->help, counter->name, counter->name,
+                    (unsigned)atomic_load_explicit(&counter->value, memory_order_relaxed));
+}
+
+int metrics_format_value(const char *name, const char *help, const char *type, long long value,
+                         char *buf, size_t len) {
+    return snprintf(buf, len, "# HELP %s %s\n# TYPE %s %s\n%s %lld\n", name, help, name, type, name, value);
+}
+
+int metrics_format_histogram(const metrics_histogram_t *histogram, char *buf, size_t len) {
+    size_t used = 0;
+    int n = snprintf(buf, len, "# HELP %s %s\n# TYPE %s histogram\n",
+                     histogram->name, histogram->help, histogram->name);
+    if (n < 0) {
+        return n;
+    }
+    used += n;
+
+    // Buckets are read one by one, so under load the total may be off by observations in flight
+    unsigned long cumulative = 0;
+    for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+        cumulative += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        if (i < METRICS_BUCKETS - 1) {
+            n = snprintf(buf + (used < len ? used : len), used < len ? len - used : 0,
+                         "%s_bucket{le=\"%u.%06u\"} %lu\n", histogram->name,
+                         (unsigned)(bucket_bounds[i] / 1000000), (unsigned)(bucket_bounds[i] % 1000000), cumulative);
+        } else {
+            n = snprintf(buf + (used < len ? used : len), used < len ? len - used : 0,
+                         "%s_bucket{le=\"+Inf\"} %lu\n", histogram->name, cumulative);
+        }
+        used += n;
+    }
+
+    unsigned sum_us = atomic_load_explicit(&histogram->sum_us, memory_order_relaxed);
+    n = snprintf(buf + (used < len ? used : len), used < len ? len - used : 0,
+                 "%s_sum %u.%06u\n%s_count %lu\n", histogram->name, sum_us / 1000000, sum_us % 1000000,
+                 histogram->name, cumulative);
+    return used + n;
+}
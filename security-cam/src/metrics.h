@@ -0,0 +1,79 @@
+/**
+ * @file metrics.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Lock-free counters & latency histograms exported in Prometheus text format
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define METRICS_BUCKETS         13              // 12 bounds (1ms - 5s) + Inf
+
+/*
+ * Values are 32-bit because Xtensa has no 64-bit atomics, atomic_ullong would take a lock on every update.
+ * They wrap around instead, Prometheus reads the wrap as counter reset, so rate() stays right as long as
+ * it is scraped more often than a value wraps (4 GiB for byte counters, ~71 min of summed latency).
+ */
+
+/**
+ * @brief Monotonic counter
+ */
+typedef struct {
+    const char *name;
+    const char *help;
+    atomic_uint value;
+} metrics_counter_t;
+
+/**
+ * @brief Latency histogram with fixed buckets, observations in microseconds
+ */
+typedef struct {
+    const char *name;
+    const char *help;
+    atomic_uint buckets[METRICS_BUCKETS];       // Not cumulative, summed up when formatted
+    atomic_uint sum_us;                         // Wraps around, see above
+    atomic_uint count;
+} metrics_histogram_t;
+
+#define METRICS_COUNTER(var, metric, text)      metrics_counter_t var = { .name = metric, .help = text }
+#define METRICS_HISTOGRAM(var, metric, text)    metrics_histogram_t var = { .name = metric, .help = text }
+
+/**
+ * @brief Add to counter, safe from any task, wraps around at 2^32
+ */
+static inline void metrics_add(metrics_counter_t *counter, uint32_t value) {
+    atomic_fetch_add_explicit(&counter->value, value, memory_order_relaxed);
+}
+
+/**
+ * @brief Record one duration, safe from any task
+ */
+void metrics_observe(metrics_histogram_t *histogram, int64_t duration_us);
+
+/**
+ * @brief Format counter as Prometheus text
+ * @return number of characters written (like snprintf)
+ */
+int metrics_format_counter(const metrics_counter_t *counter, char *buf, size_t len);
+
+/**
+ * @brief Format single value kept elsewhere as Prometheus text
+ * @param type "counter" or "gauge"
+ */
+int metrics_format_value(const char *name, const char *help, const char *type, long long value,
+                         char *buf, size_t len);
+
+/**
+ * @brief Format histogram as Prometheus text, durations in seconds
+ */
+int metrics_format_histogram(const metrics_histogram_t *histogram, char *buf, size_t len);
+
+#endif
@@ -0,0 +1,100 @@
+/**
+ * @file motion_detect.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Frame-difference motion check - compares small grayscale frame with rolling background
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include <string.h>
+#include "motion_detect.h"
+
+bool motion_detect_init(motion_detect_t *motion, uint8_t *background, size_t capacity,
+                        uint8_t block_threshold, uint8_t learn_shift) {
+    if (background == NULL || capacity == 0 || learn_shift > 7) {
+        return false;
+    }
+    memset(motion, 0, sizeof(*motion));
+    motion->background = background;
+    motion->capacity = capacity;
+    motion->block_threshold = block_threshold;
+    motion->learn_shift = learn_shift;
+    return true;
+}
+
+/**
+ * @brief Sum of pixels, used to cancel out exposure & lighting change of the whole scene
+ */
+static uint32_t frame_sum(const uint8_t *frame, size_t pixels) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < pixels; i++) {
+        sum += frame[i];
+    }
+    return sum;
+}
+
+/**
+ * @brief Sum of absolute differences of one block with brightness offset applied to the frame
+ */
+static uint32_t block_sad(const uint8_t *frame, const uint8_t *background, size_t stride,
+                          size_t block_w, size_t block_h, int offset) {
+    uint32_t sad = 0;
+    for (size_t y = 0; y < block_h; y++) {
+        const uint8_t *f = frame + y * stride;
+        const uint8_t *b = background + y * stride;
+        for (size_t x = 0; x < block_w; x++) {
+            int diff = (int)f[x] - (int)b[x] - offset;
+            sad += diff < 0 ? -diff : diff;
+        }
+    }
+    return sad;
+}
+
+int motion_detect_score(const motion_detect_t *motion, const uint8_t *frame, size_t width, size_t height) {
+    if (!motion->ready || width != motion->width || height != motion->height) {
+        return -1;
+    }
+    size_t pixels = width * height;
+    int offset = ((int)frame_sum(frame, pixels) - (int)frame_sum(motion->background, pixels)) / (int)pixels;
+
+    size_t blocks = 0;
+    size_t changed = 0;
+    for (size_t y = 0; y < height; y += MOTION_BLOCK_SIZE) {
+        size_t block_h = height - y < MOTION_BLOCK_SIZE ? height - y : MOTION_BLOCK_SIZE;
+        for (size_t x = 0; x < width; x += MOTION_BLOCK_SIZE) {
+            size_t block_w = width - x < MOTION_BLOCK_SIZE ? width - x : MOTION_BLOCK_SIZE;
+            size_t start = y * width + x;
+            // Compare with sum instead of dividing to get mean
+            uint32_t sad = block_sad(frame + start, motion->background + start, width, block_w, block_h, offset);
+            if (sad > (uint32_t)motion->block_threshold * block_w * block_h) {
+                changed++;
+            }
+            blocks++;
+        }
+    }
+    return (int)(changed * 1000 / blocks);
+}
+
+bool motion_detect_learn(motion_detect_t *motion, const uint8_t *frame, size_t width, size_t height) {
+    size_t pixels = width * height;
+    if (pixels == 0 || pixels > motion->capacity) {
+        return false;
+    }
+    if (!motion->ready || width != motion->width || height != motion->height) {
+        memcpy(motion->background, frame, pixels);
+        motion->width = width;
+        motion->height = height;
+        motion->ready = true;
+        return true;
+    }
+    // Exponential moving average, rounded so background can reach the frame value
+    int round = (1 << motion->learn_shift) - 1;
+    for (size_t i = 0; i < pixels; i++) {
+        int diff = (int)frame[i] - (int)motion->background[i];
+        motion->background[i] += diff >= 0 ? (diff + round) >> motion->learn_shift
+                                           : -((-diff + round) >> motion->learn_shift);
+    }
+    return true;
+}
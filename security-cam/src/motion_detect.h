@@ -0,0 +1,53 @@
+/**
+ * @file motion_detect.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Frame-difference motion check - compares small grayscale frame with rolling background
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef MOTION_DETECT_H
+#define MOTION_DETECT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MOTION_BLOCK_SIZE       8               // Frame is compared in blocks of 8x8 pixels
+
+/**
+ * @brief Background model
+ * Not thread safe - caller is expected to guard it with mutex.
+ */
+typedef struct {
+    uint8_t *background;        // width * height grayscale pixels
+    size_t capacity;            // Pixels available in background buffer
+    size_t width;
+    size_t height;
+    bool ready;                 // Background holds at least one frame
+    uint8_t block_threshold;    // Mean absolute difference of block counted as change
+    uint8_t learn_shift;        // Background moves towards frame by 1 / 2^learn_shift
+} motion_detect_t;
+
+/**
+ * @brief Prepare background model on top of preallocated buffer of capacity pixels
+ * @return false when buffer is missing or learn_shift is out of range
+ */
+bool motion_detect_init(motion_detect_t *motion, uint8_t *background, size_t capacity,
+                        uint8_t block_threshold, uint8_t learn_shift);
+
+/**
+ * @brief Compare frame with background, global brightness change is compensated
+ * @return changed blocks per mille, -1 when there is no background of this size yet
+ */
+int motion_detect_score(const motion_detect_t *motion, const uint8_t *frame, size_t width, size_t height);
+
+/**
+ * @brief Blend frame into background, first frame (or change of size) replaces it
+ * @return false when frame does not fit into background buffer
+ */
+bool motion_detect_learn(motion_detect_t *motion, const uint8_t *frame, size_t width, size_t height);
+
+#endif
@@ -0,0 +1,137 @@
+/**
+ * @file node_table.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Sensor node table - per-node trigger counters, token-bucket rate limit & capture episodes
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#include "node_table.h"
+
+#define TOKEN_MILLI     1000
+
+void node_table_init(node_table_t *table, uint32_t burst, int64_t refill_us, int64_t episode_us) {
+    memset(table, 0, sizeof(*table));
+    table->burst = burst > 0 ? burst : 1;
+    // Whole ms, so 1/1000 token is earned in whole us and refill_time never lags behind the tokens earned
+    table->refill_us = refill_us > 0 ? (refill_us + TOKEN_MILLI - 1) / TOKEN_MILLI * TOKEN_MILLI : TOKEN_MILLI;
+    table->episode_us = episode_us;
+}
+
+/**
+ * @brief Bucket fill at time now, refill_time is moved only by whole earned 1/1000 tokens
+ */
+static uint32_t bucket_level(const node_table_t *table, const node_entry_t *node, int64_t now,
+                             int64_t *refill_time) {
+    uint32_t capacity = table->burst * TOKEN_MILLI;
+    int64_t elapsed = now - node->refill_time;
+    int64_t earned = elapsed > 0 ? elapsed * TOKEN_MILLI / table->refill_us : 0;
+    if (node->tokens_milli + earned >= capacity) {
+        *refill_time = now;
+        return capacity;
+    }
+    *refill_time = node->refill_time + earned * table->refill_us / TOKEN_MILLI;
+    return node->tokens_milli + (uint32_t)earned;
+}
+
+/**
+ * @brief Entry of node, new one starts with full bucket in free or least recently seen slot
+ */
+static node_entry_t *node_find(node_table_t *table, uint16_t node_id, int64_t now) {
+    node_entry_t *slot = NULL;
+    for (size_t i = 0; i < NODE_TABLE_MAX; i++) {
+        node_entry_t *node = &table->nodes[i];
+        if (node->used && node->node_id == node_id) {
+            return node;
+        }
+        if (slot == NULL || (slot->used && (!node->used || node->last_seen < slot->last_seen))) {
+            slot = node;
+        }
+    }
+    if (slot->used) {
+        table->evicted++;
+    } else {
+        table->count++;
+    }
+    memset(slot, 0, sizeof(*slot));
+    slot->used = true;
+    slot->node_id = node_id;
+    slot->tokens_milli = table->burst * TOKEN_MILLI;
+    slot->refill_time = now;
+    return slot;
+}
+
+node_trigger_t node_table_trigger(node_table_t *table, uint16_t node_id, int64_t now, uint32_t *episode_id) {
+    node_entry_t *node = node_find(table, node_id, now);
+    node->triggers++;
+    node->last_seen = now;
+    if (table->episode_id != 0 && now - table->episode_start < table->episode_us) {
+        if (node->last_episode != table->episode_id) {
+            node->last_episode = table->episode_id;
+            table->episode_nodes++;
+        }
+        node->joined++;
+        *episode_id = table->episode_id;
+        return NODE_TRIGGER_MERGED;
+    }
+    int64_t refill_time;
+    uint32_t tokens = bucket_level(table, node, now, &refill_time);
+    if (tokens < TOKEN_MILLI) {
+        node->tokens_milli = tokens;
+        node->refill_time = refill_time;
+        node->limited++;
+        return NODE_TRIGGER_LIMITED;
+    }
+    return NODE_TRIGGER_NEW;
+}
+
+void node_table_open(node_table_t *table, uint16_t node_id, uint32_t episode_id, int64_t now) {
+    node_entry_t *node = node_find(table, node_id, now);
+    int64_t refill_time;
+    node->tokens_milli = bucket_level(table, node, now, &refill_time) - TOKEN_MILLI;
+    node->refill_time = refill_time;
+    node->opened++;
+    node->last_episode = episode_id;
+    table->episode_id = episode_id;
+    table->episode_start = now;
+    table->episode_nodes = 1;
+}
+
+void node_table_late(node_table_t *table, uint16_t node_id, uint32_t count, int64_t now) {
+    node_entry_t *node = node_find(table, node_id, now);
+    node->late += count;
+    node->last_seen = now;
+}
+
+uint32_t node_table_tokens(const node_table_t *table, const node_entry_t *node, int64_t now) {
+    int64_t refill_time;
+    return bucket_level(table, node, now, &refill_time);
+}
+
+size_t node_table_list(const node_table_t *table, node_entry_t *out, size_t max) {
+    size_t count = 0;
+    for (size_t i = 0; i < NODE_TABLE_MAX; i++) {
+        const node_entry_t *node = &table->nodes[i];
+        if (!node->used) {
+            continue;
+        }
+        // Insertion by last_seen, newest first
+        size_t pos = count < max ? count : max;
+        while (pos > 0 && out[pos - 1].last_seen < node->last_seen) {
+            if (pos < max) {
+                out[pos] = out[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < max) {
+            out[pos] = *node;
+            if (count < max) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
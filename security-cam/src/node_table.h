@@ -0,0 +1,102 @@
+/**
+ * @file node_table.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Sensor node table - per-node trigger counters, token-bucket rate limit & capture episodes
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef NODE_TABLE_H
+#define NODE_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NODE_TABLE_MAX          64              // Nodes tracked, least recently seen one is forgotten first
+#define NODE_ID_ANONYMOUS       0               // Trigger that did not say who sent it (old PIR firmware)
+
+/**
+ * @brief One sensor node
+ */
+typedef struct {
+    bool used;
+    uint16_t node_id;
+    uint32_t tokens_milli;      // Token bucket fill in 1/1000 of token
+    int64_t refill_time;        // Time tokens were last refilled up to (us)
+    int64_t last_seen;          // Time of the latest trigger (us)
+    uint32_t triggers;          // Every trigger, including limited ones
+    uint32_t opened;            // Episodes started by this node
+    uint32_t joined;            // Triggers merged into running episode
+    uint32_t limited;           // Triggers dropped by rate limit
+    uint32_t late;              // Replayed events too old to start or join an episode
+    uint32_t last_episode;      // Latest episode the node took part in
+} node_entry_t;
+
+/**
+ * @brief Result of node_table_trigger
+ */
+typedef enum {
+    NODE_TRIGGER_NEW,           // Start new episode - caller queues capture & calls node_table_open
+    NODE_TRIGGER_MERGED,        // Trigger belongs to running episode, nothing to capture
+    NODE_TRIGGER_LIMITED,       // Node ran out of tokens, trigger is dropped
+} node_trigger_t;
+
+/**
+ * @brief Nodes and the running capture episode
+ * Triggers from any node within episode_us after the episode started share its capture. Only starting
+ * an episode costs the node a token, so a chattering sensor can not cause more than burst captures
+ * at once and one per refill_us on average, while other nodes keep their own budget.
+ * Not thread safe - caller is expected to guard it with mutex.
+ */
+typedef struct {
+    node_entry_t nodes[NODE_TABLE_MAX];
+    uint32_t burst;             // Bucket capacity (tokens)
+    int64_t refill_us;          // Time to earn one token
+    int64_t episode_us;
+    uint32_t episode_id;        // Running (or latest) episode, 0 means none yet
+    int64_t episode_start;
+    uint32_t episode_nodes;     // Distinct nodes in the latest episode
+    size_t count;               // Used entries
+    uint32_t evicted;           // Nodes forgotten because table was full
+} node_table_t;
+
+/**
+ * @brief Empty table
+ * @param burst episodes a node may start back to back
+ * @param refill_us time to earn one more episode, rounded up to whole ms
+ * @param episode_us how long episode accepts triggers from other nodes
+ */
+void node_table_init(node_table_t *table, uint32_t burst, int64_t refill_us, int64_t episode_us);
+
+/**
+ * @brief Account trigger of node and decide what to do with it
+ * @param episode_id set to running episode when trigger is merged
+ */
+node_trigger_t node_table_trigger(node_table_t *table, uint16_t node_id, int64_t now, uint32_t *episode_id);
+
+/**
+ * @brief Start episode after NODE_TRIGGER_NEW was queued, takes token of the node
+ * Not calling it (capture queue full) leaves the node its token.
+ */
+void node_table_open(node_table_t *table, uint16_t node_id, uint32_t episode_id, int64_t now);
+
+/**
+ * @brief Account events node delivered too late to matter for capture, they cost no token
+ */
+void node_table_late(node_table_t *table, uint16_t node_id, uint32_t count, int64_t now);
+
+/**
+ * @brief Tokens left to node (in 1/1000), refilled up to now
+ */
+uint32_t node_table_tokens(const node_table_t *table, const node_entry_t *node, int64_t now);
+
+/**
+ * @brief Copy used entries, most recently seen first
+ * @return number of entries copied
+ */
+size_t node_table_list(const node_table_t *table, node_entry_t *out, size_t max);
+
+#endif
@@ -0,0 +1,199 @@
+/**
+ * @file notify.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Capture notifications - Server-Sent Events subscribers fed from shared event feed by one task
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+#include <lwip/sockets.h>
+#include "event_feed.h"
+#include "notify.h"
+
+#define DEVICE          "[ESP32 CAM]"
+
+/**
+ * @brief Subscriber, written only by notify task once its handler returned
+ */
+typedef struct {
+    httpd_handle_t server;
+    int fd;                     // -1 when the entry is free
+    uint32_t next_seq;          // Next event to send
+    size_t offset;              // Part of next event already sent
+    int64_t last_send;
+} notify_client_t;
+
+static event_feed_t notify_feed;
+static notify_client_t notify_clients[NOTIFY_MAX_CLIENTS];
+static SemaphoreHandle_t notify_lock = NULL;            // Guards notify_feed & notify_clients
+static TaskHandle_t notify_task_handle = NULL;
+
+METRICS_COUNTER(metric_notify_events, "cam_notify_events_total", "Capture events published to subscribers");
+METRICS_COUNTER(metric_notify_dropped, "cam_notify_dropped_total", "Subscribers dropped for falling too far behind");
+
+/**
+ * @brief Send feed events a subscriber is missing, never blocks on its socket
+ * Must be called with notify_lock held.
+ * @return false when subscriber has to be dropped
+ */
+static bool notify_client_flush(notify_client_t *client, int64_t now) {
+    while (1) {
+        bool expired;
+        const event_feed_msg_t *msg = event_feed_get(&notify_feed, client->next_seq, &expired);
+        if (expired) {
+            ESP_LOGE(DEVICE, "[HTTP] Subscriber too slow, dropped {fd=%d}", client->fd);
+            metrics_add(&metric_notify_dropped, 1);
+            return false;
+        }
+        if (msg == NULL) {
+            if (now - client->last_send < NOTIFY_KEEPALIVE_MS * 1000LL) {
+                return true;
+            }
+            // Nothing is pending, so comment does not end up in the middle of an event
+            const char *ping = ": ping\n\n";
+            int sent = httpd_socket_send(client->server, client->fd, ping, strlen(ping), MSG_DONTWAIT);
+            client->last_send = now;
+            return sent == HTTPD_SOCK_ERR_TIMEOUT || sent == (int)strlen(ping);
+        }
+        int sent = httpd_socket_send(client->server, client->fd, msg->text + client->offset,
+                                     msg->len - client->offset, MSG_DONTWAIT);
+        if (sent == HTTPD_SOCK_ERR_TIMEOUT) {
+            return true;                        // Socket buffer full, retried later
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        client->last_send = now;
+        client->offset += sent;
+        if (client->offset == msg->len) {
+            client->offset = 0;
+            client->next_seq++;
+        }
+    }
+}
+
+/**
+ * @brief Notify task - fans new events out to every subscriber
+ */
+static void notify_task(void *arg) {
+    TickType_t wait = portMAX_DELAY;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, wait);
+        int64_t now = esp_timer_get_time();
+        bool behind = false;
+        xSemaphoreTake(notify_lock, portMAX_DELAY);
+        for (size_t i = 0; i < NOTIFY_MAX_CLIENTS; i++) {
+            notify_client_t *client = &notify_clients[i];
+            if (client->fd < 0) {
+                continue;
+            }
+            if (!notify_client_flush(client, now)) {
+                httpd_sess_trigger_close(client->server, client->fd);
+                client->fd = -1;
+                continue;
+            }
+            behind |= client->offset > 0 || client->next_seq < notify_feed.next_seq;
+        }
+        xSemaphoreGive(notify_lock);
+        wait = (behind ? NOTIFY_RETRY_MS : NOTIFY_KEEPALIVE_MS) / portTICK_PERIOD_MS;
+    }
+}
+
+void notify_publish(const char *event, const char *data) {
+    if (notify_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(notify_lock, portMAX_DELAY);
+    event_feed_push(&notify_feed, event, data);
+    xSemaphoreGive(notify_lock);
+    metrics_add(&metric_notify_events, 1);
+    xTaskNotifyGive(notify_task_handle);
+}
+
+esp_err_t notify_handler(httpd_req_t *req) {
+    ESP_LOGI(DEVICE, "[HTTP] GET notify");
+    if (notify_lock == NULL) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Notifications disabled!");
+        return ESP_FAIL;
+    }
+    char last_id[12];
+    uint32_t resume = 0;
+    if (httpd_req_get_hdr_value_str(req, "Last-Event-ID", last_id, sizeof(last_id)) == ESP_OK) {
+        resume = strtoul(last_id, NULL, 10) + 1;
+    }
+
+    notify_client_t *client = NULL;
+    xSemaphoreTake(notify_lock, portMAX_DELAY);
+    for (size_t i = 0; i < NOTIFY_MAX_CLIENTS && client == NULL; i++) {
+        if (notify_clients[i].fd < 0) {
+            client = &notify_clients[i];
+            client->server = req->handle;
+            client->fd = httpd_req_to_sockfd(req);
+            client->offset = 0;
+            client->last_send = esp_timer_get_time();
+            bool expired;
+            client->next_seq = notify_feed.next_seq;
+            if (resume != 0 && event_feed_get(&notify_feed, resume, &expired) != NULL) {
+                client->next_seq = resume;
+            }
+        }
+    }
+    if (client == NULL) {
+        xSemaphoreGive(notify_lock);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Too many subscribers!", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    // Header goes out before notify task may write the first event
+    const char *header = "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: text/event-stream\r\n"
+                         "Cache-Control: no-cache\r\n"
+                         "Access-Control-Allow-Origin: *\r\n\r\n"
+                         "retry: 3000\n\n";
+    if (httpd_socket_send(req->handle, client->fd, header, strlen(header), 0) != (int)strlen(header)) {
+        client->fd = -1;
+        xSemaphoreGive(notify_lock);
+        return ESP_FAIL;
+    }
+    xSemaphoreGive(notify_lock);
+    xTaskNotifyGive(notify_task_handle);
+    // Events are written by the notify task, the socket stays open after returning
+    return ESP_OK;
+}
+
+void notify_forget(int fd) {
+    if (notify_lock != NULL) {
+        xSemaphoreTake(notify_lock, portMAX_DELAY);
+        for (size_t i = 0; i < NOTIFY_MAX_CLIENTS; i++) {
+            if (notify_clients[i].fd == fd) {
+                notify_clients[i].fd = -1;
+            }
+        }
+        xSemaphoreGive(notify_lock);
+    }
+}
+
+esp_err_t notify_init(void) {
+    event_feed_init(&notify_feed);
+    for (size_t i = 0; i < NOTIFY_MAX_CLIENTS; i++) {
+        notify_clients[i].fd = -1;
+    }
+    notify_lock = xSemaphoreCreateMutex();
+    if (notify_lock == NULL ||
+        xTaskCreate(notify_task, "notify", 3072, NULL, 4, &notify_task_handle) != pdPASS) {
+        notify_lock = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+
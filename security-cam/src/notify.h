@@ -0,0 +1,55 @@
+/**
+ * @file notify.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Capture notifications - Server-Sent Events subscribers fed from shared event feed by one task
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include "metrics.h"
+
+/**
+ * Subscribers are bounded by sockets, not by fan-out cost: each one holds a socket of the stream server
+ * (with its 5.7 kB send buffer) for as long as the page is open, and the 17 lwIP sockets are all given
+ * out (see main.c). Fan-out is one non-blocking send per subscriber from the notify task,
+ * host/tools/notify_sim.py measures it with more subscribers on a host build that raises the limit.
+ */
+#ifndef NOTIFY_MAX_CLIENTS                      // May come from build flags (host load test)
+#define NOTIFY_MAX_CLIENTS      2               // Server-Sent Events subscribers, served by the stream server
+#endif
+#define NOTIFY_KEEPALIVE_MS     15000           // Comment sent to idle subscribers so dead ones are noticed
+#define NOTIFY_RETRY_MS         100             // Retry of subscriber whose socket buffer was full
+
+extern metrics_counter_t metric_notify_events;
+extern metrics_counter_t metric_notify_dropped;
+
+/**
+ * @brief Start notify task
+ */
+esp_err_t notify_init(void);
+
+/**
+ * @brief Publish event to every subscriber, nothing happens when notify is not running
+ * @param data single line of data (JSON)
+ */
+void notify_publish(const char *event, const char *data);
+
+/**
+ * @brief Get Handler for Stream server - notify - text/event-stream of captures, socket is kept by notify task
+ * Subscriber reconnecting with Last-Event-ID gets events it missed, if they are still in the feed.
+ */
+esp_err_t notify_handler(httpd_req_t *req);
+
+/**
+ * @brief Forget subscriber of closed session, so its descriptor is not written after reuse
+ */
+void notify_forget(int fd);
+
+#endif
@@ -0,0 +1,270 @@
+/**
+ * @file photo_archive.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Log-structured photo archive on raw flash partition
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include <string.h>
+#include "photo_archive.h"
+
+#define SEGMENT_MAGIC       0x47455350u         // "PSEG"
+#define RECORD_MAGIC        0x43455250u         // "PREC"
+#define RECORD_PENDING      0xFFFFFFFFu         // Erased flash - record data not complete
+#define RECORD_COMMITTED    0x00000000u         // Programmed after data - only clears bits
+#define ALIGN4(x)           (((x) + 3) & ~(size_t)3)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t erase_count;
+    uint32_t reserved;
+} segment_hdr_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t commit;
+    uint32_t id;
+    uint32_t len;
+    int64_t timestamp;
+    uint16_t width;
+    uint16_t height;
+    uint32_t reserved;
+} record_hdr_t;
+
+static size_t segment_base(const photo_archive_t *archive, size_t segment) {
+    return segment * archive->segment_size;
+}
+
+/**
+ * @brief Add entry at the end of index ring, dropping the oldest one when full
+ */
+static void index_push(photo_archive_t *archive, const archive_entry_t *entry) {
+    if (archive->count == archive->max_entries) {
+        archive->first = (archive->first + 1) % archive->max_entries;
+        archive->count--;
+    }
+    archive->entries[(archive->first + archive->count) % archive->max_entries] = *entry;
+    archive->count++;
+}
+
+/**
+ * @brief Remove entries stored in given segment - they are always the oldest ones
+ */
+static void index_drop_segment(photo_archive_t *archive, size_t segment) {
+    size_t start = segment_base(archive, segment);
+    size_t end = start + archive->segment_size;
+    while (archive->count > 0) {
+        const archive_entry_t *entry = &archive->entries[archive->first];
+        if (entry->offset < start || entry->offset >= end) {
+            break;
+        }
+        archive->first = (archive->first + 1) % archive->max_entries;
+        archive->count--;
+    }
+}
+
+/**
+ * @brief Walk record headers of one segment, adding committed photos to index
+ * @return offset within segment right after the last record, segment size when the rest is unusable
+ */
+static size_t scan_segment(photo_archive_t *archive, size_t segment) {
+    size_t base = segment_base(archive, segment);
+    size_t offset = sizeof(segment_hdr_t);
+    record_hdr_t hdr;
+    while (offset + sizeof(hdr) <= archive->segment_size) {
+        if (!archive->flash.read(archive->flash.ctx, base + offset, &hdr, sizeof(hdr))) {
+            break;
+        }
+        if (hdr.magic != RECORD_MAGIC || hdr.len > archive->segment_size - offset - sizeof(hdr)) {
+            // Torn header can not be programmed over, continue in a fresh segment
+            if (hdr.magic != 0xFFFFFFFFu) {
+                return archive->segment_size;
+            }
+            break;
+        }
+        // Interrupted write still occupies its space but is not indexed
+        if (hdr.commit == RECORD_COMMITTED) {
+            archive_entry_t entry = {
+                .id = hdr.id,
+                .timestamp = hdr.timestamp,
+                .offset = base + offset + sizeof(hdr),
+                .len = hdr.len,
+                .width = hdr.width,
+                .height = hdr.height,
+            };
+            index_push(archive, &entry);
+            if (hdr.id >= archive->next_id) {
+                archive->next_id = hdr.id + 1;
+            }
+        }
+        offset += ALIGN4(sizeof(hdr) + hdr.len);
+    }
+    return offset;
+}
+
+/**
+ * @brief Erase segment and start it as the newest one
+ */
+static bool open_segment(photo_archive_t *archive, size_t segment, uint32_t seq) {
+    index_drop_segment(archive, segment);
+    if (!archive->flash.erase(archive->flash.ctx, segment_base(archive, segment), archive->segment_size)) {
+        return false;
+    }
+    segment_hdr_t hdr = {
+        .magic = SEGMENT_MAGIC,
+        .seq = seq,
+        .erase_count = archive->segment_erases[segment] + 1,
+        .reserved = 0xFFFFFFFFu,
+    };
+    if (!archive->flash.write(archive->flash.ctx, segment_base(archive, segment), &hdr, sizeof(hdr))) {
+        archive->segment_seq[segment] = 0;
+        return false;
+    }
+    archive->segment_seq[segment] = seq;
+    archive->segment_erases[segment] = hdr.erase_count;
+    archive->active = segment;
+    archive->write_offset = sizeof(hdr);
+    return true;
+}
+
+bool photo_archive_mount(photo_archive_t *archive, const archive_flash_t *flash, size_t segment_size,
+                         archive_entry_t *entries, size_t max_entries) {
+    if (archive == NULL || flash == NULL || entries == NULL || max_entries == 0 ||
+        segment_size == 0 || segment_size % flash->erase_size != 0) {
+        return false;
+    }
+    memset(archive, 0, sizeof(*archive));
+    archive->flash = *flash;
+    archive->segment_size = segment_size;
+    archive->segment_count = flash->size / segment_size;
+    archive->entries = entries;
+    archive->max_entries = max_entries;
+    archive->next_id = 1;
+    if (archive->segment_count < 2 || archive->segment_count > ARCHIVE_MAX_SEGMENTS) {
+        return false;
+    }
+
+    // Segment headers only - tells which segments hold data and in which order
+    for (size_t i = 0; i < archive->segment_count; i++) {
+        segment_hdr_t hdr;
+        if (!flash->read(flash->ctx, segment_base(archive, i), &hdr, sizeof(hdr))) {
+            return false;
+        }
+        if (hdr.magic == SEGMENT_MAGIC && hdr.seq != 0 && hdr.seq != 0xFFFFFFFFu) {
+            archive->segment_seq[i] = hdr.seq;
+            archive->segment_erases[i] = hdr.erase_count;
+        }
+    }
+
+    // Replay segments from the oldest, so index ends up ordered by age
+    uint32_t last_seq = 0;
+    while (1) {
+        size_t next = archive->segment_count;
+        for (size_t i = 0; i < archive->segment_count; i++) {
+            if (archive->segment_seq[i] > last_seq &&
+                (next == archive->segment_count || archive->segment_seq[i] < archive->segment_seq[next])) {
+                next = i;
+            }
+        }
+        if (next == archive->segment_count) {
+            break;
+        }
+        last_seq = archive->segment_seq[next];
+        archive->active = next;
+        archive->write_offset = scan_segment(archive, next);
+    }
+
+    if (last_seq == 0) {
+        return open_segment(archive, 0, 1);     // Blank flash
+    }
+    return true;
+}
+
+bool photo_archive_append(photo_archive_t *archive, uint32_t id, const uint8_t *data, size_t len,
+                          int64_t timestamp, uint16_t width, uint16_t height) {
+    size_t needed = ALIGN4(sizeof(record_hdr_t) + len);
+    if (id < archive->next_id || needed > archive->segment_size - sizeof(segment_hdr_t)) {
+        return false;
+    }
+    if (archive->write_offset + needed > archive->segment_size) {
+        size_t next = (archive->active + 1) % archive->segment_count;
+        if (!open_segment(archive, next, archive->segment_seq[archive->active] + 1)) {
+            return false;
+        }
+    }
+
+    size_t offset = segment_base(archive, archive->active) + archive->write_offset;
+    record_hdr_t hdr = {
+        .magic = RECORD_MAGIC,
+        .commit = RECORD_PENDING,
+        .id = id,
+        .len = len,
+        .timestamp = timestamp,
+        .width = width,
+        .height = height,
+        .reserved = 0xFFFFFFFFu,
+    };
+    // Header first so the space is accounted for, commit mark last
+    archive->write_offset += needed;
+    if (!archive->flash.write(archive->flash.ctx, offset, &hdr, sizeof(hdr)) ||
+        !archive->flash.write(archive->flash.ctx, offset + sizeof(hdr), data, len)) {
+        return false;
+    }
+    uint32_t commit = RECORD_COMMITTED;
+    if (!archive->flash.write(archive->flash.ctx, offset + offsetof(record_hdr_t, commit), &commit, sizeof(commit))) {
+        return false;
+    }
+
+    archive_entry_t entry = {
+        .id = hdr.id,
+        .timestamp = timestamp,
+        .offset = offset + sizeof(hdr),
+        .len = len,
+        .width = width,
+        .height = height,
+    };
+    index_push(archive, &entry);
+    archive->next_id = id + 1;
+    return true;
+}
+
+const archive_entry_t *photo_archive_find(const photo_archive_t *archive, uint32_t id) {
+    if (archive->count == 0) {
+        return NULL;
+    }
+    // Ids grow with position in the index, so binary search works on the ring
+    size_t lo = 0;
+    size_t hi = archive->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const archive_entry_t *entry = photo_archive_at(archive, mid);
+        if (entry->id == id) {
+            return entry;
+        }
+        if (entry->id < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+const archive_entry_t *photo_archive_at(const photo_archive_t *archive, size_t index) {
+    if (index >= archive->count) {
+        return NULL;
+    }
+    return &archive->entries[(archive->first + index) % archive->max_entries];
+}
+
+bool photo_archive_read(const photo_archive_t *archive, const archive_entry_t *entry, size_t offset,
+                        void *dst, size_t len) {
+    if (offset > entry->len || len > entry->len - offset) {
+        return false;
+    }
+    return archive->flash.read(archive->flash.ctx, entry->offset + offset, dst, len);
+}
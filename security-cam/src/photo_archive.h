@@ -0,0 +1,100 @@
+/**
+ * @file photo_archive.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Log-structured photo archive on raw flash partition
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ * Partition is split into fixed-size segments written round-robin. Every segment starts
+ * with a header carrying its sequence number and erase count, photos are appended as
+ * records (header + JPEG data). Once the log wraps around, the oldest segment is erased
+ * together with its photos. Index is rebuilt at boot from segment and record headers only.
+ */
+#ifndef PHOTO_ARCHIVE_H
+#define PHOTO_ARCHIVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARCHIVE_MAX_SEGMENTS    32
+
+/**
+ * @brief Flash access used by the archive (esp_partition on device, file image on host)
+ */
+typedef struct {
+    void *ctx;
+    size_t size;                // Usable bytes
+    size_t erase_size;          // Erase block size, segments are multiple of it
+    bool (*read)(void *ctx, size_t offset, void *dst, size_t len);
+    bool (*write)(void *ctx, size_t offset, const void *src, size_t len);
+    bool (*erase)(void *ctx, size_t offset, size_t len);
+} archive_flash_t;
+
+/**
+ * @brief One archived photo as kept in RAM index
+ */
+typedef struct {
+    uint32_t id;
+    int64_t timestamp;
+    uint32_t offset;            // Offset of JPEG data in flash
+    uint32_t len;
+    uint16_t width;
+    uint16_t height;
+} archive_entry_t;
+
+/**
+ * @brief Archive state, not thread safe - caller is expected to guard it with mutex
+ */
+typedef struct {
+    archive_flash_t flash;
+    size_t segment_size;
+    size_t segment_count;
+    uint32_t segment_seq[ARCHIVE_MAX_SEGMENTS];         // 0 - segment holds no valid data
+    uint32_t segment_erases[ARCHIVE_MAX_SEGMENTS];
+    size_t active;                                      // Segment being appended to
+    size_t write_offset;                                // Offset within active segment
+    uint32_t next_id;                                   // Lowest id accepted by next append
+    // Index ring, ordered from the oldest photo
+    archive_entry_t *entries;
+    size_t max_entries;
+    size_t first;
+    size_t count;
+} photo_archive_t;
+
+/**
+ * @brief Mount archive - rebuild index from flash or start a new log on blank flash
+ * @param entries buffer for max_entries index entries
+ * @return false when flash layout does not fit the segment size or flash access fails
+ */
+bool photo_archive_mount(photo_archive_t *archive, const archive_flash_t *flash, size_t segment_size,
+                         archive_entry_t *entries, size_t max_entries);
+
+/**
+ * @brief Append photo to the log, oldest segment is reclaimed when needed
+ * @param id event id, must be at least next_id so the index stays ordered
+ * @return false when id is out of order, photo does not fit into a segment or flash access fails
+ */
+bool photo_archive_append(photo_archive_t *archive, uint32_t id, const uint8_t *data, size_t len,
+                          int64_t timestamp, uint16_t width, uint16_t height);
+
+/**
+ * @brief Find photo by event id
+ * @return NULL when photo is not (or no longer) archived
+ */
+const archive_entry_t *photo_archive_find(const photo_archive_t *archive, uint32_t id);
+
+/**
+ * @brief Get photo by age, index 0 is the oldest archived photo
+ */
+const archive_entry_t *photo_archive_at(const photo_archive_t *archive, size_t index);
+
+/**
+ * @brief Read part of archived photo
+ */
+bool photo_archive_read(const photo_archive_t *archive, const archive_entry_t *entry, size_t offset,
+                        void *dst, size_t len);
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * @file photo_slots.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Reference counted photo slots - latest photo published without copy or lock
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include <string.h>
+#include "photo_slots.h"
+
+bool photo_slots_init(photo_slots_t *slots, uint8_t *pool, size_t capacity) {
+    if (slots == NULL || pool == NULL || capacity == 0) {
+        return false;
+    }
+    memset(slots, 0, sizeof(*slots));
+    for (size_t i = 0; i < PHOTO_SLOTS_COUNT; i++) {
+        slots->slots[i].buf = pool + i * capacity;
+        slots->slots[i].capacity = capacity;
+        atomic_init(&slots->slots[i].refs, 0);
+    }
+    atomic_init(&slots->latest, NULL);
+    atomic_init(&slots->generation, 0);
+    return true;
+}
+
+bool photo_slots_init_rendition(photo_slots_t *slots, size_t rendition, uint8_t *pool, size_t capacity) {
+    if (slots == NULL || pool == NULL || capacity == 0 || rendition >= PHOTO_RENDITIONS) {
+        return false;
+    }
+    for (size_t i = 0; i < PHOTO_SLOTS_COUNT; i++) {
+        slots->slots[i].renditions[rendition].buf = pool + i * capacity;
+        slots->slots[i].renditions[rendition].capacity = capacity;
+    }
+    return true;
+}
+
+photo_slot_t *photo_slots_begin_write(photo_slots_t *slots) {
+    for (size_t i = 0; i < PHOTO_SLOTS_COUNT; i++) {
+        photo_slot_t *slot = &slots->slots[i];
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&slot->refs, &expected, PHOTO_SLOT_WRITING)) {
+            for (size_t r = 0; r < PHOTO_RENDITIONS; r++) {
+                slot->renditions[r].len = 0;
+            }
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+uint32_t photo_slots_publish(photo_slots_t *slots, photo_slot_t *slot) {
+    slot->generation = atomic_fetch_add(&slots->generation, 1) + 1;
+    // The reference is owned by "latest" until a newer photo replaces it
+    atomic_store(&slot->refs, 1);
+    photo_slot_t *previous = atomic_exchange(&slots->latest, slot);
+    if (previous != NULL) {
+        atomic_fetch_sub(&previous->refs, 1);
+    }
+    return slot->generation;
+}
+
+void photo_slots_abort(photo_slots_t *slots, photo_slot_t *slot) {
+    (void)slots;
+    atomic_store(&slot->refs, 0);
+}
+
+photo_slot_t *photo_slots_acquire(photo_slots_t *slots) {
+    while (1) {
+        photo_slot_t *slot = atomic_load(&slots->latest);
+        if (slot == NULL) {
+            return NULL;
+        }
+        int refs = atomic_load(&slot->refs);
+        // Zero or writing means the slot was replaced meanwhile, look again
+        if (refs <= 0) {
+            continue;
+        }
+        if (!atomic_compare_exchange_weak(&slot->refs, &refs, refs + 1)) {
+            continue;
+        }
+        if (atomic_load(&slots->latest) == slot) {
+            return slot;
+        }
+        // Newer photo got published while taking reference, prefer it
+        photo_slots_release(slots, slot);
+    }
+}
+
+void photo_slots_release(photo_slots_t *slots, photo_slot_t *slot) {
+    (void)slots;
+    atomic_fetch_sub(&slot->refs, 1);
+}
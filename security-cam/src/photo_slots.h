@@ -0,0 +1,99 @@
+/**
+ * @file photo_slots.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Reference counted photo slots - latest photo published without copy or lock
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef PHOTO_SLOTS_H
+#define PHOTO_SLOTS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PHOTO_SLOTS_COUNT       3               // Triple buffering - latest, one being read, one being written
+#define PHOTO_SLOT_WRITING      (-1)            // Reference count of slot owned by writer
+#define PHOTO_RENDITIONS        2               // Smaller versions of the photo kept next to it
+
+/**
+ * @brief Smaller version of the photo, len 0 when it was not made
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t capacity;
+    size_t len;
+    size_t width;
+    size_t height;
+} photo_rendition_t;
+
+/**
+ * @brief One preallocated photo buffer
+ * refs:  0 free, PHOTO_SLOT_WRITING owned by writer, >0 published and/or held by readers
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t capacity;
+    size_t len;
+    size_t width;
+    size_t height;
+    int format;
+    int64_t timestamp;          // Time of capture (us)
+    uint32_t event_id;          // Trigger event the photo belongs to
+    uint32_t generation;        // Increments with every published photo, 0 means never published
+    photo_rendition_t renditions[PHOTO_RENDITIONS];
+    atomic_int refs;
+} photo_slot_t;
+
+/**
+ * @brief Set of slots with one published as latest
+ */
+typedef struct {
+    photo_slot_t slots[PHOTO_SLOTS_COUNT];
+    _Atomic(photo_slot_t *) latest;
+    atomic_uint generation;
+} photo_slots_t;
+
+/**
+ * @brief Prepare slots on top of preallocated pool of PHOTO_SLOTS_COUNT * capacity bytes
+ */
+bool photo_slots_init(photo_slots_t *slots, uint8_t *pool, size_t capacity);
+
+/**
+ * @brief Give every slot a rendition buffer from preallocated pool of PHOTO_SLOTS_COUNT * capacity bytes
+ */
+bool photo_slots_init_rendition(photo_slots_t *slots, size_t rendition, uint8_t *pool, size_t capacity);
+
+/**
+ * @brief Claim free slot for writing - never blocks, renditions of the claimed slot are emptied
+ * @return NULL when every slot is held by readers
+ */
+photo_slot_t *photo_slots_begin_write(photo_slots_t *slots);
+
+/**
+ * @brief Publish written slot as latest, previous latest is freed once its readers are done
+ * @return generation assigned to the photo
+ */
+uint32_t photo_slots_publish(photo_slots_t *slots, photo_slot_t *slot);
+
+/**
+ * @brief Give up slot claimed by photo_slots_begin_write without publishing it
+ */
+void photo_slots_abort(photo_slots_t *slots, photo_slot_t *slot);
+
+/**
+ * @brief Get reference to latest photo, must be released by photo_slots_release
+ * @return NULL when no photo was published yet
+ */
+photo_slot_t *photo_slots_acquire(photo_slots_t *slots);
+
+/**
+ * @brief Drop reference obtained by photo_slots_acquire
+ */
+void photo_slots_release(photo_slots_t *slots, photo_slot_t *slot);
+
+#endif
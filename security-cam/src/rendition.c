@@ -0,0 +1,99 @@
+/**
+ * @file rendition.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Photo renditions - medium & thumbnail JPEG made from one decode at 1/4 scale
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include "esp_jpg_decode.h"
+#include "img_converters.h"
+#include "image_scale.h"
+#include "rendition.h"
+
+#define DEVICE          "[ESP32 CAM]"
+
+/**
+ * @brief JPEG decoder input & decoded RGB888 image
+ */
+typedef struct {
+    const uint8_t *jpg;
+    size_t len;
+    uint8_t *out;
+    size_t width;               // Size of decoded (scaled) image, known once decoding starts
+    size_t height;
+} rendition_decode_t;
+
+/**
+ * @brief JPEG decoder callback - read input from memory
+ */
+static size_t rendition_jpg_read(void *arg, size_t index, uint8_t *buf, size_t len) {
+    rendition_decode_t *decode = arg;
+    if (index + len > decode->len) {
+        len = decode->len - index;
+    }
+    if (buf != NULL) {
+        memcpy(buf, decode->jpg + index, len);
+    }
+    return len;
+}
+
+/**
+ * @brief JPEG decoder callback - copy RGB888 block into image allocated once the size is known
+ */
+static bool rendition_rgb_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+    rendition_decode_t *decode = arg;
+    if (data == NULL) {
+        if (x == 0 && y == 0) {
+            decode->width = w;
+            decode->height = h;
+            decode->out = heap_caps_malloc((size_t)w * h * 3, MALLOC_CAP_SPIRAM);
+        }
+        return decode->out != NULL;
+    }
+    for (uint16_t row = 0; row < h; row++) {
+        memcpy(decode->out + ((y + row) * decode->width + x) * 3, data + row * w * 3, w * 3);
+    }
+    return true;
+}
+
+/**
+ * @brief JPEG encoder callback - write into rendition buffer, stops encoder when it does not fit
+ */
+static size_t rendition_jpg_write(void *arg, size_t index, const void *data, size_t len) {
+    photo_rendition_t *rendition = arg;
+    if (index + len > rendition->capacity) {
+        return 0;
+    }
+    memcpy(rendition->buf + index, data, len);
+    rendition->len = index + len;
+    return len;
+}
+
+static void rendition_encode(photo_rendition_t *rendition, uint8_t *rgb, size_t width, size_t height) {
+    rendition->width = width;
+    rendition->height = height;
+    if (!fmt2jpg_cb(rgb, width * height * 3, width, height, PIXFORMAT_RGB888, RENDITION_QUALITY,
+                    rendition_jpg_write, rendition)) {
+        ESP_LOGE(DEVICE, "[CAM] Rendition %zux%zu does not fit {%zu bytes}", width, height, rendition->capacity);
+        rendition->len = 0;
+    }
+}
+
+esp_err_t rendition_make(const uint8_t *jpg, size_t len, photo_rendition_t *medium, photo_rendition_t *thumb) {
+    rendition_decode_t decode = { .jpg = jpg, .len = len };
+    esp_err_t res = esp_jpg_decode(len, JPG_SCALE_4X, rendition_jpg_read, rendition_rgb_write, &decode);
+    if (res == ESP_OK) {
+        rendition_encode(medium, decode.out, decode.width, decode.height);
+        image_scale_halve_rgb888(decode.out, decode.width, decode.height, decode.out);
+        rendition_encode(thumb, decode.out, decode.width / 2, decode.height / 2);
+    }
+    free(decode.out);
+    return res;
+}
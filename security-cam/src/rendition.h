@@ -0,0 +1,29 @@
+/**
+ * @file rendition.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Photo renditions - medium & thumbnail JPEG made from one decode at 1/4 scale
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef RENDITION_H
+#define RENDITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "photo_slots.h"
+
+#define RENDITION_QUALITY       60              // JPEG quality of renditions (1-100)
+
+/**
+ * @brief Make medium (1/4 scale) & thumbnail (1/8 scale) version of JPEG, one decode at 1/4 scale serves both
+ * Decoded image is allocated in PSRAM only for the time of encoding (360 kB for UXGA), thumbnail is halved
+ * in place. Rendition that does not fit its buffer is left with len 0.
+ * @return ESP_OK, error of esp_jpg_decode when photo could not be decoded
+ */
+esp_err_t rendition_make(const uint8_t *jpg, size_t len, photo_rendition_t *medium, photo_rendition_t *thumb);
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * @file static_assets.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Dashboard files from html/ embedded at build time, gzipped, see tools/embed_assets.py
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include <string.h>
+#include "static_assets.h"
+
+const static_asset_t *static_assets_find(const char *uri) {
+    size_t len = strcspn(uri, "?#");
+    if (len == 1 && uri[0] == '/') {
+        uri = "/index.html";
+        len = strlen(uri);
+    }
+    for (size_t i = 0; i < static_assets_count; i++) {
+        if (strlen(static_assets[i].uri) == len && strncmp(static_assets[i].uri, uri, len) == 0) {
+            return &static_assets[i];
+        }
+    }
+    return NULL;
+}
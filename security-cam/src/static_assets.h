@@ -0,0 +1,38 @@
+/**
+ * @file static_assets.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Dashboard files from html/ embedded at build time, gzipped, see tools/embed_assets.py
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef STATIC_ASSETS_H
+#define STATIC_ASSETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief One embedded file
+ */
+typedef struct {
+    const char *uri;            // "/" + file name
+    const char *type;
+    const char *etag;           // Quoted hash of original content
+    const uint8_t *data;        // gzip compressed content
+    size_t len;
+    size_t original_len;
+} static_asset_t;
+
+extern const static_asset_t static_assets[];
+extern const size_t static_assets_count;
+
+/**
+ * @brief Find asset for request URI, query string is ignored and "/" means "/index.html"
+ * @return NULL when there is no such asset
+ */
+const static_asset_t *static_assets_find(const char *uri);
+
+#endif
@@ -0,0 +1,143 @@
+/**
+ * @file supervisor.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Supervisor - samples heap & PSRAM, brings camera back after failed grabs, restarts on fatal condition
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdint.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include "supervisor.h"
+
+#define DEVICE          "[ESP32 CAM]"
+
+/**
+ * Supervisor - sleeps on event group, woken by other tasks or every SUPERVISOR_SAMPLE_MS
+ */
+#define SUPERVISOR_CAMERA_FAILED    (1 << 0)    // SUPERVISOR_CAMERA_ERRORS grabs failed in a row
+#define SUPERVISOR_FATAL            (1 << 1)    // Device does not recover without restart, see supervisor_reason
+static EventGroupHandle_t supervisor_events = NULL;
+static const supervisor_hooks_t *supervisor_hooks = NULL;
+static const char *supervisor_reason = "";
+static atomic_uint heap_fragmentation = 0;              // Of last sample, percent
+static atomic_uint psram_fragmentation = 0;
+static atomic_uint heap_min_block = UINT32_MAX;         // Smallest largest internal block sampled
+
+METRICS_HISTOGRAM(metric_supervisor_busy, "cam_supervisor_busy_seconds",
+                  "Time supervisor task was awake per wake up, it sleeps otherwise");
+METRICS_COUNTER(metric_supervisor_wakeups, "cam_supervisor_wakeups_total",
+                "Supervisor wake ups, by heap sample period or event of other task");
+METRICS_COUNTER(metric_camera_reinits, "cam_camera_reinits_total", "Camera driver initialized again after grabs failed");
+
+void supervisor_fatal(const char *reason) {
+    supervisor_reason = reason;
+    xEventGroupSetBits(supervisor_events, SUPERVISOR_FATAL);
+}
+
+void supervisor_camera_failed(void) {
+    if (supervisor_events != NULL) {
+        xEventGroupSetBits(supervisor_events, SUPERVISOR_CAMERA_FAILED);
+    }
+}
+
+supervisor_memory_t supervisor_memory(void) {
+    unsigned min_block = atomic_load(&heap_min_block);
+    supervisor_memory_t memory = {
+        .heap_fragmentation = atomic_load(&heap_fragmentation),
+        .psram_fragmentation = atomic_load(&psram_fragmentation),
+        .heap_min_block = min_block != UINT32_MAX ? min_block : 0,
+    };
+    return memory;
+}
+
+/**
+ * @brief Percent of free memory outside the largest block - allocation of that size fails although it is free
+ */
+static unsigned fragmentation(size_t free, size_t largest) {
+    return free > 0 && largest < free ? (unsigned)(100 - largest * 100 / free) : 0;
+}
+
+/**
+ * @brief Sample internal heap & PSRAM, internal heap too broken to serve requests is fatal
+ * @param low_samples samples in a row with largest internal block under SUPERVISOR_HEAP_MIN_BLOCK
+ */
+static void supervisor_sample(uint32_t *low_samples) {
+    size_t heap_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    size_t heap_block = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+    atomic_store(&heap_fragmentation, fragmentation(heap_free, heap_block));
+    atomic_store(&psram_fragmentation, fragmentation(heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+                                                     heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM)));
+    if (heap_block < heap_min_block) {
+        heap_min_block = heap_block;
+    }
+    if (heap_fragmentation > SUPERVISOR_FRAGMENTED) {
+        ESP_LOGW(DEVICE, "[SUPERVISOR] Internal heap fragmented {%zu free, largest block %zu}", heap_free, heap_block);
+    }
+    *low_samples = heap_block < SUPERVISOR_HEAP_MIN_BLOCK ? *low_samples + 1 : 0;
+    if (*low_samples >= SUPERVISOR_HEAP_LOW_SAMPLES) {
+        supervisor_fatal("Internal heap exhausted");
+    }
+}
+
+/**
+ * @brief Supervisor task - blocks on supervisor_events, wakes to sample memory, bring camera back
+ * after failed grabs and restart device after shutdown hook on fatal condition
+ */
+static void supervisor_task(void *arg) {
+    uint32_t low_samples = 0;
+    uint32_t reinits = 0;           // Re-inits in a row without a frame in between
+    while (1) {
+        EventBits_t bits = xEventGroupWaitBits(supervisor_events, SUPERVISOR_CAMERA_FAILED | SUPERVISOR_FATAL,
+                                               pdTRUE, pdFALSE, pdMS_TO_TICKS(SUPERVISOR_SAMPLE_MS));
+        int64_t start = esp_timer_get_time();
+        metrics_add(&metric_supervisor_wakeups, 1);
+        supervisor_sample(&low_samples);
+
+        if (bits & SUPERVISOR_CAMERA_FAILED) {
+            if (supervisor_hooks->camera_delivered()) {
+                reinits = 0;
+            }
+            if (++reinits > SUPERVISOR_REINIT_LIMIT) {
+                supervisor_fatal("Camera does not recover");
+            } else {
+                ESP_LOGE(DEVICE, "[SUPERVISOR] %d frame grabs failed, initializing camera again {attempt %u}",
+                         SUPERVISOR_CAMERA_ERRORS, (unsigned)reinits);
+                esp_err_t err = supervisor_hooks->reinit_camera();
+                metrics_add(&metric_camera_reinits, 1);
+                if (err != ESP_OK) {
+                    ESP_LOGE(DEVICE, "[SUPERVISOR] Camera initialization failed {%s}", esp_err_to_name(err));
+                }
+                // Grabs stuck in the old driver failed meanwhile
+                xEventGroupClearBits(supervisor_events, SUPERVISOR_CAMERA_FAILED);
+            }
+        }
+
+        if ((bits | xEventGroupGetBits(supervisor_events)) & SUPERVISOR_FATAL) {
+            ESP_LOGE(DEVICE, "[SUPERVISOR] %s, stopping web servers and restarting", supervisor_reason);
+            supervisor_hooks->shutdown();
+            esp_restart();
+        }
+        metrics_observe(&metric_supervisor_busy, esp_timer_get_time() - start);
+    }
+}
+
+esp_err_t supervisor_init(const supervisor_hooks_t *hooks) {
+    supervisor_hooks = hooks;
+    supervisor_events = xEventGroupCreate();
+    if (supervisor_events == NULL || xTaskCreate(supervisor_task, "supervisor", 3072, NULL, 3, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(DEVICE, "[SUPERVISOR] Sampling memory every %d ms, camera initialized again after %d failed grabs",
+             SUPERVISOR_SAMPLE_MS, SUPERVISOR_CAMERA_ERRORS);
+    return ESP_OK;
+}
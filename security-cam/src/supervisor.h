@@ -0,0 +1,71 @@
+/**
+ * @file supervisor.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Supervisor - samples heap & PSRAM, brings camera back after failed grabs, restarts on fatal condition
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include "metrics.h"
+
+#define SUPERVISOR_SAMPLE_MS        10000       // Heap & PSRAM are sampled this often, supervisor sleeps otherwise
+#define SUPERVISOR_CAMERA_ERRORS    3           // Failed frame grabs in a row that get the camera initialized again
+#define SUPERVISOR_REINIT_LIMIT     3           // Re-inits in a row without a frame in between before restart
+#define SUPERVISOR_DRAIN_MS         6000        // Wait for frames out to come back before re-init (over driver frame timeout)
+#define SUPERVISOR_FRAGMENTED       50          // Fragmentation (percent of free heap outside largest block) worth a warning
+#define SUPERVISOR_HEAP_MIN_BLOCK   (8 * 1024)  // Largest internal heap block under this ...
+#define SUPERVISOR_HEAP_LOW_SAMPLES 3           // ... in this many samples in a row restarts the device
+
+extern metrics_histogram_t metric_supervisor_busy;
+extern metrics_counter_t metric_supervisor_wakeups;
+extern metrics_counter_t metric_camera_reinits;
+
+/**
+ * @brief Camera & device actions of the application, called from supervisor task
+ */
+typedef struct {
+    esp_err_t (*reinit_camera)(void);   // Initialize camera driver again, grabs wait meanwhile
+    bool (*camera_delivered)(void);     // Frame was grabbed since the last reinit_camera
+    void (*shutdown)(void);             // Stop what must not be cut by restart (web servers, flash LED)
+} supervisor_hooks_t;
+
+/**
+ * @brief Memory as of the last sample
+ */
+typedef struct {
+    unsigned heap_fragmentation;        // Percent of free internal heap outside largest block
+    unsigned psram_fragmentation;
+    size_t heap_min_block;              // Smallest largest internal block sampled, 0 before the first sample
+} supervisor_memory_t;
+
+/**
+ * @brief Start supervisor task
+ * @param hooks kept by the supervisor, has to stay valid
+ */
+esp_err_t supervisor_init(const supervisor_hooks_t *hooks);
+
+/**
+ * @brief SUPERVISOR_CAMERA_ERRORS grabs failed in a row, nothing happens when supervisor is not running
+ */
+void supervisor_camera_failed(void);
+
+/**
+ * @brief Stop device on condition it does not recover from, supervisor restarts it
+ * @param reason static string logged before restart
+ */
+void supervisor_fatal(const char *reason);
+
+/**
+ * @brief Memory as of the last sample
+ */
+supervisor_memory_t supervisor_memory(void);
+
+#endif
@@ -0,0 +1,214 @@
+/**
+ * @file upload.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Upload of archived photos to the collector - batched multipart POSTs retried with backoff
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+#include <esp_http_client.h>
+#include "upload.h"
+
+#define DEVICE          "[ESP32 CAM]"
+
+static QueueHandle_t upload_queue = NULL;
+static photo_archive_t *upload_archive = NULL;
+static SemaphoreHandle_t upload_archive_lock = NULL;    // Guards upload_archive, shared with the archive writer
+
+METRICS_HISTOGRAM(metric_upload_batch, "cam_upload_batch_seconds",
+                  "Accepted multipart upload of one batch to the collector");
+METRICS_COUNTER(metric_upload_photos, "cam_upload_photos_total", "Photos accepted by the collector");
+METRICS_COUNTER(metric_upload_batches, "cam_upload_batches_total", "Multipart requests accepted by the collector");
+METRICS_COUNTER(metric_upload_failures, "cam_upload_failures_total", "Upload attempts that failed and were retried");
+METRICS_COUNTER(metric_upload_lost, "cam_upload_lost_total",
+                "Photos never uploaded - queue was full, archive reclaimed them or collector refused them");
+
+void upload_enqueue(uint32_t event_id) {
+    if (upload_queue == NULL) {
+        return;
+    }
+    while (xQueueSend(upload_queue, &event_id, 0) != pdTRUE) {
+        uint32_t oldest;
+        if (xQueueReceive(upload_queue, &oldest, 0) == pdTRUE) {
+            metrics_add(&metric_upload_lost, 1);
+            ESP_LOGE(DEVICE, "[UPLOAD] Queue full, photo %u will not be uploaded", (unsigned)oldest);
+        }
+    }
+}
+
+/**
+ * @brief Write whole buffer to open upload request
+ */
+static bool upload_write(esp_http_client_handle_t client, const char *data, size_t len) {
+    return esp_http_client_write(client, data, len) == (int)len;
+}
+
+/**
+ * @brief Send photos as one multipart/form-data POST, first part is JSON metadata of all of them
+ * Photo data is streamed from flash in UPLOAD_CHUNK_SIZE pieces, photos the archive reclaimed
+ * meanwhile are left out. Timestamps are camera uptime, uptime_ms tells the collector when the
+ * request was made, so it can place them on its own clock.
+ * @param ids events to send, reduced to the ones still archived
+ * @return ESP_OK when accepted, ESP_ERR_INVALID_RESPONSE when refused for good, other error to retry
+ */
+static esp_err_t upload_batch(esp_http_client_handle_t client, uint32_t *ids, size_t *count, char *chunk) {
+    archive_entry_t entries[UPLOAD_BATCH_MAX];
+    size_t found = 0;
+    xSemaphoreTake(upload_archive_lock, portMAX_DELAY);
+    for (size_t i = 0; i < *count; i++) {
+        const archive_entry_t *entry = photo_archive_find(upload_archive, ids[i]);
+        if (entry != NULL) {
+            ids[found] = ids[i];
+            entries[found++] = *entry;
+        } else {
+            metrics_add(&metric_upload_lost, 1);
+            ESP_LOGE(DEVICE, "[UPLOAD] Photo %u no longer archived", (unsigned)ids[i]);
+        }
+    }
+    xSemaphoreGive(upload_archive_lock);
+    *count = found;
+    if (found == 0) {
+        return ESP_OK;
+    }
+
+    // Body length has to be known up front, part heads are formatted twice
+    int meta = sprintf(chunk, "--" UPLOAD_BOUNDARY "\r\nContent-Disposition: form-data; name=\"metadata\"\r\n"
+                              "Content-Type: application/json\r\n\r\n{\"uptime_ms\":%lld,\"photos\":[",
+                       (long long)(esp_timer_get_time() / 1000));
+    for (size_t i = 0; i < found; i++) {
+        meta += sprintf(chunk + meta, "%s{\"event\":%u,\"timestamp_ms\":%lld,\"size\":%u,\"width\":%u,\"height\":%u}",
+                        i > 0 ? "," : "", (unsigned)entries[i].id, (long long)(entries[i].timestamp / 1000),
+                        (unsigned)entries[i].len, entries[i].width, entries[i].height);
+    }
+    meta += sprintf(chunk + meta, "]}\r\n");
+    char head[160];
+    const char *head_format = "--" UPLOAD_BOUNDARY "\r\nContent-Disposition: form-data; name=\"photo\"; "
+                              "filename=\"event-%u.jpg\"\r\nContent-Type: image/jpeg\r\n\r\n";
+    const char *tail = "--" UPLOAD_BOUNDARY "--\r\n";
+    size_t total = meta + strlen(tail);
+    for (size_t i = 0; i < found; i++) {
+        total += sprintf(head, head_format, (unsigned)entries[i].id) + entries[i].len + 2;
+    }
+
+    esp_err_t res = esp_http_client_open(client, total);
+    if (res != ESP_OK) {
+        return res;
+    }
+    bool ok = upload_write(client, chunk, meta);
+    for (size_t i = 0; ok && i < found; i++) {
+        ok = upload_write(client, head, sprintf(head, head_format, (unsigned)entries[i].id));
+        for (size_t sent = 0; ok && sent < entries[i].len; ) {
+            size_t len = entries[i].len - sent < UPLOAD_CHUNK_SIZE ? entries[i].len - sent : UPLOAD_CHUNK_SIZE;
+            // Segment may get reclaimed while uploading, the request then fails and the photo is skipped on retry
+            xSemaphoreTake(upload_archive_lock, portMAX_DELAY);
+            const archive_entry_t *entry = photo_archive_find(upload_archive, entries[i].id);
+            ok = entry != NULL && photo_archive_read(upload_archive, entry, sent, chunk, len);
+            xSemaphoreGive(upload_archive_lock);
+            ok = ok && upload_write(client, chunk, len);
+            sent += len;
+        }
+        ok = ok && upload_write(client, "\r\n", 2);
+    }
+    ok = ok && upload_write(client, tail, strlen(tail));
+    if (!ok || esp_http_client_fetch_headers(client) < 0) {
+        return ESP_FAIL;
+    }
+    // Response body is only informative, read it so the request completes
+    while (esp_http_client_read(client, chunk, UPLOAD_CHUNK_SIZE) > 0) {
+    }
+    int status = esp_http_client_get_status_code(client);
+    if (status >= 200 && status < 300) {
+        return ESP_OK;
+    }
+    ESP_LOGE(DEVICE, "[UPLOAD] Collector answered %d", status);
+    return status >= 400 && status < 500 && status != 408 && status != 429 ? ESP_ERR_INVALID_RESPONSE : ESP_FAIL;
+}
+
+/**
+ * @brief Upload task - sends archived photos to the collector, retrying with backoff
+ * Never touches capture or web server, a slow or dead collector only fills the upload queue.
+ */
+static void upload_task(void *arg) {
+    esp_http_client_config_t config = {
+        .url = UPLOAD_URL,
+        .method = HTTP_METHOD_POST,
+        .timeout_ms = UPLOAD_TIMEOUT_MS,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    char *chunk = malloc(UPLOAD_CHUNK_SIZE);
+    if (client == NULL || chunk == NULL) {
+        ESP_LOGE(DEVICE, "[UPLOAD] Failed to start uploader");
+        vTaskDelete(NULL);
+        return;
+    }
+    esp_http_client_set_header(client, "Content-Type", "multipart/form-data; boundary=" UPLOAD_BOUNDARY);
+
+    uint32_t ids[UPLOAD_BATCH_MAX];
+    size_t count = 0;
+    uint32_t backoff_ms = 0;
+    while (1) {
+        if (count == 0) {
+            xQueueReceive(upload_queue, &ids[count++], portMAX_DELAY);
+        }
+        // Photos of one burst are archived shortly after each other, let them share the request
+        while (count < UPLOAD_BATCH_MAX &&
+               xQueueReceive(upload_queue, &ids[count], UPLOAD_BATCH_WINDOW_MS / portTICK_PERIOD_MS) == pdTRUE) {
+            count++;
+        }
+        int64_t start = esp_timer_get_time();
+        esp_err_t res = upload_batch(client, ids, &count, chunk);
+        esp_http_client_close(client);
+        if (res == ESP_OK) {
+            if (count > 0) {
+                metrics_observe(&metric_upload_batch, esp_timer_get_time() - start);
+                metrics_add(&metric_upload_photos, count);
+                metrics_add(&metric_upload_batches, 1);
+                ESP_LOGI(DEVICE, "[UPLOAD] %u photo(s) uploaded in %lld ms {first %u}", (unsigned)count,
+                         (long long)((esp_timer_get_time() - start) / 1000), (unsigned)ids[0]);
+            }
+            count = 0;
+            backoff_ms = 0;
+        } else if (res == ESP_ERR_INVALID_RESPONSE) {
+            metrics_add(&metric_upload_lost, count);
+            ESP_LOGE(DEVICE, "[UPLOAD] Collector refused %u photo(s), dropping them", (unsigned)count);
+            count = 0;
+            backoff_ms = 0;
+        } else {
+            metrics_add(&metric_upload_failures, 1);
+            backoff_ms = backoff_ms == 0 ? UPLOAD_BACKOFF_MIN_MS
+                       : backoff_ms * 2 < UPLOAD_BACKOFF_MAX_MS ? backoff_ms * 2 : UPLOAD_BACKOFF_MAX_MS;
+            ESP_LOGE(DEVICE, "[UPLOAD] Upload of %u photo(s) failed {%s}, retry in %u ms", (unsigned)count,
+                     esp_err_to_name(res), (unsigned)backoff_ms);
+            vTaskDelay(backoff_ms / portTICK_PERIOD_MS);
+        }
+    }
+}
+
+esp_err_t upload_init(photo_archive_t *archive, SemaphoreHandle_t archive_lock) {
+    if (archive_lock == NULL) {
+        ESP_LOGE(DEVICE, "[UPLOAD] Photo archive is needed for upload");
+        return ESP_ERR_INVALID_STATE;
+    }
+    upload_archive = archive;
+    upload_archive_lock = archive_lock;
+    upload_queue = xQueueCreate(UPLOAD_QUEUE_LEN, sizeof(uint32_t));
+    if (upload_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    xTaskCreate(upload_task, "upload", 4096, NULL, 2, NULL);
+    ESP_LOGI(DEVICE, "[UPLOAD] Uploading photos to %s", UPLOAD_URL);
+    return ESP_OK;
+}
+
+size_t upload_pending(void) {
+    return upload_queue != NULL ? uxQueueMessagesWaiting(upload_queue) : 0;
+}
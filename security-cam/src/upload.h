@@ -0,0 +1,57 @@
+/**
+ * @file upload.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Upload of archived photos to the collector - batched multipart POSTs retried with backoff
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "photo_archive.h"
+#include "metrics.h"
+
+#ifndef UPLOAD_URL                              // May come from build flags (host simulation)
+#define UPLOAD_URL              ""              // Collector taking archived photos as multipart POST, empty disables upload
+#endif
+#define UPLOAD_QUEUE_LEN        32              // Photos waiting for upload, the oldest one is dropped when full
+#define UPLOAD_BATCH_MAX        4               // Photos sent in one request
+#define UPLOAD_BATCH_WINDOW_MS  500             // Wait for more photos of a burst before sending
+#define UPLOAD_TIMEOUT_MS       10000           // Collector connect & response timeout
+#define UPLOAD_BACKOFF_MIN_MS   1000            // First retry after failed upload
+#define UPLOAD_BACKOFF_MAX_MS   60000           // Retry interval doubles up to this
+#define UPLOAD_CHUNK_SIZE       4096            // Read buffer when streaming photo from flash
+#define UPLOAD_BOUNDARY         "esp32cam-upload-boundary"
+
+extern metrics_histogram_t metric_upload_batch;
+extern metrics_counter_t metric_upload_photos;
+extern metrics_counter_t metric_upload_batches;
+extern metrics_counter_t metric_upload_failures;
+extern metrics_counter_t metric_upload_lost;
+
+/**
+ * @brief Start upload task, photos are read back from the archive so it has to be mounted
+ * @param archive_lock guards archive, shared with the archive writer
+ */
+esp_err_t upload_init(photo_archive_t *archive, SemaphoreHandle_t archive_lock);
+
+/**
+ * @brief Queue archived photo for upload, the oldest waiting one gives way when queue is full
+ * Nothing happens when upload is not running.
+ */
+void upload_enqueue(uint32_t event_id);
+
+/**
+ * @brief Photos waiting for upload
+ */
+size_t upload_pending(void);
+
+#endif
@@ -0,0 +1,72 @@
+"""
+Embed dashboard files into firmware - each file is gzipped and written as C array with ETag.
+
+Usage: embed_assets.py <output.c> <file>...
+Files are served under "/<file name>", see static_assets.h.
+
+Author: Roman Janiczek (xjanic25@vutbr.cz)
+"""
+import gzip
+import hashlib
+import os
+import sys
+
+MIME_TYPES = {
+    '.html': 'text/html',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.json': 'application/json',
+    '.svg': 'image/svg+xml',
+    '.png': 'image/png',
+    '.jpg': 'image/jpeg',
+    '.ico': 'image/x-icon',
+}
+
+
+def c_array(name, data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append('    ' + ', '.join('0x%02x' % b for b in data[i:i + 16]) + ',')
+    return 'static const uint8_t %s[] = {\n%s\n};\n' % (name, '\n'.join(lines))
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit('usage: embed_assets.py <output.c> <file>...')
+    output = sys.argv[1]
+    files = sorted(sys.argv[2:], key=os.path.basename)
+
+    arrays = []
+    entries = []
+    for index, path in enumerate(files):
+        with open(path, 'rb') as f:
+            content = f.read()
+        name = os.path.basename(path)
+        # mtime 0 keeps the output (and so the build) reproducible
+        data = gzip.compress(content, compresslevel=9, mtime=0)
+        etag = hashlib.sha256(content).hexdigest()[:16]
+        mime = MIME_TYPES.get(os.path.splitext(name)[1].lower(), 'application/octet-stream')
+        arrays.append(c_array('asset_%d' % index, data))
+        entries.append('    {"/%s", "%s", "\\"%s\\"", asset_%d, sizeof(asset_%d), %d},'
+                       % (name, mime, etag, index, index, len(content)))
+
+    source = ['/* Generated by tools/embed_assets.py - do not edit */',
+              '#include "static_assets.h"', '']
+    source += arrays
+    source.append('const static_asset_t static_assets[] = {')
+    source += entries
+    source.append('};')
+    source.append('const size_t static_assets_count = %d;' % len(entries))
+
+    text = '\n'.join(source) + '\n'
+    # Only touch output when it changed, so rebuild is not triggered for nothing
+    if os.path.exists(output):
+        with open(output) as f:
+            if f.read() == text:
+                return
+    with open(output, 'w') as f:
+        f.write(text)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,51 @@
+/**
+ * @file clock_sync.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief NTP-style clock offset estimate between this node and the camera
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#include "clock_sync.h"
+
+void clock_sync_init(clock_sync_t *sync) {
+    memset(sync, 0, sizeof(*sync));
+}
+
+bool clock_sync_sample(clock_sync_t *sync, int64_t t1, int64_t t2, int64_t t3, int64_t t4) {
+    int64_t delay = (t4 - t1) - (t3 - t2);
+    if (t4 < t1 || t3 < t2 || delay < 0) {
+        sync->rejected++;
+        return false;
+    }
+    clock_sample_t *sample = &sync->samples[sync->count % CLOCK_SYNC_SAMPLES];
+    sample->offset = ((t2 - t1) + (t3 - t4)) / 2;
+    sample->delay = delay;
+    sample->at = t4;
+    sync->count++;
+    return true;
+}
+
+bool clock_sync_offset(const clock_sync_t *sync, int64_t now, int64_t *offset, int64_t *error) {
+    uint32_t kept = sync->count < CLOCK_SYNC_SAMPLES ? sync->count : CLOCK_SYNC_SAMPLES;
+    const clock_sample_t *best = NULL;
+    int64_t best_error = 0;
+    for (uint32_t i = 0; i < kept; i++) {
+        const clock_sample_t *sample = &sync->samples[i];
+        int64_t age = now > sample->at ? now - sample->at : 0;
+        int64_t bound = sample->delay / 2 + age * CLOCK_SYNC_DRIFT_PPM / 1000000;
+        if (best == NULL || bound < best_error) {
+            best = sample;
+            best_error = bound;
+        }
+    }
+    if (best == NULL) {
+        return false;
+    }
+    *offset = best->offset;
+    *error = best_error;
+    return true;
+}
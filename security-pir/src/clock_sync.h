@@ -0,0 +1,67 @@
+/**
+ * @file clock_sync.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief NTP-style clock offset estimate between this node and the camera
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CLOCK_SYNC_SAMPLES      8               // Exchanges the estimate is picked from
+#define CLOCK_SYNC_DRIFT_PPM    50              // Assumed worst drift between two crystals
+
+/**
+ * @brief One request & reply exchange
+ */
+typedef struct {
+    int64_t offset;             // Camera clock minus node clock (us)
+    int64_t delay;              // Round trip without camera processing time (us)
+    int64_t at;                 // Node time of the reply
+} clock_sample_t;
+
+/**
+ * @brief Offset estimate
+ * Each exchange gives offset = ((t2 - t1) + (t3 - t4)) / 2 with error up to half of its round trip.
+ * Like the NTP clock filter, the sample with the smallest error bound is used, where the bound grows
+ * with sample age by CLOCK_SYNC_DRIFT_PPM - an exchange delayed in the air loses to an older clean one
+ * only while the clocks could not have drifted apart more than the extra delay.
+ * Not thread safe - caller is expected to guard it with mutex.
+ */
+typedef struct {
+    clock_sample_t samples[CLOCK_SYNC_SAMPLES];
+    uint32_t count;             // Samples taken, the newest CLOCK_SYNC_SAMPLES are kept
+    uint32_t rejected;          // Replies with impossible timestamps
+} clock_sync_t;
+
+/**
+ * @brief Forget all samples
+ */
+void clock_sync_init(clock_sync_t *sync);
+
+/**
+ * @brief Add exchange
+ * @param t1 request sent, node clock
+ * @param t2 request received, camera clock
+ * @param t3 reply sent, camera clock
+ * @param t4 reply received, node clock
+ * @return false when timestamps are not consistent and sample was dropped
+ */
+bool clock_sync_sample(clock_sync_t *sync, int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+
+/**
+ * @brief Current estimate
+ * @param now node time
+ * @param offset camera clock minus node clock (us)
+ * @param error bound of the offset error at now (us)
+ * @return false when there is no sample yet
+ */
+bool clock_sync_offset(const clock_sync_t *sync, int64_t now, int64_t *offset, int64_t *error);
+
+#endif
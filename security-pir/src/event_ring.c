@@ -0,0 +1,68 @@
+/**
+ * @file event_ring.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Motion events waiting for delivery to the camera, meant to live in RTC memory
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+#include "event_ring.h"
+
+#define EVENT_RING_MAGIC        0x45565231      // "EVR1"
+
+bool event_ring_restore(event_ring_t *ring, uint32_t first_seq) {
+    if (ring->magic == EVENT_RING_MAGIC && ring->head < EVENT_RING_MAX && ring->count <= EVENT_RING_MAX) {
+        ring->boot++;
+        return true;
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->magic = EVENT_RING_MAGIC;
+    ring->seq = first_seq;
+    return false;
+}
+
+bool event_ring_push(event_ring_t *ring, uint32_t seq, int64_t timestamp) {
+    bool kept = true;
+    if (ring->count == EVENT_RING_MAX) {
+        ring->head = (ring->head + 1) % EVENT_RING_MAX;
+        ring->count--;
+        ring->overwritten++;
+        kept = false;
+    }
+    event_ring_entry_t *entry = &ring->entries[(ring->head + ring->count) % EVENT_RING_MAX];
+    entry->timestamp = timestamp;
+    entry->seq = seq;
+    entry->boot = ring->boot;
+    ring->seq = seq;
+    ring->count++;
+    ring->stored++;
+    return kept;
+}
+
+size_t event_ring_peek(const event_ring_t *ring, event_ring_entry_t *out, size_t max) {
+    size_t count = ring->count < max ? ring->count : max;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = ring->entries[(ring->head + i) % EVENT_RING_MAX];
+    }
+    return count;
+}
+
+void event_ring_drop(event_ring_t *ring, size_t count, bool replayed) {
+    if (count > ring->count) {
+        count = ring->count;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (ring->entries[(ring->head + i) % EVENT_RING_MAX].boot != ring->boot) {
+            ring->stale++;
+        }
+    }
+    ring->head = (ring->head + count) % EVENT_RING_MAX;
+    ring->count -= count;
+    ring->delivered += count;
+    if (replayed) {
+        ring->replayed += count;
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * @file event_ring.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Motion events waiting for delivery to the camera, meant to live in RTC memory
+ * @version 0.1
+ * @date 2021-11-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef EVENT_RING_H
+#define EVENT_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define EVENT_RING_MAX          16              // Pending events, the oldest one is overwritten when full
+
+/**
+ * @brief One undelivered motion event
+ */
+typedef struct {
+    int64_t timestamp;          // Time of the PIR edge (us), only meaningful in the boot it was stored in
+    uint32_t seq;
+    uint32_t boot;              // Boot of the ring the event was stored in
+} event_ring_entry_t;
+
+/**
+ * @brief Bounded FIFO of undelivered events with delivery counters
+ * The whole struct survives soft reset when placed in RTC_NOINIT memory, event_ring_restore tells
+ * a surviving ring from garbage after power up. Counters are kept across reboots as well.
+ * Not thread safe - caller is expected to guard it with mutex.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t boot;              // Boots since the ring was created
+    uint32_t seq;               // Newest sequence number stored, node continues from it after reboot
+    event_ring_entry_t entries[EVENT_RING_MAX];
+    uint32_t head;              // Oldest entry
+    uint32_t count;
+    uint32_t stored;            // Events put into ring
+    uint32_t delivered;         // Events acked by camera
+    uint32_t replayed;          // Delivered ones that waited for the link to come back
+    uint32_t overwritten;       // Lost because ring was full
+    uint32_t stale;             // Delivered without age, they were stored before reboot
+} event_ring_t;
+
+/**
+ * @brief Keep ring that survived reboot, or start empty one when its contents are not valid
+ * @param first_seq sequence to continue from in a new ring (random, so the camera sees a new sequence)
+ * @return true when pending events and counters survived
+ */
+bool event_ring_restore(event_ring_t *ring, uint32_t first_seq);
+
+/**
+ * @brief Append event, overwriting the oldest one when full
+ * @return false when an event was overwritten
+ */
+bool event_ring_push(event_ring_t *ring, uint32_t seq, int64_t timestamp);
+
+/**
+ * @brief Copy up to max oldest events, oldest first
+ * @return number of events copied
+ */
+size_t event_ring_peek(const event_ring_t *ring, event_ring_entry_t *out, size_t max);
+
+/**
+ * @brief Remove count oldest events after the camera acked them
+ * @param replayed they were sent as batch after failed delivery
+ */
+void event_ring_drop(event_ring_t *ring, size_t count, bool replayed);
+
+#endif
@@ -1,262 +1,656 @@
-/**
- * @file main.c
- * @author Roman Janiczek (xjanic25@vutbr.cz)
- * @brief Motion detection sensor
- * @version 0.1
- * @date 2021-11-30
- * 
- * @copyright Copyright (c) 2021
- * 
- */
-// ============================ SYSTEM ============================
-#include <stdio.h>
-#include <string.h>
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
-#include "esp_event.h"
-#include "esp_log.h"
-#include "nvs_flash.h"
-// ============================= GPIO =============================
-#include <driver/gpio.h>
-// ============================= WIFI =============================
-#include "esp_wifi.h"
-// ============================= HTTP =============================
-#include "esp_tls.h"
-#include "esp_http_client.h"
-// ================================================================
-
-
-// ============================ SYSTEM ============================
-#define DEVICE          "[ESP32 PIR]"
-// ============================= GPIO =============================
-#define LED_GPIO        GPIO_NUM_2                              // GPIO pin number for sending OUTPUT signal to LED
-#define PIR_GPIO        GPIO_NUM_39                             // GPIO pin number for receiveing INPUT signal from PIR
-// ============================= WIFI =============================
-#define WIFI_SSID       "ESP32-Cam AP"
-// ============================= HTTP =============================
-#define DEFAULT_GW      "192.168.4.1"
-#define DEFAULT_PORT    "80"
-esp_ip4_addr_t my_ip;
-esp_ip4_addr_t gateway;
-// ================================================================
-
-
-const TickType_t delay = 1000 / portTICK_PERIOD_MS;              // 1s
-
-
-// ============================= WIFI =============================
-/**
- * @brief Handle WiFi connect & disconnect event
- * source: https://github.com/espressif/esp-idf/blob/42cce06704a24b01721cd34920f25b2e48b88c55/examples/wifi/getting_started/softAP/main/softap_example_main.c
- * source: https://github.com/espressif/esp-idf/blob/5c33570524118873f7bd32490c7a0442fede4bf8/examples/wifi/fast_scan/main/fast_scan.c
- */
-static void wifi_event_handler(void* arg, esp_event_base_t event_base,
-                                    int32_t event_id, void* event_data)
-{
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {                 // Connect on power ON
-        esp_wifi_connect();
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {   // Attempt reconnect
-        esp_wifi_connect();
-    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
-        my_ip = event->ip_info.ip;
-        gateway = event->ip_info.gw;
-        ESP_LOGI(DEVICE, "[WIFI] IP:\t" IPSTR, IP2STR(&my_ip));
-        ESP_LOGI(DEVICE, "[WIFI] GATEWAY:\t" IPSTR, IP2STR(&gateway));
-    }
-}
-
-/**
- * @brief Configure and start WiFi STA
- * source: https://github.com/espressif/esp-idf/blob/42cce06704a24b01721cd34920f25b2e48b88c55/examples/wifi/getting_started/softAP/main/softap_example_main.c
- * source: https://github.com/espressif/esp-idf/blob/5c33570524118873f7bd32490c7a0442fede4bf8/examples/wifi/fast_scan/main/fast_scan.c
- */
-void wifi_config_sta(void) {
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-
-    // Initialize default station as network interface instance (esp-netif)
-    esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
-    assert(sta_netif);
-
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &wifi_event_handler,
-                                                        NULL,
-                                                        NULL));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &wifi_event_handler,
-                                                        NULL,
-                                                        NULL));
-
-    wifi_config_t custom_config = {
-        .sta = {
-            .ssid = WIFI_SSID,
-            .scan_method = WIFI_FAST_SCAN,
-            .sort_method = WIFI_CONNECT_AP_BY_SIGNAL,
-            .threshold.rssi = -127,
-            .threshold.authmode = WIFI_AUTH_OPEN,
-        },
-    };
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &custom_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
-}
-// ================================================================
-
-// ============================= HTTP =============================
-/**
- * @brief Handle HTTP event
- * source: https://github.com/espressif/esp-idf/blob/5c33570524118873f7bd32490c7a0442fede4bf8/examples/protocols/esp_http_client/main/esp_http_client_example.c
- */
-esp_err_t http_event_handler(esp_http_client_event_t *evt) {
-    static char *output_buffer;  // Buffer to store response of http request from event handler
-    static int output_len;       // Stores number of bytes read
-    switch(evt->event_id) {
-        case HTTP_EVENT_ERROR:
-            ESP_LOGD(DEVICE, "[HTTP] ERROR");
-            break;
-        case HTTP_EVENT_ON_CONNECTED:
-            ESP_LOGD(DEVICE, "[HTTP] CONNECTED");
-            break;
-        case HTTP_EVENT_HEADER_SENT:
-            ESP_LOGD(DEVICE, "[HTTP] HEADER SENT");
-            break;
-        case HTTP_EVENT_ON_HEADER:
-            ESP_LOGD(DEVICE, "[HTTP] HEADER {key=%s : value=%s}", evt->header_key, evt->header_value);
-            break;
-        case HTTP_EVENT_ON_DATA:
-            ESP_LOGD(DEVICE, "[HTTP] DATA {len=%d}", evt->data_len);
-            if (!esp_http_client_is_chunked_response(evt->client)) {
-                // If user_data buffer is configured, copy the response into the buffer
-                if (evt->user_data) {
-                    memcpy(evt->user_data + output_len, evt->data, evt->data_len);
-                } else {
-                    if (output_buffer == NULL) {
-                        output_buffer = (char *) malloc(esp_http_client_get_content_length(evt->client));
-                        output_len = 0;
-                        if (output_buffer == NULL) {
-                            ESP_LOGE(DEVICE, "[HTTP] Failed to allocate memory for output buffer");
-                            return ESP_FAIL;
-                        }
-                    }
-                    memcpy(output_buffer + output_len, evt->data, evt->data_len);
-                }
-                output_len += evt->data_len;
-            }
-            break;
-        case HTTP_EVENT_ON_FINISH:
-            ESP_LOGD(DEVICE, "[HTTP] FINISHED");
-            if (output_buffer != NULL) {
-                // Response is accumulated in output_buffer. Uncomment the below line to print the accumulated response
-                ESP_LOG_BUFFER_CHAR(DEVICE, output_buffer, output_len);
-                free(output_buffer);
-                output_buffer = NULL;
-            }
-            output_len = 0;
-            break;
-        case HTTP_EVENT_DISCONNECTED:
-            ESP_LOGI(DEVICE, "[HTTP] DISCONNECTED");
-            int mbedtls_err = 0;
-            esp_err_t err = esp_tls_get_and_clear_last_error(evt->data, &mbedtls_err, NULL);
-            if (err != 0) {
-                if (output_buffer != NULL) {
-                    free(output_buffer);
-                    output_buffer = NULL;
-                }
-                output_len = 0;
-                ESP_LOGI(DEVICE, "[HTTP] Last esp error code: 0x%x", err);
-                ESP_LOGI(DEVICE, "[HTTP] Last mbedtls failure: 0x%x", mbedtls_err);
-            }
-            break;
-    }
-    return ESP_OK;
-}
-
-/**
- * @brief Configure HTTP & send request
- * source: https://github.com/espressif/esp-idf/blob/5c33570524118873f7bd32490c7a0442fede4bf8/examples/protocols/esp_http_client/main/esp_http_client_example.c
- * source: https://github.com/espressif/esp-idf/blob/5c33570524118873f7bd32490c7a0442fede4bf8/examples/protocols/http_request/main/http_request_example_main.c
- */
-void send_request_to_camera() {
-    char local_response_buffer[2048] = {0};
-    char temp_url[50];
-
-    sprintf(temp_url, "http://%d.%d.%d.%d/pir", IP2STR(&gateway));
-    
-    esp_http_client_config_t config = {
-        .url = temp_url,
-        .method = HTTP_METHOD_GET,
-        .event_handler = http_event_handler,
-        .user_data = local_response_buffer,        // Pass address of local buffer to get response
-        .disable_auto_redirect = true,
-    };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-
-    esp_err_t err = esp_http_client_perform(client);
-    if (err == ESP_OK) {
-        ESP_LOGI(DEVICE, "[HTTP] Response from CAM to PIR signal : %d : %d",
-                esp_http_client_get_status_code(client),
-                esp_http_client_get_content_length(client));
-    } else {
-        ESP_LOGE(DEVICE, "[HTTP] Sending PIR signal to CAM failed {%s}", 
-                esp_err_to_name(err));
-    }
-    
-    ESP_LOG_BUFFER_CHAR(DEVICE, local_response_buffer, strlen(local_response_buffer));
-
-    esp_http_client_cleanup(client);
-}
-// ================================================================
-
-// ============================ MAIN ==============================
-void app_main() {
-    // ====================== CONFIGURATION PART ======================
-    // Initialize NVS
-    // Taken from https://github.com/espressif/esp-idf/blob/42cce06704a24b01721cd34920f25b2e48b88c55/examples/wifi/getting_started/softAP/main/softap_example_main.c
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(ret);
-    // Configure WIFI module & connect
-    wifi_config_sta();
-    // Setup OUTPUT
-    gpio_pad_select_gpio(LED_GPIO);
-    gpio_set_direction(LED_GPIO, GPIO_MODE_OUTPUT);
-    gpio_set_level(LED_GPIO, 0);
-    // Setup INPUT
-    gpio_pad_select_gpio(PIR_GPIO);
-    gpio_set_direction(PIR_GPIO, GPIO_MODE_INPUT);
-    // ================================================================
-    
-    // ======================== LOGGING  SETUP ========================
-    // Info printout variables
-    int64_t timestamp;
-    // ================================================================
-
-    
-    // ========================== EXECUTION ===========================
-    // Infinite loop for detecting and deciding if signal should be sent to camera
-    while(1) {  
-        if (gpio_get_level(PIR_GPIO)) {
-            timestamp = esp_timer_get_time();
-            ESP_LOGI(DEVICE, "[PIR] Motion detected at %lli!", timestamp);
-            gpio_set_level(LED_GPIO, 1);
-            ESP_LOGI(DEVICE, "[PIR] Sending signal to the camera!");
-            send_request_to_camera();
-            vTaskDelay(delay);
-            gpio_set_level(LED_GPIO, 0);
-        } else {
-            gpio_set_level(LED_GPIO, 0);
-            vTaskDelay(delay);
-        }
-    }
-    // ================================================================
-}
+/**
+ * @file main.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief Motion detection sensor
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+// ============================ SYSTEM ============================
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <stdatomic.h>
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "nvs_flash.h"
+// ============================= GPIO =============================
+#include <driver/gpio.h>
+// ============================= WIFI =============================
+#include "esp_wifi.h"
+// ============================= HTTP =============================
+#include "esp_tls.h"
+#include "esp_http_client.h"
+// ============================= UDP ==============================
+#include "lwip/sockets.h"
+#include "trigger_proto.h"
+#include "clock_sync.h"
+// ============================= PIR ==============================
+#include "pir_debounce.h"
+#include "event_ring.h"
+// ================================================================
+
+
+// ============================ SYSTEM ============================
+#define DEVICE          "[ESP32 PIR]"
+// ============================= GPIO =============================
+#define LED_GPIO        GPIO_NUM_2                              // GPIO pin number for sending OUTPUT signal to LED
+#define PIR_GPIO        GPIO_NUM_39                             // GPIO pin number for receiveing INPUT signal from PIR
+// ============================= PIR ==============================
+#define PIR_GLITCH_US   2000                                    // Level has to hold 2ms, shorter pulses are bounce
+#define PIR_HOLDOFF_US  1000000                                 // At most one motion event per 1s
+#define PIR_QUEUE_LEN   8                                       // Motion events waiting to be sent
+#define PIR_EDGE_QUEUE_LEN 16                                   // Raw edges waiting for debounce task
+// ============================= UDP ==============================
+#define TRIGGER_USE_UDP         1                               // Send motion as UDP datagram, HTTP /pir is the fallback
+#define TRIGGER_ACK_TIMEOUT_MS  30                              // Wait for camera ack before retransmitting
+#define TRIGGER_RETRIES         4                               // Retransmissions before falling back to HTTP
+#define TRIGGER_NODE_ID         0                               // Identity sent with every trigger, 0 = low bytes of STA MAC
+// ============================ REPLAY ============================
+#define TRIGGER_HTTP_TIMEOUT_MS 1000                            // HTTP fallback gives up this soon, event waits in ring
+#define TRIGGER_BACKOFF_MIN_MS  500                             // First retry after camera did not get events
+#define TRIGGER_BACKOFF_MAX_MS  30000                           // Retry interval doubles up to this
+// ============================= SYNC =============================
+#define CLOCK_SYNC_ENABLED      1                               // Track camera clock, triggers then carry detection time
+#define CLOCK_SYNC_INTERVAL_MS  16000                           // Sync round period while camera answers
+#define CLOCK_SYNC_RETRY_MS     2000                            // Sync round period while camera does not answer
+#define CLOCK_SYNC_EXCHANGES    4                               // Request & reply pairs per round
+#define CLOCK_SYNC_MAX_ERROR_US 5000                            // Offset with bigger error bound is not used
+// ============================= WIFI =============================
+#define WIFI_SSID       "ESP32-Cam AP"
+// ============================= HTTP =============================
+#define DEFAULT_GW      "192.168.4.1"
+#define DEFAULT_PORT    "80"
+esp_ip4_addr_t my_ip;
+esp_ip4_addr_t gateway;
+// ================================================================
+
+
+/**
+ * Raw edges - timestamped by GPIO interrupt, debounced by debounce task
+ */
+typedef struct {
+    int64_t timestamp;          // Time of the PIR edge (us)
+    int level;
+} pir_edge_t;
+
+static QueueHandle_t pir_edge_queue = NULL;
+static pir_debounce_t pir_debounce;                     // Owned by debounce task
+
+/**
+ * Motion events - produced by debounce task, consumed by sender task
+ */
+typedef struct {
+    int64_t timestamp;          // Time of the PIR edge (us)
+    uint32_t seq;
+} pir_event_t;
+
+static QueueHandle_t pir_queue = NULL;
+static uint32_t pir_seq = 0;                            // Continues from pir_ring after reboot
+static atomic_uint pir_queued = 0;                      // Events handed over to sender task
+static atomic_uint pir_dropped = 0;                     // Events lost because queue was full
+static atomic_uint pir_high_water = 0;                  // Most events waiting at once
+
+/**
+ * Events not delivered yet - owned by sender task, kept in RTC memory so soft reset does not lose them
+ */
+static RTC_NOINIT_ATTR event_ring_t pir_ring;
+static atomic_bool pir_link_up = false;                 // Got IP, retry pending events without waiting for backoff
+
+/**
+ * Camera connection - one client kept open across motion events
+ */
+static esp_http_client_handle_t camera_client = NULL;
+static atomic_bool camera_client_stale = false;         // Link changed, reopen socket before next request
+
+/**
+ * UDP trigger
+ */
+static int trigger_sock = -1;
+static uint16_t node_id = 0;                            // TRIGGER_NODE_ID or low bytes of STA MAC address
+
+/**
+ * Camera clock offset - owned by sender task, started over whenever link comes up (camera may have rebooted)
+ */
+static clock_sync_t clock_sync;
+static uint32_t clock_sync_seq = 0;
+
+
+// ============================= WIFI =============================
+/**
+ * @brief Handle WiFi connect & disconnect event
+ * source: https://github.com/espressif/esp-idf/blob/42cce06704a24b01721cd34920f25b2e48b88c55/examples/wifi/getting_started/softAP/main/softap_example_main.c
+ * source: https://github.com/espressif/esp-idf/blob/5c33570524118873f7bd32490c7a0442fede4bf8/examples/wifi/fast_scan/main/fast_scan.c
+ */
+static void wifi_event_handler(void* arg, esp_event_base_t event_base,
+                                    int32_t event_id, void* event_data)
+{
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {                 // Connect on power ON
+        esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {   // Attempt reconnect
+        camera_client_stale = true;
+        esp_wifi_connect();
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
+        my_ip = event->ip_info.ip;
+        gateway = event->ip_info.gw;
+        camera_client_stale = true;
+        pir_link_up = true;
+        ESP_LOGI(DEVICE, "[WIFI] IP:\t" IPSTR, IP2STR(&my_ip));
+        ESP_LOGI(DEVICE, "[WIFI] GATEWAY:\t" IPSTR, IP2STR(&gateway));
+    }
+}
+
+/**
+ * @brief Configure and start WiFi STA
+ * source: https://github.com/espressif/esp-idf/blob/42cce06704a24b01721cd34920f25b2e48b88c55/examples/wifi/getting_started/softAP/main/softap_example_main.c
+ * source: https://github.com/espressif/esp-idf/blob/5c33570524118873f7bd32490c7a0442fede4bf8/examples/wifi/fast_scan/main/fast_scan.c
+ */
+void wifi_config_sta(void) {
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    // Initialize default station as network interface instance (esp-netif)
+    esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
+    assert(sta_netif);
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                        ESP_EVENT_ANY_ID,
+                                                        &wifi_event_handler,
+                                                        NULL,
+                                                        NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_STA_GOT_IP,
+                                                        &wifi_event_handler,
+                                                        NULL,
+                                                        NULL));
+
+    wifi_config_t custom_config = {
+        .sta = {
+            .ssid = WIFI_SSID,
+            .scan_method = WIFI_FAST_SCAN,
+            .sort_method = WIFI_CONNECT_AP_BY_SIGNAL,
+            .threshold.rssi = -127,
+            .threshold.authmode = WIFI_AUTH_OPEN,
+        },
+    };
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &custom_config));
+    ESP_ERROR_CHECK(esp_wifi_start());
+}
+// ================================================================
+
+// ============================= HTTP =============================
+/**
+ * @brief Handle HTTP event
+ * source: https://github.com/espressif/esp-idf/blob/5c33570524118873f7bd32490c7a0442fede4bf8/examples/protocols/esp_http_client/main/esp_http_client_example.c
+ */
+esp_err_t http_event_handler(esp_http_client_event_t *evt) {
+    switch(evt->event_id) {
+        case HTTP_EVENT_ERROR:
+            ESP_LOGD(DEVICE, "[HTTP] ERROR");
+            break;
+        case HTTP_EVENT_ON_CONNECTED:
+            ESP_LOGI(DEVICE, "[HTTP] CONNECTED");
+            break;
+        case HTTP_EVENT_HEADER_SENT:
+            ESP_LOGD(DEVICE, "[HTTP] HEADER SENT");
+            break;
+        case HTTP_EVENT_ON_HEADER:
+            ESP_LOGD(DEVICE, "[HTTP] HEADER {key=%s : value=%s}", evt->header_key, evt->header_value);
+            break;
+        case HTTP_EVENT_ON_DATA:
+            // Response body is only informative, it is read to keep the connection usable and dropped
+            ESP_LOGD(DEVICE, "[HTTP] DATA {len=%d}", evt->data_len);
+            break;
+        case HTTP_EVENT_ON_FINISH:
+            ESP_LOGD(DEVICE, "[HTTP] FINISHED");
+            break;
+        case HTTP_EVENT_DISCONNECTED:
+            ESP_LOGI(DEVICE, "[HTTP] DISCONNECTED");
+            int mbedtls_err = 0;
+            esp_err_t err = esp_tls_get_and_clear_last_error(evt->data, &mbedtls_err, NULL);
+            if (err != 0) {
+                ESP_LOGI(DEVICE, "[HTTP] Last esp error code: 0x%x", err);
+                ESP_LOGI(DEVICE, "[HTTP] Last mbedtls failure: 0x%x", mbedtls_err);
+            }
+            break;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Send request to camera over persistent connection
+ * Client is created once and the TCP connection is reused (HTTP keep-alive). After Wi-Fi drop
+ * or new IP the socket is closed, so the next request reconnects to the current gateway.
+ * Single event is GET /pir, batch datagram (trigger_encode_batch) is posted to the same path.
+ * @param query appended to /pir?node=<id>, empty for none
+ * @return true when camera answered, whatever the status - it got the events
+ * source: https://github.com/espressif/esp-idf/blob/5c33570524118873f7bd32490c7a0442fede4bf8/examples/protocols/esp_http_client/main/esp_http_client_example.c
+ * source: https://github.com/espressif/esp-idf/blob/5c33570524118873f7bd32490c7a0442fede4bf8/examples/protocols/http_request/main/http_request_example_main.c
+ */
+bool send_request_to_camera(const uint8_t *batch, size_t len, const char *query) {
+    char url[112];
+    int64_t start = esp_timer_get_time();
+
+    // Same host keeps the connection, only the query changes between requests
+    sprintf(url, "http://" IPSTR "/pir?node=%04x%s", IP2STR(&gateway), node_id, query);
+    if (camera_client == NULL) {
+        camera_client_stale = false;
+        esp_http_client_config_t config = {
+            .url = url,
+            .method = HTTP_METHOD_GET,
+            .event_handler = http_event_handler,
+            .disable_auto_redirect = true,
+            .keep_alive_enable = true,
+            .timeout_ms = TRIGGER_HTTP_TIMEOUT_MS,
+        };
+        camera_client = esp_http_client_init(&config);
+    } else {
+        if (camera_client_stale) {
+            camera_client_stale = false;
+            esp_http_client_close(camera_client);
+        }
+        esp_http_client_set_url(camera_client, url);
+    }
+
+    if (batch != NULL) {
+        esp_http_client_set_method(camera_client, HTTP_METHOD_POST);
+        esp_http_client_set_header(camera_client, "Content-Type", "application/octet-stream");
+        esp_http_client_set_post_field(camera_client, (const char *)batch, len);
+    }
+    esp_err_t err = esp_http_client_perform(camera_client);
+    if (err != ESP_OK) {
+        // Camera may have dropped the idle connection, retry once on a new one
+        esp_http_client_close(camera_client);
+        err = esp_http_client_perform(camera_client);
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(DEVICE, "[HTTP] Response from CAM to PIR signal : %d : %d in %lli us",
+                esp_http_client_get_status_code(camera_client),
+                esp_http_client_get_content_length(camera_client),
+                (long long)(esp_timer_get_time() - start));
+    } else {
+        esp_http_client_close(camera_client);
+        ESP_LOGE(DEVICE, "[HTTP] Sending PIR signal to CAM failed {%s}", 
+                esp_err_to_name(err));
+    }
+    if (batch != NULL) {
+        esp_http_client_set_method(camera_client, HTTP_METHOD_GET);
+        esp_http_client_set_post_field(camera_client, NULL, 0);
+    }
+    return err == ESP_OK;
+}
+// ================================================================
+
+// ============================= UDP ==============================
+/**
+ * @brief Create trigger socket on first use, receive waits at most TRIGGER_ACK_TIMEOUT_MS
+ * @return false when socket can not be created
+ */
+static bool open_trigger_socket(void) {
+    if (trigger_sock >= 0) {
+        return true;
+    }
+    trigger_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (trigger_sock < 0) {
+        ESP_LOGE(DEVICE, "[UDP] Failed to create socket");
+        return false;
+    }
+    struct timeval timeout = {
+        .tv_sec = 0,
+        .tv_usec = TRIGGER_ACK_TIMEOUT_MS * 1000,
+    };
+    setsockopt(trigger_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return true;
+}
+
+/**
+ * @brief Send trigger datagram and wait for camera ack, retransmitting on loss
+ * @param entries events of TRIGGER_MSG_BATCH, ignored for single event
+ * @return false when camera did not ack any copy
+ */
+bool send_udp_trigger(trigger_msg_t *msg, const trigger_batch_entry_t *entries, size_t count) {
+    if (!open_trigger_socket()) {
+        return false;
+    }
+
+    struct sockaddr_in camera = {
+        .sin_family = AF_INET,
+        .sin_port = htons(TRIGGER_UDP_PORT),
+        .sin_addr.s_addr = gateway.addr,
+    };
+    uint8_t buf[TRIGGER_BATCH_MAX_SIZE];
+    int64_t start = esp_timer_get_time();
+    uint32_t delay_us = msg->delay_us;
+
+    for (int attempt = 0; attempt <= TRIGGER_RETRIES; attempt++) {
+        if (attempt > 0) {
+            msg->flags |= TRIGGER_FLAG_RETRY;
+        }
+        int64_t sent_at = esp_timer_get_time();
+        msg->delay_us = delay_us + (uint32_t)(sent_at - start);     // Sent with synced event only
+        size_t size = msg->type == TRIGGER_MSG_BATCH ? trigger_encode_batch(msg, entries, count, buf)
+                                                      : trigger_encode(msg, buf);
+        if (sendto(trigger_sock, buf, size, 0, (struct sockaddr *)&camera, sizeof(camera)) < 0) {
+            ESP_LOGE(DEVICE, "[UDP] Send failed {errno=%d}", errno);
+            continue;
+        }
+        // Acks of earlier attempts may still arrive, skip them until timeout
+        int len;
+        while ((len = recv(trigger_sock, buf, sizeof(buf), 0)) >= 0) {
+            trigger_msg_t ack;
+            if (trigger_decode(buf, len, &ack) && ack.type == TRIGGER_MSG_ACK &&
+                ack.node_id == node_id && ack.seq == msg->seq) {
+                ESP_LOGI(DEVICE, "[UDP] Event #%u acked after %d attempt(s), rtt %lli us", (unsigned)msg->seq,
+                         attempt + 1, (long long)(esp_timer_get_time() - sent_at));
+                return true;
+            }
+        }
+    }
+    ESP_LOGE(DEVICE, "[UDP] Event #%u not acked", (unsigned)msg->seq);
+    return false;
+}
+
+/**
+ * @brief One round of NTP-style exchanges with the camera, every reply becomes clock sync sample
+ * @return number of samples added
+ */
+static int sync_clock(void) {
+    if (!open_trigger_socket()) {
+        return 0;
+    }
+    struct sockaddr_in camera = {
+        .sin_family = AF_INET,
+        .sin_port = htons(TRIGGER_UDP_PORT),
+        .sin_addr.s_addr = gateway.addr,
+    };
+    uint8_t buf[TRIGGER_BATCH_MAX_SIZE];
+    int added = 0;
+
+    for (int exchange = 0; exchange < CLOCK_SYNC_EXCHANGES; exchange++) {
+        trigger_msg_t request = {
+            .type = TRIGGER_MSG_SYNC,
+            .node_id = node_id,
+            .seq = ++clock_sync_seq,
+            .timestamp = esp_timer_get_time(),
+        };
+        size_t size = trigger_encode(&request, buf);
+        if (sendto(trigger_sock, buf, size, 0, (struct sockaddr *)&camera, sizeof(camera)) < 0) {
+            ESP_LOGE(DEVICE, "[SYNC] Send failed {errno=%d}", errno);
+            break;
+        }
+        // Late acks & replies of earlier exchanges may still arrive, skip them until timeout
+        int len;
+        while ((len = recv(trigger_sock, buf, sizeof(buf), 0)) >= 0) {
+            int64_t received = esp_timer_get_time();
+            trigger_msg_t reply;
+            if (trigger_decode(buf, len, &reply) && reply.type == TRIGGER_MSG_SYNC_REPLY &&
+                reply.node_id == node_id && reply.seq == request.seq) {
+                if (clock_sync_sample(&clock_sync, request.timestamp, reply.receive, reply.timestamp, received)) {
+                    added++;
+                }
+                break;
+            }
+        }
+    }
+    int64_t offset, error;
+    if (clock_sync_offset(&clock_sync, esp_timer_get_time(), &offset, &error)) {
+        ESP_LOGI(DEVICE, "[SYNC] Camera clock offset %lli us +- %lli us {replies=%d of %d, rejected=%u}",
+                 (long long)offset, (long long)error, added, CLOCK_SYNC_EXCHANGES, (unsigned)clock_sync.rejected);
+    } else {
+        ESP_LOGE(DEVICE, "[SYNC] Camera did not answer clock sync");
+    }
+    return added;
+}
+
+/**
+ * @brief Offset to add to node time to get camera time
+ * @return false when clock is not synced well enough
+ */
+static bool camera_clock_offset(int64_t now, int64_t *offset) {
+    int64_t error;
+    return CLOCK_SYNC_ENABLED && clock_sync_offset(&clock_sync, now, offset, &error) &&
+           error <= CLOCK_SYNC_MAX_ERROR_US;
+}
+// ================================================================
+
+// ============================= PIR ==============================
+/**
+ * @brief PIR edge interrupt - timestamps the edge and hands it to debounce task
+ * Edge lost on full queue is noticed when the debouncer re-reads the pin.
+ */
+static void IRAM_ATTR pir_isr_handler(void *arg) {
+    pir_edge_t edge = {
+        .timestamp = esp_timer_get_time(),
+        .level = gpio_get_level(PIR_GPIO),
+    };
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(pir_edge_queue, &edge, &woken);
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/**
+ * @brief Debounce task - feeds edges to the debouncer, re-reads the pin once a new level held
+ * PIR_GLITCH_US and queues motion event
+ */
+static void pir_debounce_task(void *arg) {
+    while (1) {
+        TickType_t wait = portMAX_DELAY;
+        int64_t deadline = pir_debounce_deadline(&pir_debounce);
+        if (deadline >= 0) {
+            int64_t left = deadline - esp_timer_get_time();
+            // Tick may end early, settle below just waits once more then
+            wait = left > 0 ? pdMS_TO_TICKS((left + 999) / 1000) + 1 : 0;
+        }
+        pir_edge_t edge;
+        if (xQueueReceive(pir_edge_queue, &edge, wait) == pdTRUE) {
+            pir_debounce_edge(&pir_debounce, edge.level, edge.timestamp);
+            continue;
+        }
+        if (!pir_debounce_settle(&pir_debounce, gpio_get_level(PIR_GPIO), esp_timer_get_time())) {
+            continue;
+        }
+        pir_event_t event = {
+            .timestamp = pir_debounce.last_event,
+            .seq = ++pir_seq,
+        };
+        if (xQueueSend(pir_queue, &event, 0) == pdTRUE) {
+            pir_queued++;
+        } else {
+            pir_dropped++;
+        }
+    }
+}
+
+/**
+ * @brief Send oldest pending events to camera, UDP first and HTTP as fallback
+ * Fresh single event goes as before, anything that waited for the camera or queued up behind
+ * another event goes as one batch carrying the age of every event. With synced clock the event
+ * (or batch send) time is converted to camera clock, so camera can trace detection to photo.
+ * @param replay events already failed to be delivered
+ * @return true when camera got them
+ */
+static bool deliver_events(bool replay) {
+    event_ring_entry_t pending[TRIGGER_BATCH_MAX];
+    trigger_batch_entry_t entries[TRIGGER_BATCH_MAX];
+    size_t count = event_ring_peek(&pir_ring, pending, TRIGGER_BATCH_MAX);
+    int64_t now = esp_timer_get_time();
+    replay = replay || count > 1 || pending[0].boot != pir_ring.boot;
+    for (size_t i = 0; i < count; i++) {
+        entries[i].seq = pending[i].seq;
+        entries[i].age_ms = pending[i].boot == pir_ring.boot ? (uint32_t)((now - pending[i].timestamp) / 1000)
+                                                             : TRIGGER_AGE_UNKNOWN;
+    }
+    int64_t offset = 0;
+    bool synced = camera_clock_offset(now, &offset);
+    trigger_msg_t msg = {
+        .type = replay ? TRIGGER_MSG_BATCH : TRIGGER_MSG_EVENT,
+        .node_id = node_id,
+        .flags = TRIGGER_FLAG_MOTION | (synced ? TRIGGER_FLAG_SYNCED : 0),
+        .seq = pending[count - 1].seq,
+        .timestamp = (replay ? now : pending[0].timestamp) + offset,
+        .delay_us = replay ? 0 : (uint32_t)(now - pending[0].timestamp),
+    };
+    ESP_LOGI(DEVICE, "[PIR] Sending %s to the camera {events=%u, oldest #%u}", replay ? "batch" : "signal",
+             (unsigned)count, (unsigned)pending[0].seq);
+    bool sent = TRIGGER_USE_UDP && send_udp_trigger(&msg, entries, count);
+    if (!sent && replay) {
+        uint8_t batch[TRIGGER_BATCH_MAX_SIZE];
+        size_t len = trigger_encode_batch(&msg, entries, count, batch);
+        sent = send_request_to_camera(batch, len, "");
+    } else if (!sent) {
+        char query[48] = "";
+        if (synced) {
+            sprintf(query, "&detected=%lli&sent=%lli", (long long)msg.timestamp,
+                    (long long)(esp_timer_get_time() + offset));
+        }
+        sent = send_request_to_camera(NULL, 0, query);
+    }
+    if (sent) {
+        event_ring_drop(&pir_ring, count, replay);
+    }
+    return sent;
+}
+
+/**
+ * @brief Sender task - moves queued motion events into the ring and delivers them to the camera
+ * Failed delivery leaves events in the ring and retries with exponential backoff, the task keeps
+ * draining the queue meanwhile, so detection never waits for the camera. Clock sync rounds run
+ * only while no event is pending.
+ */
+void pir_sender_task(void *arg) {
+    pir_event_t event;
+    uint32_t backoff_ms = 0;                            // Non zero while camera is unreachable
+    int64_t retry_at = 0;
+    int64_t sync_at = 0;
+    bool linked = false;                                // Got IP at least once, camera address is known
+    clock_sync_init(&clock_sync);
+    while (1) {
+        // Pending events wait for backoff, checked at least every TRIGGER_BACKOFF_MIN_MS for new link
+        TickType_t wait = portMAX_DELAY;
+        if (pir_ring.count > 0) {
+            int64_t left_ms = (retry_at - esp_timer_get_time()) / 1000;
+            wait = left_ms <= 0 ? 0 : pdMS_TO_TICKS(left_ms < TRIGGER_BACKOFF_MIN_MS ? left_ms : TRIGGER_BACKOFF_MIN_MS) + 1;
+        } else if (CLOCK_SYNC_ENABLED) {
+            // Link may come up meanwhile, it is checked at least every TRIGGER_BACKOFF_MIN_MS too
+            int64_t left_ms = linked ? (sync_at - esp_timer_get_time()) / 1000 : TRIGGER_BACKOFF_MIN_MS;
+            wait = left_ms <= 0 ? 0 : pdMS_TO_TICKS(left_ms < TRIGGER_BACKOFF_MIN_MS ? left_ms : TRIGGER_BACKOFF_MIN_MS) + 1;
+        }
+        if (xQueueReceive(pir_queue, &event, wait) == pdTRUE) {
+            unsigned waiting = uxQueueMessagesWaiting(pir_queue) + 1;
+            if (waiting > pir_high_water) {
+                pir_high_water = waiting;
+            }
+            do {
+                ESP_LOGI(DEVICE, "[PIR] Motion #%u detected at %lli, picked up after %lli us!", (unsigned)event.seq,
+                         (long long)event.timestamp, (long long)(esp_timer_get_time() - event.timestamp));
+                if (!event_ring_push(&pir_ring, event.seq, event.timestamp)) {
+                    ESP_LOGE(DEVICE, "[PIR] Pending events full, oldest one lost {overwritten=%u}",
+                             (unsigned)pir_ring.overwritten);
+                }
+            } while (xQueueReceive(pir_queue, &event, 0) == pdTRUE);
+        }
+        if (pir_link_up) {
+            pir_link_up = false;
+            retry_at = 0;
+            // Camera may have rebooted with its clock
+            linked = true;
+            clock_sync_init(&clock_sync);
+            sync_at = 0;
+        }
+        if (CLOCK_SYNC_ENABLED && linked && pir_ring.count == 0 && esp_timer_get_time() >= sync_at) {
+            int added = sync_clock();
+            sync_at = esp_timer_get_time() + (added > 0 ? CLOCK_SYNC_INTERVAL_MS : CLOCK_SYNC_RETRY_MS) * 1000LL;
+        }
+        if (pir_ring.count == 0 || esp_timer_get_time() < retry_at) {
+            continue;
+        }
+
+        gpio_set_level(LED_GPIO, 1);
+        bool delivered = deliver_events(backoff_ms > 0);
+        gpio_set_level(LED_GPIO, 0);
+        if (delivered && pir_ring.count == 0) {
+            if (backoff_ms > 0) {
+                ESP_LOGI(DEVICE, "[PIR] Camera reachable again, pending events delivered");
+            }
+            backoff_ms = 0;
+            retry_at = 0;
+        } else if (!delivered) {
+            backoff_ms = backoff_ms == 0 ? TRIGGER_BACKOFF_MIN_MS
+                       : backoff_ms * 2 < TRIGGER_BACKOFF_MAX_MS ? backoff_ms * 2 : TRIGGER_BACKOFF_MAX_MS;
+            retry_at = esp_timer_get_time() + backoff_ms * 1000LL;
+            ESP_LOGE(DEVICE, "[PIR] Camera unreachable, %u event(s) pending, retry in %u ms",
+                     (unsigned)pir_ring.count, (unsigned)backoff_ms);
+        }
+        ESP_LOGI(DEVICE, "[PIR] Events {queued=%u, dropped=%u, max waiting=%u, ignored edges=%u, pending=%u, "
+                 "delivered=%u, replayed=%u, overwritten=%u, stale=%u}",
+                 (unsigned)pir_queued, (unsigned)pir_dropped, (unsigned)pir_high_water,
+                 (unsigned)pir_debounce.ignored, (unsigned)pir_ring.count, (unsigned)pir_ring.delivered,
+                 (unsigned)pir_ring.replayed, (unsigned)pir_ring.overwritten, (unsigned)pir_ring.stale);
+    }
+}
+
+/**
+ * @brief Configure PIR input for edge interrupts and start sender task
+ */
+void pir_config(void) {
+    uint8_t mac[6];
+    esp_wifi_get_mac(WIFI_IF_STA, mac);
+    node_id = TRIGGER_NODE_ID != 0 ? TRIGGER_NODE_ID : mac[4] << 8 | mac[5];
+    // Random sequence after power up tells the camera this is not a retransmission of older events
+    if (event_ring_restore(&pir_ring, esp_random())) {
+        ESP_LOGI(DEVICE, "[PIR] %u pending event(s) kept over reboot {boot=%u}", (unsigned)pir_ring.count,
+                 (unsigned)pir_ring.boot);
+    }
+    pir_seq = pir_ring.seq;
+    pir_queue = xQueueCreate(PIR_QUEUE_LEN, sizeof(pir_event_t));
+    pir_edge_queue = xQueueCreate(PIR_EDGE_QUEUE_LEN, sizeof(pir_edge_t));
+    pir_debounce_init(&pir_debounce, PIR_GLITCH_US, PIR_HOLDOFF_US);
+    xTaskCreate(pir_sender_task, "pir_sender", 4096, NULL, 5, NULL);
+    xTaskCreate(pir_debounce_task, "pir_debounce", 2048, NULL, 6, NULL);
+
+    gpio_pad_select_gpio(PIR_GPIO);
+    gpio_set_direction(PIR_GPIO, GPIO_MODE_INPUT);
+    gpio_set_intr_type(PIR_GPIO, GPIO_INTR_ANYEDGE);
+    ESP_ERROR_CHECK(gpio_install_isr_service(0));
+    ESP_ERROR_CHECK(gpio_isr_handler_add(PIR_GPIO, pir_isr_handler, NULL));
+}
+// ================================================================
+
+// ============================ MAIN ==============================
+void app_main() {
+    // ====================== CONFIGURATION PART ======================
+    // Initialize NVS
+    // Taken from https://github.com/espressif/esp-idf/blob/42cce06704a24b01721cd34920f25b2e48b88c55/examples/wifi/getting_started/softAP/main/softap_example_main.c
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+    // Configure WIFI module & connect
+    wifi_config_sta();
+    // Setup OUTPUT
+    gpio_pad_select_gpio(LED_GPIO);
+    gpio_set_direction(LED_GPIO, GPIO_MODE_OUTPUT);
+    gpio_set_level(LED_GPIO, 0);
+    // Setup INPUT - motion is detected by edge interrupt
+    pir_config();
+    // ================================================================
+    
+    // ========================== EXECUTION ===========================
+    // Nothing left to do here, motion events are handled by PIR interrupt & sender task
+    // ================================================================
+}
 // ================================================================
\ No newline at end of file
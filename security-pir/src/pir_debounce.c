@@ -0,0 +1,82 @@
+/**
+ * @file pir_debounce.c
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief PIR edge debouncing - turns raw GPIO edges into motion events
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include "pir_debounce.h"
+
+void pir_debounce_init(pir_debounce_t *db, int64_t glitch_us, int64_t holdoff_us) {
+    db->glitch_us = glitch_us;
+    db->holdoff_us = holdoff_us;
+    db->level = 0;
+    db->pin = 0;
+    db->pending = -1;
+    db->pending_since = 0;
+    db->pending_start = 0;
+    db->last_edge = -glitch_us;
+    db->last_event = 0;
+    db->has_event = false;
+    db->ignored = 0;
+}
+
+bool pir_debounce_edge(pir_debounce_t *db, int level, int64_t timestamp) {
+    level = level ? 1 : 0;
+    bool repeated = level == db->pin;
+    bool bouncing = timestamp - db->last_edge < db->glitch_us;
+    db->pin = level;
+    db->last_edge = timestamp;
+    // Previous edge did not hold long enough
+    if (db->pending >= 0) {
+        db->pending = -1;
+        db->ignored++;
+    }
+    // Back at the accepted level before it changed - spike, nothing to settle
+    if (level == db->level && !repeated) {
+        db->ignored++;
+        return false;
+    }
+    // Transition interrupted by bounce keeps time of its first edge
+    if (!bouncing) {
+        db->pending_start = timestamp;
+    }
+    db->pending = level;
+    db->pending_since = timestamp;
+    return true;
+}
+
+int64_t pir_debounce_deadline(const pir_debounce_t *db) {
+    return db->pending >= 0 ? db->pending_since + db->glitch_us : -1;
+}
+
+bool pir_debounce_settle(pir_debounce_t *db, int level, int64_t timestamp) {
+    if (db->pending < 0 || timestamp < pir_debounce_deadline(db)) {
+        return false;
+    }
+    level = level ? 1 : 0;
+    if (level != db->pending) {
+        // Edge away from the pending level was lost, pin has to hold its level from now on
+        db->ignored++;
+        db->pin = level;
+        db->pending = level != db->level ? level : -1;
+        db->pending_since = timestamp;
+        db->pending_start = timestamp;
+        return false;
+    }
+    db->pending = -1;
+    db->level = level;
+    if (!level) {
+        return false;
+    }
+    if (db->has_event && db->pending_start - db->last_event < db->holdoff_us) {
+        db->ignored++;
+        return false;
+    }
+    db->last_event = db->pending_start;
+    db->has_event = true;
+    return true;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file pir_debounce.h
+ * @author Roman Janiczek (xjanic25@vutbr.cz)
+ * @brief PIR edge debouncing - turns raw GPIO edges into motion events
+ * @version 0.1
+ * @date 2021-11-30
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#ifndef PIR_DEBOUNCE_H
+#define PIR_DEBOUNCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Debouncer state, fed with edges timestamped by GPIO interrupt
+ *
+ * Level is accepted only once the pin held it for glitch_us, pir_debounce_settle re-reads the pin
+ * when that time is up. Edge coming back earlier is a spike, neither of the two edges counts.
+ */
+typedef struct {
+    int64_t glitch_us;          // Level has to hold this long to be accepted
+    int64_t holdoff_us;         // Minimum time between two reported motion events
+    int level;                  // Last accepted level
+    int pin;                    // Level after the last edge
+    int pending;                // Level waiting for pir_debounce_settle, -1 for none
+    int64_t pending_since;      // Edge the pending level has to hold from (us)
+    int64_t pending_start;      // First edge of the pending transition, bounce included (us)
+    int64_t last_edge;          // Time of last edge (us)
+    int64_t last_event;         // Time of last reported motion event (us)
+    bool has_event;             // last_event is valid
+    uint32_t ignored;           // Edges rejected as bounce or spike, rising levels within holdoff
+} pir_debounce_t;
+
+/**
+ * @brief Reset debouncer
+ */
+void pir_debounce_init(pir_debounce_t *db, int64_t glitch_us, int64_t holdoff_us);
+
+/**
+ * @brief Process one edge
+ * Level equal to the level of the previous edge means the edge in between was missed, it starts
+ * a new transition as well.
+ * @param level GPIO level right after the edge
+ * @param timestamp time of the edge (us)
+ * @return true when the edge starts a transition, pir_debounce_settle is due at pir_debounce_deadline
+ */
+bool pir_debounce_edge(pir_debounce_t *db, int level, int64_t timestamp);
+
+/**
+ * @brief Time pending transition is settled at
+ * @return -1 when no transition is pending
+ */
+int64_t pir_debounce_deadline(const pir_debounce_t *db);
+
+/**
+ * @brief Accept pending level when the pin still has it after glitch_us
+ * Pin found at the other level means an edge was missed, transition to it starts at timestamp.
+ * @param level GPIO level read now
+ * @param timestamp now (us)
+ * @return true when a motion event starts, its time (first rising edge) is in last_event
+ */
+bool pir_debounce_settle(pir_debounce_t *db, int level, int64_t timestamp);
+
+#endif